@@ -0,0 +1,592 @@
+#include "uconv.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <random>
+#include <ranges>
+#include <string_view>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#    if defined(_MSC_VER)
+#        include <intrin.h>
+#    else
+#        include <x86intrin.h>
+#    endif
+#    define UCONV_BENCH_CYCLES 1
+#endif
+
+using namespace uconv;
+
+namespace
+{
+    std::atomic<size_t> allocation_count{0};
+} // namespace
+
+// Counts every allocation, the array and nothrow forms end up here
+void* operator new(size_t size)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if(void* pointer = std::malloc(0 < size ? size : 1)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    size_t align = static_cast<size_t>(alignment);
+#if defined(_MSC_VER)
+    if(void* pointer = _aligned_malloc(0 < size ? size : 1, align)) {
+        return pointer;
+    }
+#else
+    if(void* pointer = std::aligned_alloc(align, (0 < size ? size + align - 1 : align) / align * align)) {
+        return pointer;
+    }
+#endif
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept
+{
+#if defined(_MSC_VER)
+    _aligned_free(pointer);
+#else
+    std::free(pointer);
+#endif
+}
+
+void operator delete(void* pointer, size_t, std::align_val_t alignment) noexcept
+{
+    operator delete(pointer, alignment);
+}
+
+namespace
+{
+    struct Corpus
+    {
+        std::string name;
+        std::u8string utf8;
+        std::u16string utf16;
+        std::u16string utf16le;
+        std::u16string utf16be;
+        std::u32string utf32;
+        std::string latin1;
+        // The Latin-1 text in the Unicode forms, the conversions to Latin-1 stop at the first code point above U+00FF
+        std::u8string latin1_utf8;
+        std::u16string latin1_utf16;
+        std::u32string latin1_utf32;
+        std::vector<size_t> utf8_offsets; // Splits the UTF-8 text into short strings, a column of values
+    };
+
+    enum class Input
+    {
+        utf8,
+        utf16,
+        utf32,
+        latin1,
+        latin1_utf8,
+        latin1_utf16,
+        latin1_utf32,
+    };
+
+    struct Entry
+    {
+        const char* name;
+        Input input;
+        std::function<size_t(const Corpus&)> run;
+    };
+
+    struct Measurement
+    {
+        double seconds;
+        double cycles;
+        double allocations;
+    };
+
+    struct Options
+    {
+        size_t corpus_size = 1024 * 1024;
+        double min_seconds = 0.05;
+        std::vector<const char*> files;
+    };
+
+    // Keeps the results of the measured calls alive
+    volatile size_t sink;
+
+    static constexpr size_t min_repetitions = 3;
+    static constexpr size_t stream_chunk_size = 64 * 1024;
+
+    const char* kernel_name(Kernel kernel)
+    {
+        switch(kernel) {
+        case Kernel::scalar:
+            return "scalar";
+        case Kernel::sse42:
+            return "sse42";
+        case Kernel::avx2:
+            return "avx2";
+        case Kernel::avx512:
+            return "avx512";
+        case Kernel::neon:
+            return "neon";
+        }
+        return "unknown";
+    }
+
+    uint64_t read_cycles()
+    {
+#if defined(UCONV_BENCH_CYCLES)
+        return __rdtsc();
+#else
+        return 0;
+#endif
+    }
+
+    char32_t ascii_text(std::mt19937& random)
+    {
+        // Words of letters separated by spaces, punctuation and line breaks
+        uint32_t value = random() % 64;
+        if(value < 52) {
+            return U'a' + value % 26;
+        }
+        static constexpr char32_t separators[] = {U' ', U' ', U' ', U' ', U',', U'.', U'\n', U'0', U'1', U'-', U'(', U')'};
+        return separators[value - 52];
+    }
+
+    // Derives the UTF-16LE, UTF-16BE, UTF-32 and Latin-1 forms and the short strings. Code points above
+    // U+00FF become other non-ASCII characters, so the Latin-1 text keeps the share of non-ASCII characters.
+    void add_other_forms(Corpus& corpus)
+    {
+        corpus.utf16le = corpus.utf16;
+        corpus.utf16be = corpus.utf16;
+        for(char16_t& unit: (std::endian::native == std::endian::little) ? corpus.utf16be : corpus.utf16le) {
+            unit = std::byteswap(unit);
+        }
+        corpus.utf32 = utf16_to_utf32(corpus.utf16);
+        corpus.latin1.clear();
+        for(char32_t codepoint: corpus.utf32) {
+            corpus.latin1.push_back(static_cast<char>((codepoint <= 0xFF) ? codepoint : (0x80 | (codepoint & 0x7F))));
+        }
+        corpus.latin1_utf8 = latin1_to_utf8(corpus.latin1);
+        corpus.latin1_utf16 = latin1_to_utf16(corpus.latin1);
+        corpus.latin1_utf32 = latin1_to_utf32(corpus.latin1);
+
+        // Strings of 1 to 32 bytes, cut on code point boundaries
+        std::mt19937 random(13579);
+        corpus.utf8_offsets.assign(1, 0);
+        for(size_t offset = 0; offset < corpus.utf8.length();) {
+            offset = std::min(corpus.utf8.length(), offset + 1 + random() % 32);
+            while(offset < corpus.utf8.length() && 0x80 == (corpus.utf8[offset] & 0xC0)) {
+                ++offset;
+            }
+            corpus.utf8_offsets.push_back(offset);
+        }
+    }
+
+    size_t input_bytes(const Corpus& corpus, Input input)
+    {
+        switch(input) {
+        case Input::utf8:
+            return corpus.utf8.length();
+        case Input::utf16:
+            return corpus.utf16.length() * sizeof(char16_t);
+        case Input::utf32:
+            return corpus.utf32.length() * sizeof(char32_t);
+        case Input::latin1:
+            return corpus.latin1.length();
+        case Input::latin1_utf8:
+            return corpus.latin1_utf8.length();
+        case Input::latin1_utf16:
+            return corpus.latin1_utf16.length() * sizeof(char16_t);
+        case Input::latin1_utf32:
+            return corpus.latin1_utf32.length() * sizeof(char32_t);
+        }
+        return 0;
+    }
+
+    // Builds about size bytes of UTF-8 from a code point generator
+    Corpus generate(const char* name, size_t size, const std::function<char32_t(std::mt19937&)>& next)
+    {
+        std::mt19937 random(12345);
+        Corpus corpus{name, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}};
+        std::u32string utf32_string;
+        while(utf8_length_from_utf32(utf32_string.length(), utf32_string.data()) < size) {
+            for(size_t i = 0; i < 4096; ++i) {
+                utf32_string.push_back(next(random));
+            }
+        }
+        corpus.utf16 = utf32_to_utf16(utf32_string);
+        corpus.utf8 = utf16_to_utf8(corpus.utf16);
+        add_other_forms(corpus);
+        return corpus;
+    }
+
+    std::vector<Corpus> make_corpora(const Options& options)
+    {
+        const size_t size = options.corpus_size;
+        std::vector<Corpus> corpora;
+        corpora.push_back(generate("ascii", size, ascii_text));
+        corpora.push_back(generate("latin1", size, [](std::mt19937& random) {
+            return (0 == random() % 4) ? U'\u00C0' + random() % 0x40 : ascii_text(random);
+        }));
+        corpora.push_back(generate("cjk", size, [](std::mt19937& random) {
+            return (0 == random() % 10) ? U'\u3001' : U'\u4E00' + random() % 0x5200;
+        }));
+        corpora.push_back(generate("emoji", size, [](std::mt19937& random) {
+            return (0 == random() % 5) ? U' ' : U'\U0001F300' + random() % 0x800;
+        }));
+        auto mixed = [](std::mt19937& random) -> char32_t {
+            switch(random() % 8) {
+            case 0:
+                return U'\u00C0' + random() % 0x40;
+            case 1:
+                return U'\u0400' + random() % 0x100;
+            case 2:
+                return U'\u4E00' + random() % 0x5200;
+            case 3:
+                return U'\U0001F300' + random() % 0x800;
+            default:
+                return ascii_text(random);
+            }
+        };
+        corpora.push_back(generate("mixed", size, mixed));
+
+        // Mixed text with one broken byte or unit in about every 1000
+        Corpus invalid = generate("random_invalid", size, mixed);
+        std::mt19937 random(54321);
+        for(size_t i = 0; i < invalid.utf8.length() / 1000; ++i) {
+            invalid.utf8[random() % invalid.utf8.length()] = static_cast<char8_t>(0x80 + random() % 0x80);
+        }
+        for(size_t i = 0; i < invalid.utf16.length() / 1000; ++i) {
+            invalid.utf16[random() % invalid.utf16.length()] = static_cast<char16_t>(0xD800 + random() % 0x800);
+        }
+        corpora.push_back(std::move(invalid));
+
+        for(const char* path: options.files) {
+            std::ifstream file(path, std::ios::binary);
+            if(!file) {
+                std::fprintf(stderr, "uconv_bench: cannot read %s\n", path);
+                std::exit(2);
+            }
+            Corpus corpus{path, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}};
+            corpus.utf8.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            corpus.utf16.resize(utf16_length_from_utf8(corpus.utf8.length(), corpus.utf8.data()));
+            Result result = convert<ErrorPolicy::replace>(corpus.utf16.length(), corpus.utf16.data(), corpus.utf8.length(), corpus.utf8.data());
+            corpus.utf16.resize(result.written);
+            add_other_forms(corpus);
+            corpora.push_back(std::move(corpus));
+        }
+        return corpora;
+    }
+
+    // Output buffer of the buffer entry points, large enough for every conversion of the corpus,
+    // so they do not allocate
+    size_t output_size(const Corpus& corpus)
+    {
+        return std::max({corpus.utf8.length(), corpus.utf16.length() * 3, corpus.utf32.length() * 4, corpus.latin1.length() * 2});
+    }
+
+    template<class Char>
+    Char* output_buffer(const Corpus& corpus)
+    {
+        static std::basic_string<Char> buffer;
+        buffer.resize(std::max(buffer.length(), output_size(corpus)));
+        return buffer.data();
+    }
+
+    std::vector<Entry> make_entries()
+    {
+        return {
+            {"utf8_to_utf16", Input::utf8, [](const Corpus& corpus) { return utf8_to_utf16(corpus.utf8).length(); }},
+            {"utf16_to_utf8", Input::utf16, [](const Corpus& corpus) { return utf16_to_utf8(corpus.utf16).length(); }},
+            {"utf8_to_utf16_buffer", Input::utf8, [](const Corpus& corpus) {
+                 return utf8_to_utf16(output_size(corpus), output_buffer<char16_t>(corpus), corpus.utf8.length(), corpus.utf8.data()).produced;
+             }},
+            {"utf16_to_utf8_buffer", Input::utf16, [](const Corpus& corpus) {
+                 return utf16_to_utf8(output_size(corpus), output_buffer<char8_t>(corpus), corpus.utf16.length(), corpus.utf16.data()).produced;
+             }},
+            {"convert_strict_utf8_to_utf16", Input::utf8, [](const Corpus& corpus) {
+                 return convert<ErrorPolicy::strict>(output_size(corpus), output_buffer<char16_t>(corpus), corpus.utf8.length(), corpus.utf8.data()).written;
+             }},
+            {"convert_strict_utf16_to_utf8", Input::utf16, [](const Corpus& corpus) {
+                 return convert<ErrorPolicy::strict>(output_size(corpus), output_buffer<char8_t>(corpus), corpus.utf16.length(), corpus.utf16.data()).written;
+             }},
+            {"convert_replace_utf8_to_utf16", Input::utf8, [](const Corpus& corpus) {
+                 return convert<ErrorPolicy::replace>(output_size(corpus), output_buffer<char16_t>(corpus), corpus.utf8.length(), corpus.utf8.data()).written;
+             }},
+            {"convert_replace_utf16_to_utf8", Input::utf16, [](const Corpus& corpus) {
+                 return convert<ErrorPolicy::replace>(output_size(corpus), output_buffer<char8_t>(corpus), corpus.utf16.length(), corpus.utf16.data()).written;
+             }},
+            {"validate_utf8", Input::utf8, [](const Corpus& corpus) { return validate_utf8(corpus.utf8.length(), corpus.utf8.data()); }},
+            {"validate_utf16", Input::utf16, [](const Corpus& corpus) { return validate_utf16(corpus.utf16.length(), corpus.utf16.data()); }},
+            {"utf16_length_from_utf8", Input::utf8, [](const Corpus& corpus) { return utf16_length_from_utf8(corpus.utf8.length(), corpus.utf8.data()); }},
+            {"utf8_length_from_utf16", Input::utf16, [](const Corpus& corpus) { return utf8_length_from_utf16(corpus.utf16.length(), corpus.utf16.data()); }},
+            {"utf8_to_utf16_stream", Input::utf8, [](const Corpus& corpus) {
+                 Utf8ToUtf16Stream stream;
+                 char16_t* output = output_buffer<char16_t>(corpus);
+                 size_t written = 0;
+                 for(size_t offset = 0; offset < corpus.utf8.length(); offset += stream_chunk_size) {
+                     size_t length = std::min(stream_chunk_size, corpus.utf8.length() - offset);
+                     StreamResult result = stream.convert(output_size(corpus) - written, output + written, length, corpus.utf8.data() + offset);
+                     written += result.produced;
+                     if(result.consumed < length) {
+                         break;
+                     }
+                 }
+                 return written;
+             }},
+            {"utf16_to_utf8_stream", Input::utf16, [](const Corpus& corpus) {
+                 Utf16ToUtf8Stream stream;
+                 char8_t* output = output_buffer<char8_t>(corpus);
+                 size_t written = 0;
+                 for(size_t offset = 0; offset < corpus.utf16.length(); offset += stream_chunk_size) {
+                     size_t length = std::min(stream_chunk_size, corpus.utf16.length() - offset);
+                     StreamResult result = stream.convert(output_size(corpus) - written, output + written, length, corpus.utf16.data() + offset);
+                     written += result.produced;
+                     if(result.consumed < length) {
+                         break;
+                     }
+                 }
+                 return written + stream.finish(output_size(corpus) - written, output + written);
+             }},
+            {"parallel_utf8_to_utf16", Input::utf8, [](const Corpus& corpus) { return parallel::utf8_to_utf16(corpus.utf8).length(); }},
+            {"parallel_utf16_to_utf8", Input::utf16, [](const Corpus& corpus) { return parallel::utf16_to_utf8(corpus.utf16).length(); }},
+            {"utf8_to_utf32", Input::utf8, [](const Corpus& corpus) { return utf8_to_utf32(corpus.utf8).length(); }},
+            {"utf32_to_utf8", Input::utf32, [](const Corpus& corpus) { return utf32_to_utf8(corpus.utf32).length(); }},
+            {"utf16_to_utf32", Input::utf16, [](const Corpus& corpus) { return utf16_to_utf32(corpus.utf16).length(); }},
+            {"utf32_to_utf16", Input::utf32, [](const Corpus& corpus) { return utf32_to_utf16(corpus.utf32).length(); }},
+            {"latin1_to_utf8", Input::latin1, [](const Corpus& corpus) { return latin1_to_utf8(corpus.latin1).length(); }},
+            {"utf8_to_latin1", Input::latin1_utf8, [](const Corpus& corpus) { return utf8_to_latin1(corpus.latin1_utf8).length(); }},
+            {"latin1_to_utf16", Input::latin1, [](const Corpus& corpus) { return latin1_to_utf16(corpus.latin1).length(); }},
+            {"utf16_to_latin1", Input::latin1_utf16, [](const Corpus& corpus) { return utf16_to_latin1(corpus.latin1_utf16).length(); }},
+            {"latin1_to_utf32", Input::latin1, [](const Corpus& corpus) { return latin1_to_utf32(corpus.latin1).length(); }},
+            {"utf32_to_latin1", Input::latin1_utf32, [](const Corpus& corpus) { return utf32_to_latin1(corpus.latin1_utf32).length(); }},
+            {"utf8_to_utf32_buffer", Input::utf8, [](const Corpus& corpus) {
+                 return utf8_to_utf32(output_size(corpus), output_buffer<char32_t>(corpus), corpus.utf8.length(), corpus.utf8.data());
+             }},
+            {"utf32_to_utf8_buffer", Input::utf32, [](const Corpus& corpus) {
+                 return utf32_to_utf8(output_size(corpus), output_buffer<char8_t>(corpus), corpus.utf32.length(), corpus.utf32.data());
+             }},
+            {"utf16_to_utf32_buffer", Input::utf16, [](const Corpus& corpus) {
+                 return utf16_to_utf32(output_size(corpus), output_buffer<char32_t>(corpus), corpus.utf16.length(), corpus.utf16.data());
+             }},
+            {"utf32_to_utf16_buffer", Input::utf32, [](const Corpus& corpus) {
+                 return utf32_to_utf16(output_size(corpus), output_buffer<char16_t>(corpus), corpus.utf32.length(), corpus.utf32.data());
+             }},
+            {"latin1_to_utf8_buffer", Input::latin1, [](const Corpus& corpus) {
+                 return latin1_to_utf8(output_size(corpus), output_buffer<char8_t>(corpus), corpus.latin1.length(), corpus.latin1.data());
+             }},
+            {"utf8_to_latin1_buffer", Input::latin1_utf8, [](const Corpus& corpus) {
+                 return utf8_to_latin1(output_size(corpus), output_buffer<char>(corpus), corpus.latin1_utf8.length(), corpus.latin1_utf8.data());
+             }},
+            {"latin1_to_utf16_buffer", Input::latin1, [](const Corpus& corpus) {
+                 return latin1_to_utf16(output_size(corpus), output_buffer<char16_t>(corpus), corpus.latin1.length(), corpus.latin1.data());
+             }},
+            {"utf16_to_latin1_buffer", Input::latin1_utf16, [](const Corpus& corpus) {
+                 return utf16_to_latin1(output_size(corpus), output_buffer<char>(corpus), corpus.latin1_utf16.length(), corpus.latin1_utf16.data());
+             }},
+            {"latin1_to_utf32_buffer", Input::latin1, [](const Corpus& corpus) {
+                 return latin1_to_utf32(output_size(corpus), output_buffer<char32_t>(corpus), corpus.latin1.length(), corpus.latin1.data());
+             }},
+            {"utf32_to_latin1_buffer", Input::latin1_utf32, [](const Corpus& corpus) {
+                 return utf32_to_latin1(output_size(corpus), output_buffer<char>(corpus), corpus.latin1_utf32.length(), corpus.latin1_utf32.data());
+             }},
+            {"utf16le_to_utf8", Input::utf16, [](const Corpus& corpus) { return utf16le_to_utf8(corpus.utf16le).length(); }},
+            {"utf16be_to_utf8", Input::utf16, [](const Corpus& corpus) { return utf16be_to_utf8(corpus.utf16be).length(); }},
+            {"utf8_to_utf16le", Input::utf8, [](const Corpus& corpus) { return utf8_to_utf16le(corpus.utf8).length(); }},
+            {"utf8_to_utf16be", Input::utf8, [](const Corpus& corpus) { return utf8_to_utf16be(corpus.utf8).length(); }},
+            {"utf16be_to_utf8_buffer", Input::utf16, [](const Corpus& corpus) {
+                 return utf16be_to_utf8(output_size(corpus), output_buffer<char8_t>(corpus), corpus.utf16be.length(), corpus.utf16be.data()).produced;
+             }},
+            {"utf8_to_utf16be_buffer", Input::utf8, [](const Corpus& corpus) {
+                 return utf8_to_utf16be(output_size(corpus), output_buffer<char16_t>(corpus), corpus.utf8.length(), corpus.utf8.data()).produced;
+             }},
+            {"utf8_to_utf16_reused", Input::utf8, [](const Corpus& corpus) {
+                 static std::u16string utf16_output;
+                 utf16_output.clear();
+                 return utf8_to_utf16(utf16_output, corpus.utf8);
+             }},
+            {"utf16_to_utf8_reused", Input::utf16, [](const Corpus& corpus) {
+                 static std::u8string utf8_output;
+                 utf8_output.clear();
+                 return utf16_to_utf8(utf8_output, corpus.utf16);
+             }},
+            {"codepoints_utf8", Input::utf8, [](const Corpus& corpus) { return static_cast<size_t>(std::ranges::distance(codepoints(corpus.utf8))); }},
+            {"codepoints_utf16", Input::utf16, [](const Corpus& corpus) { return static_cast<size_t>(std::ranges::distance(codepoints(corpus.utf16))); }},
+            {"offset_index_build", Input::utf8, [](const Corpus& corpus) { return OffsetIndex(corpus.utf8).utf16_length(); }},
+            {"utf8_to_utf16_each", Input::utf8, [](const Corpus& corpus) {
+                 char16_t* output = output_buffer<char16_t>(corpus);
+                 size_t written = 0;
+                 for(size_t i = 0; (i + 1) < corpus.utf8_offsets.size(); ++i) {
+                     const size_t offset = corpus.utf8_offsets[i];
+                     written += utf8_to_utf16(output_size(corpus) - written, output + written, corpus.utf8_offsets[i + 1] - offset, corpus.utf8.data() + offset).produced;
+                 }
+                 return written;
+             }},
+            {"utf8_to_utf16_batch", Input::utf8, [](const Corpus& corpus) {
+                 static std::vector<size_t> offsets;
+                 offsets.resize(std::max(offsets.size(), corpus.utf8_offsets.size()));
+                 const size_t count = corpus.utf8_offsets.size() - 1;
+                 utf8_to_utf16_batch(count, corpus.utf8_offsets.data(), corpus.utf8.data(), output_size(corpus), output_buffer<char16_t>(corpus), offsets.data());
+                 return offsets[count];
+             }},
+            {"utf8_to_utf16_cached", Input::utf8, [](const Corpus& corpus) {
+                 // Every string is a hit after the warm-up, a repeated column
+                 static ConversionCache cache(1 << 20);
+                 size_t written = 0;
+                 for(size_t i = 0; (i + 1) < corpus.utf8_offsets.size(); ++i) {
+                     const size_t offset = corpus.utf8_offsets[i];
+                     written += cache.utf8_to_utf16(std::u8string_view(corpus.utf8).substr(offset, corpus.utf8_offsets[i + 1] - offset))->length();
+                 }
+                 return written;
+             }},
+            {"equal_utf8_utf16", Input::utf8, [](const Corpus& corpus) { return static_cast<size_t>(equal(corpus.utf8, corpus.utf16)); }},
+            {"hash_utf8", Input::utf8, [](const Corpus& corpus) { return hash(std::u8string_view(corpus.utf8)); }},
+            {"hash_utf16", Input::utf16, [](const Corpus& corpus) { return hash(std::u16string_view(corpus.utf16)); }},
+        };
+    }
+
+    // Best of the repetitions run within the time budget, allocations are averaged
+    Measurement measure(const Entry& entry, const Corpus& corpus, double min_seconds)
+    {
+        sink = entry.run(corpus); // Warm up the caches and the output buffers
+        Measurement best{1e300, 1e300, 0.0};
+        size_t allocations = 0;
+        size_t repetitions = 0;
+        double total = 0.0;
+        while(repetitions < min_repetitions || total < min_seconds) {
+            const size_t allocations_before = allocation_count.load(std::memory_order_relaxed);
+            const uint64_t cycles_before = read_cycles();
+            const auto start = std::chrono::steady_clock::now();
+            sink = entry.run(corpus);
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            const uint64_t cycles = read_cycles() - cycles_before;
+            allocations += allocation_count.load(std::memory_order_relaxed) - allocations_before;
+            best.seconds = std::min(best.seconds, seconds);
+            best.cycles = std::min(best.cycles, static_cast<double>(cycles));
+            total += seconds;
+            ++repetitions;
+        }
+        best.allocations = static_cast<double>(allocations) / static_cast<double>(repetitions);
+        return best;
+    }
+
+    void print_json_string(std::string_view string)
+    {
+        std::putchar('"');
+        for(char c: string) {
+            if('"' == c || '\\' == c) {
+                std::printf("\\%c", c);
+            } else if(static_cast<unsigned char>(c) < 0x20) {
+                std::printf("\\u%04x", c);
+            } else {
+                std::putchar(c);
+            }
+        }
+        std::putchar('"');
+    }
+
+    bool parse_options(Options& options, int argc, char** argv)
+    {
+        for(int i = 1; i < argc; ++i) {
+            std::string_view argument = argv[i];
+            if(("--size" == argument || "--time" == argument) && (i + 1) < argc) {
+                char* end;
+                double value = std::strtod(argv[++i], &end);
+                if(*end != '\0' || value <= 0) {
+                    return false;
+                }
+                if("--size" == argument) {
+                    options.corpus_size = static_cast<size_t>(value);
+                } else {
+                    options.min_seconds = value / 1000.0;
+                }
+            } else if(!argument.empty() && '-' != argument[0]) {
+                options.files.push_back(argv[i]);
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if(!parse_options(options, argc, argv)) {
+        std::fputs("Usage: uconv_bench [--size BYTES] [--time MILLISECONDS] [utf8 files...]\n"
+                   "Runs every conversion entry point on every supported kernel and prints the results as JSON.\n"
+                   "--size sets the size of the generated corpora, 1 MiB by default, --time the minimum time\n"
+                   "per measurement, 50 ms by default. Files are added as UTF-8 corpora.\n",
+                   stderr);
+        return 2;
+    }
+
+    const Kernel default_kernel = active_kernel();
+    const std::vector<Corpus> corpora = make_corpora(options);
+    const std::vector<Entry> entries = make_entries();
+
+    std::printf("{\n  \"active_kernel\": \"%s\",\n  \"cycle_counter\": %s,\n  \"corpora\": [", kernel_name(default_kernel),
+#if defined(UCONV_BENCH_CYCLES)
+                "\"tsc\""
+#else
+                "null"
+#endif
+    );
+    for(size_t i = 0; i < corpora.size(); ++i) {
+        std::printf("%s\n    {\"name\": ", (0 < i) ? "," : "");
+        print_json_string(corpora[i].name);
+        std::printf(", \"utf8_bytes\": %zu, \"utf16_bytes\": %zu, \"utf32_bytes\": %zu, \"latin1_bytes\": %zu}", corpora[i].utf8.length(),
+                    corpora[i].utf16.length() * sizeof(char16_t), corpora[i].utf32.length() * sizeof(char32_t), corpora[i].latin1.length());
+    }
+    std::printf("\n  ],\n  \"results\": [");
+
+    bool first = true;
+    for(Kernel kernel: {Kernel::scalar, Kernel::sse42, Kernel::avx2, Kernel::avx512, Kernel::neon}) {
+        if(!select_kernel(kernel)) {
+            continue;
+        }
+        for(const Corpus& corpus: corpora) {
+            for(const Entry& entry: entries) {
+                const size_t bytes = input_bytes(corpus, entry.input);
+                const Measurement measurement = measure(entry, corpus, options.min_seconds);
+                std::printf("%s\n    {\"kernel\": \"%s\", \"corpus\": ", first ? "" : ",", kernel_name(kernel));
+                print_json_string(corpus.name);
+                std::printf(", \"function\": \"%s\", \"input_bytes\": %zu, \"gb_per_s\": %.3f, \"cycles_per_byte\": ", entry.name, bytes,
+                            (0 < measurement.seconds) ? static_cast<double>(bytes) / measurement.seconds / 1e9 : 0.0);
+#if defined(UCONV_BENCH_CYCLES)
+                std::printf("%.3f", (0 < bytes) ? measurement.cycles / static_cast<double>(bytes) : 0.0);
+#else
+                std::printf("null");
+#endif
+                std::printf(", \"allocations_per_call\": %.2f}", measurement.allocations);
+                std::fflush(stdout);
+                first = false;
+            }
+        }
+    }
+    std::printf("\n  ]\n}\n");
+    select_kernel(default_kernel);
+    return 0;
+}
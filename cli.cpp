@@ -0,0 +1,798 @@
+#include "uconv.h"
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <vector>
+
+#if defined(_WIN32)
+#    define WIN32_LEAN_AND_MEAN
+#    define NOMINMAX
+#    include <fcntl.h>
+#    include <io.h>
+#    include <windows.h>
+#else
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+using namespace uconv;
+
+namespace
+{
+    enum class Encoding
+    {
+        unknown,
+        utf8,
+        utf16le,
+        utf16be,
+        utf32le,
+        utf32be,
+    };
+
+    struct EncodingName
+    {
+        std::string_view name;
+        Encoding encoding;
+        bool bom; // Written by default, the byte order is taken from the BOM when reading
+    };
+
+    static constexpr EncodingName encoding_names[] = {
+        {"utf-8", Encoding::utf8, false},
+        {"utf8", Encoding::utf8, false},
+        {"utf-16", Encoding::utf16le, true},
+        {"utf16", Encoding::utf16le, true},
+        {"utf-16le", Encoding::utf16le, false},
+        {"utf16le", Encoding::utf16le, false},
+        {"utf-16be", Encoding::utf16be, false},
+        {"utf16be", Encoding::utf16be, false},
+        {"utf-32", Encoding::utf32le, true},
+        {"utf32", Encoding::utf32le, true},
+        {"utf-32le", Encoding::utf32le, false},
+        {"utf32le", Encoding::utf32le, false},
+        {"utf-32be", Encoding::utf32be, false},
+        {"utf32be", Encoding::utf32be, false},
+    };
+
+    // Input read and converted at a time, in bytes
+    static constexpr size_t chunk_size = 1024 * 1024;
+    // Every output encoding needs at most 4 bytes per UTF-16 code unit
+    static constexpr size_t output_buffer_size = chunk_size * 4;
+    static constexpr std::align_val_t buffer_alignment{4096};
+
+    static constexpr bool little_endian = std::endian::native == std::endian::little;
+
+    struct Options
+    {
+        Encoding from = Encoding::unknown;
+        bool from_generic = false;
+        Encoding to = Encoding::utf8;
+        bool bom = false;
+        ErrorPolicy policy = ErrorPolicy::strict;
+        bool stats = false;
+        const char* input = nullptr;
+        const char* output = nullptr;
+    };
+
+    void print_usage(std::FILE* file)
+    {
+        std::fputs("Usage: uconv [options] input [output]\n"
+                   "Converts a file between Unicode encodings, reads the standard input if input is -,\n"
+                   "writes to the standard output without output.\n"
+                   "\n"
+                   "  -f, --from ENCODING   Input encoding, detected from a byte order mark, UTF-8 without one\n"
+                   "  -t, --to ENCODING     Output encoding, UTF-8 by default\n"
+                   "  -b, --bom             Write a byte order mark\n"
+                   "  -r, --replace         Replace invalid input with U+FFFD instead of failing\n"
+                   "  -p, --pass-through    Keep unpaired surrogates, replace other invalid input with U+FFFD\n"
+                   "  -s, --stats           Print the throughput to the standard error\n"
+                   "  -h, --help            Print this help\n"
+                   "\n"
+                   "Encodings: utf-8, utf-16, utf-16le, utf-16be, utf-32, utf-32le, utf-32be\n"
+                   "A byte order mark of the input is removed. utf-16 and utf-32 read the byte order from it,\n"
+                   "big endian without one, and are written in little endian with a byte order mark.\n",
+                   file);
+    }
+
+    const EncodingName* find_encoding(std::string_view name)
+    {
+        std::string name_lower(name);
+        for(char& c: name_lower) {
+            c = static_cast<char>(('A' <= c && c <= 'Z') ? c - 'A' + 'a' : c);
+        }
+        for(const EncodingName& encoding: encoding_names) {
+            if(encoding.name == name_lower) {
+                return &encoding;
+            }
+        }
+        return nullptr;
+    }
+
+    // Returns 0 on success, the exit code otherwise
+    int parse_options(Options& options, int argc, char** argv)
+    {
+        for(int i = 1; i < argc; ++i) {
+            std::string_view argument = argv[i];
+            if("-f" == argument || "--from" == argument || "-t" == argument || "--to" == argument) {
+                if(argc <= (i + 1)) {
+                    std::fprintf(stderr, "uconv: %s needs an encoding\n", argv[i]);
+                    return 2;
+                }
+                const EncodingName* encoding = find_encoding(argv[++i]);
+                if(nullptr == encoding) {
+                    std::fprintf(stderr, "uconv: unknown encoding %s\n", argv[i]);
+                    return 2;
+                }
+                if("-f" == argument || "--from" == argument) {
+                    options.from = encoding->encoding;
+                    options.from_generic = encoding->bom;
+                } else {
+                    options.to = encoding->encoding;
+                    options.bom = options.bom || encoding->bom;
+                }
+            } else if("-b" == argument || "--bom" == argument) {
+                options.bom = true;
+            } else if("-r" == argument || "--replace" == argument) {
+                options.policy = ErrorPolicy::replace;
+            } else if("-p" == argument || "--pass-through" == argument) {
+                options.policy = ErrorPolicy::pass_through;
+            } else if("-s" == argument || "--stats" == argument) {
+                options.stats = true;
+            } else if("-h" == argument || "--help" == argument) {
+                print_usage(stdout);
+                return -1;
+            } else if(1 < argument.length() && '-' == argument[0]) {
+                std::fprintf(stderr, "uconv: unknown option %s\n", argv[i]);
+                return 2;
+            } else if(nullptr == options.input) {
+                options.input = argv[i];
+            } else if(nullptr == options.output) {
+                options.output = argv[i];
+            } else {
+                print_usage(stderr);
+                return 2;
+            }
+        }
+        if(nullptr == options.input) {
+            print_usage(stderr);
+            return 2;
+        }
+        return 0;
+    }
+
+    // Input file, memory mapped if it is a regular file. Pipes, sockets and devices have no size and
+    // are read in chunks instead, data() and size() then hold the bytes read and not yet consumed.
+    class Input
+    {
+    public:
+        Input() = default;
+        Input(const Input&) = delete;
+        Input& operator=(const Input&) = delete;
+
+        ~Input()
+        {
+#if defined(_WIN32)
+            if(mapped_) {
+                UnmapViewOfFile(data_);
+            }
+            if(INVALID_HANDLE_VALUE != file_ && GetStdHandle(STD_INPUT_HANDLE) != file_) {
+                CloseHandle(file_);
+            }
+#else
+            if(mapped_) {
+                munmap(const_cast<uint8_t*>(data_), size_);
+            }
+            if(0 <= file_ && STDIN_FILENO != file_) {
+                ::close(file_);
+            }
+#endif
+        }
+
+        bool open(const char* path)
+        {
+            const bool standard_input = std::string_view("-") == path;
+            bool success = true;
+#if defined(_WIN32)
+            HANDLE file = standard_input ? GetStdHandle(STD_INPUT_HANDLE)
+                                         : CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if(INVALID_HANDLE_VALUE == file || nullptr == file) {
+                return false;
+            }
+            if(FILE_TYPE_DISK == GetFileType(file)) {
+                LARGE_INTEGER size;
+                success = GetFileSizeEx(file, &size);
+                size_ = static_cast<size_t>(size.QuadPart);
+                if(success && 0 < size_) {
+                    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                    success = nullptr != mapping;
+                    if(success) {
+                        data_ = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                        success = nullptr != data_;
+                        mapped_ = success;
+                        CloseHandle(mapping);
+                    }
+                }
+                if(!standard_input) {
+                    CloseHandle(file);
+                }
+                return success;
+            }
+#else
+            int file = standard_input ? STDIN_FILENO : ::open(path, O_RDONLY);
+            if(file < 0) {
+                return false;
+            }
+            struct stat status;
+            if(0 == fstat(file, &status) && S_ISREG(status.st_mode)) {
+                size_ = static_cast<size_t>(status.st_size);
+                if(0 < size_) {
+                    void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, file, 0);
+                    success = MAP_FAILED != data;
+                    if(success) {
+                        data_ = static_cast<const uint8_t*>(data);
+                        mapped_ = true;
+                        madvise(data, size_, MADV_SEQUENTIAL);
+                    }
+                }
+                if(!standard_input) {
+                    ::close(file);
+                }
+                return success;
+            }
+#endif
+            // A few bytes more than a chunk, the bytes after a chunk tell if it ends inside a sequence
+            file_ = file;
+            end_ = false;
+            contents_.resize(chunk_size + 4);
+            size_t position = 0;
+            return fill(position);
+        }
+
+        // Drops the bytes before position and reads until a chunk and the bytes after it follow position
+        // or the input ends, position is moved along with the bytes. A mapping holds everything already.
+        // Returns false if reading failed.
+        bool fill(size_t& position)
+        {
+            if(end_) {
+                return true;
+            }
+            offset_ += position;
+            size_ -= position;
+            std::memmove(contents_.data(), contents_.data() + position, size_);
+            position = 0;
+            data_ = contents_.data();
+            while(!end_ && size_ < contents_.size()) {
+#if defined(_WIN32)
+                DWORD count = 0;
+                if(!ReadFile(file_, contents_.data() + size_, static_cast<DWORD>(contents_.size() - size_), &count, nullptr)
+                   && ERROR_BROKEN_PIPE != GetLastError()) {
+                    return false;
+                }
+                size_ += count;
+                end_ = 0 == count;
+#else
+                const ssize_t count = ::read(file_, contents_.data() + size_, contents_.size() - size_);
+                if(0 < count) {
+                    size_ += static_cast<size_t>(count);
+                } else if(0 == count) {
+                    end_ = true;
+                } else if(EINTR != errno) {
+                    return false;
+                }
+#endif
+            }
+            return true;
+        }
+
+        const uint8_t* data() const
+        {
+            return data_;
+        }
+
+        size_t size() const
+        {
+            return size_;
+        }
+
+        // Offset of data() in the input
+        size_t offset() const
+        {
+            return offset_;
+        }
+
+        // Drops the pages before offset from the resident set, they are not read again
+        void release(size_t offset)
+        {
+#if !defined(_WIN32)
+            if(!mapped_) {
+                return;
+            }
+            static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            const size_t end = offset / page_size * page_size;
+            if(released_ < end) {
+                madvise(const_cast<uint8_t*>(data_) + released_, end - released_, MADV_DONTNEED);
+                released_ = end;
+            }
+#else
+            (void)offset;
+#endif
+        }
+
+    private:
+        const uint8_t* data_ = nullptr;
+        size_t size_ = 0;
+        size_t offset_ = 0;
+        size_t released_ = 0;
+        bool mapped_ = false;
+        bool end_ = true;
+#if defined(_WIN32)
+        HANDLE file_ = INVALID_HANDLE_VALUE;
+#else
+        int file_ = -1;
+#endif
+        std::vector<uint8_t> contents_;
+    };
+
+    // Unbuffered file or standard output, every write goes straight to the system
+    class Output
+    {
+    public:
+        Output() = default;
+        Output(const Output&) = delete;
+        Output& operator=(const Output&) = delete;
+
+        ~Output()
+        {
+            close();
+        }
+
+        bool open(const char* path)
+        {
+            if(nullptr == path || std::string_view("-") == path) {
+#if defined(_WIN32)
+                _setmode(_fileno(stdout), _O_BINARY);
+#endif
+                file_ = stdout;
+            } else {
+                file_ = std::fopen(path, "wb");
+                if(nullptr == file_) {
+                    return false;
+                }
+            }
+            std::setvbuf(file_, nullptr, _IONBF, 0);
+            return true;
+        }
+
+        bool write(const void* data, size_t size)
+        {
+            written_ += size;
+            return size == std::fwrite(data, 1, size, file_);
+        }
+
+        bool close()
+        {
+            bool success = true;
+            if(nullptr != file_ && stdout != file_) {
+                success = 0 == std::fclose(file_);
+            } else if(nullptr != file_) {
+                success = 0 == std::fflush(file_);
+            }
+            file_ = nullptr;
+            return success;
+        }
+
+        size_t written() const
+        {
+            return written_;
+        }
+
+    private:
+        std::FILE* file_ = nullptr;
+        size_t written_ = 0;
+    };
+
+    struct AlignedDelete
+    {
+        void operator()(void* pointer) const
+        {
+            ::operator delete[](pointer, buffer_alignment);
+        }
+    };
+
+    template<class T>
+    std::unique_ptr<T[], AlignedDelete> allocate_buffer(size_t size)
+    {
+        return std::unique_ptr<T[], AlignedDelete>(static_cast<T*>(::operator new[](size * sizeof(T), buffer_alignment)));
+    }
+
+    // Encoding and length of a byte order mark at the start of data
+    Encoding sniff_bom(const uint8_t* data, size_t size, size_t& length)
+    {
+        if(3 <= size && 0xEF == data[0] && 0xBB == data[1] && 0xBF == data[2]) {
+            length = 3;
+            return Encoding::utf8;
+        } else if(4 <= size && 0xFF == data[0] && 0xFE == data[1] && 0x00 == data[2] && 0x00 == data[3]) {
+            length = 4;
+            return Encoding::utf32le;
+        } else if(4 <= size && 0x00 == data[0] && 0x00 == data[1] && 0xFE == data[2] && 0xFF == data[3]) {
+            length = 4;
+            return Encoding::utf32be;
+        } else if(2 <= size && 0xFF == data[0] && 0xFE == data[1]) {
+            length = 2;
+            return Encoding::utf16le;
+        } else if(2 <= size && 0xFE == data[0] && 0xFF == data[1]) {
+            length = 2;
+            return Encoding::utf16be;
+        }
+        length = 0;
+        return Encoding::unknown;
+    }
+
+    bool is_native(Encoding encoding)
+    {
+        return little_endian == (Encoding::utf16le == encoding || Encoding::utf32le == encoding);
+    }
+
+    char16_t load_utf16(const uint8_t* data, bool native)
+    {
+        char16_t unit;
+        std::memcpy(&unit, data, sizeof(unit));
+        return native ? unit : std::byteswap(unit);
+    }
+
+    char32_t load_utf32(const uint8_t* data, bool native)
+    {
+        char32_t unit;
+        std::memcpy(&unit, data, sizeof(unit));
+        return native ? unit : std::byteswap(unit);
+    }
+
+    // Writes UTF-16 in native byte order in the output encoding, unpaired surrogates
+    // were already handled by the reader
+    bool write_utf16(Output& output, Encoding encoding, uint8_t* buffer, size_t length, const char16_t* units)
+    {
+        switch(encoding) {
+        case Encoding::utf8: {
+            Result result = convert<ErrorPolicy::pass_through>(output_buffer_size, reinterpret_cast<char8_t*>(buffer), length, units);
+            return output.write(buffer, result.written);
+        }
+        case Encoding::utf16le:
+        case Encoding::utf16be: {
+            if(is_native(encoding)) {
+                return output.write(units, length * sizeof(char16_t));
+            }
+            char16_t* swapped = reinterpret_cast<char16_t*>(buffer);
+            for(size_t i = 0; i < length; ++i) {
+                swapped[i] = std::byteswap(units[i]);
+            }
+            return output.write(buffer, length * sizeof(char16_t));
+        }
+        case Encoding::utf32le:
+        case Encoding::utf32be: {
+            char32_t* codepoints = reinterpret_cast<char32_t*>(buffer);
+            const size_t count = utf16_to_utf32(output_buffer_size / sizeof(char32_t), codepoints, length, units);
+            if(!is_native(encoding)) {
+                for(size_t i = 0; i < count; ++i) {
+                    codepoints[i] = std::byteswap(codepoints[i]);
+                }
+            }
+            return output.write(buffer, count * sizeof(char32_t));
+        }
+        default:
+            return false;
+        }
+    }
+
+    const uint8_t* byte_order_mark(Encoding encoding, size_t& length)
+    {
+        static const uint8_t utf8[] = {0xEF, 0xBB, 0xBF};
+        static const uint8_t utf16le[] = {0xFF, 0xFE};
+        static const uint8_t utf16be[] = {0xFE, 0xFF};
+        static const uint8_t utf32le[] = {0xFF, 0xFE, 0x00, 0x00};
+        static const uint8_t utf32be[] = {0x00, 0x00, 0xFE, 0xFF};
+        switch(encoding) {
+        case Encoding::utf16le:
+            length = sizeof(utf16le);
+            return utf16le;
+        case Encoding::utf16be:
+            length = sizeof(utf16be);
+            return utf16be;
+        case Encoding::utf32le:
+            length = sizeof(utf32le);
+            return utf32le;
+        case Encoding::utf32be:
+            length = sizeof(utf32be);
+            return utf32be;
+        default:
+            length = sizeof(utf8);
+            return utf8;
+        }
+    }
+
+    // Length of the byte order mark of encoding at the start of data, 0 without one
+    size_t bom_length_of(Encoding encoding, const uint8_t* data, size_t size)
+    {
+        size_t length;
+        const uint8_t* bom = byte_order_mark(encoding, length);
+        return (length <= size && 0 == std::memcmp(data, bom, length)) ? length : 0;
+    }
+
+    int report_invalid(size_t offset)
+    {
+        std::fprintf(stderr, "uconv: invalid input at byte offset %zu\n", offset);
+        return 1;
+    }
+
+    int report_read_error()
+    {
+        std::perror("uconv: read failed");
+        return 2;
+    }
+
+    int report_write_error()
+    {
+        std::perror("uconv: write failed");
+        return 2;
+    }
+
+    // True if no code point is a surrogate or above U+10FFFF, swapping them to native byte order into swapped if not native
+    bool valid_utf32(size_t length, const uint8_t* data, bool native, char32_t* swapped)
+    {
+        for(size_t i = 0; i < length; ++i) {
+            const char32_t codepoint = load_utf32(data + i * 4, native);
+            if(0x10FFFF < codepoint || 0xD800 == (codepoint & 0xFFFFF800)) {
+                return false;
+            }
+            if(!native) {
+                swapped[i] = codepoint;
+            }
+        }
+        return true;
+    }
+
+    // Writes a chunk in the output encoding without the UTF-16 pivot if both encodings are the same or a
+    // kernel converts between them directly. Returns false if there is no such path or the chunk is invalid,
+    // the pivot then handles it by the error policy. success is false if the write failed.
+    template<ErrorPolicy Policy>
+    bool write_direct(Encoding from, Encoding to, size_t size, const uint8_t* data, uint8_t* buffer, char16_t* scratch, Output& output, bool& success)
+    {
+        const bool native = is_native(from);
+        const char8_t* utf8 = reinterpret_cast<const char8_t*>(data);
+        const bool utf16_from = Encoding::utf16le == from || Encoding::utf16be == from;
+        const bool utf32_from = Encoding::utf32le == from || Encoding::utf32be == from;
+        if(from == to) {
+            bool valid = true;
+            if(Encoding::utf8 == from) {
+                valid = size == validate_utf8(size, utf8);
+            } else if(utf16_from && ErrorPolicy::pass_through != Policy) {
+                const size_t length = size / 2;
+                const char16_t* units = reinterpret_cast<const char16_t*>(data);
+                if(!native) {
+                    for(size_t i = 0; i < length; ++i) {
+                        scratch[i] = load_utf16(data + i * 2, false);
+                    }
+                    units = scratch;
+                }
+                valid = length == validate_utf16(length, units);
+            } else if(utf32_from) {
+                valid = valid_utf32(size / 4, data, native, reinterpret_cast<char32_t*>(scratch));
+            }
+            if(valid) {
+                success = output.write(data, size);
+            }
+            return valid;
+        }
+        if(Encoding::utf8 == from && (Encoding::utf32le == to || Encoding::utf32be == to)) {
+            if(size != validate_utf8(size, utf8)) {
+                return false;
+            }
+            char32_t* codepoints = reinterpret_cast<char32_t*>(buffer);
+            const size_t count = utf8_to_utf32(output_buffer_size / sizeof(char32_t), codepoints, size, utf8);
+            if(!is_native(to)) {
+                for(size_t i = 0; i < count; ++i) {
+                    codepoints[i] = std::byteswap(codepoints[i]);
+                }
+            }
+            success = output.write(buffer, count * sizeof(char32_t));
+            return true;
+        }
+        if(utf32_from && Encoding::utf8 == to) {
+            const size_t length = size / 4;
+            const char32_t* codepoints = native ? reinterpret_cast<const char32_t*>(data) : reinterpret_cast<const char32_t*>(scratch);
+            if(!valid_utf32(length, data, native, reinterpret_cast<char32_t*>(scratch))) {
+                return false;
+            }
+            const size_t count = utf32_to_utf8(output_buffer_size, reinterpret_cast<char8_t*>(buffer), length, codepoints);
+            success = output.write(buffer, count);
+            return true;
+        }
+        if(Encoding::utf8 == from && (Encoding::utf16le == to || Encoding::utf16be == to) && !is_native(to)) {
+            // The kernels swap in registers, the pivot would need a second pass for the byte order
+            char16_t* units = reinterpret_cast<char16_t*>(buffer);
+            const BufferResult result = (Encoding::utf16le == to) ? utf8_to_utf16le(output_buffer_size / sizeof(char16_t), units, size, utf8)
+                                                                  : utf8_to_utf16be(output_buffer_size / sizeof(char16_t), units, size, utf8);
+            if(size != result.consumed) {
+                return false;
+            }
+            success = output.write(buffer, result.produced * sizeof(char16_t));
+            return true;
+        }
+        return false;
+    }
+
+    // Converts the input chunk by chunk and writes every chunk in the output encoding. Encodings
+    // without a direct path go through UTF-16 in native byte order, in place for UTF-16 input in
+    // native byte order.
+    template<ErrorPolicy Policy>
+    int transcode(const Options& options, Encoding from, size_t position, Input& input, Output& output)
+    {
+        auto pivot = allocate_buffer<char16_t>(chunk_size);
+        auto buffer = allocate_buffer<uint8_t>(output_buffer_size);
+        const size_t unit_size = (Encoding::utf8 == from) ? 1 : (Encoding::utf16le == from || Encoding::utf16be == from) ? 2 : 4;
+        const bool native = is_native(from);
+        for(;;) {
+            // The bytes of a sequence cut off at the end of the last chunk are kept for this one
+            if(!input.fill(position)) {
+                return report_read_error();
+            }
+            const uint8_t* data = input.data();
+            const size_t size = input.size();
+            if(size <= position) {
+                break;
+            }
+            // End the chunk on a code point boundary
+            size_t end = std::min(size, position + chunk_size);
+            if(Encoding::utf8 == from) {
+                for(size_t i = 0; i < 3 && end < size && 0x80 == (data[end] & 0xC0); ++i) {
+                    --end;
+                }
+            } else if(unit_size <= (end - position)) {
+                end = position + (end - position) / unit_size * unit_size;
+                if(2 == unit_size && end < size && 0xD800 == (load_utf16(data + end - 2, native) & 0xFC00)) {
+                    end -= 2;
+                }
+            }
+            bool success = true;
+            if(unit_size <= (end - position) && write_direct<Policy>(from, options.to, end - position, data + position, buffer.get(), pivot.get(), output, success)) {
+                if(!success) {
+                    return report_write_error();
+                }
+                input.release(end);
+                position = end;
+                continue;
+            }
+
+            const char16_t* units = pivot.get();
+            size_t length = 0;
+            if(Encoding::utf8 == from) {
+                Result result = convert<Policy>(chunk_size, pivot.get(), end - position, reinterpret_cast<const char8_t*>(data + position));
+                if(Status::invalid_input == result.status) {
+                    return report_invalid(input.offset() + position + result.error_offset);
+                }
+                length = result.written;
+            } else if((end - position) < unit_size) {
+                // Truncated code unit at the end of the input
+                if constexpr(ErrorPolicy::strict == Policy) {
+                    return report_invalid(input.offset() + position);
+                }
+                pivot[length++] = 0xFFFD;
+            } else if(2 == unit_size) {
+                length = (end - position) / 2;
+                if(native) {
+                    units = reinterpret_cast<const char16_t*>(data + position);
+                } else {
+                    for(size_t i = 0; i < length; ++i) {
+                        pivot[i] = load_utf16(data + position + i * 2, false);
+                    }
+                }
+                if constexpr(ErrorPolicy::pass_through != Policy) {
+                    size_t error = validate_utf16(length, units);
+                    if(error < length) {
+                        if constexpr(ErrorPolicy::strict == Policy) {
+                            return report_invalid(input.offset() + position + error * 2);
+                        }
+                        if(units != pivot.get()) {
+                            std::memcpy(pivot.get(), units, length * sizeof(char16_t));
+                            units = pivot.get();
+                        }
+                        while(error < length) {
+                            pivot[error] = 0xFFFD;
+                            error += 1 + validate_utf16(length - error - 1, pivot.get() + error + 1);
+                        }
+                    }
+                }
+            } else {
+                for(size_t offset = position; offset < end; offset += 4) {
+                    char32_t codepoint = load_utf32(data + offset, native);
+                    const bool surrogate = 0xD800 == (codepoint & 0xFFFFF800);
+                    if(0x10FFFF < codepoint || (surrogate && ErrorPolicy::pass_through != Policy)) {
+                        if constexpr(ErrorPolicy::strict == Policy) {
+                            return report_invalid(input.offset() + offset);
+                        }
+                        codepoint = 0xFFFD;
+                    }
+                    if(codepoint <= 0xFFFF) {
+                        pivot[length++] = static_cast<char16_t>(codepoint);
+                    } else {
+                        pivot[length++] = static_cast<char16_t>(0xD800 + ((codepoint - 0x10000) >> 10));
+                        pivot[length++] = static_cast<char16_t>(0xDC00 + (codepoint & 0x3FF));
+                    }
+                }
+            }
+            if(!write_utf16(output, options.to, buffer.get(), length, units)) {
+                return report_write_error();
+            }
+            input.release(end);
+            position = end;
+        }
+        return 0;
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options options;
+    int status = parse_options(options, argc, argv);
+    if(0 != status) {
+        return (status < 0) ? 0 : status;
+    }
+
+    Input input;
+    if(!input.open(options.input)) {
+        std::fprintf(stderr, "uconv: cannot read %s\n", options.input);
+        return 2;
+    }
+    Output output;
+    if(!output.open(options.output)) {
+        std::fprintf(stderr, "uconv: cannot write %s\n", options.output);
+        return 2;
+    }
+
+    // A byte order mark decides the input encoding if none was given, utf-16 and utf-32 are
+    // little endian after a little endian byte order mark of their width and big endian otherwise
+    if(Encoding::unknown == options.from) {
+        size_t length;
+        const Encoding from = sniff_bom(input.data(), input.size(), length);
+        options.from = (Encoding::unknown == from) ? Encoding::utf8 : from;
+    } else if(options.from_generic && 0 == bom_length_of(options.from, input.data(), input.size())) {
+        options.from = (Encoding::utf16le == options.from) ? Encoding::utf16be : Encoding::utf32be;
+    }
+    const size_t bom_length = bom_length_of(options.from, input.data(), input.size());
+
+    const auto start = std::chrono::steady_clock::now();
+    if(options.bom) {
+        size_t length;
+        const uint8_t* bom = byte_order_mark(options.to, length);
+        if(!output.write(bom, length)) {
+            return report_write_error();
+        }
+    }
+    switch(options.policy) {
+    case ErrorPolicy::strict:
+        status = transcode<ErrorPolicy::strict>(options, options.from, bom_length, input, output);
+        break;
+    case ErrorPolicy::replace:
+        status = transcode<ErrorPolicy::replace>(options, options.from, bom_length, input, output);
+        break;
+    case ErrorPolicy::pass_through:
+        status = transcode<ErrorPolicy::pass_through>(options, options.from, bom_length, input, output);
+        break;
+    }
+    if(!output.close() && 0 == status) {
+        status = report_write_error();
+    }
+
+    if(options.stats) {
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const size_t input_size = input.offset() + input.size();
+        std::fprintf(stderr, "uconv: %zu bytes in, %zu bytes out, %.3f s, %.2f GB/s\n", input_size, output.written(), seconds,
+                     (0 < seconds) ? static_cast<double>(input_size) / seconds / 1e9 : 0.0);
+    }
+    return status;
+}
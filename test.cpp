@@ -1,9 +1,46 @@
 #include "uconv.h"
+#include <algorithm>
+#include <bit>
 #include <cassert>
+#include <cstring>
+#include <functional>
 #include <iostream>
+#include <iterator>
+#include <memory_resource>
+#include <random>
+#include <ranges>
+#include <span>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
 
 using namespace uconv;
 
+// Appends a code point as UTF-16, a surrogate pair above U+FFFF
+void append_codepoint(std::u16string& utf16_string, char32_t codepoint)
+{
+    if(0xFFFF < codepoint) {
+        utf16_string.push_back(static_cast<char16_t>(0xD800 + ((codepoint - 0x10000) >> 10)));
+        utf16_string.push_back(static_cast<char16_t>(0xDC00 + (codepoint & 0x3FF)));
+    } else {
+        utf16_string.push_back(static_cast<char16_t>(codepoint));
+    }
+}
+
+// Runs test with every kernel the CPU supports, the scalar kernel first, and selects the active kernel again
+template<class Test>
+void for_each_kernel(Test test)
+{
+    const Kernel kernel = active_kernel();
+    for(Kernel candidate: {Kernel::scalar, Kernel::sse42, Kernel::avx2, Kernel::avx512, Kernel::neon}) {
+        if(select_kernel(candidate)) {
+            test(candidate);
+        }
+    }
+    select_kernel(kernel);
+}
+
 void test_ascii()
 {
     std::u8string utf8_ascii = u8"Hello, World!";
@@ -76,6 +113,24 @@ void test_surrogate_pairs()
     std::cout << "Surrogate pair test passed." << std::endl;
 }
 
+void test_output_lengths()
+{
+    std::u8string utf8_string = u8"Hello, 世界 👋";
+    assert(12 == utf16_length_from_utf8(utf8_string.length(), utf8_string.data()));
+    assert(utf8_to_utf16(utf8_string).length() == utf16_length_from_utf8(utf8_string.length(), utf8_string.data()));
+
+    std::u16string utf16_string = u"Hello, 世界 👋";
+    assert(utf8_string.length() == utf8_length_from_utf16(utf16_string.length(), utf16_string.data()));
+    assert(0 == utf8_length_from_utf16(0, utf16_string.data()));
+
+    // Unpaired surrogates are encoded with 3 bytes, a reversed pair is two unpaired surrogates
+    [[maybe_unused]] const char16_t surrogates[] = {0xDC00, 0xD800, 0xD800, 0xDC00, 0xD800};
+    assert(13 == utf8_length_from_utf16(std::size(surrogates), surrogates));
+    assert(13 == utf16_to_utf8(std::u16string(surrogates, std::size(surrogates))).length());
+
+    std::cout << "Output length test passed." << std::endl;
+}
+
 // "regacha" tests for tricky cases like malformed sequences
 void test_malformed_sequences()
 {
@@ -115,6 +170,1010 @@ void test_malformed_sequences()
     std::cout << "Finished 'regacha' tests for malformed sequences." << std::endl;
 }
 
+void test_ascii_blocks()
+{
+    // Non-ASCII characters at every position around the SIMD block boundaries
+    for(size_t length = 0; length < 140; ++length) {
+        for(size_t position = 0; position <= length; ++position) {
+            std::u8string utf8_string(length, u8'a');
+            std::u16string utf16_string(length, u'a');
+            utf8_string.insert(position, u8"\u00E9\u4E16");
+            utf16_string.insert(position, u"\u00E9\u4E16");
+            assert(utf8_to_utf16(utf8_string) == utf16_string);
+            assert(utf16_to_utf8(utf16_string) == utf8_string);
+        }
+        std::u8string utf8_ascii(length, u8'z');
+        std::u16string utf16_ascii(length, u'z');
+        assert(utf8_to_utf16(utf8_ascii) == utf16_ascii);
+        assert(utf16_to_utf8(utf16_ascii) == utf8_ascii);
+    }
+    std::cout << "ASCII block test passed." << std::endl;
+}
+
+// Random mixes of 1-4 byte characters, lone surrogates and random bytes
+void test_kernels()
+{
+    static const char32_t codepoints[] = {U'a', U'Z', U'0', U'\u00E9', U'\u07FF', U'\u0800', U'\u4E16', U'\uFFFD', U'\U0001F44B', U'\U0010FFFF'};
+    std::mt19937 random(12345);
+    std::vector<std::u8string> utf8_inputs;
+    std::vector<std::u16string> utf16_inputs;
+    for(size_t i = 0; i < 2000; ++i) {
+        size_t length = random() % 300;
+        // Mostly one script, sometimes mixed
+        size_t first = random() % std::size(codepoints);
+        size_t last = (0 == (random() % 3)) ? std::size(codepoints) : first + 1;
+        std::u16string utf16_string;
+        for(size_t j = 0; j < length; ++j) {
+            char32_t codepoint = codepoints[first + random() % (last - first)];
+            append_codepoint(utf16_string, codepoint);
+        }
+        std::u8string utf8_string = utf16_to_utf8(utf16_string);
+        if(0 < length && 0 == (i % 4)) {
+            utf16_string[random() % utf16_string.length()] = static_cast<char16_t>(0xD800 + random() % 0x800);
+            utf8_string[random() % utf8_string.length()] = static_cast<char8_t>(random());
+        }
+        utf8_inputs.push_back(utf8_string);
+        utf16_inputs.push_back(utf16_string);
+    }
+
+    std::vector<std::u8string> utf8_expected;
+    std::vector<std::u16string> utf16_expected;
+    std::vector<size_t> utf16_lengths;
+    for_each_kernel([&](Kernel candidate) {
+        if(Kernel::scalar == candidate) {
+            // The scalar kernel runs first and gives the expected results
+            for(size_t i = 0; i < utf8_inputs.size(); ++i) {
+                utf16_expected.push_back(utf8_to_utf16(utf8_inputs[i]));
+                utf8_expected.push_back(utf16_to_utf8(utf16_inputs[i]));
+                utf16_lengths.push_back(utf16_length_from_utf8(utf8_inputs[i].length(), utf8_inputs[i].data()));
+                // Exact for valid UTF-8, an upper bound for the mutated strings
+                assert(utf16_expected[i].length() <= utf16_lengths[i]);
+                assert(0 == (i % 4) || utf16_expected[i].length() == utf16_lengths[i]);
+                assert(utf8_expected[i].length() == utf8_length_from_utf16(utf16_inputs[i].length(), utf16_inputs[i].data()));
+            }
+            return;
+        }
+        for(size_t i = 0; i < utf8_inputs.size(); ++i) {
+            assert(utf8_to_utf16(utf8_inputs[i]) == utf16_expected[i]);
+            assert(utf16_to_utf8(utf16_inputs[i]) == utf8_expected[i]);
+            assert(utf16_length_from_utf8(utf8_inputs[i].length(), utf8_inputs[i].data()) == utf16_lengths[i]);
+            assert(utf8_length_from_utf16(utf16_inputs[i].length(), utf16_inputs[i].data()) == utf8_expected[i].length());
+        }
+        std::cout << "Kernel test passed (" << static_cast<int>(candidate) << ")." << std::endl;
+    });
+}
+
+void test_validation()
+{
+    struct Utf8Case
+    {
+        std::u8string string;
+        size_t error;
+    };
+    const Utf8Case utf8_cases[] = {
+        {u8"", 0},
+        {u8"Hello, 世界 👋", 18},
+        {u8"A\x80", 1},                 // Lone continuation byte
+        {u8"A\xC3", 1},                 // Truncated
+        {u8"A\xC3(", 1},                // Missing continuation byte
+        {u8"A\xC0\xAF", 1},             // Overlong 2-byte
+        {u8"A\xE0\x80\xAF", 1},         // Overlong 3-byte
+        {u8"A\xF0\x80\x80\xAF", 1},     // Overlong 4-byte
+        {u8"A\xED\xA0\x80", 1},         // Encoded surrogate
+        {u8"A\xF4\x90\x80\x80", 1},     // Above U+10FFFF
+        {u8"A\xF8\x88\x80\x80\x80", 1}, // 5-byte sequence
+        {u8"A\xE2\x82\xAC\xFF", 4},     // Invalid byte after a valid sequence
+        {u8"\xF4\x8F\xBF\xBF\xEF\xBF\xBF\xDF\xBF\x7F", 10},
+    };
+    std::u16string utf16_valid = u"Hello, 世界 👋";
+    [[maybe_unused]] const char16_t utf16_lone[] = {u'A', 0xDC00, u'B', 0xD800, 0xDC00, 0xD800};
+
+    // Random corruption of valid text, checked against the scalar validator
+    std::mt19937 random(4242);
+    std::vector<std::u8string> utf8_inputs;
+    std::vector<std::u16string> utf16_inputs;
+    for(size_t i = 0; i < 500; ++i) {
+        std::u16string utf16_string;
+        for(size_t j = random() % 300; 0 < j; --j) {
+            utf16_string += (0 == random() % 4) ? u"👋" : (0 == random() % 2) ? u"世" : u"a";
+        }
+        std::u8string utf8_string = utf16_to_utf8(utf16_string);
+        if(0 < utf16_string.length()) {
+            utf8_string[random() % utf8_string.length()] = static_cast<char8_t>(random());
+            utf16_string[random() % utf16_string.length()] = static_cast<char16_t>(0xD800 + random() % 0x800);
+        }
+        utf8_inputs.push_back(utf8_string);
+        utf16_inputs.push_back(utf16_string);
+    }
+    std::vector<size_t> utf8_errors;
+    std::vector<size_t> utf16_errors;
+    for_each_kernel([&](Kernel candidate) {
+        if(Kernel::scalar == candidate) {
+            // The scalar kernel runs first and gives the expected results
+            for(size_t i = 0; i < utf8_inputs.size(); ++i) {
+                utf8_errors.push_back(validate_utf8(utf8_inputs[i].length(), utf8_inputs[i].data()));
+                utf16_errors.push_back(validate_utf16(utf16_inputs[i].length(), utf16_inputs[i].data()));
+            }
+        }
+        for(const Utf8Case& utf8_case: utf8_cases) {
+            assert(utf8_case.error == validate_utf8(utf8_case.string.length(), utf8_case.string.data()));
+            // The same error behind ASCII or 3-byte characters, at every position of a SIMD block
+            for(size_t prefix = 60; prefix < 200; ++prefix) {
+                std::u8string ascii_string = std::u8string(prefix, u8'a') + utf8_case.string;
+                assert(prefix + utf8_case.error == validate_utf8(ascii_string.length(), ascii_string.data()));
+                std::u8string cjk_string;
+                for(size_t i = 0; i < prefix / 3; ++i) {
+                    cjk_string += u8"世";
+                }
+                cjk_string += std::u8string(prefix % 3, u8'a') + utf8_case.string;
+                assert(prefix + utf8_case.error == validate_utf8(cjk_string.length(), cjk_string.data()));
+            }
+        }
+
+        assert(utf16_valid.length() == validate_utf16(utf16_valid.length(), utf16_valid.data()));
+        assert(1 == validate_utf16(std::size(utf16_lone), utf16_lone));
+        assert(2 == validate_utf16(std::size(utf16_lone) - 3, utf16_lone + 3));
+        for(size_t prefix = 0; prefix < 70; ++prefix) {
+            for(char16_t unit: {char16_t(0xD800), char16_t(0xDFFF)}) {
+                std::u16string utf16_string(prefix, u'ä');
+                for(size_t i = 0; i < 40; ++i) {
+                    utf16_string += u"👋";
+                }
+                assert(utf16_string.length() == validate_utf16(utf16_string.length(), utf16_string.data()));
+                utf16_string.insert(prefix + 2 * (prefix % 3), 1, unit);
+                assert(prefix + 2 * (prefix % 3) == validate_utf16(utf16_string.length(), utf16_string.data()));
+            }
+        }
+
+        for(size_t i = 0; i < utf8_inputs.size(); ++i) {
+            assert(utf8_errors[i] == validate_utf8(utf8_inputs[i].length(), utf8_inputs[i].data()));
+            assert(utf16_errors[i] == validate_utf16(utf16_inputs[i].length(), utf16_inputs[i].data()));
+        }
+    });
+    std::cout << "Validation test passed." << std::endl;
+}
+
+void test_convert()
+{
+    char16_t utf16_buffer[32];
+    char8_t utf8_buffer[64];
+
+    std::u8string utf8_valid = u8"Hello, 世界 👋";
+    Result result = convert(std::size(utf16_buffer), utf16_buffer, utf8_valid.length(), utf8_valid.data());
+    assert(Status::success == result.status && utf8_valid.length() == result.consumed && utf8_valid.length() == result.error_offset);
+    assert(std::u16string(utf16_buffer, result.written) == u"Hello, 世界 👋");
+
+    // Table 3-8 of the Unicode Standard, one U+FFFD per maximal subpart
+    std::u8string utf8_invalid = u8"\x61\xF1\x80\x80\xE1\x80\xC2\x62\x80\x63\x80\xBF\x64";
+    result = convert<ErrorPolicy::strict>(std::size(utf16_buffer), utf16_buffer, utf8_invalid.length(), utf8_invalid.data());
+    assert(Status::invalid_input == result.status && 1 == result.consumed && 1 == result.written && 1 == result.error_offset);
+    result = convert<ErrorPolicy::replace>(std::size(utf16_buffer), utf16_buffer, utf8_invalid.length(), utf8_invalid.data());
+    assert(Status::success == result.status && utf8_invalid.length() == result.consumed && 1 == result.error_offset);
+    assert(std::u16string(utf16_buffer, result.written) == u"a\uFFFD\uFFFD\uFFFDb\uFFFDc\uFFFD\uFFFDd");
+
+    // Encoded surrogates, overlongs and a truncated sequence at the end
+    std::u8string utf8_surrogates = u8"A\xED\xA0\xBD\xED\xB1\x8B\xC0\xAFZ\xF0\x9F\x98";
+    result = convert<ErrorPolicy::replace>(std::size(utf16_buffer), utf16_buffer, utf8_surrogates.length(), utf8_surrogates.data());
+    assert(std::u16string(utf16_buffer, result.written) == u"A\uFFFD\uFFFD\uFFFD\uFFFD\uFFFD\uFFFD\uFFFD\uFFFDZ\uFFFD");
+    result = convert<ErrorPolicy::pass_through>(std::size(utf16_buffer), utf16_buffer, utf8_surrogates.length(), utf8_surrogates.data());
+    assert(Status::success == result.status && 1 == result.error_offset);
+    assert(std::u16string(utf16_buffer, result.written) == u"A👋\uFFFD\uFFFDZ\uFFFD");
+
+    // Unpaired surrogates
+    const char16_t utf16_invalid[] = {u'A', 0xDC00, u'B', 0xD83D, 0xDC4B, 0xD800};
+    result = convert<ErrorPolicy::strict>(std::size(utf8_buffer), utf8_buffer, std::size(utf16_invalid), utf16_invalid);
+    assert(Status::invalid_input == result.status && 1 == result.consumed && 1 == result.written && 1 == result.error_offset);
+    result = convert<ErrorPolicy::replace>(std::size(utf8_buffer), utf8_buffer, std::size(utf16_invalid), utf16_invalid);
+    assert(Status::success == result.status && std::size(utf16_invalid) == result.consumed && 1 == result.error_offset);
+    assert(std::u8string(utf8_buffer, result.written) == u8"A\uFFFDB👋\uFFFD");
+    result = convert<ErrorPolicy::pass_through>(std::size(utf8_buffer), utf8_buffer, std::size(utf16_invalid), utf16_invalid);
+    assert(std::u8string(utf8_buffer, result.written) == utf16_to_utf8(std::u16string(utf16_invalid, std::size(utf16_invalid))));
+
+    // A full output buffer stops on a code point boundary
+    result = convert(3, utf16_buffer, utf8_valid.length(), utf8_valid.data());
+    assert(Status::output_too_small == result.status && 3 == result.consumed && 3 == result.written && 3 == result.error_offset);
+    result = convert<ErrorPolicy::replace>(3, utf8_buffer, std::size(utf16_invalid), utf16_invalid);
+    assert(Status::output_too_small == result.status && 1 == result.consumed && 1 == result.written && 1 == result.error_offset);
+
+    // Errors and sequences around the validation blocks
+    std::u16string utf16_long;
+    for(size_t i = 0; i < 6000; ++i) {
+        utf16_long += (0 == (i % 5)) ? u"👋" : u"世a";
+    }
+    std::u8string utf8_long = utf16_to_utf8(utf16_long);
+    std::vector<char16_t> utf16_output(utf8_long.length() + 1);
+    std::vector<char8_t> utf8_output(utf8_long.length() + 3);
+    for(size_t offset = 8185; offset < 8200; ++offset) {
+        result = convert(utf16_output.size(), utf16_output.data(), offset, utf8_long.data());
+        [[maybe_unused]] size_t error = validate_utf8(offset, utf8_long.data());
+        assert(error == result.error_offset && error == result.consumed);
+        std::u8string utf8_string = utf8_long;
+        utf8_string[offset] = 0xFF;
+        result = convert<ErrorPolicy::replace>(utf16_output.size(), utf16_output.data(), utf8_string.length(), utf8_string.data());
+        assert(Status::success == result.status && utf8_string.length() == result.consumed);
+        assert(validate_utf8(utf8_string.length(), utf8_string.data()) == result.error_offset);
+
+        result = convert(utf8_output.size(), utf8_output.data(), offset, utf16_long.data());
+        error = validate_utf16(offset, utf16_long.data());
+        assert(error == result.error_offset && error == result.consumed);
+        assert(std::u8string(utf8_output.data(), result.written) == utf16_to_utf8(utf16_long.substr(0, error)));
+    }
+    result = convert(utf16_output.size(), utf16_output.data(), utf8_long.length(), utf8_long.data());
+    assert(Status::success == result.status && std::u16string(utf16_output.data(), result.written) == utf16_long);
+
+    std::cout << "Convert test passed." << std::endl;
+}
+
+void test_parallel()
+{
+    std::mt19937 random(777);
+    std::u16string utf16_string;
+    while(utf16_string.length() < 1500000) {
+        utf16_string += (0 == random() % 4) ? u"👋" : (0 == random() % 2) ? u"世" : u"ab";
+    }
+    std::u8string utf8_string = utf16_to_utf8(utf16_string);
+
+    // Runs the slices one after the other, in reverse to catch order dependencies
+    parallel::Executor serial = [](size_t count, const std::function<void(size_t)>& task) {
+        for(size_t i = count; 0 < i; --i) {
+            task(i - 1);
+        }
+    };
+    for([[maybe_unused]] size_t thread_count: {0, 1, 2, 3, 7}) {
+        assert(parallel::utf8_to_utf16(utf8_string, thread_count) == utf16_string);
+        assert(parallel::utf16_to_utf8(utf16_string, thread_count) == utf8_string);
+    }
+    assert(parallel::utf8_to_utf16(utf8_string, serial, 5) == utf16_string);
+    assert(parallel::utf16_to_utf8(utf16_string, serial, 5) == utf8_string);
+    assert(parallel::utf8_to_utf16(u8"short", 4) == u"short");
+
+    // Malformed input stops the conversion at the same place, wherever the slices are split
+    for(size_t i = 0; i < 20; ++i) {
+        std::u8string malformed = utf8_string;
+        size_t position = (i < 10) ? (malformed.length() / 5 * (1 + i % 4) - 3 + i / 4) : random() % malformed.length();
+        malformed[position] = (0 == (i % 2)) ? 0xFF : 0xE4;
+        assert(parallel::utf8_to_utf16(malformed, serial, 5) == utf8_to_utf16(malformed));
+        assert(parallel::utf8_to_utf16(malformed, 3) == utf8_to_utf16(malformed));
+        std::u16string lone = utf16_string;
+        lone[random() % lone.length()] = 0xD800;
+        assert(parallel::utf16_to_utf8(lone, serial, 5) == utf16_to_utf8(lone));
+    }
+
+    std::cout << "Parallel test passed." << std::endl;
+}
+
+void test_streams()
+{
+    static const char32_t codepoints[] = {U'a', U'\u00E9', U'\u4E16', U'\U0001F44B'};
+    std::mt19937 random(54321);
+    for(size_t i = 0; i < 200; ++i) {
+        std::u16string utf16_string;
+        for(size_t j = random() % 200; 0 < j; --j) {
+            char32_t codepoint = codepoints[random() % std::size(codepoints)];
+            append_codepoint(utf16_string, codepoint);
+        }
+        std::u8string utf8_string = utf16_to_utf8(utf16_string);
+
+        // Random chunks into small output buffers, every split position gets hit
+        Utf8ToUtf16Stream utf8_stream;
+        std::u16string utf16_result;
+        for(size_t offset = 0; offset < utf8_string.length();) {
+            size_t chunk = std::min<size_t>(1 + random() % 17, utf8_string.length() - offset);
+            size_t chunk_offset = 0;
+            while(chunk_offset < chunk) {
+                char16_t buffer[8];
+                StreamResult result = utf8_stream.convert(2 + random() % 7, buffer, chunk - chunk_offset, utf8_string.data() + offset + chunk_offset);
+                chunk_offset += result.consumed;
+                utf16_result.append(buffer, result.produced);
+            }
+            offset += chunk;
+        }
+        assert(utf8_stream.finish());
+        assert(utf16_result == utf16_string);
+
+        Utf16ToUtf8Stream utf16_stream;
+        std::u8string utf8_result;
+        for(size_t offset = 0; offset < utf16_string.length();) {
+            size_t chunk = std::min<size_t>(1 + random() % 9, utf16_string.length() - offset);
+            size_t chunk_offset = 0;
+            while(chunk_offset < chunk) {
+                char8_t buffer[16];
+                StreamResult result = utf16_stream.convert(4 + random() % 13, buffer, chunk - chunk_offset, utf16_string.data() + offset + chunk_offset);
+                chunk_offset += result.consumed;
+                utf8_result.append(buffer, result.produced);
+            }
+            offset += chunk;
+        }
+        [[maybe_unused]] char8_t buffer[4];
+        assert(0 == utf16_stream.finish(sizeof(buffer), buffer));
+        assert(utf8_result == utf8_string);
+    }
+
+    // Input ending in a partial sequence
+    Utf8ToUtf16Stream utf8_stream;
+    char16_t utf16_buffer[4];
+    StreamResult result = utf8_stream.convert(std::size(utf16_buffer), utf16_buffer, 3, u8"A\xF0\x9F");
+    assert(3 == result.consumed && 1 == result.produced && utf8_stream.pending());
+    assert(!utf8_stream.finish() && !utf8_stream.pending());
+
+    // A high surrogate followed by something else, or nothing, is encoded as-is
+    Utf16ToUtf8Stream utf16_stream;
+    char8_t utf8_buffer[8];
+    const char16_t high_surrogate[] = {0xD83D};
+    result = utf16_stream.convert(sizeof(utf8_buffer), utf8_buffer, 1, high_surrogate);
+    assert(1 == result.consumed && 0 == result.produced && utf16_stream.pending());
+    result = utf16_stream.convert(sizeof(utf8_buffer), utf8_buffer, 1, u"A");
+    assert(1 == result.consumed && 4 == result.produced && 0 == std::memcmp(utf8_buffer, u8"\xED\xA0\xBD" "A", 4));
+    result = utf16_stream.convert(sizeof(utf8_buffer), utf8_buffer, 1, high_surrogate);
+    assert(3 == utf16_stream.finish(sizeof(utf8_buffer), utf8_buffer) && !utf16_stream.pending());
+
+    std::cout << "Stream test passed." << std::endl;
+}
+
+void test_utf32_latin1()
+{
+    assert(utf8_to_utf32(u8"aé世\U0001F44B") == U"aé世\U0001F44B");
+    assert(utf32_to_utf8(U"aé世\U0001F44B") == u8"aé世\U0001F44B");
+    assert(utf16_to_utf32(u"aé世\U0001F44B") == U"aé世\U0001F44B");
+    assert(utf32_to_utf16(U"aé世\U0001F44B") == u"aé世\U0001F44B");
+    assert(latin1_to_utf8("caf\xE9") == u8"café");
+    assert(latin1_to_utf16("caf\xE9") == u"café");
+    assert(latin1_to_utf32("caf\xE9") == U"café");
+    // Conversions to Latin-1 stop at the first code point above U+00FF
+    assert(utf8_to_latin1(u8"café 世") == "caf\xE9 ");
+    assert(utf16_to_latin1(u"café 世") == "caf\xE9 ");
+    assert(utf32_to_latin1(U"café \U0001F44B") == "caf\xE9 ");
+    // Out of range code points become U+FFFD, unpaired surrogates are kept
+    const std::u32string out_of_range = {U'a', 0x110000, 0xDC00, U'b'};
+    assert(utf32_to_utf8(out_of_range) == std::u8string(reinterpret_cast<const char8_t*>("a\xEF\xBF\xBD\xED\xB0\x80"
+                                                                                         "b")));
+    assert(utf32_to_utf16(out_of_range) == std::u16string({u'a', 0xFFFD, 0xDC00, u'b'}));
+    assert(utf16_to_utf32(std::u16string({0xD800, u'a', 0xDC00})) == std::u32string({0xD800, U'a', 0xDC00}));
+
+    // Runs of one script, long enough for the kernels, checked against plain encoders
+    static const char32_t firsts[] = {0x20, 0xA0, 0x400, 0x4E00, 0x1F300, 0xDC00, 0x110000, 0xFFFFFF00};
+    std::mt19937 random(2024);
+    std::vector<std::u32string> inputs;
+    for(size_t i = 0; i < 500; ++i) {
+        std::u32string utf32_string;
+        const bool with_invalid = (0 == (i % 5));
+        while(utf32_string.length() < (random() % 400)) {
+            const size_t script = random() % (std::size(firsts) - (with_invalid ? 0 : 3));
+            for(size_t j = random() % 100; 0 < j; --j) {
+                utf32_string.push_back(firsts[script] + random() % 0x5F);
+            }
+        }
+        inputs.push_back(utf32_string);
+    }
+
+    for_each_kernel([&](Kernel candidate) {
+        for(const std::u32string& utf32_string: inputs) {
+            std::u32string codepoints;
+            std::u8string utf8_expected;
+            std::u16string utf16_expected;
+            std::string latin1_expected;
+            bool latin1_stopped = false;
+            for(char32_t codepoint: utf32_string) {
+                codepoint = (codepoint <= 0x10FFFF) ? codepoint : 0xFFFD;
+                codepoints.push_back(codepoint);
+                if(codepoint < 0x80) {
+                    utf8_expected.push_back(static_cast<char8_t>(codepoint));
+                } else if(codepoint < 0x800) {
+                    utf8_expected.push_back(static_cast<char8_t>(0xC0 | (codepoint >> 6)));
+                    utf8_expected.push_back(static_cast<char8_t>(0x80 | (codepoint & 0x3F)));
+                } else if(codepoint < 0x10000) {
+                    utf8_expected.push_back(static_cast<char8_t>(0xE0 | (codepoint >> 12)));
+                    utf8_expected.push_back(static_cast<char8_t>(0x80 | ((codepoint >> 6) & 0x3F)));
+                    utf8_expected.push_back(static_cast<char8_t>(0x80 | (codepoint & 0x3F)));
+                } else {
+                    utf8_expected.push_back(static_cast<char8_t>(0xF0 | (codepoint >> 18)));
+                    utf8_expected.push_back(static_cast<char8_t>(0x80 | ((codepoint >> 12) & 0x3F)));
+                    utf8_expected.push_back(static_cast<char8_t>(0x80 | ((codepoint >> 6) & 0x3F)));
+                    utf8_expected.push_back(static_cast<char8_t>(0x80 | (codepoint & 0x3F)));
+                }
+                append_codepoint(utf16_expected, codepoint);
+                latin1_stopped = latin1_stopped || (0xFF < codepoint);
+                if(!latin1_stopped) {
+                    latin1_expected.push_back(static_cast<char>(codepoint));
+                }
+            }
+
+            assert(utf32_to_utf8(utf32_string) == utf8_expected);
+            assert(utf32_to_utf16(utf32_string) == utf16_expected);
+            assert(utf32_to_latin1(utf32_string) == latin1_expected);
+            assert(utf16_to_utf32(utf16_expected) == codepoints);
+            assert(utf16_to_latin1(utf16_expected) == latin1_expected);
+            assert(utf8_to_latin1(utf8_expected) == latin1_expected);
+            assert(utf8_length_from_utf32(utf32_string.length(), utf32_string.data()) == utf8_expected.length());
+            assert(utf16_length_from_utf32(utf32_string.length(), utf32_string.data()) == utf16_expected.length());
+            assert(utf32_length_from_utf16(utf16_expected.length(), utf16_expected.data()) == codepoints.length());
+            assert(utf32_length_from_utf8(utf8_expected.length(), utf8_expected.data()) == codepoints.length());
+            if(validate_utf8(utf8_expected.length(), utf8_expected.data()) == utf8_expected.length()) {
+                assert(utf8_to_utf32(utf8_expected) == codepoints);
+            }
+
+            std::string latin1_string;
+            for(char32_t codepoint: utf32_string) {
+                latin1_string.push_back(static_cast<char>(codepoint));
+            }
+            const std::u32string latin1_codepoints = utf16_to_utf32(latin1_to_utf16(latin1_string));
+            assert(latin1_to_utf32(latin1_string) == latin1_codepoints);
+            assert(latin1_to_utf8(latin1_string) == utf32_to_utf8(latin1_codepoints));
+            assert(utf8_to_latin1(latin1_to_utf8(latin1_string)) == latin1_string);
+            assert(utf8_length_from_latin1(latin1_string.length(), latin1_string.data()) == latin1_to_utf8(latin1_string).length());
+            for(size_t j = 0; j < latin1_string.length(); ++j) {
+                assert(latin1_codepoints[j] == static_cast<unsigned char>(latin1_string[j]));
+            }
+
+            // A small buffer stops the conversion on a code point boundary
+            std::u8string utf8_buffer(utf8_expected.length() / 2, u8'\0');
+            [[maybe_unused]] const size_t written = utf32_to_utf8(utf8_buffer.length(), utf8_buffer.data(), utf32_string.length(), utf32_string.data());
+            assert(written <= utf8_buffer.length() && (utf8_buffer.length() - written) < 4);
+            assert(0 == utf8_expected.compare(0, written, utf8_buffer, 0, written));
+            assert(written == utf8_expected.length() || 0x80 != (utf8_expected[written] & 0xC0));
+            std::u16string utf16_buffer(utf16_expected.length() / 2, u'\0');
+            [[maybe_unused]] const size_t units = utf32_to_utf16(utf16_buffer.length(), utf16_buffer.data(), utf32_string.length(), utf32_string.data());
+            assert(units <= utf16_buffer.length() && (utf16_buffer.length() - units) < 2);
+            assert(0 == utf16_expected.compare(0, units, utf16_buffer, 0, units));
+            std::u32string utf32_buffer(codepoints.length() / 2, U'\0');
+            assert(utf32_buffer.length() == utf16_to_utf32(utf32_buffer.length(), utf32_buffer.data(), utf16_expected.length(), utf16_expected.data()));
+            assert(0 == codepoints.compare(0, utf32_buffer.length(), utf32_buffer));
+        }
+        std::cout << "UTF-32 and Latin-1 test passed (" << static_cast<int>(candidate) << ")." << std::endl;
+    });
+}
+
+void test_utf16_byte_order()
+{
+    // Runs of one script, long enough for the kernels, with unpaired surrogates in every fourth string
+    static const char32_t codepoints[] = {U'a', U'\u00E9', U'\u0800', U'\u4E16', U'\U0001F44B', U'\uFEFF'};
+    std::mt19937 random(4321);
+    std::vector<std::u16string> inputs;
+    for(size_t i = 0; i < 1000; ++i) {
+        std::u16string utf16_string;
+        while(utf16_string.length() < (random() % 400)) {
+            const char32_t codepoint = codepoints[random() % std::size(codepoints)];
+            for(size_t j = random() % 80; 0 < j; --j) {
+                append_codepoint(utf16_string, codepoint);
+            }
+        }
+        if(!utf16_string.empty() && 0 == (i % 4)) {
+            utf16_string[random() % utf16_string.length()] = static_cast<char16_t>(0xD800 + random() % 0x800);
+        }
+        inputs.push_back(utf16_string);
+    }
+
+    const bool little_endian = (std::endian::native == std::endian::little);
+    for_each_kernel([&](Kernel candidate) {
+        for(const std::u16string& utf16_string: inputs) {
+            std::u16string swapped = utf16_string;
+            for(char16_t& unit: swapped) {
+                unit = std::byteswap(unit);
+            }
+            [[maybe_unused]] const std::u16string& utf16le = little_endian ? utf16_string : swapped;
+            [[maybe_unused]] const std::u16string& utf16be = little_endian ? swapped : utf16_string;
+            const std::u8string utf8_string = utf16_to_utf8(utf16_string);
+
+            assert(utf16le_to_utf8(utf16le) == utf8_string);
+            assert(utf16be_to_utf8(utf16be) == utf8_string);
+            assert(utf8_length_from_utf16le(utf16le.length(), utf16le.data()) == utf8_string.length());
+            assert(utf8_length_from_utf16be(utf16be.length(), utf16be.data()) == utf8_string.length());
+            if(validate_utf16(utf16_string.length(), utf16_string.data()) == utf16_string.length()) {
+                assert(utf8_to_utf16le(utf8_string) == utf16le);
+                assert(utf8_to_utf16be(utf8_string) == utf16be);
+            }
+
+            // The byte order mark selects the byte order and is removed, big endian without one
+            assert(utf16bom_to_utf8(u'\uFEFF' + utf16_string) == utf8_string);
+            assert(utf16bom_to_utf8(std::byteswap(u'\uFEFF') + swapped) == utf8_string);
+            if(utf16_string.empty() || u'\uFEFF' != utf16_string[0]) {
+                assert(utf16bom_to_utf8(utf16be) == utf8_string);
+            }
+
+            std::u8string utf8_buffer(utf8_string.length() + 128, u8'\0');
+            assert(utf16be_to_utf8(utf8_buffer.length(), utf8_buffer.data(), utf16be.length(), utf16be.data()).produced == utf8_string.length());
+            assert(0 == utf8_buffer.compare(0, utf8_string.length(), utf8_string));
+            assert(utf16le_to_utf8(utf8_buffer.length(), utf8_buffer.data(), utf16le.length(), utf16le.data()).produced == utf8_string.length());
+            assert(0 == utf8_buffer.compare(0, utf8_string.length(), utf8_string));
+            std::u16string utf16_buffer(utf16_string.length() + 64, u'\0');
+            [[maybe_unused]] const size_t written = utf8_to_utf16be(utf16_buffer.length(), utf16_buffer.data(), utf8_string.length(), utf8_string.data()).produced;
+            assert(written == utf8_to_utf16(utf8_string).length());
+            // Conversion stops at an encoded unpaired surrogate
+            assert(utf16be_to_utf8(utf16_buffer.substr(0, written)) == utf8_string.substr(0, validate_utf8(utf8_string.length(), utf8_string.data())));
+        }
+        std::cout << "UTF-16 byte order test passed (" << static_cast<int>(candidate) << ")." << std::endl;
+    });
+}
+
+void test_batch()
+{
+    // A column of short strings stored back to back, with malformed strings in every fifth
+    static const char32_t codepoints[] = {U'a', U'0', U'é', U'ࠀ', U'世', U'\U0001F44B'};
+    std::mt19937 random(2468);
+    std::u8string column;
+    std::vector<size_t> column_offsets = {0};
+    for(size_t i = 0; i < 2000; ++i) {
+        std::u16string utf16_string;
+        const size_t first = random() % std::size(codepoints);
+        for(size_t j = random() % 24; 0 < j; --j) {
+            const char32_t codepoint = (0 == (random() % 4)) ? codepoints[random() % std::size(codepoints)] : codepoints[first];
+            append_codepoint(utf16_string, codepoint);
+        }
+        std::u8string utf8_string = utf16_to_utf8(utf16_string);
+        if(!utf8_string.empty() && 0 == (i % 5)) {
+            utf8_string[random() % utf8_string.length()] = static_cast<char8_t>(random());
+        }
+        column += utf8_string;
+        column_offsets.push_back(column.length());
+    }
+    // A string ending inside a sequence the next string completes, valid as a whole
+    column += u8"\xE4\xB8\x96";
+    column_offsets.push_back(column.length() - 1);
+    column_offsets.push_back(column.length());
+
+    const size_t count = column_offsets.size() - 1;
+    std::vector<std::u8string_view> views;
+    std::vector<std::u8string> copies;
+    for(size_t i = 0; i < count; ++i) {
+        views.push_back(std::u8string_view(column).substr(column_offsets[i], column_offsets[i + 1] - column_offsets[i]));
+        copies.push_back(std::u8string(views.back()));
+    }
+    const std::vector<std::u8string_view> copy_views(copies.begin(), copies.end());
+
+    for_each_kernel([&](Kernel candidate) {
+        std::vector<std::u16string> expected;
+        size_t arena_length = 0;
+        for(const std::u8string& utf8_string: copies) {
+            expected.push_back(utf8_to_utf16(utf8_string));
+            arena_length += utf16_length_from_utf8(utf8_string.length(), utf8_string.data());
+        }
+        assert(expected[count - 2].empty() && expected[count - 1].empty());
+
+        // Adjacent views, separate strings and the columnar layout convert the same
+        std::u16string arena(arena_length, u'\0');
+        std::vector<size_t> offsets(count + 1);
+        const auto check = [&](size_t converted, size_t first) {
+            for(size_t i = first; i < first + converted; ++i) {
+                assert(0 == arena.compare(offsets[i - first], offsets[i - first + 1] - offsets[i - first], expected[i]));
+            }
+        };
+        assert(count == utf8_to_utf16_batch(count, views.data(), arena.length(), arena.data(), offsets.data()));
+        check(count, 0);
+        assert(count == utf8_to_utf16_batch(count, copy_views.data(), arena.length(), arena.data(), offsets.data()));
+        check(count, 0);
+        assert(count == utf8_to_utf16_batch(count, column_offsets.data(), column.data(), arena.length(), arena.data(), offsets.data()));
+        check(count, 0);
+
+        // A full arena stops before the first string that may not fit, the rest converts in a second call
+        const size_t converted = utf8_to_utf16_batch(count, views.data(), arena_length / 2, arena.data(), offsets.data());
+        assert(0 < converted && converted < count);
+        check(converted, 0);
+        assert(count - converted == utf8_to_utf16_batch(count - converted, views.data() + converted, arena.length(), arena.data(), offsets.data()));
+        check(count - converted, converted);
+
+        // The arena and the offsets come from the memory resource
+        std::vector<std::byte> buffer((arena_length + count) * sizeof(size_t));
+        std::pmr::monotonic_buffer_resource resource(buffer.data(), buffer.size(), std::pmr::null_memory_resource());
+        const Utf16Batch batch = utf8_to_utf16_batch(count, views.data(), &resource);
+        assert(count == batch.size());
+        for(size_t i = 0; i < count; ++i) {
+            assert(batch[i] == expected[i]);
+        }
+        assert(0 == utf8_to_utf16_batch(0, views.data(), &resource).size());
+
+        // A valid prefix whose last string ends inside a sequence the next string completes
+        const std::u8string split = u8"cdab\xE4\xB8\xAD\xFF";
+        const std::u8string_view split_views[] = {std::u8string_view(split).substr(0, 2), std::u8string_view(split).substr(2, 4), std::u8string_view(split).substr(6)};
+        char16_t split_arena[8];
+        size_t split_offsets[4];
+        [[maybe_unused]] const size_t split_converted = utf8_to_utf16_batch(3, split_views, std::size(split_arena), split_arena, split_offsets);
+        assert(3 == split_converted);
+        for(size_t i = 0; i < 3; ++i) {
+            char16_t utf16_string[8];
+            [[maybe_unused]] const size_t length = utf8_to_utf16(std::size(utf16_string), utf16_string, split_views[i].length(), split_views[i].data()).produced;
+            assert(std::u16string_view(split_arena + split_offsets[i], split_offsets[i + 1] - split_offsets[i]) == std::u16string_view(utf16_string, length));
+        }
+        std::cout << "Batch test passed (" << static_cast<int>(candidate) << ")." << std::endl;
+    });
+}
+
+void test_containers()
+{
+    const std::u8string utf8_string = u8"Hello, 世界 👋";
+    const std::u16string utf16_string = u"Hello, 世界 👋";
+
+    // Appended to what the container holds, the capacity is kept when it is cleared and reused
+    std::vector<char16_t> utf16_vector = {u'>'};
+    assert(utf16_string.length() == utf8_to_utf16(utf16_vector, utf8_string));
+    assert(std::u16string(utf16_vector.begin(), utf16_vector.end()) == u'>' + utf16_string);
+    utf16_vector.clear();
+    [[maybe_unused]] const char16_t* data = utf16_vector.data();
+    utf8_to_utf16(utf16_vector, std::u8string_view(std::span(utf8_string)));
+    assert(data == utf16_vector.data() && std::u16string(utf16_vector.begin(), utf16_vector.end()) == utf16_string);
+
+    // Malformed input stops the conversion, unpaired surrogates are encoded as-is, as by the string overloads
+    std::u16string truncated = u"x";
+    assert(1 == utf8_to_utf16(truncated, u8"A\xF0\x9D\x84"));
+    assert(u"xA" == truncated);
+    [[maybe_unused]] const char16_t unpaired[] = {u'a', 0xDC00, u'b'};
+    std::vector<char8_t> utf8_vector;
+    assert(5 == utf16_to_utf8(utf8_vector, std::u16string_view(unpaired, std::size(unpaired))));
+    assert(std::u8string(utf8_vector.begin(), utf8_vector.end()) == utf16_to_utf8(std::u16string(unpaired, std::size(unpaired))));
+
+    // The result is allocated from the given allocator
+    char buffer[256];
+    std::pmr::monotonic_buffer_resource resource(buffer, sizeof(buffer), std::pmr::null_memory_resource());
+    const std::pmr::u16string pmr_utf16 = utf8_to_utf16(utf8_string, std::pmr::polymorphic_allocator<char16_t>(&resource));
+    assert(std::u16string_view(pmr_utf16) == utf16_string);
+    const std::pmr::u8string pmr_utf8 = utf16_to_utf8(pmr_utf16, std::pmr::polymorphic_allocator<char8_t>(&resource));
+    assert(std::u8string_view(pmr_utf8) == utf8_string);
+    assert(u"" == utf8_to_utf16(u8"", std::allocator<char16_t>()));
+    std::cout << "Container test passed." << std::endl;
+}
+
+void test_stats()
+{
+    [[maybe_unused]] const Stats before = thread_stats();
+    [[maybe_unused]] const Stats aggregate_before = aggregate_stats();
+    utf8_to_utf16(std::u8string(u8"plain ascii"));
+    utf16_to_utf8(std::u16string(u"Hello, 世界"));
+    const char16_t unpaired[] = {u'a', 0xDC00, u'b'};
+    utf16_to_utf8(std::u16string(unpaired, std::size(unpaired)));
+    for(const char8_t* malformed : {u8"A\xF0\x9D\x84", u8"\x80", u8"\xC0\xAF", u8"\xE3\x81" u8"A", u8"\xED\xA0\x80"}) {
+        utf8_to_utf16(std::u8string(malformed));
+    }
+    char16_t utf16_buffer[32];
+    const std::u8string long_ascii(64, u8'a');
+    utf8_to_utf16(std::size(utf16_buffer), utf16_buffer, long_ascii.length(), long_ascii.data());
+    convert<ErrorPolicy::replace>(std::size(utf16_buffer), utf16_buffer, 5, u8"a\x80" u8"b\xFF!");
+    std::vector<char16_t> utf16_vector;
+    utf8_to_utf16(utf16_vector, long_ascii);
+    [[maybe_unused]] const Stats after = thread_stats();
+    if(!stats_enabled) {
+        // Compiled out, nothing is counted
+        assert(0 == after.calls && 0 == after.bytes_in && 0 == after.reallocations && 0 == aggregate_stats().calls);
+        std::cout << "Stats test passed (disabled)." << std::endl;
+        return;
+    }
+
+    assert(11 == after.calls - before.calls);
+    assert(2 == after.ascii_calls - before.ascii_calls);
+    assert(after.bytes_in - before.bytes_in == 11 + 2 * 9 + 2 * 3 + 1 + 32 + 5 + 64);
+    assert(after.bytes_out - before.bytes_out == 2 * 11 + 13 + 5 + 2 + 2 * 32 + 2 * 5 + 2 * 64);
+    assert(1 == after.truncated - before.truncated);
+    assert(2 == after.unexpected_continuation - before.unexpected_continuation);
+    assert(1 == after.missing_continuation - before.missing_continuation);
+    assert(3 == after.out_of_range - before.out_of_range);
+    assert(1 == after.unpaired_surrogates - before.unpaired_surrogates);
+    assert(1 == after.output_full - before.output_full);
+    assert(2 == after.reallocations - before.reallocations);
+
+    // Exited threads stay in the aggregate
+    std::thread thread([]() { utf8_to_utf16(std::u8string(u8"other thread")); });
+    thread.join();
+    [[maybe_unused]] const Stats aggregate = aggregate_stats();
+    assert(aggregate.calls - aggregate_before.calls == 12 && aggregate.bytes_in - aggregate_before.bytes_in == after.bytes_in - before.bytes_in + 12);
+    std::cout << "Stats test passed." << std::endl;
+}
+
+void test_conversion_cache()
+{
+    // Repeats share the result of the first conversion
+    ConversionCache cache(4, 1);
+    const std::shared_ptr<const std::u16string> first = cache.utf8_to_utf16(u8"Hello, 世界");
+    assert(u"Hello, 世界" == *first);
+    assert(first == cache.utf8_to_utf16(std::u8string(u8"Hello, 世界")));
+    assert(1 == cache.size() && 1 == cache.stats().hits && 1 == cache.stats().misses);
+
+    // Malformed input converts as by utf8_to_utf16(), empty input is cached like any other
+    assert(utf8_to_utf16(std::u8string(u8"A\xF0\x9D\x84")) == *cache.utf8_to_utf16(u8"A\xF0\x9D\x84"));
+    assert(cache.utf8_to_utf16(u8"")->empty() && 3 == cache.size());
+
+    // The oldest entry is dropped first, results handed out stay valid
+    cache.utf8_to_utf16(u8"key 1");
+    cache.utf8_to_utf16(u8"key 2");
+    assert(4 == cache.size() && 1 == cache.stats().evictions);
+    assert(u"Hello, 世界" == *first);
+    assert(first != cache.utf8_to_utf16(u8"Hello, 世界") && 2 == cache.stats().evictions);
+
+    // Long inputs are not cached
+    const std::u8string long_string(ConversionCache::max_cached_length + 1, u8'a');
+    assert(cache.utf8_to_utf16(long_string) != cache.utf8_to_utf16(long_string) && 4 == cache.size());
+    cache.clear();
+    assert(0 == cache.size() && 1 == ConversionCache(0).utf8_to_utf16(u8"x").use_count());
+
+    // More shards than entries, the size stays within the capacity
+    for(size_t capacity: {1, 2, 5, 17}) {
+        ConversionCache small_cache(capacity, 16);
+        for(size_t i = 0; i < 200; ++i) {
+            small_cache.utf8_to_utf16(u8"key " + std::u8string(1, static_cast<char8_t>(u8'0' + i % 64)) + std::u8string(i / 64, u8'x'));
+            assert(small_cache.size() <= capacity);
+        }
+        assert(capacity == small_cache.size());
+    }
+
+    // Concurrent lookups of a few keys, every lookup is a hit or a miss
+    ConversionCache shared_cache(64, 4);
+    std::vector<std::thread> threads;
+    for(size_t t = 0; t < 4; ++t) {
+        threads.emplace_back([&shared_cache, t]() {
+            for(size_t i = 0; i < 1000; ++i) {
+                const std::u8string key = u8"column " + std::u8string(1, static_cast<char8_t>(u8'a' + (i + t) % 16));
+                assert(utf8_to_utf16(key) == *shared_cache.utf8_to_utf16(key));
+            }
+        });
+    }
+    for(std::thread& thread : threads) {
+        thread.join();
+    }
+    [[maybe_unused]] const CacheStats stats = shared_cache.stats();
+    assert(4000 == stats.hits + stats.misses && 16 <= stats.misses && 16 == shared_cache.size());
+    std::cout << "Conversion cache test passed." << std::endl;
+}
+
+void test_compare_hash()
+{
+    // Code point order, where the UTF-16 code units order the other way round
+    assert(compare(u8"\uFFFF", u"\U0001D11E") < 0 && u"\U0001D11E" < std::u16string_view(u"\uFFFF"));
+    assert(0 == compare(u8"", u"") && compare(u8"ab", u"a") > 0 && compare(u8"a", u"ab") < 0);
+    assert(equal(u8"Hello, 世界 👋", u"Hello, 世界 👋") && !equal(u8"Hello", u"Hellp") && !equal(u8"\u00E9", u"e"));
+    assert(hash(std::u8string_view(u8"Hello, 世界 👋")) == hash(std::u16string_view(u"Hello, 世界 👋")));
+    // An unpaired surrogate compares as utf16_to_utf8() encodes it
+    [[maybe_unused]] const char16_t unpaired[] = {u'a', 0xD800, u'b'};
+    assert(equal(utf16_to_utf8(std::u16string(unpaired, std::size(unpaired))), std::u16string_view(unpaired, std::size(unpaired))));
+
+    // Strings longer than a block, equal or differing anywhere, on every kernel
+    static const char32_t codepoints[] = {U'a', U'\u00E9', U'\u4E16', U'\U0001F44B'};
+    std::mt19937 random(2468);
+    for_each_kernel([&](Kernel) {
+        for(size_t i = 0; i < 300; ++i) {
+            std::u32string utf32_string;
+            for(size_t length = random() % 600; utf32_string.length() < length;) {
+                utf32_string.append(1 + random() % 40, codepoints[random() % ((0 == i % 2) ? 1 : std::size(codepoints))]);
+            }
+            const std::u16string utf16_string = utf32_to_utf16(utf32_string);
+            std::u8string utf8_string = utf32_to_utf8(utf32_string);
+            assert(equal(utf8_string, utf16_string) && 0 == compare(utf8_string, utf16_string));
+            assert(hash(std::u8string_view(utf8_string)) == hash(std::u16string_view(utf16_string)));
+            if(0 == (i % 3) && !utf8_string.empty()) {
+                utf8_string[random() % utf8_string.length()] ^= static_cast<char8_t>(1 + random() % 0x7F);
+            } else if(1 == (i % 3) && !utf8_string.empty()) {
+                utf8_string.resize(random() % utf8_string.length());
+            } else {
+                utf8_string.push_back(u8'z');
+            }
+            [[maybe_unused]] const int expected = utf8_string.compare(utf16_to_utf8(utf16_string));
+            assert(std::clamp(compare(utf8_string, utf16_string), -1, 1) == std::clamp(expected, -1, 1));
+            assert(equal(utf8_string, utf16_string) == (0 == expected));
+        }
+    });
+
+    // Keys of one encoding are found with keys of the other
+    std::unordered_map<std::u16string, int, TextHash, TextEqual> map = {{u"Content-Type", 1}, {u"日本語", 2}};
+    assert(1 == map.find(std::u8string_view(u8"Content-Type"))->second);
+    assert(2 == map.find(std::u8string_view(u8"日本語"))->second);
+    assert(map.end() == map.find(std::u8string_view(u8"content-type")));
+    std::cout << "Comparison and hashing test passed." << std::endl;
+}
+
+void test_literal()
+{
+    // Converted while compiling, the size is the exact number of code units
+    static constexpr auto greeting = literal<u8"Hello, 世界 👋">();
+    static_assert(std::is_same_v<const std::array<char16_t, 12>, decltype(greeting)>);
+    static_assert(u'世' == greeting[7] && 0xD83D == greeting[10] && 0xDC4B == greeting[11]);
+    static_assert(literal<u8"">().empty());
+    static_assert(3 == literal<u8"a\0b">().size());
+    assert(std::u16string(greeting.begin(), greeting.end()) == utf8_to_utf16(u8"Hello, 世界 👋"));
+
+    // The scalar core is usable in constant expressions
+    static_assert([] {
+        char8_t utf8_units[4] = {};
+        size_t index = 0;
+        const size_t length = detail::codepoint_to_utf8(utf8_units, U'\U0001F44B');
+        return 4 == length && U'\U0001F44B' == detail::decode_to_codepoint(length, utf8_units, index) && 4 == index;
+    }());
+    static_assert(detail::invalid_length == detail::utf16_length_of(1, u8"\xE4"));
+    static_assert(detail::invalid_length == detail::utf16_length_of(2, u8"\xC0\xAF"));
+    std::cout << "Literal test passed." << std::endl;
+}
+
+void test_codepoint_views()
+{
+    static_assert(std::ranges::bidirectional_range<CodepointView<char8_t>> && std::ranges::view<CodepointView<char8_t>>);
+    static_assert(std::ranges::bidirectional_range<TranscodingView<char16_t, char8_t>> && std::ranges::borrowed_range<TranscodingView<char16_t, char8_t>>);
+    static_assert(3 == std::ranges::distance(codepoints(u8"世界👋")) && 4 == std::ranges::distance(as_utf16(u8"世界👋")));
+    static_assert(U'👋' == codepoints(u8"世界👋").back() && U'👋' == codepoints(u"世界👋").back());
+
+    // Searching returns the position in the string
+    const std::u8string utf8_string = u8"Hello, 世界 👋";
+    [[maybe_unused]] const auto found = std::ranges::find(codepoints(utf8_string), U'界');
+    assert(10 == found.base() - utf8_string.data() && 3 == found.length());
+
+    const auto collect = [](auto&& range) {
+        std::vector<std::ranges::range_value_t<decltype(range)>> elements;
+        std::ranges::copy(range, std::back_inserter(elements));
+        return elements;
+    };
+
+    // Random strings with malformed sequences, unpaired surrogates and random bytes
+    static const char32_t samples[] = {U'a', U'é', U'ࠀ', U'世', U'\U0001F44B', U'\U0010FFFF'};
+    std::mt19937 random(97531);
+    for(size_t i = 0; i < 1000; ++i) {
+        std::u16string utf16_string;
+        for(size_t j = random() % 40; 0 < j; --j) {
+            const char32_t codepoint = samples[random() % std::size(samples)];
+            append_codepoint(utf16_string, codepoint);
+        }
+        std::u8string utf8_string = utf16_to_utf8(utf16_string);
+        assert(std::ranges::equal(codepoints(utf8_string), utf8_to_utf32(utf8_string)));
+        assert(std::ranges::equal(codepoints(utf16_string), utf16_to_utf32(utf16_string)));
+        assert(std::ranges::equal(as_utf16(utf8_string), utf16_string));
+        if(!utf16_string.empty() && 0 == (i % 2)) {
+            utf16_string[random() % utf16_string.length()] = static_cast<char16_t>(0xD800 + random() % 0x800);
+            for(size_t j = random() % 4; 0 < j; --j) {
+                utf8_string[random() % utf8_string.length()] = static_cast<char8_t>(random());
+            }
+        }
+        assert(std::ranges::equal(as_utf8(utf16_string), utf16_to_utf8(utf16_string)));
+
+        // Backward iteration finds the same code points and code units
+        std::vector<char32_t> forward = collect(codepoints(utf8_string));
+        assert(std::ranges::equal(forward | std::views::reverse, codepoints(utf8_string) | std::views::reverse));
+        assert(std::ranges::all_of(forward, [](char32_t codepoint) { return codepoint <= 0x10FFFF; }));
+        assert(std::ranges::equal(collect(as_utf16(utf8_string)) | std::views::reverse, as_utf16(utf8_string) | std::views::reverse));
+        forward = collect(codepoints(utf16_string));
+        assert(std::ranges::equal(forward | std::views::reverse, codepoints(utf16_string) | std::views::reverse));
+        assert(std::ranges::equal(as_utf8(utf16_string) | std::views::reverse, utf16_to_utf8(utf16_string) | std::views::reverse));
+    }
+
+    // Every byte of a malformed sequence is one U+FFFD, the lead of a truncated sequence included
+    assert(std::ranges::equal(codepoints(u8"a\xE4\xB8" "b\x80\xF4\x90\x80\x80"), std::u32string(U"a��b�����")));
+    std::cout << "Code point view test passed." << std::endl;
+}
+
+void test_offset_index()
+{
+    static const char32_t samples[] = {U'a', U'é', U'世', U'\U0001F44B'};
+    std::mt19937 random(8642);
+    const auto random_text = [&](size_t length) {
+        std::u16string utf16_string;
+        while(utf16_string.length() < length) {
+            const char32_t codepoint = samples[random() % std::size(samples)];
+            append_codepoint(utf16_string, codepoint);
+        }
+        std::u8string utf8_string = utf16_to_utf8(utf16_string);
+        if(!utf8_string.empty() && 0 == (random() % 4)) {
+            utf8_string[random() % utf8_string.length()] = static_cast<char8_t>(random());
+        }
+        return utf8_string;
+    };
+
+    // Every offset against the code points of the whole prefix as codepoints() decodes it, before and after random edits
+    std::u8string utf8_string = random_text(300);
+    OffsetIndex index(utf8_string);
+    for(size_t edit = 0; edit < 200; ++edit) {
+        const size_t length = utf8_string.length();
+        std::vector<size_t> utf16_offsets(length + 1, 0);
+        std::vector<size_t> codepoint_offsets(length + 1, 0);
+        const CodepointView<char8_t> view = codepoints(utf8_string);
+        for(auto iterator = view.begin(); iterator != view.end(); ++iterator) {
+            // The bytes of a sequence round down to its first byte
+            const size_t start = static_cast<size_t>(iterator.base() - utf8_string.data());
+            for(size_t i = start; i <= start + iterator.length(); ++i) {
+                utf16_offsets[i] = utf16_offsets[start] + ((start + iterator.length() == i) ? 1 + (0xFFFF < *iterator) : 0);
+                codepoint_offsets[i] = codepoint_offsets[start] + ((start + iterator.length() == i) ? 1 : 0);
+            }
+        }
+        assert(length == index.utf8_length() && utf16_offsets[length] == index.utf16_length() && codepoint_offsets[length] == index.codepoint_length());
+        for(size_t i = 0; i <= length; ++i) {
+            assert(utf16_offsets[i] == index.utf16_offset_from_utf8(i));
+            assert(codepoint_offsets[i] == index.codepoint_offset_from_utf8(i));
+        }
+        for(size_t offset = 0; offset <= utf16_offsets[length] + 1; ++offset) {
+            // The first byte of the sequence that takes the count past the offset
+            [[maybe_unused]] const size_t expected = std::ranges::lower_bound(utf16_offsets, *(std::ranges::upper_bound(utf16_offsets, offset) - 1)) - utf16_offsets.begin();
+            assert(expected == index.utf8_offset_from_utf16(offset));
+            assert(index.codepoint_offset_from_utf8(index.utf8_offset_from_utf16(offset)) == index.codepoint_offset_from_utf16(offset));
+        }
+        for(size_t offset = 0; offset <= codepoint_offsets[length] + 1; ++offset) {
+            [[maybe_unused]] const size_t expected = std::ranges::lower_bound(codepoint_offsets, *(std::ranges::upper_bound(codepoint_offsets, offset) - 1)) - codepoint_offsets.begin();
+            assert(expected == index.utf8_offset_from_codepoint(offset));
+            assert(index.utf16_offset_from_utf8(expected) == index.utf16_offset_from_codepoint(offset));
+        }
+
+        const size_t position = random() % (length + 1);
+        const size_t removed = (0 == edit % 3) ? 0 : random() % (length - position + 1);
+        const std::u8string inserted = (1 == edit % 3) ? std::u8string() : random_text(random() % 150);
+        utf8_string.replace(position, removed, inserted);
+        index.update(utf8_string, position, removed, inserted.length());
+    }
+
+    // Offsets inside a sequence round down, past the end to the end
+    const std::u8string text = u8"a世👋b";
+    const OffsetIndex text_index(text);
+    assert(1 == text_index.utf16_offset_from_utf8(2) && 2 == text_index.utf16_offset_from_utf8(7));
+    assert(4 == text_index.utf8_offset_from_utf16(3) && 8 == text_index.utf8_offset_from_utf16(4));
+    assert(text.length() == text_index.utf8_offset_from_utf16(100) && 5 == text_index.utf16_offset_from_utf8(100));
+    assert(0 == OffsetIndex().utf8_offset_from_utf16(3));
+
+    // Every byte of a malformed sequence counts as one code point, as in codepoints(), until an edit completes the sequence
+    std::u8string malformed = u8"\x80\x80" "ab";
+    OffsetIndex malformed_index(malformed);
+    assert(4 == malformed_index.codepoint_length() && 4 == malformed_index.utf16_length());
+    assert(0 == malformed_index.utf8_offset_from_utf16(0) && 1 == malformed_index.utf8_offset_from_codepoint(1) && 2 == malformed_index.codepoint_offset_from_utf8(2));
+    malformed.insert(0, u8"\xE4");
+    malformed_index.update(malformed, 0, 0, 1);
+    assert(std::ranges::distance(codepoints(malformed)) == 3 && 3 == malformed_index.codepoint_length());
+    assert(3 == malformed_index.utf8_offset_from_codepoint(1) && 0 == malformed_index.codepoint_offset_from_utf8(2));
+    std::cout << "Offset index test passed." << std::endl;
+}
+
+void test_utf8_decoder()
+{
+    // Every lead and second byte against the well-formed sequences of Table 3-7, inside ASCII long enough for the kernels
+    const auto reference = [](const char8_t* bytes) -> char32_t {
+        struct Range
+        {
+            size_t length;
+            char8_t second_min;
+            char8_t second_max;
+        };
+        const char8_t lead = bytes[0];
+        const Range range = (lead < 0x80)   ? Range{1, 0, 0}
+                            : (lead < 0xC2) ? Range{0, 0, 0}
+                            : (lead < 0xE0) ? Range{2, 0x80, 0xBF}
+                            : (lead == 0xE0) ? Range{3, 0xA0, 0xBF}
+                            : (lead == 0xED) ? Range{3, 0x80, 0x9F}
+                            : (lead < 0xF0) ? Range{3, 0x80, 0xBF}
+                            : (lead == 0xF0) ? Range{4, 0x90, 0xBF}
+                            : (lead < 0xF4) ? Range{4, 0x80, 0xBF}
+                            : (lead == 0xF4) ? Range{4, 0x80, 0x8F}
+                                             : Range{0, 0, 0};
+        if(0 == range.length) {
+            return detail::invalid_codepoint;
+        }
+        if(1 < range.length && (bytes[1] < range.second_min || range.second_max < bytes[1])) {
+            return detail::invalid_codepoint;
+        }
+        char32_t codepoint = lead & (0xFFU >> (range.length + (1 < range.length)));
+        for(size_t i = 1; i < range.length; ++i) {
+            codepoint = (codepoint << 6) | (bytes[i] & 0x3F);
+        }
+        return codepoint;
+    };
+
+    for_each_kernel([&](Kernel candidate) {
+        for(size_t lead = 0; lead < 0x100; ++lead) {
+            // Single bytes are followed by ASCII, lead bytes by any second byte and the continuation bytes they announce
+            const size_t length = (lead < 0xC0) ? 1 : (lead < 0xE0) ? 2 : (lead < 0xF0) ? 3 : 4;
+            for(size_t second = (1 == length) ? 'a' : 0; second < ((1 == length) ? 'b' : 0x100); ++second) {
+                std::u8string utf8_string(100, u8'a');
+                utf8_string[40] = static_cast<char8_t>(lead);
+                utf8_string[41] = static_cast<char8_t>(second);
+                for(size_t i = 2; i < length; ++i) {
+                    utf8_string[40 + i] = 0x80 | ((second + i) & 0x3F);
+                }
+                const char32_t codepoint = reference(utf8_string.data() + 40);
+
+                [[maybe_unused]] size_t index = 40;
+                assert(codepoint == detail::decode_to_codepoint(utf8_string.length(), utf8_string.data(), index));
+                [[maybe_unused]] const size_t valid = validate_utf8(utf8_string.length(), utf8_string.data());
+                const std::u16string utf16_string = utf8_to_utf16(utf8_string);
+                if(detail::invalid_codepoint == codepoint) {
+                    assert(40 == valid && std::u16string(40, u'a') == utf16_string);
+                } else {
+                    assert(utf8_string.length() == valid);
+                    assert(utf16_string == utf8_to_utf16(utf16_to_utf8(utf16_string)));
+                    assert(codepoint == *codepoints(utf16_string.substr(40)).begin());
+                    assert(std::ranges::equal(codepoints(utf8_string), codepoints(utf16_string)));
+                }
+            }
+        }
+        std::cout << "UTF-8 decoder test passed (" << static_cast<int>(candidate) << ")." << std::endl;
+    });
+}
+
 void test_ascii_short()
 {
     std::u8string utf8_ascii = u8"Hello, World!";
@@ -122,11 +1181,14 @@ void test_ascii_short()
     static constexpr size_t utf16_length = 32;
     char16_t utf16_string[utf16_length+1] = {};
 
-    size_t length = utf8_to_utf16(utf16_length, utf16_string, utf8_ascii.length(), utf8_ascii.c_str());
+    const BufferResult result = utf8_to_utf16(utf16_length, utf16_string, utf8_ascii.length(), utf8_ascii.c_str());
+    assert(result.consumed == utf8_ascii.length() && 13 == result.produced);
+    const size_t length = result.produced;
     assert(0<length);
     static constexpr size_t utf8_length = 128;
     char8_t utf8_string[utf8_length+1] = {};
-    size_t length2 = utf16_to_utf8(utf8_length, utf8_string, length, utf16_string);
+    [[maybe_unused]] const BufferResult result2 = utf16_to_utf8(utf8_length, utf8_string, length, utf16_string);
+    assert(result2.consumed == length && result2.produced == utf8_ascii.length());
     assert(0 == strcmp(reinterpret_cast<const char*>(utf8_ascii.c_str()), reinterpret_cast<const char*>(utf8_string)));
 }
 
@@ -137,10 +1199,13 @@ void test_japanese_short()
     static constexpr size_t utf16_length = 32;
     char16_t utf16_string[utf16_length+1] = {};
 
-    size_t length = utf8_to_utf16(utf16_length, utf16_string, utf8_japanese.length(), utf8_japanese.c_str());
+    const BufferResult result = utf8_to_utf16(utf16_length, utf16_string, utf8_japanese.length(), utf8_japanese.c_str());
+    assert(result.consumed == utf8_japanese.length() && 9 == result.produced);
+    const size_t length = result.produced;
     static constexpr size_t utf8_length = 128;
     char8_t utf8_string[utf8_length+1] = {};
-    size_t length2 = utf16_to_utf8(utf8_length, utf8_string, length, utf16_string);
+    [[maybe_unused]] const BufferResult result2 = utf16_to_utf8(utf8_length, utf8_string, length, utf16_string);
+    assert(result2.consumed == length && result2.produced == utf8_japanese.length());
     assert(0 == strcmp(reinterpret_cast<const char*>(utf8_japanese.c_str()), reinterpret_cast<const char*>(utf8_string)));
 }
 
@@ -151,10 +1216,13 @@ void test_emoji_short()
     static constexpr size_t utf16_length = 32;
     char16_t utf16_string[utf16_length+1] = {};
 
-    size_t length = utf8_to_utf16(utf16_length, utf16_string, utf8_emoji.length(), utf8_emoji.c_str());
+    const BufferResult result = utf8_to_utf16(utf16_length, utf16_string, utf8_emoji.length(), utf8_emoji.c_str());
+    assert(result.consumed == utf8_emoji.length() && 4 == result.produced);
+    const size_t length = result.produced;
     static constexpr size_t utf8_length = 128;
     char8_t utf8_string[utf8_length+1] = {};
-    size_t length2 = utf16_to_utf8(utf8_length, utf8_string, length, utf16_string);
+    [[maybe_unused]] const BufferResult result2 = utf16_to_utf8(utf8_length, utf8_string, length, utf16_string);
+    assert(result2.consumed == length && result2.produced == utf8_emoji.length());
     assert(0 == strcmp(reinterpret_cast<const char*>(utf8_emoji.c_str()), reinterpret_cast<const char*>(utf8_string)));
 }
 
@@ -164,10 +1232,13 @@ void test_empty_short()
     static constexpr size_t utf16_length = 32;
     char16_t utf16_string[utf16_length+1] = {};
 
-    size_t length = utf8_to_utf16(utf16_length, utf16_string, utf8_empty.length(), utf8_empty.c_str());
+    const BufferResult result = utf8_to_utf16(utf16_length, utf16_string, utf8_empty.length(), utf8_empty.c_str());
+    assert(result.consumed == utf8_empty.length() && 0 == result.produced);
+    const size_t length = result.produced;
     static constexpr size_t utf8_length = 128;
     char8_t utf8_string[utf8_length+1] = {};
-    size_t length2 = utf16_to_utf8(utf8_length, utf8_string, length, utf16_string);
+    [[maybe_unused]] const BufferResult result2 = utf16_to_utf8(utf8_length, utf8_string, length, utf16_string);
+    assert(result2.consumed == length && result2.produced == utf8_empty.length());
     assert(0 == strcmp(reinterpret_cast<const char*>(utf8_empty.c_str()), reinterpret_cast<const char*>(utf8_string)));
 }
 
@@ -179,19 +1250,21 @@ void test_roundtrip_short()
     static constexpr size_t utf16_length = 32;
     char16_t utf16_string[utf16_length+1] = {};
 
-    size_t length = utf8_to_utf16(utf16_length, utf16_string, original_utf8.length(), original_utf8.c_str());
+    size_t length = utf8_to_utf16(utf16_length, utf16_string, original_utf8.length(), original_utf8.c_str()).produced;
     static constexpr size_t utf8_length = 128;
     char8_t roundtrip_utf8[utf8_length+1] = {};
-    size_t length2 = utf16_to_utf8(utf8_length, roundtrip_utf8, length, utf16_string);
+    [[maybe_unused]] size_t length2 = utf16_to_utf8(utf8_length, roundtrip_utf8, length, utf16_string).produced;
+    assert(length2 == original_utf8.length());
     assert(0 == strcmp(reinterpret_cast<const char*>(original_utf8.c_str()), reinterpret_cast<const char*>(roundtrip_utf8)));
     std::cout << "Roundtrip UTF-8 tests passed." << reinterpret_cast<const char*>(roundtrip_utf8) << std::endl;
 
     // UTF-16 -> UTF-8 -> UTF-16
     std::u16string original_utf16 = u"Another 𝄞 clef and symbols: €£¥";
     char8_t converted_utf8[utf8_length+1] = {};
-    length = utf16_to_utf8(utf8_length, converted_utf8, original_utf16.length(), original_utf16.c_str());
+    length = utf16_to_utf8(utf8_length, converted_utf8, original_utf16.length(), original_utf16.c_str()).produced;
     char16_t roundtrip_utf16[utf16_length+1] = {};
-    length2 = utf8_to_utf16(utf16_length, roundtrip_utf16, utf8_length, converted_utf8);
+    length2 = utf8_to_utf16(utf16_length, roundtrip_utf16, length, converted_utf8).produced;
+    assert(length2 == original_utf16.length());
     assert(0 == strcmp(reinterpret_cast<const char*>(original_utf16.c_str()), reinterpret_cast<const char*>(roundtrip_utf16)));
     std::cout << "Roundtrip UTF-16 tests passed." << reinterpret_cast<const char*>(roundtrip_utf16) << std::endl;
 }
@@ -205,23 +1278,102 @@ void test_surrogate_pairs_short()
     static constexpr size_t utf16_length = 32;
     char16_t utf16_surrogate[utf16_length+1] = {};
 
-    size_t length = utf8_to_utf16(utf16_length, utf16_surrogate, utf8_surrogate.length(), utf8_surrogate.c_str());
+    size_t length = utf8_to_utf16(utf16_length, utf16_surrogate, utf8_surrogate.length(), utf8_surrogate.c_str()).produced;
     static constexpr size_t utf8_length = 128;
     char8_t utf8_surrogate_roundtrip[utf8_length+1] = {};
-    size_t length2 = utf16_to_utf8(utf8_length, utf8_surrogate_roundtrip, length, utf16_surrogate);
+    [[maybe_unused]] size_t length2 = utf16_to_utf8(utf8_length, utf8_surrogate_roundtrip, length, utf16_surrogate).produced;
+    assert(length2 == utf8_surrogate.length());
     assert(0 == strcmp(reinterpret_cast<const char*>(utf8_surrogate.c_str()), reinterpret_cast<const char*>(utf8_surrogate_roundtrip)));
     std::cout << "Roundtrip UTF-8 tests passed." << reinterpret_cast<const char*>(utf8_surrogate_roundtrip) << std::endl;
 
     std::u16string original_utf16_surrogate = u"𝄞𐐀";
     char8_t converted_utf8_surrogate[utf8_length+1] = {};
-    length = utf16_to_utf8(utf8_length, converted_utf8_surrogate, original_utf16_surrogate.length(), original_utf16_surrogate.c_str());
+    length = utf16_to_utf8(utf8_length, converted_utf8_surrogate, original_utf16_surrogate.length(), original_utf16_surrogate.c_str()).produced;
     char16_t roundtrip_utf16_surrogate[utf16_length] = {};
-    length2 = utf8_to_utf16(utf16_length, roundtrip_utf16_surrogate, utf8_length, converted_utf8_surrogate);
+    length2 = utf8_to_utf16(utf16_length, roundtrip_utf16_surrogate, length, converted_utf8_surrogate).produced;
+    assert(length2 == original_utf16_surrogate.length());
     assert(original_utf16_surrogate == roundtrip_utf16_surrogate);
 
     std::cout << "Surrogate pair test passed." << std::endl;
 }
 
+void test_length_short()
+{
+    // Only the first utf8_length bytes are converted, embedded nulls included
+    const char8_t utf8_string[] = u8"ab\0cdé";
+
+    static constexpr size_t utf16_length = 32;
+    char16_t utf16_string[utf16_length] = {};
+    [[maybe_unused]] size_t length = utf8_to_utf16(utf16_length, utf16_string, 4, utf8_string).produced;
+    assert(4 == length);
+    assert(std::u16string_view(utf16_string, length) == std::u16string_view(u"ab\0c", 4));
+
+    length = utf8_to_utf16(utf16_length, utf16_string, sizeof(utf8_string) - 1, utf8_string).produced;
+    assert(6 == length);
+    assert(std::u16string_view(utf16_string, length) == std::u16string_view(u"ab\0cd\u00E9", 6));
+
+    // A sequence cut by the length is not completed from the bytes beyond it
+    length = utf8_to_utf16(utf16_length, utf16_string, sizeof(utf8_string) - 2, utf8_string).produced;
+    assert(5 == length);
+    std::cout << "Input length test passed." << std::endl;
+}
+
+void test_resume_short()
+{
+    // A buffer too small for the whole conversion is drained and the rest converted into it again
+    const std::u8string utf8_string = u8"Hello, 世界 👋 𝄞 and more ASCII text after the pairs";
+    const std::u16string utf16_string = utf8_to_utf16(utf8_string);
+    for(size_t buffer_length = 1; buffer_length < 8; ++buffer_length) {
+        char16_t utf16_buffer[8];
+        std::u16string utf16_drained;
+        for(size_t consumed = 0; consumed < utf8_string.length();) {
+            BufferResult result = utf8_to_utf16(buffer_length, utf16_buffer, utf8_string.length() - consumed, utf8_string.data() + consumed);
+            // A surrogate pair is not split, one code unit of room left stops before it
+            assert(0 < result.produced || 1 == buffer_length);
+            if(0 == result.produced) {
+                assert(0 == result.consumed && 0xF0 == utf8_string[consumed]);
+                break;
+            }
+            utf16_drained.append(utf16_buffer, result.produced);
+            consumed += result.consumed;
+        }
+        if(1 < buffer_length) {
+            assert(utf16_drained == utf16_string);
+        }
+
+        char8_t utf8_buffer[8];
+        std::u8string utf8_drained;
+        for(size_t consumed = 0; consumed < utf16_string.length();) {
+            BufferResult result = utf16_to_utf8(buffer_length, utf8_buffer, utf16_string.length() - consumed, utf16_string.data() + consumed);
+            if(0 == result.produced) {
+                assert(0 == result.consumed && buffer_length < 4);
+                break;
+            }
+            utf8_drained.append(utf8_buffer, result.produced);
+            consumed += result.consumed;
+        }
+        if(3 < buffer_length) {
+            assert(utf8_drained == utf8_string);
+        }
+    }
+
+    // Room left at the stop means a malformed sequence, an empty buffer converts nothing
+    char16_t utf16_buffer[8];
+    BufferResult result = utf8_to_utf16(std::size(utf16_buffer), utf16_buffer, 4, u8"ab\xC0z");
+    assert(2 == result.consumed && 2 == result.produced);
+    result = utf8_to_utf16(0, nullptr, utf8_string.length(), utf8_string.data());
+    assert(0 == result.consumed && 0 == result.produced);
+
+    // The byte order mark is consumed, the rest resumes in the byte order it selected
+    const char16_t utf16le[] = {0xFEFF, u'a', u'\u00E9', u'b'};
+    char8_t utf8_buffer[3];
+    result = utf16bom_to_utf8(std::size(utf8_buffer), utf8_buffer, std::size(utf16le), utf16le);
+    assert(3 == result.consumed && 3 == result.produced);
+    result = utf16le_to_utf8(std::size(utf8_buffer), utf8_buffer, std::size(utf16le) - 3, utf16le + 3);
+    assert(1 == result.consumed && 1 == result.produced && u8'b' == utf8_buffer[0]);
+    std::cout << "Resumable buffer test passed." << std::endl;
+}
+
 void test_malformed_sequences_short()
 {
     static constexpr size_t utf8_length = 128;
@@ -231,7 +1383,8 @@ void test_malformed_sequences_short()
     char16_t high_surrogate[] = {static_cast<char16_t>(0xD834), 0};
     char8_t utf8_buffer_high[utf8_length] = {}; // Buffer for UTF-8 output
 
-    size_t utf8_length_high = utf16_to_utf8(sizeof(utf8_buffer_high), utf8_buffer_high, 1, high_surrogate);
+    [[maybe_unused]] const BufferResult result_high = utf16_to_utf8(sizeof(utf8_buffer_high), utf8_buffer_high, 1, high_surrogate);
+    assert(1 == result_high.consumed && 3 == result_high.produced);
     std::u8string utf8_from_unpaired_high(reinterpret_cast<const char8_t*>(utf8_buffer_high));
 
     // Common behavior is to replace with U+FFFD (EF BF BD in UTF-8)
@@ -246,7 +1399,8 @@ void test_malformed_sequences_short()
     char16_t low_surrogate[] = {static_cast<char16_t>(0xDD1E), 0};
     char8_t utf8_buffer_low[utf8_length] = {}; // Buffer for UTF-8 output
 
-    size_t utf8_length_low = utf16_to_utf8(sizeof(utf8_buffer_low), utf8_buffer_low, 1, low_surrogate);
+    [[maybe_unused]] const BufferResult result_low = utf16_to_utf8(sizeof(utf8_buffer_low), utf8_buffer_low, 1, low_surrogate);
+    assert(1 == result_low.consumed && 3 == result_low.produced);
     std::u8string utf8_from_unpaired_low(reinterpret_cast<const char8_t*>(utf8_buffer_low));
 
     std::u8string expected_utf8_low = u8"\xEF\xBF\xBD";
@@ -265,7 +1419,25 @@ int main(void)
     test_empty();
     test_roundtrip();
     test_surrogate_pairs();
+    test_output_lengths();
     test_malformed_sequences();
+    test_ascii_blocks();
+    test_kernels();
+    test_validation();
+    test_convert();
+    test_parallel();
+    test_streams();
+    test_utf32_latin1();
+    test_utf16_byte_order();
+    test_batch();
+    test_containers();
+    test_codepoint_views();
+    test_offset_index();
+    test_utf8_decoder();
+    test_stats();
+    test_conversion_cache();
+    test_compare_hash();
+    test_literal();
 
     test_ascii_short();
     test_japanese_short();
@@ -273,6 +1445,8 @@ int main(void)
     test_empty_short();
     test_roundtrip_short();
     test_surrogate_pairs_short();
+    test_length_short();
+    test_resume_short();
     test_malformed_sequences_short();
 
     std::cout << "All tests passed!" << std::endl;
@@ -1,214 +1,4315 @@
 #include "uconv.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <cassert>
 #include <cstdint>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#    define UCONV_X86
+#    if defined(_MSC_VER)
+#        include <intrin.h>
+#    else
+#        include <cpuid.h>
+#    endif
+#    if defined(__GNUC__) && !defined(__clang__)
+// False positives on the undefined pass-through operands of the AVX-512 intrinsics
+#        pragma GCC diagnostic push
+#        pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#    endif
+#    include <immintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#    define UCONV_NEON
+#    include <arm_neon.h>
+#endif
+
+// Kernels are compiled for their instruction set with target attributes, the rest of
+// the library only assumes the baseline of the target architecture.
+#if defined(_MSC_VER) && !defined(__clang__)
+#    define UCONV_TARGET(x)
+#    define UCONV_FORCE_INLINE __forceinline
+#else
+#    define UCONV_TARGET(x) __attribute__((target(x)))
+#    define UCONV_FORCE_INLINE inline __attribute__((always_inline))
+#endif
+#define UCONV_TARGET_SSE42 UCONV_TARGET("ssse3,sse4.1,sse4.2,popcnt")
+#define UCONV_TARGET_AVX2 UCONV_TARGET("avx2,bmi,bmi2,popcnt")
+#define UCONV_TARGET_AVX512 UCONV_TARGET("avx2,bmi,bmi2,popcnt,avx512f,avx512bw,avx512vl,avx512vbmi,avx512vbmi2")
+
+// The header-only build includes this file from uconv.h into every translation unit. The
+// functions are inline and the internals get a named namespace, so the selected kernel and
+// the statistics are shared by the whole program.
+#if defined(UCONV_HEADER_ONLY)
+#    define UCONV_INLINE inline
+#    define UCONV_INTERNAL_NAMESPACE internal
+#else
+#    define UCONV_INLINE
+#    define UCONV_INTERNAL_NAMESPACE
+#endif
 
 namespace uconv
 {
-namespace
+namespace UCONV_INTERNAL_NAMESPACE
 {
-    size_t round_up4(size_t x)
+    // Number of code units converted by the scalar code before a kernel is tried again
+    static constexpr size_t scalar_block_size = 16;
+
+    // The scalar core is constexpr and lives in the header
+    using detail::codepoint_to_utf16;
+    using detail::codepoint_to_utf8;
+    using detail::decode_to_codepoint;
+    using detail::invalid_codepoint;
+
+    //--------------------------------------------------------------------------
+    // Kernels
+    //
+    // A kernel converts the longest prefix of the input it can handle in vector
+    // registers and leaves everything else, malformed input included, to the
+    // scalar code. It never reads or writes outside of the given lengths, and it
+    // only stops on a code point boundary.
+
+    // Code units read from the input and written to the output by a kernel
+    struct Progress
+    {
+        size_t read;
+        size_t written;
+    };
+
+    using Utf8ToUtf16Kernel = Progress (*)(size_t utf16_length, char16_t* utf16_string, size_t utf8_length, const char8_t* utf8_string);
+    using Utf16ToUtf8Kernel = Progress (*)(size_t utf8_length, char8_t* utf8_string, size_t utf16_length, const char16_t* utf16_string);
+
+    // Output length counters, unlike the kernels they always process the whole input
+    using Utf16LengthCounter = size_t (*)(size_t utf8_length, const char8_t* utf8_string);
+    using Utf8LengthCounter = size_t (*)(size_t utf16_length, const char16_t* utf16_string);
+    template<class From>
+    using LengthCounter = size_t (*)(size_t length, const From* string);
+
+    // Validators return the offset of the first error, or the input length
+    using Utf8Validator = size_t (*)(size_t utf8_length, const char8_t* utf8_string);
+    using Utf16Validator = size_t (*)(size_t utf16_length, const char16_t* utf16_string);
+
+    // Code units a unit kernel copies to the output
+    enum class UnitRange
+    {
+        ascii,  // U+0000 – U+007F
+        latin1, // U+0000 – U+00FF
+        bmp,    // U+0000 – U+FFFF but surrogates
+        any,    // Every code unit of the input
+    };
+
+    // Unit kernels convert code units one to one, from and to a different width, while they
+    // are in range. They run the conversions between Latin-1, UTF-16 and UTF-32, and the
+    // ASCII fast paths of the conversions between UTF-8 and UTF-32 or Latin-1.
+    template<class From, class To>
+    using UnitKernel = Progress (*)(size_t output_length, To* output, size_t input_length, const From* input);
+
+    struct Kernels
+    {
+        Kernel kernel;
+        Utf8ToUtf16Kernel utf8_to_utf16;
+        Utf16ToUtf8Kernel utf16_to_utf8;
+        Utf16LengthCounter utf16_length_from_utf8;
+        Utf8LengthCounter utf8_length_from_utf16;
+        Utf8Validator validate_utf8;
+        Utf16Validator validate_utf16;
+        UnitKernel<char8_t, char32_t> utf8_to_utf32;
+        UnitKernel<char32_t, char8_t> utf32_to_utf8;
+        UnitKernel<char16_t, char32_t> utf16_to_utf32;
+        UnitKernel<char32_t, char16_t> utf32_to_utf16;
+        UnitKernel<char, char8_t> latin1_to_utf8;
+        UnitKernel<char8_t, char> utf8_to_latin1;
+        UnitKernel<char, char16_t> latin1_to_utf16;
+        UnitKernel<char16_t, char> utf16_to_latin1;
+        UnitKernel<char, char32_t> latin1_to_utf32;
+        UnitKernel<char32_t, char> utf32_to_latin1;
+        LengthCounter<char8_t> utf32_length_from_utf8;
+        LengthCounter<char> utf8_length_from_latin1;
+        LengthCounter<char16_t> utf32_length_from_utf16;
+        LengthCounter<char32_t> utf8_length_from_utf32;
+        LengthCounter<char32_t> utf16_length_from_utf32;
+        Utf8ToUtf16Kernel utf8_to_utf16_swapped;
+        Utf16ToUtf8Kernel utf16_to_utf8_swapped;
+        Utf8LengthCounter utf8_length_from_utf16_swapped;
+    };
+
+    // UTF-16 in the byte order of the host or, with Swap, in the other one. The UTF-16 kernels
+    // swap the bytes of every vector they load or store, so both byte orders run the same code.
+    template<bool Swap>
+    UCONV_FORCE_INLINE char16_t swap_unit(char16_t unit)
     {
-        return (x + 0x03ULL) & ~0x03ULL;
+        if constexpr(Swap) {
+            return std::byteswap(unit);
+        } else {
+            return unit;
+        }
     }
-} // namespace
 
-std::u8string utf16_to_utf8(const std::u16string& utf16_string)
-{
-    std::u8string utf8_bytes;
-    utf8_bytes.reserve(round_up4(utf16_string.length()));
-    for(size_t i = 0; i < utf16_string.length(); ++i) {
-        char32_t code_point;
-        char16_t unit = utf16_string[i];
+    // Every byte but a continuation byte starts a character, 4-byte sequences need a surrogate pair
+    UCONV_INLINE size_t count_utf16_from_utf8(size_t utf8_length, const char8_t* utf8_string, size_t index)
+    {
+        size_t count = 0;
+        for(; index < utf8_length; ++index) {
+            const char8_t byte = utf8_string[index];
+            count += (0x80 != (byte & 0xC0)) + (0xF0 <= byte);
+        }
+        return count;
+    }
+
+    // Surrogates count 3 bytes each, a valid pair 4 bytes in total
+    template<bool Swap = false>
+    size_t count_utf8_from_utf16(size_t utf16_length, const char16_t* utf16_string, size_t index)
+    {
+        size_t count = 0;
+        for(; index < utf16_length; ++index) {
+            const char16_t unit = swap_unit<Swap>(utf16_string[index]);
+            count += 1 + (0x80 <= unit) + (0x800 <= unit);
+            if(0xD800 == (unit & 0xFC00) && (index + 1) < utf16_length && 0xDC00 == (swap_unit<Swap>(utf16_string[index + 1]) & 0xFC00)) {
+                count -= 2;
+            }
+        }
+        return count;
+    }
+
+    // Every byte but a continuation byte starts a code point
+    UCONV_INLINE size_t count_utf32_from_utf8(size_t utf8_length, const char8_t* utf8_string, size_t index)
+    {
+        size_t count = 0;
+        for(; index < utf8_length; ++index) {
+            count += (0x80 != (utf8_string[index] & 0xC0));
+        }
+        return count;
+    }
+
+    // Characters from U+0080 on take 2 bytes
+    UCONV_INLINE size_t count_utf8_from_latin1(size_t latin1_length, const char* latin1_string, size_t index)
+    {
+        size_t count = 0;
+        for(; index < latin1_length; ++index) {
+            count += 1 + (static_cast<unsigned char>(latin1_string[index]) >> 7);
+        }
+        return count;
+    }
+
+    // A surrogate pair is counted at its high surrogate
+    UCONV_INLINE size_t count_utf32_from_utf16(size_t utf16_length, const char16_t* utf16_string, size_t index)
+    {
+        size_t count = 0;
+        for(; index < utf16_length; ++index) {
+            count += !(0xD800 == (utf16_string[index] & 0xFC00) && (index + 1) < utf16_length && 0xDC00 == (utf16_string[index + 1] & 0xFC00));
+        }
+        return count;
+    }
+
+    // Code points above U+10FFFF take the 3 bytes of U+FFFD
+    UCONV_INLINE size_t count_utf8_from_utf32(size_t utf32_length, const char32_t* utf32_string, size_t index)
+    {
+        size_t count = 0;
+        for(; index < utf32_length; ++index) {
+            const char32_t codepoint = utf32_string[index];
+            count += 1 + (0x80 <= codepoint) + (0x800 <= codepoint) + ((codepoint - 0x10000) < 0x100000);
+        }
+        return count;
+    }
+
+    UCONV_INLINE size_t count_utf16_from_utf32(size_t utf32_length, const char32_t* utf32_string, size_t index)
+    {
+        size_t count = 0;
+        for(; index < utf32_length; ++index) {
+            count += 1 + ((utf32_string[index] - 0x10000) < 0x100000);
+        }
+        return count;
+    }
+
+    UCONV_INLINE Progress utf8_to_utf16_scalar(size_t, char16_t*, size_t, const char8_t*)
+    {
+        return {0, 0};
+    }
+
+    UCONV_INLINE Progress utf16_to_utf8_scalar(size_t, char8_t*, size_t, const char16_t*)
+    {
+        return {0, 0};
+    }
+
+    template<class From, class To, UnitRange Range>
+    Progress convert_units_scalar(size_t, To*, size_t, const From*)
+    {
+        return {0, 0};
+    }
+
+    UCONV_INLINE size_t utf16_length_from_utf8_scalar(size_t utf8_length, const char8_t* utf8_string)
+    {
+        return count_utf16_from_utf8(utf8_length, utf8_string, 0);
+    }
+
+    template<bool Swap>
+    size_t utf8_length_from_utf16_scalar(size_t utf16_length, const char16_t* utf16_string)
+    {
+        return count_utf8_from_utf16<Swap>(utf16_length, utf16_string, 0);
+    }
+
+    UCONV_INLINE size_t utf32_length_from_utf8_scalar(size_t utf8_length, const char8_t* utf8_string)
+    {
+        return count_utf32_from_utf8(utf8_length, utf8_string, 0);
+    }
+
+    UCONV_INLINE size_t utf8_length_from_latin1_scalar(size_t latin1_length, const char* latin1_string)
+    {
+        return count_utf8_from_latin1(latin1_length, latin1_string, 0);
+    }
+
+    UCONV_INLINE size_t utf32_length_from_utf16_scalar(size_t utf16_length, const char16_t* utf16_string)
+    {
+        return count_utf32_from_utf16(utf16_length, utf16_string, 0);
+    }
+
+    UCONV_INLINE size_t utf8_length_from_utf32_scalar(size_t utf32_length, const char32_t* utf32_string)
+    {
+        return count_utf8_from_utf32(utf32_length, utf32_string, 0);
+    }
+
+    UCONV_INLINE size_t utf16_length_from_utf32_scalar(size_t utf32_length, const char32_t* utf32_string)
+    {
+        return count_utf16_from_utf32(utf32_length, utf32_string, 0);
+    }
+
+    // Whether the 8 bytes at utf8_string are ASCII
+    inline bool is_ascii_word(const char8_t* utf8_string)
+    {
+        uint64_t word;
+        std::memcpy(&word, utf8_string, sizeof(word));
+        return 0 == (word & 0x8080808080808080ULL);
+    }
+
+    // Strict validation from index on, which must be a code point boundary. Rejects
+    // overlong sequences, encoded surrogates and code points above U+10FFFF.
+    UCONV_INLINE size_t find_utf8_error(size_t utf8_length, const char8_t* utf8_string, size_t index)
+    {
+        // Only the state is needed, the automaton is run without decoding. Between code
+        // points 8 ASCII bytes are skipped at once, the check is made once per 8 bytes.
+        uint32_t state = detail::utf8_accept;
+        size_t boundary = index;
+        while(index < utf8_length) {
+            if(detail::utf8_accept == state && 8 <= (utf8_length - index) && is_ascii_word(utf8_string + index)) {
+                index += 8;
+                boundary = index;
+                continue;
+            }
+            const size_t end = index + std::min<size_t>(utf8_length - index, 8);
+            for(; index < end; ++index) {
+                state = detail::next_utf8_state(state, utf8_string[index]);
+                if(detail::utf8_reject == state) {
+                    return boundary;
+                }
+                boundary = (detail::utf8_accept == state) ? index + 1 : boundary;
+            }
+        }
+        return boundary;
+    }
+
+    // Start of the code point containing index, index itself if it is a boundary or
+    // inside an invalid run. Used to resume validation in the scalar code.
+    UCONV_INLINE size_t utf8_boundary(const char8_t* utf8_string, size_t index)
+    {
+        for(size_t length = 1; length <= std::min<size_t>(3, index); ++length) {
+            if(0x80 != (utf8_string[index - length] & 0xC0)) {
+                return index - length;
+            }
+        }
+        return index;
+    }
+
+    // Validation from index on, which must not be the low half of a pair
+    UCONV_INLINE size_t find_utf16_error(size_t utf16_length, const char16_t* utf16_string, size_t index)
+    {
+        for(; index < utf16_length; ++index) {
+            const char16_t unit = utf16_string[index];
+            if(0xD800 == (unit & 0xF800)) {
+                if(0xDC00 <= unit || (index + 1) == utf16_length || 0xDC00 != (utf16_string[index + 1] & 0xFC00)) {
+                    return index;
+                }
+                ++index;
+            }
+        }
+        return utf16_length;
+    }
+
+    UCONV_INLINE size_t validate_utf8_scalar(size_t utf8_length, const char8_t* utf8_string)
+    {
+        return find_utf8_error(utf8_length, utf8_string, 0);
+    }
+
+    UCONV_INLINE size_t validate_utf16_scalar(size_t utf16_length, const char16_t* utf16_string)
+    {
+        return find_utf16_error(utf16_length, utf16_string, 0);
+    }
+
+    static constexpr Kernels scalar_kernels = {Kernel::scalar,
+                                               utf8_to_utf16_scalar,
+                                               utf16_to_utf8_scalar,
+                                               utf16_length_from_utf8_scalar,
+                                               utf8_length_from_utf16_scalar<false>,
+                                               validate_utf8_scalar,
+                                               validate_utf16_scalar,
+                                               convert_units_scalar<char8_t, char32_t, UnitRange::ascii>,
+                                               convert_units_scalar<char32_t, char8_t, UnitRange::ascii>,
+                                               convert_units_scalar<char16_t, char32_t, UnitRange::bmp>,
+                                               convert_units_scalar<char32_t, char16_t, UnitRange::bmp>,
+                                               convert_units_scalar<char, char8_t, UnitRange::ascii>,
+                                               convert_units_scalar<char8_t, char, UnitRange::ascii>,
+                                               convert_units_scalar<char, char16_t, UnitRange::any>,
+                                               convert_units_scalar<char16_t, char, UnitRange::latin1>,
+                                               convert_units_scalar<char, char32_t, UnitRange::any>,
+                                               convert_units_scalar<char32_t, char, UnitRange::latin1>,
+                                               utf32_length_from_utf8_scalar,
+                                               utf8_length_from_latin1_scalar,
+                                               utf32_length_from_utf16_scalar,
+                                               utf8_length_from_utf32_scalar,
+                                               utf16_length_from_utf32_scalar,
+                                               utf8_to_utf16_scalar,
+                                               utf16_to_utf8_scalar,
+                                               utf8_length_from_utf16_scalar<true>};
+
+#if defined(UCONV_X86) || defined(UCONV_NEON)
+    // UTF-8 validation after "Validating UTF-8 In Less Than One Instruction Per Byte"
+    // (Keiser, Lemire). Each table maps a nibble of a byte pair to the errors it can
+    // take part in, the pair is invalid if an error is set in all three lookups.
+    static constexpr uint8_t too_short = 1 << 0;         // 11______ 0_______, 11______ 11______
+    static constexpr uint8_t too_long = 1 << 1;          // 0_______ 10______
+    static constexpr uint8_t overlong_3 = 1 << 2;        // 11100000 100_____
+    static constexpr uint8_t too_large = 1 << 3;         // 11110100 1001____ and above
+    static constexpr uint8_t surrogate = 1 << 4;         // 11101101 101_____
+    static constexpr uint8_t overlong_2 = 1 << 5;        // 1100000_ 10______
+    static constexpr uint8_t too_large_1000 = 1 << 6;    // 11110101 1000____ and above
+    static constexpr uint8_t overlong_4 = 1 << 6;        // 11110000 1000____
+    static constexpr uint8_t two_continuations = 1 << 7; // 10______ 10______
+    static constexpr uint8_t carry = too_short | too_long | two_continuations;
+
+    alignas(16) static constexpr uint8_t utf8_byte1_high[16] = {
+        too_long, too_long, too_long, too_long, too_long, too_long, too_long, too_long,
+        two_continuations, two_continuations, two_continuations, two_continuations,
+        too_short | overlong_2,
+        too_short,
+        too_short | overlong_3 | surrogate,
+        too_short | too_large | too_large_1000 | overlong_4,
+    };
+    alignas(16) static constexpr uint8_t utf8_byte1_low[16] = {
+        carry | overlong_3 | overlong_2 | overlong_4,
+        carry | overlong_2,
+        carry,
+        carry,
+        carry | too_large,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000 | surrogate,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+    };
+    alignas(16) static constexpr uint8_t utf8_byte2_high[16] = {
+        too_short, too_short, too_short, too_short, too_short, too_short, too_short, too_short,
+        too_long | overlong_2 | two_continuations | overlong_3 | too_large_1000 | overlong_4,
+        too_long | overlong_2 | two_continuations | overlong_3 | too_large,
+        too_long | overlong_2 | two_continuations | surrogate | too_large,
+        too_long | overlong_2 | two_continuations | surrogate | too_large,
+        too_short, too_short, too_short, too_short,
+    };
+
+    // Largest values of the last 3 bytes of a block not leaving a sequence incomplete
+    alignas(16) static constexpr uint8_t utf8_incomplete_limits[16] = {
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xEF, 0xDF, 0xBF,
+    };
+#endif
+
+#if defined(UCONV_X86)
+    // Shuffle pattern gathering the characters of a 12 byte UTF-8 window into
+    // 16-bit or 32-bit lanes, after "Transcoding Billions of Unicode Characters per
+    // Second with SIMD Instructions" (Lemire, Muła).
+    struct Utf8Pattern
+    {
+        uint8_t shuffle[16];
+        uint8_t consumed; // bytes of the complete characters gathered
+        uint8_t kind;     // 0: invalid, 1: six 1-2 byte, 2: four 1-3 byte, 3: three 1-4 byte characters
+    };
+
+    struct Utf8Patterns
+    {
+        static constexpr uint32_t invalid = 209;
+        uint8_t index[4096]; // indexed by the end-of-character mask of the window
+        Utf8Pattern patterns[invalid + 1];
+    };
+
+    constexpr Utf8Patterns make_utf8_patterns()
+    {
+        Utf8Patterns table = {};
+        for(uint32_t mask = 0; mask < 4096; ++mask) {
+            uint32_t lengths[12] = {};
+            uint32_t starts[12] = {};
+            uint32_t count = 0;
+            uint32_t start = 0;
+            for(uint32_t i = 0; i < 12; ++i) {
+                if(0 == (mask & (1U << i))) {
+                    continue;
+                }
+                if(4 < (i + 1 - start)) {
+                    break;
+                }
+                starts[count] = start;
+                lengths[count++] = i + 1 - start;
+                start = i + 1;
+            }
+            uint32_t id = Utf8Patterns::invalid;
+            uint32_t kind = 0;
+            uint32_t characters = 0;
+            if(6 <= count && std::all_of(lengths, lengths + 6, [](uint32_t x) { return x <= 2; })) {
+                kind = 1;
+                characters = 6;
+                id = 0;
+                for(uint32_t i = 0; i < 6; ++i) {
+                    id += (lengths[i] - 1) << i;
+                }
+            } else if(4 <= count && std::all_of(lengths, lengths + 4, [](uint32_t x) { return x <= 3; })) {
+                kind = 2;
+                characters = 4;
+                id = 64;
+                for(uint32_t i = 0, scale = 1; i < 4; ++i, scale *= 3) {
+                    id += (lengths[i] - 1) * scale;
+                }
+            } else if(3 <= count) {
+                kind = 3;
+                characters = 3;
+                id = 64 + 81;
+                for(uint32_t i = 0, scale = 1; i < 3; ++i, scale *= 4) {
+                    id += (lengths[i] - 1) * scale;
+                }
+            }
+            table.index[mask] = static_cast<uint8_t>(id);
+            Utf8Pattern& pattern = table.patterns[id];
+            pattern.kind = static_cast<uint8_t>(kind);
+            pattern.consumed = 0;
+            for(uint32_t i = 0; i < 16; ++i) {
+                pattern.shuffle[i] = 0x80;
+            }
+            // Bytes are stored in reverse order, the last byte of a character lands in the lowest byte of its lane
+            uint32_t lane_size = (1 == kind) ? 2 : 4;
+            for(uint32_t i = 0; i < characters; ++i) {
+                for(uint32_t j = 0; j < lengths[i]; ++j) {
+                    pattern.shuffle[i * lane_size + j] = static_cast<uint8_t>(starts[i] + lengths[i] - 1 - j);
+                }
+                pattern.consumed = static_cast<uint8_t>(pattern.consumed + lengths[i]);
+            }
+        }
+        return table;
+    }
+
+    static constexpr Utf8Patterns utf8_patterns = make_utf8_patterns();
 
-        if(0xD800 <= unit && unit <= 0xDBFF) { // High surrogate
-            if(i + 1 < utf16_string.length()) {
-                char16_t next_unit = utf16_string[++i];
-                if(0xDC00 <= next_unit && next_unit <= 0xDFFF) { // Low surrogate
-                    code_point = 0x10000 + ((unit - 0xD800) << 10) + (next_unit - 0xDC00);
+    // Shuffle pattern compacting the UTF-8 bytes of encoded UTF-16 lanes
+    struct Utf16Pattern
+    {
+        uint8_t shuffle[16];
+        uint8_t length; // bytes of UTF-8 produced
+    };
+
+    // Indexed by a mask of the ASCII lanes among eight 16-bit lanes of 1-2 byte encodings
+    constexpr std::array<Utf16Pattern, 256> make_utf16_patterns2()
+    {
+        std::array<Utf16Pattern, 256> table = {};
+        for(uint32_t mask = 0; mask < 256; ++mask) {
+            Utf16Pattern& pattern = table[mask];
+            uint32_t length = 0;
+            for(uint32_t i = 0; i < 8; ++i) {
+                if(mask & (1U << i)) {
+                    pattern.shuffle[length++] = static_cast<uint8_t>(2 * i);
                 } else {
-                    // Handle malformed UTF-16 (e.g., lone high surrogate)
-                    // Just treat it as a single unit
-                    code_point = unit;
+                    pattern.shuffle[length++] = static_cast<uint8_t>(2 * i + 1);
+                    pattern.shuffle[length++] = static_cast<uint8_t>(2 * i);
                 }
-            } else {
-                // Handle malformed UTF-16 (e.g., lone high surrogate at end)
-                code_point = unit;
             }
-        } else {
-            code_point = unit;
+            for(uint32_t i = length; i < 16; ++i) {
+                pattern.shuffle[i] = 0x80;
+            }
+            pattern.length = static_cast<uint8_t>(length);
         }
+        return table;
+    }
 
-        // Encode code_point to UTF-8
-        if(code_point <= 0x7F) {
-            utf8_bytes.push_back(static_cast<char8_t>(code_point));
-        } else if(code_point <= 0x7FF) {
-            utf8_bytes.push_back(static_cast<char8_t>(0xC0 | (code_point >> 6)));
-            utf8_bytes.push_back(static_cast<char8_t>(0x80 | (code_point & 0x3F)));
-        } else if(code_point <= 0xFFFF) {
-            utf8_bytes.push_back(static_cast<char8_t>(0xE0 | (code_point >> 12)));
-            utf8_bytes.push_back(static_cast<char8_t>(0x80 | ((code_point >> 6) & 0x3F)));
-            utf8_bytes.push_back(static_cast<char8_t>(0x80 | (code_point & 0x3F)));
-        } else if(code_point <= 0x10FFFF) {
-            utf8_bytes.push_back(static_cast<char8_t>(0xF0 | (code_point >> 18)));
-            utf8_bytes.push_back(static_cast<char8_t>(0x80 | ((code_point >> 12) & 0x3F)));
-            utf8_bytes.push_back(static_cast<char8_t>(0x80 | ((code_point >> 6) & 0x3F)));
-            utf8_bytes.push_back(static_cast<char8_t>(0x80 | (code_point & 0x3F)));
+    // Indexed by masks of the lanes >= 0x80 (low nibble) and >= 0x800 (high nibble)
+    // among four 32-bit lanes of 1-3 byte encodings
+    constexpr std::array<Utf16Pattern, 256> make_utf16_patterns3()
+    {
+        std::array<Utf16Pattern, 256> table = {};
+        for(uint32_t mask = 0; mask < 256; ++mask) {
+            Utf16Pattern& pattern = table[mask];
+            uint32_t length = 0;
+            for(uint32_t i = 0; i < 4; ++i) {
+                uint32_t bytes = 1 + ((mask >> i) & 0x01U) + ((mask >> (i + 4)) & 0x01U);
+                switch(bytes) {
+                case 1:
+                    pattern.shuffle[length++] = static_cast<uint8_t>(4 * i + 3);
+                    break;
+                case 2:
+                    pattern.shuffle[length++] = static_cast<uint8_t>(4 * i + 1);
+                    pattern.shuffle[length++] = static_cast<uint8_t>(4 * i + 2);
+                    break;
+                default:
+                    pattern.shuffle[length++] = static_cast<uint8_t>(4 * i);
+                    pattern.shuffle[length++] = static_cast<uint8_t>(4 * i + 1);
+                    pattern.shuffle[length++] = static_cast<uint8_t>(4 * i + 2);
+                    break;
+                }
+            }
+            for(uint32_t i = length; i < 16; ++i) {
+                pattern.shuffle[i] = 0x80;
+            }
+            pattern.length = static_cast<uint8_t>(length);
         }
+        return table;
     }
-    return utf8_bytes;
-}
 
-namespace
-{
-    // Function to convert a Unicode codepoint to UTF-16 code units
-    size_t codepoint_to_utf16(char16_t utf16_units[4], char32_t codepoint)
+    static constexpr std::array<Utf16Pattern, 256> utf16_patterns2 = make_utf16_patterns2();
+    static constexpr std::array<Utf16Pattern, 256> utf16_patterns3 = make_utf16_patterns3();
+
+    template<bool Swap>
+    UCONV_TARGET_SSE42 UCONV_FORCE_INLINE __m128i swap_units(__m128i units)
     {
-        size_t length = 0;
-        if(codepoint <= 0xFFFF) {
-            utf16_units[length++] = static_cast<char16_t>(codepoint);
+        if constexpr(Swap) {
+            return _mm_shuffle_epi8(units, _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14));
         } else {
-            char32_t temp = codepoint - 0x10000;
-            char16_t high_surrogate = static_cast<char16_t>(0xD800 + (temp >> 10));
-            char16_t low_surrogate = 0xDC00 + (temp & 0x3FF);
-            utf16_units[length++] = high_surrogate;
-            utf16_units[length++] = low_surrogate;
+            return units;
         }
-        return length;
     }
 
-    // Simplified function to decode a single UTF-8 sequence to a codepoint
-    char32_t decode_to_codepoint(const std::u8string& utf8_string, size_t& index)
+    // Decodes the characters selected by pattern from 16 readable bytes, writes at most 8 code units
+    template<bool Swap>
+    UCONV_TARGET_SSE42 UCONV_FORCE_INLINE size_t utf8_to_utf16_sse42_gather(char16_t* utf16_string, __m128i bytes, const Utf8Pattern& pattern)
     {
-        assert(0 < utf8_string.length());
-        char32_t byte1 = utf8_string[index++];
-        if((byte1 & 0x80) == 0) { // 1-byte sequence
-            return byte1;
-        } else if((byte1 & 0xE0) == 0xC0) { // 2-byte sequence
-            if((utf8_string.length() - index) < 1) {
-                return 0;
-            }
-            char32_t byte2 = utf8_string[index++];
-            return ((byte1 & 0x1F) << 6) | (byte2 & 0x3F);
-        } else if((byte1 & 0xF0) == 0xE0) { // 3-byte sequence
-            if((utf8_string.length() - index) < 2) {
-                return 0;
+        __m128i* output = reinterpret_cast<__m128i*>(utf16_string);
+        const __m128i perm = _mm_shuffle_epi8(bytes, _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern.shuffle)));
+        switch(pattern.kind) {
+        case 1: {
+            const __m128i ascii = _mm_and_si128(perm, _mm_set1_epi16(0x7F));
+            const __m128i high = _mm_and_si128(perm, _mm_set1_epi16(0x1F00));
+            _mm_storeu_si128(output, swap_units<Swap>(_mm_or_si128(ascii, _mm_srli_epi16(high, 2))));
+            return 6;
+        }
+        case 2: {
+            const __m128i ascii = _mm_and_si128(perm, _mm_set1_epi32(0x7F));
+            const __m128i middle = _mm_srli_epi32(_mm_and_si128(perm, _mm_set1_epi32(0x3F00)), 2);
+            const __m128i high = _mm_srli_epi32(_mm_and_si128(perm, _mm_set1_epi32(0x0F0000)), 4);
+            const __m128i codepoints = _mm_or_si128(ascii, _mm_or_si128(middle, high));
+            _mm_storeu_si128(output, swap_units<Swap>(_mm_packus_epi32(codepoints, codepoints)));
+            return 4;
+        }
+        default: {
+            const __m128i ascii = _mm_and_si128(perm, _mm_set1_epi32(0x7F));
+            const __m128i middle = _mm_srli_epi32(_mm_and_si128(perm, _mm_set1_epi32(0x3F00)), 2);
+            // The third byte of a lane is either a continuation byte or the lead byte 1110____
+            __m128i middle_high = _mm_and_si128(perm, _mm_set1_epi32(0x3F0000));
+            middle_high = _mm_xor_si128(middle_high, _mm_srli_epi32(_mm_and_si128(perm, _mm_set1_epi32(0x400000)), 1));
+            middle_high = _mm_srli_epi32(middle_high, 4);
+            const __m128i high = _mm_srli_epi32(_mm_and_si128(perm, _mm_set1_epi32(0x07000000)), 6);
+            const __m128i codepoints = _mm_or_si128(_mm_or_si128(ascii, middle), _mm_or_si128(middle_high, high));
+            alignas(16) uint32_t values[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(values), codepoints);
+            size_t written = 0;
+            for(size_t i = 0; i < 3; ++i) {
+                written += codepoint_to_utf16(utf16_string + written, values[i]);
             }
-            char32_t byte2 = utf8_string[index++];
-            char32_t byte3 = utf8_string[index++];
-            return ((byte1 & 0x0F) << 12) | ((byte2 & 0x3F) << 6) | (byte3 & 0x3F);
-        } else if((byte1 & 0xF8) == 0xF0) { // 4-byte sequence
-            if((utf8_string.length() - index) < 3) {
-                return 0;
+            for(size_t i = 0; i < written; ++i) {
+                utf16_string[i] = swap_unit<Swap>(utf16_string[i]);
             }
-            char32_t byte2 = utf8_string[index++];
-            char32_t byte3 = utf8_string[index++];
-            char32_t byte4 = utf8_string[index++];
-            return ((byte1 & 0x07) << 18) | ((byte2 & 0x3F) << 12) | ((byte3 & 0x3F) << 6) | (byte4 & 0x3F);
+            return written;
+        }
         }
-        return 0; // Error or invalid sequence
     }
-} // namespace
 
-std::u16string utf8_to_utf16(const std::u8string& utf8_string)
-{
-    std::u16string utf16_string;
-    utf16_string.reserve(round_up4(utf8_string.length()));
-    size_t index = 0;
-    char16_t utf16_units[4];
-    while(index < utf8_string.length()) {
-        char32_t codepoint = decode_to_codepoint(utf8_string, index);
-        if(0 == codepoint) {
-            break;
+    // The kernels accept what the scalar automaton accepts. The lookups of the validators report every
+    // error of Table 3-7 within a few bytes of the character it belongs to, a window starting on a code
+    // point boundary is classified with a zero previous block.
+    UCONV_FORCE_INLINE UCONV_TARGET_SSE42 __m128i utf8_errors_sse42(__m128i input, __m128i previous)
+    {
+        const __m128i nibble = _mm_set1_epi8(0x0F);
+        const __m128i previous1 = _mm_alignr_epi8(input, previous, 15);
+        const __m128i byte1_high = _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(utf8_byte1_high)),
+                                                    _mm_and_si128(_mm_srli_epi16(previous1, 4), nibble));
+        const __m128i byte1_low = _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(utf8_byte1_low)), _mm_and_si128(previous1, nibble));
+        const __m128i byte2_high = _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(utf8_byte2_high)),
+                                                    _mm_and_si128(_mm_srli_epi16(input, 4), nibble));
+        const __m128i special_cases = _mm_and_si128(_mm_and_si128(byte1_high, byte1_low), byte2_high);
+        // Bytes 2 and 3 positions after a 3 or 4-byte lead must be continuation bytes
+        const __m128i third = _mm_subs_epu8(_mm_alignr_epi8(input, previous, 14), _mm_set1_epi8(0xE0 - 0x80));
+        const __m128i fourth = _mm_subs_epu8(_mm_alignr_epi8(input, previous, 13), _mm_set1_epi8(0xF0 - 0x80));
+        const __m128i continuations = _mm_and_si128(_mm_or_si128(third, fourth), _mm_set1_epi8(static_cast<char>(0x80)));
+        return _mm_xor_si128(continuations, special_cases);
+    }
+
+    // Mask of the bytes with an error
+    UCONV_TARGET_SSE42 UCONV_FORCE_INLINE uint32_t utf8_error_mask(__m128i bytes, __m128i previous)
+    {
+        const __m128i errors = utf8_errors_sse42(bytes, previous);
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(errors, _mm_setzero_si128()))) ^ 0xFFFFU;
+    }
+
+    // Converts the characters ending within the first 12 of 16 readable bytes, writes at most 16 code units
+    template<bool Swap>
+    UCONV_TARGET_SSE42 UCONV_FORCE_INLINE Progress utf8_to_utf16_sse42_step(char16_t* utf16_string, const char8_t* utf8_string)
+    {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(utf8_string));
+        if(0 == _mm_movemask_epi8(bytes)) {
+            __m128i* output = reinterpret_cast<__m128i*>(utf16_string);
+            _mm_storeu_si128(output, swap_units<Swap>(_mm_cvtepu8_epi16(bytes)));
+            _mm_storeu_si128(output + 1, swap_units<Swap>(_mm_cvtepu8_epi16(_mm_srli_si128(bytes, 8))));
+            return {16, 16};
+        }
+        const uint32_t continuation = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmplt_epi8(bytes, _mm_set1_epi8(-64))));
+        const Utf8Pattern& pattern = utf8_patterns.patterns[utf8_patterns.index[(~continuation >> 1) & 0xFFFU]];
+        if(0 == pattern.kind) {
+            return {0, 0};
         }
-        size_t length = codepoint_to_utf16(utf16_units, codepoint);
-        for(size_t i = 0; i < length; ++i) {
-            utf16_string.push_back(utf16_units[i]);
+        // An error in the gathered characters is reported at the latest on the byte following them
+        if(0 != (utf8_error_mask(bytes, _mm_setzero_si128()) & ((2U << pattern.consumed) - 1))) {
+            return {0, 0};
         }
+        return {pattern.consumed, utf8_to_utf16_sse42_gather<Swap>(utf16_string, bytes, pattern)};
     }
-    return utf16_string;
-}
 
-size_t utf16_to_utf8(size_t utf8_length, char8_t* utf8_string, size_t utf16_length, const char16_t* utf16_string)
-{
-    assert(127<=utf8_length);
-    assert(nullptr != utf8_string);
-    assert(0<=utf16_length);
-    assert(nullptr != utf16_string);
-    size_t count = 0;
-    for(size_t i = 0; i < utf16_length; ++i) {
-        char32_t code_point;
-        char16_t unit = utf16_string[i];
+    // Classification of the bytes of a 64 byte block, bit i describes byte i
+    struct Utf8Block
+    {
+        uint64_t non_ascii;
+        uint64_t continuation;
+        uint64_t errors;
+    };
 
-        if(0xD800 <= unit && unit <= 0xDBFF) { // High surrogate
-            if(i + 1 < utf16_length) {
-                char16_t next_unit = utf16_string[++i];
-                if(0xDC00 <= next_unit && next_unit <= 0xDFFF) { // Low surrogate
-                    code_point = 0x10000 + ((unit - 0xD800) << 10) + (next_unit - 0xDC00);
-                } else {
-                    // Handle malformed UTF-16 (e.g., lone high surrogate)
-                    // Just treat it as a single unit
-                    code_point = unit;
+    // Converts the characters of a classified 64 byte block, 12 byte windows at a time, up to the first error.
+    // Characters crossing the end of the block are left to the next block, writes at most 64 code units.
+    template<bool Swap>
+    UCONV_TARGET_SSE42 UCONV_FORCE_INLINE Progress utf8_to_utf16_sse42_block(char16_t* utf16_string, const char8_t* utf8_string, const Utf8Block& block)
+    {
+        // Every window is checked up to its 16th byte, so consumed characters are fully validated
+        const size_t limit = (0 == block.errors) ? 64 : static_cast<size_t>(std::countr_zero(block.errors));
+        const uint64_t ends = ~block.continuation >> 1;
+        size_t read = 0;
+        size_t written = 0;
+        while((read + 16) <= limit) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(utf8_string + read));
+            if(0 == ((block.non_ascii >> read) & 0xFFFFU)) {
+                __m128i* output = reinterpret_cast<__m128i*>(utf16_string + written);
+                _mm_storeu_si128(output, swap_units<Swap>(_mm_cvtepu8_epi16(bytes)));
+                _mm_storeu_si128(output + 1, swap_units<Swap>(_mm_cvtepu8_epi16(_mm_srli_si128(bytes, 8))));
+                read += 16;
+                written += 16;
+                continue;
+            }
+            const Utf8Pattern& pattern = utf8_patterns.patterns[utf8_patterns.index[(ends >> read) & 0xFFFU]];
+            if(0 == pattern.kind) {
+                break;
+            }
+            written += utf8_to_utf16_sse42_gather<Swap>(utf16_string + written, bytes, pattern);
+            read += pattern.consumed;
+        }
+        return {read, written};
+    }
+
+    UCONV_TARGET_SSE42 UCONV_FORCE_INLINE Utf8Block classify_utf8_sse42(const __m128i bytes[4])
+    {
+        Utf8Block block = {0, 0, 0};
+        for(size_t i = 0; i < 4; ++i) {
+            const __m128i previous = (0 == i) ? _mm_setzero_si128() : bytes[i - 1];
+            block.non_ascii |= static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(bytes[i]))) << (16 * i);
+            block.continuation |= static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmplt_epi8(bytes[i], _mm_set1_epi8(-64))))) << (16 * i);
+            block.errors |= static_cast<uint64_t>(utf8_error_mask(bytes[i], previous)) << (16 * i);
+        }
+        return block;
+    }
+
+    // Converts 8 readable code units without surrogates, writes at most 32 bytes
+    template<bool Swap>
+    UCONV_TARGET_SSE42 UCONV_FORCE_INLINE Progress utf16_to_utf8_sse42_step(char8_t* utf8_string, const char16_t* utf16_string)
+    {
+        const __m128i units = swap_units<Swap>(_mm_loadu_si128(reinterpret_cast<const __m128i*>(utf16_string)));
+        const __m128i zero = _mm_setzero_si128();
+        __m128i* output = reinterpret_cast<__m128i*>(utf8_string);
+        if(_mm_testz_si128(units, _mm_set1_epi16(static_cast<short>(0xFF80)))) {
+            _mm_storel_epi64(output, _mm_packus_epi16(units, units));
+            return {8, 8};
+        }
+        if(_mm_testz_si128(units, _mm_set1_epi16(static_cast<short>(0xF800)))) {
+            // 1-2 bytes: 110aaaaa 10bbbbbb in each lane, compacted with a shuffle
+            const __m128i high = _mm_and_si128(_mm_slli_epi16(units, 2), _mm_set1_epi16(0x1F00));
+            const __m128i low = _mm_and_si128(units, _mm_set1_epi16(0x3F));
+            const __m128i two = _mm_or_si128(_mm_or_si128(high, low), _mm_set1_epi16(static_cast<short>(0xC080)));
+            const __m128i one = _mm_cmpeq_epi16(_mm_and_si128(units, _mm_set1_epi16(static_cast<short>(0xFF80))), zero);
+            const __m128i encoded = _mm_blendv_epi8(two, units, one);
+            const Utf16Pattern& pattern = utf16_patterns2[_mm_movemask_epi8(_mm_packs_epi16(one, zero))];
+            _mm_storeu_si128(output, _mm_shuffle_epi8(encoded, _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern.shuffle))));
+            return {8, pattern.length};
+        }
+        if(0 != _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(units, _mm_set1_epi16(static_cast<short>(0xF800))), _mm_set1_epi16(static_cast<short>(0xD800))))) {
+            return {0, 0};
+        }
+        // 1-3 bytes: four 32-bit lanes at a time, 1110aaaa 10bbbbbb 10cccccc in the lower three bytes,
+        // 110bbbbb 10cccccc in the middle two bytes or 0ccccccc in the highest byte
+        size_t written = 0;
+        for(size_t i = 0; i < 2; ++i) {
+            const __m128i values = (0 == i) ? _mm_unpacklo_epi16(units, zero) : _mm_unpackhi_epi16(units, zero);
+            const __m128i two = _mm_and_si128(_mm_cmplt_epi32(values, _mm_set1_epi32(0x800)), _mm_set1_epi32(0x4000));
+            const __m128i byte0 = _mm_or_si128(_mm_srli_epi32(values, 12), _mm_set1_epi32(0xE0));
+            const __m128i byte1 = _mm_or_si128(_mm_and_si128(_mm_slli_epi32(values, 2), _mm_set1_epi32(0x3F00)), _mm_or_si128(two, _mm_set1_epi32(0x8000)));
+            const __m128i byte2 = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(values, _mm_set1_epi32(0x3F)), 16), _mm_set1_epi32(0x800000));
+            const __m128i byte3 = _mm_slli_epi32(values, 24);
+            const __m128i encoded = _mm_or_si128(_mm_or_si128(byte0, byte1), _mm_or_si128(byte2, byte3));
+            const uint32_t mask1 = static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(values, _mm_set1_epi32(0x7F)))));
+            const uint32_t mask2 = static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(values, _mm_set1_epi32(0x7FF)))));
+            const Utf16Pattern& pattern = utf16_patterns3[mask1 | (mask2 << 4)];
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(utf8_string + written), _mm_shuffle_epi8(encoded, _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern.shuffle))));
+            written += pattern.length;
+        }
+        return {8, written};
+    }
+
+    template<bool Swap>
+    UCONV_TARGET_SSE42 Progress utf8_to_utf16_sse42(size_t utf16_length, char16_t* utf16_string, size_t utf8_length, const char8_t* utf8_string)
+    {
+        Progress progress = {0, 0};
+        while(64 <= (utf8_length - progress.read) && 64 <= (utf16_length - progress.written)) {
+            __m128i bytes[4];
+            for(size_t i = 0; i < 4; ++i) {
+                bytes[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(utf8_string + progress.read + 16 * i));
+            }
+            if(0 == _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(bytes[0], bytes[1]), _mm_or_si128(bytes[2], bytes[3])))) {
+                __m128i* output = reinterpret_cast<__m128i*>(utf16_string + progress.written);
+                for(size_t i = 0; i < 4; ++i) {
+                    _mm_storeu_si128(output + 2 * i, swap_units<Swap>(_mm_cvtepu8_epi16(bytes[i])));
+                    _mm_storeu_si128(output + 2 * i + 1, swap_units<Swap>(_mm_cvtepu8_epi16(_mm_srli_si128(bytes[i], 8))));
                 }
-            } else {
-                // Handle malformed UTF-16 (e.g., lone high surrogate at end)
-                code_point = unit;
+                progress.read += 64;
+                progress.written += 64;
+                continue;
+            }
+            const Utf8Block block = classify_utf8_sse42(bytes);
+            Progress step = utf8_to_utf16_sse42_block<Swap>(utf16_string + progress.written, utf8_string + progress.read, block);
+            if(0 == step.read) {
+                break;
+            }
+            progress.read += step.read;
+            progress.written += step.written;
+        }
+        while(16 <= (utf8_length - progress.read) && 16 <= (utf16_length - progress.written)) {
+            Progress step = utf8_to_utf16_sse42_step<Swap>(utf16_string + progress.written, utf8_string + progress.read);
+            if(0 == step.read) {
+                break;
+            }
+            progress.read += step.read;
+            progress.written += step.written;
+        }
+        return progress;
+    }
+
+    template<bool Swap>
+    UCONV_TARGET_SSE42 Progress utf16_to_utf8_sse42(size_t utf8_length, char8_t* utf8_string, size_t utf16_length, const char16_t* utf16_string)
+    {
+        Progress progress = {0, 0};
+        while(8 <= (utf16_length - progress.read) && 32 <= (utf8_length - progress.written)) {
+            Progress step = utf16_to_utf8_sse42_step<Swap>(utf8_string + progress.written, utf16_string + progress.read);
+            if(0 == step.read) {
+                break;
             }
+            progress.read += step.read;
+            progress.written += step.written;
+        }
+        return progress;
+    }
+
+    template<bool Swap>
+    UCONV_TARGET_AVX2 UCONV_FORCE_INLINE __m256i swap_units(__m256i units)
+    {
+        if constexpr(Swap) {
+            return _mm256_shuffle_epi8(units, _mm256_broadcastsi128_si256(_mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14)));
         } else {
-            code_point = unit;
+            return units;
         }
+    }
+
+    UCONV_FORCE_INLINE UCONV_TARGET_AVX2 __m256i utf8_errors_avx2(__m256i input, __m256i previous)
+    {
+        const __m256i nibble = _mm256_set1_epi8(0x0F);
+        const __m256i shifted = _mm256_permute2x128_si256(previous, input, 0x21);
+        const __m256i previous1 = _mm256_alignr_epi8(input, shifted, 15);
+        const __m256i byte1_high = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(utf8_byte1_high))),
+                                                       _mm256_and_si256(_mm256_srli_epi16(previous1, 4), nibble));
+        const __m256i byte1_low =
+            _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(utf8_byte1_low))), _mm256_and_si256(previous1, nibble));
+        const __m256i byte2_high = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(utf8_byte2_high))),
+                                                       _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+        const __m256i special_cases = _mm256_and_si256(_mm256_and_si256(byte1_high, byte1_low), byte2_high);
+        const __m256i third = _mm256_subs_epu8(_mm256_alignr_epi8(input, shifted, 14), _mm256_set1_epi8(0xE0 - 0x80));
+        const __m256i fourth = _mm256_subs_epu8(_mm256_alignr_epi8(input, shifted, 13), _mm256_set1_epi8(0xF0 - 0x80));
+        const __m256i continuations = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(static_cast<char>(0x80)));
+        return _mm256_xor_si256(continuations, special_cases);
+    }
 
-        // Encode code_point to UTF-8
-        if(code_point <= 0x7F) {
-            if(utf8_length<=count){
-                return 0;
+    template<bool Swap>
+    UCONV_TARGET_AVX2 Progress utf8_to_utf16_avx2(size_t utf16_length, char16_t* utf16_string, size_t utf8_length, const char8_t* utf8_string)
+    {
+        Progress progress = {0, 0};
+        while(64 <= (utf8_length - progress.read) && 64 <= (utf16_length - progress.written)) {
+            const __m256i bytes0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(utf8_string + progress.read));
+            const __m256i bytes1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(utf8_string + progress.read + 32));
+            const uint64_t non_ascii = static_cast<uint32_t>(_mm256_movemask_epi8(bytes0)) | (static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(bytes1))) << 32);
+            if(0 == non_ascii) {
+                __m256i* output = reinterpret_cast<__m256i*>(utf16_string + progress.written);
+                _mm256_storeu_si256(output, swap_units<Swap>(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(bytes0))));
+                _mm256_storeu_si256(output + 1, swap_units<Swap>(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(bytes0, 1))));
+                _mm256_storeu_si256(output + 2, swap_units<Swap>(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(bytes1))));
+                _mm256_storeu_si256(output + 3, swap_units<Swap>(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(bytes1, 1))));
+                progress.read += 64;
+                progress.written += 64;
+                continue;
+            }
+            const __m256i continuation_threshold = _mm256_set1_epi8(-64);
+            const uint64_t continuation = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(continuation_threshold, bytes0)))
+                                          | (static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(continuation_threshold, bytes1)))) << 32);
+            const __m256i zero = _mm256_setzero_si256();
+            const uint64_t valid = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(utf8_errors_avx2(bytes0, zero), zero)))
+                                   | (static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(utf8_errors_avx2(bytes1, bytes0), zero)))) << 32);
+            const Utf8Block block = {non_ascii, continuation, ~valid};
+            Progress step = utf8_to_utf16_sse42_block<Swap>(utf16_string + progress.written, utf8_string + progress.read, block);
+            if(0 == step.read) {
+                break;
             }
-            utf8_string[count++] = static_cast<char8_t>(code_point);
-        } else if(code_point <= 0x7FF) {
-            if(utf8_length<=(count+1)){
-                return 0;
+            progress.read += step.read;
+            progress.written += step.written;
+        }
+        while(16 <= (utf8_length - progress.read) && 16 <= (utf16_length - progress.written)) {
+            Progress step = utf8_to_utf16_sse42_step<Swap>(utf16_string + progress.written, utf8_string + progress.read);
+            if(0 == step.read) {
+                break;
             }
-            utf8_string[count++] = static_cast<char8_t>(0xC0 | (code_point >> 6));
-            utf8_string[count++] = static_cast<char8_t>(0x80 | (code_point & 0x3F));
-        } else if(code_point <= 0xFFFF) {
-            if(utf8_length<=(count+2)){
-                return 0;
+            progress.read += step.read;
+            progress.written += step.written;
+        }
+        return progress;
+    }
+
+    template<bool Swap>
+    UCONV_TARGET_AVX2 Progress utf16_to_utf8_avx2(size_t utf8_length, char8_t* utf8_string, size_t utf16_length, const char16_t* utf16_string)
+    {
+        Progress progress = {0, 0};
+        const __m256i zero = _mm256_setzero_si256();
+        while(8 <= (utf16_length - progress.read) && 32 <= (utf8_length - progress.written)) {
+            if(16 <= (utf16_length - progress.read)) {
+                const __m256i units = swap_units<Swap>(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(utf16_string + progress.read)));
+                char8_t* output = utf8_string + progress.written;
+                if(_mm256_testz_si256(units, _mm256_set1_epi16(static_cast<short>(0xFF80)))) {
+                    const __m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(units, units), 0xD8);
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(output), _mm256_castsi256_si128(bytes));
+                    progress.read += 16;
+                    progress.written += 16;
+                    continue;
+                }
+                if(_mm256_testz_si256(units, _mm256_set1_epi16(static_cast<short>(0xF800)))) {
+                    // Same as utf16_to_utf8_sse42_step(), one pattern per 128-bit lane
+                    const __m256i high = _mm256_and_si256(_mm256_slli_epi16(units, 2), _mm256_set1_epi16(0x1F00));
+                    const __m256i low = _mm256_and_si256(units, _mm256_set1_epi16(0x3F));
+                    const __m256i two = _mm256_or_si256(_mm256_or_si256(high, low), _mm256_set1_epi16(static_cast<short>(0xC080)));
+                    const __m256i one = _mm256_cmpeq_epi16(_mm256_and_si256(units, _mm256_set1_epi16(static_cast<short>(0xFF80))), zero);
+                    const __m256i encoded = _mm256_blendv_epi8(two, units, one);
+                    const uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_packs_epi16(one, zero)));
+                    const Utf16Pattern& pattern0 = utf16_patterns2[mask & 0xFFU];
+                    const Utf16Pattern& pattern1 = utf16_patterns2[(mask >> 16) & 0xFFU];
+                    const __m256i shuffle = _mm256_inserti128_si256(
+                        _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern0.shuffle))),
+                        _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern1.shuffle)), 1);
+                    const __m256i bytes = _mm256_shuffle_epi8(encoded, shuffle);
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(output), _mm256_castsi256_si128(bytes));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(output + pattern0.length), _mm256_extracti128_si256(bytes, 1));
+                    progress.read += 16;
+                    progress.written += pattern0.length + pattern1.length;
+                    continue;
+                }
             }
-            utf8_string[count++] = static_cast<char8_t>(0xE0 | (code_point >> 12));
-            utf8_string[count++] = static_cast<char8_t>(0x80 | ((code_point >> 6) & 0x3F));
-            utf8_string[count++] = static_cast<char8_t>(0x80 | (code_point & 0x3F));
-        } else if(code_point <= 0x10FFFF) {
-            if(utf8_length<=(count+3)){
-                return 0;
+            Progress step = utf16_to_utf8_sse42_step<Swap>(utf8_string + progress.written, utf16_string + progress.read);
+            if(0 == step.read) {
+                break;
             }
-            utf8_string[count++] = static_cast<char8_t>(0xF0 | (code_point >> 18));
-            utf8_string[count++] = static_cast<char8_t>(0x80 | ((code_point >> 12) & 0x3F));
-            utf8_string[count++] = static_cast<char8_t>(0x80 | ((code_point >> 6) & 0x3F));
-            utf8_string[count++] = static_cast<char8_t>(0x80 | (code_point & 0x3F));
+            progress.read += step.read;
+            progress.written += step.written;
         }
+        return progress;
     }
-    return count;
-}
 
-size_t utf8_to_utf16(size_t utf16_length, char16_t* utf16_string, size_t utf8_length, const char8_t* utf8_string)
-{
-    assert(31<=utf16_length);
-    assert(nullptr != utf16_string);
-    assert(0<=utf8_length);
-    assert(nullptr != utf8_string);
-    size_t index = 0;
-    char16_t utf16_units[4];
-    size_t count = 0;
-    while(index < utf8_length) {
-        char32_t codepoint = decode_to_codepoint(utf8_string, index);
-        if(0 == codepoint) {
-            break;
+    template<bool Swap>
+    UCONV_TARGET_AVX512 UCONV_FORCE_INLINE __m512i swap_units(__m512i units)
+    {
+        if constexpr(Swap) {
+            return _mm512_shuffle_epi8(units, _mm512_broadcast_i32x4(_mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14)));
+        } else {
+            return units;
+        }
+    }
+
+    UCONV_FORCE_INLINE UCONV_TARGET_AVX512 __m512i utf8_errors_avx512(__m512i input, __m512i previous)
+    {
+        const __m512i nibble = _mm512_set1_epi8(0x0F);
+        const __m512i shifted = _mm512_alignr_epi64(input, previous, 6);
+        const __m512i previous1 = _mm512_alignr_epi8(input, shifted, 15);
+        const __m512i byte1_high = _mm512_shuffle_epi8(_mm512_broadcast_i32x4(_mm_load_si128(reinterpret_cast<const __m128i*>(utf8_byte1_high))),
+                                                       _mm512_and_si512(_mm512_srli_epi16(previous1, 4), nibble));
+        const __m512i byte1_low =
+            _mm512_shuffle_epi8(_mm512_broadcast_i32x4(_mm_load_si128(reinterpret_cast<const __m128i*>(utf8_byte1_low))), _mm512_and_si512(previous1, nibble));
+        const __m512i byte2_high = _mm512_shuffle_epi8(_mm512_broadcast_i32x4(_mm_load_si128(reinterpret_cast<const __m128i*>(utf8_byte2_high))),
+                                                       _mm512_and_si512(_mm512_srli_epi16(input, 4), nibble));
+        const __m512i special_cases = _mm512_and_si512(_mm512_and_si512(byte1_high, byte1_low), byte2_high);
+        const __m512i third = _mm512_subs_epu8(_mm512_alignr_epi8(input, shifted, 14), _mm512_set1_epi8(0xE0 - 0x80));
+        const __m512i fourth = _mm512_subs_epu8(_mm512_alignr_epi8(input, shifted, 13), _mm512_set1_epi8(0xF0 - 0x80));
+        const __m512i continuations = _mm512_and_si512(_mm512_or_si512(third, fourth), _mm512_set1_epi8(static_cast<char>(0x80)));
+        return _mm512_xor_si512(continuations, special_cases);
+    }
+
+    // Converts the characters of the Basic Multilingual Plane ending within the first 32 of 34 readable bytes,
+    // each byte is decoded as if it was a lead byte and the code points of the actual lead bytes are compressed.
+    // Writes at most 32 code units.
+    template<bool Swap>
+    UCONV_TARGET_AVX512 inline Progress utf8_to_utf16_avx512_step(char16_t* utf16_string, const char8_t* utf8_string)
+    {
+        const __m512i bytes = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(utf8_string)));
+        const __m512i next1 = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(utf8_string + 1)));
+        const __m512i next2 = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(utf8_string + 2)));
+        if(0 != _mm512_cmpge_epu16_mask(bytes, _mm512_set1_epi16(0xF0))) {
+            return {0, 0};
+        }
+        const uint64_t lead2 = _mm512_cmpge_epu16_mask(bytes, _mm512_set1_epi16(0xC0));
+        const uint64_t lead3 = _mm512_cmpge_epu16_mask(bytes, _mm512_set1_epi16(0xE0));
+        // Overlong sequences and encoded surrogates are reported on their lead byte, the second
+        // byte is only looked at after the rare leads E0 and ED
+        uint64_t out_of_range = _mm512_mask_cmplt_epu16_mask(static_cast<__mmask32>(lead2), bytes, _mm512_set1_epi16(0xC2));
+        const __mmask32 lead_e0 = _mm512_cmpeq_epi16_mask(bytes, _mm512_set1_epi16(0xE0));
+        const __mmask32 lead_ed = _mm512_cmpeq_epi16_mask(bytes, _mm512_set1_epi16(0xED));
+        if(0 != (lead_e0 | lead_ed)) {
+            out_of_range |= _mm512_mask_cmplt_epu16_mask(lead_e0, next1, _mm512_set1_epi16(0xA0));
+            out_of_range |= _mm512_mask_cmpge_epu16_mask(lead_ed, next1, _mm512_set1_epi16(0xA0));
+        }
+        const __m512i mask_c0 = _mm512_set1_epi16(0xC0);
+        const __m512i value_80 = _mm512_set1_epi16(0x80);
+        uint64_t continuation = _mm512_cmpeq_epi16_mask(_mm512_and_si512(bytes, mask_c0), value_80);
+        continuation |= static_cast<uint64_t>(0x80 == (utf8_string[32] & 0xC0)) << 32;
+        continuation |= static_cast<uint64_t>(0x80 == (utf8_string[33] & 0xC0)) << 33;
+
+        // Leave a character crossing the end of the window to the next step
+        uint32_t consumed = 32;
+        if(lead3 & (1ULL << 30)) {
+            consumed = 30;
+        } else if(lead2 & (1ULL << 31)) {
+            consumed = 31;
+        }
+        const uint64_t range = (1ULL << consumed) - 1;
+        const uint64_t expected = ((lead2 & range) << 1) | ((lead3 & range) << 2);
+        if(0 != ((((expected ^ continuation) | out_of_range) & range) | (expected & ~range))) {
+            return {0, 0};
         }
-        size_t length = codepoint_to_utf16(utf16_units, codepoint);
-        for(size_t i = 0; i < length; ++i) {
-            utf16_string[count++] = utf16_units[i];
+
+        const __m512i low1 = _mm512_and_si512(next1, _mm512_set1_epi16(0x3F));
+        const __m512i low2 = _mm512_and_si512(next2, _mm512_set1_epi16(0x3F));
+        const __m512i two = _mm512_or_si512(_mm512_slli_epi16(_mm512_and_si512(bytes, _mm512_set1_epi16(0x1F)), 6), low1);
+        const __m512i three = _mm512_or_si512(
+            _mm512_slli_epi16(_mm512_and_si512(bytes, _mm512_set1_epi16(0x0F)), 12),
+            _mm512_or_si512(_mm512_slli_epi16(low1, 6), low2));
+        __m512i codepoints = _mm512_mask_blend_epi16(static_cast<__mmask32>(lead2), bytes, two);
+        codepoints = _mm512_mask_blend_epi16(static_cast<__mmask32>(lead3), codepoints, three);
+        const __mmask32 leads = static_cast<__mmask32>(~continuation & range);
+        _mm512_storeu_si512(utf16_string, swap_units<Swap>(_mm512_maskz_compress_epi16(leads, codepoints)));
+        return {consumed, static_cast<size_t>(_mm_popcnt_u32(leads))};
+    }
+
+    // Converts 16 code units with one more readable for a surrogate pair crossing the window, writes at most 64 bytes.
+    // Each code unit is encoded in a 32-bit lane and the bytes actually used are compressed.
+    template<bool Swap>
+    UCONV_TARGET_AVX512 inline Progress utf16_to_utf8_avx512_step(char8_t* utf8_string, const char16_t* utf16_string)
+    {
+        const __m512i units = _mm512_cvtepu16_epi32(swap_units<Swap>(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(utf16_string))));
+        const __m512i next = _mm512_cvtepu16_epi32(swap_units<Swap>(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(utf16_string + 1))));
+        const __m512i surrogate_mask = _mm512_set1_epi32(0xFC00);
+        const uint32_t high = _mm512_cmpeq_epi32_mask(_mm512_and_si512(units, surrogate_mask), _mm512_set1_epi32(0xD800));
+        const uint32_t next_low = _mm512_cmpeq_epi32_mask(_mm512_and_si512(next, surrogate_mask), _mm512_set1_epi32(0xDC00));
+        uint32_t pairs = high & next_low;
+        uint32_t lanes = 0xFFFFU;
+        if(pairs & 0x8000U) {
+            // The pair crosses the window
+            pairs &= 0x7FFFU;
+            lanes = 0x7FFFU;
         }
+        const uint32_t second = pairs << 1;
+        const uint32_t one = _mm512_cmplt_epu32_mask(units, _mm512_set1_epi32(0x80)) & lanes;
+        const uint32_t two = _mm512_cmplt_epu32_mask(units, _mm512_set1_epi32(0x800)) & ~one & lanes;
+        const uint32_t three = lanes & ~(one | two | pairs | second);
+
+        const __m512i byte0 = _mm512_or_si512(_mm512_srli_epi32(units, 12), _mm512_set1_epi32(0xE0));
+        const __m512i byte1 = _mm512_or_si512(
+            _mm512_and_si512(_mm512_slli_epi32(units, 2), _mm512_set1_epi32(0x3F00)),
+            _mm512_mask_blend_epi32(static_cast<__mmask16>(two), _mm512_set1_epi32(0x8000), _mm512_set1_epi32(0xC000)));
+        const __m512i byte2 = _mm512_or_si512(_mm512_slli_epi32(_mm512_and_si512(units, _mm512_set1_epi32(0x3F)), 16), _mm512_set1_epi32(0x800000));
+        const __m512i byte3 = _mm512_slli_epi32(units, 24);
+        __m512i encoded = _mm512_or_si512(_mm512_or_si512(byte0, byte1), _mm512_or_si512(byte2, byte3));
+
+        // 11110aaa 10aabbbb 10bbbbcc 10cccccc
+        const __m512i codepoints = _mm512_sub_epi32(_mm512_add_epi32(_mm512_slli_epi32(units, 10), next), _mm512_set1_epi32(0x35FDC00));
+        const __m512i mask_3f = _mm512_set1_epi32(0x3F);
+        const __m512i four = _mm512_or_si512(
+            _mm512_or_si512(_mm512_srli_epi32(codepoints, 18), _mm512_slli_epi32(_mm512_and_si512(_mm512_srli_epi32(codepoints, 12), mask_3f), 8)),
+            _mm512_or_si512(_mm512_slli_epi32(_mm512_and_si512(_mm512_srli_epi32(codepoints, 6), mask_3f), 16), _mm512_slli_epi32(_mm512_and_si512(codepoints, mask_3f), 24)));
+        encoded = _mm512_mask_blend_epi32(static_cast<__mmask16>(pairs), encoded, _mm512_or_si512(four, _mm512_set1_epi32(static_cast<int>(0x808080F0U))));
+
+        const uint64_t keep = _pdep_u64(one, 0x8888888888888888ULL)
+                              | (_pdep_u64(two, 0x2222222222222222ULL) * 3)
+                              | (_pdep_u64(three, 0x1111111111111111ULL) * 7)
+                              | (_pdep_u64(pairs, 0x1111111111111111ULL) * 15);
+        _mm512_storeu_si512(utf8_string, _mm512_maskz_compress_epi8(keep, encoded));
+        return {static_cast<size_t>(_mm_popcnt_u32(lanes)), static_cast<size_t>(_mm_popcnt_u64(keep))};
     }
-    return count;
+
+    template<bool Swap>
+    UCONV_TARGET_AVX512 Progress utf8_to_utf16_avx512(size_t utf16_length, char16_t* utf16_string, size_t utf8_length, const char8_t* utf8_string)
+    {
+        Progress progress = {0, 0};
+        while(66 <= (utf8_length - progress.read) && 64 <= (utf16_length - progress.written)) {
+            const __m512i bytes = _mm512_loadu_si512(utf8_string + progress.read);
+            const uint64_t non_ascii = _mm512_movepi8_mask(bytes);
+            if(0 == non_ascii) {
+                __m512i* output = reinterpret_cast<__m512i*>(utf16_string + progress.written);
+                _mm512_storeu_si512(output, swap_units<Swap>(_mm512_cvtepu8_epi16(_mm512_castsi512_si256(bytes))));
+                _mm512_storeu_si512(output + 1, swap_units<Swap>(_mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(bytes, 1))));
+                progress.read += 64;
+                progress.written += 64;
+                continue;
+            }
+            Progress step = utf8_to_utf16_avx512_step<Swap>(utf16_string + progress.written, utf8_string + progress.read);
+            if(0 == step.read) {
+                // 4-byte sequences
+                const __m512i errors = utf8_errors_avx512(bytes, _mm512_setzero_si512());
+                const Utf8Block block = {non_ascii, _mm512_cmplt_epi8_mask(bytes, _mm512_set1_epi8(-64)), _mm512_test_epi8_mask(errors, errors)};
+                step = utf8_to_utf16_sse42_block<Swap>(utf16_string + progress.written, utf8_string + progress.read, block);
+                if(0 == step.read) {
+                    break;
+                }
+            }
+            progress.read += step.read;
+            progress.written += step.written;
+        }
+        while(16 <= (utf8_length - progress.read) && 16 <= (utf16_length - progress.written)) {
+            Progress step = utf8_to_utf16_sse42_step<Swap>(utf16_string + progress.written, utf8_string + progress.read);
+            if(0 == step.read) {
+                break;
+            }
+            progress.read += step.read;
+            progress.written += step.written;
+        }
+        return progress;
+    }
+
+    template<bool Swap>
+    UCONV_TARGET_AVX512 Progress utf16_to_utf8_avx512(size_t utf8_length, char8_t* utf8_string, size_t utf16_length, const char16_t* utf16_string)
+    {
+        Progress progress = {0, 0};
+        while(8 <= (utf16_length - progress.read) && 32 <= (utf8_length - progress.written)) {
+            const size_t remaining = utf16_length - progress.read;
+            const size_t space = utf8_length - progress.written;
+            if(32 <= remaining && 32 <= space) {
+                const __m512i units = swap_units<Swap>(_mm512_loadu_si512(utf16_string + progress.read));
+                if(0 == _mm512_test_epi16_mask(units, _mm512_set1_epi16(static_cast<short>(0xFF80)))) {
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(utf8_string + progress.written), _mm512_cvtepi16_epi8(units));
+                    progress.read += 32;
+                    progress.written += 32;
+                    continue;
+                }
+            }
+            Progress step;
+            if(17 <= remaining && 64 <= space) {
+                step = utf16_to_utf8_avx512_step<Swap>(utf8_string + progress.written, utf16_string + progress.read);
+            } else {
+                step = utf16_to_utf8_sse42_step<Swap>(utf8_string + progress.written, utf16_string + progress.read);
+                if(0 == step.read) {
+                    break;
+                }
+            }
+            progress.read += step.read;
+            progress.written += step.written;
+        }
+        return progress;
+    }
+
+    // Length counters, popcounts of the lead byte and 4-byte lead masks for UTF-8 and of
+    // the non-ASCII, 3-byte and surrogate pair masks for UTF-16. The pair mask compares
+    // every unit with the one after it, so the last unit is always left to the scalar code.
+    UCONV_INLINE UCONV_TARGET_SSE42 size_t utf16_length_from_utf8_sse42(size_t utf8_length, const char8_t* utf8_string)
+    {
+        const __m128i continuation = _mm_set1_epi8(static_cast<char>(0xBF));
+        const __m128i four_byte = _mm_set1_epi8(static_cast<char>(0xF0));
+        size_t count = 0;
+        size_t index = 0;
+        for(; 16 <= (utf8_length - index); index += 16) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(utf8_string + index));
+            // Continuation bytes are the signed values up to 0xBF
+            const uint32_t leads = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpgt_epi8(bytes, continuation)));
+            const uint32_t fours = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(bytes, four_byte), bytes)));
+            count += std::popcount(leads) + std::popcount(fours);
+        }
+        return count + count_utf16_from_utf8(utf8_length, utf8_string, index);
+    }
+
+    template<bool Swap>
+    UCONV_TARGET_SSE42 size_t utf8_length_from_utf16_sse42(size_t utf16_length, const char16_t* utf16_string)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i ascii = _mm_set1_epi16(static_cast<short>(0xFF80));
+        const __m128i two_byte = _mm_set1_epi16(static_cast<short>(0xF800));
+        const __m128i surrogate = _mm_set1_epi16(static_cast<short>(0xFC00));
+        const __m128i high = _mm_set1_epi16(static_cast<short>(0xD800));
+        const __m128i low = _mm_set1_epi16(static_cast<short>(0xDC00));
+        size_t count = 0;
+        size_t index = 0;
+        for(; 9 <= (utf16_length - index); index += 8) {
+            const __m128i units = swap_units<Swap>(_mm_loadu_si128(reinterpret_cast<const __m128i*>(utf16_string + index)));
+            const __m128i next = swap_units<Swap>(_mm_loadu_si128(reinterpret_cast<const __m128i*>(utf16_string + index + 1)));
+            // 2 mask bits per unit
+            const uint32_t ones = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(units, ascii), zero)));
+            const uint32_t twos = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(units, two_byte), zero)));
+            const __m128i pairs = _mm_and_si128(_mm_cmpeq_epi16(_mm_and_si128(units, surrogate), high), _mm_cmpeq_epi16(_mm_and_si128(next, surrogate), low));
+            count += 24 - ((std::popcount(ones) + std::popcount(twos)) >> 1) - std::popcount(static_cast<uint32_t>(_mm_movemask_epi8(pairs)));
+        }
+        return count + count_utf8_from_utf16<Swap>(utf16_length, utf16_string, index);
+    }
+
+    UCONV_INLINE UCONV_TARGET_AVX2 size_t utf16_length_from_utf8_avx2(size_t utf8_length, const char8_t* utf8_string)
+    {
+        const __m256i continuation = _mm256_set1_epi8(static_cast<char>(0xBF));
+        const __m256i four_byte = _mm256_set1_epi8(static_cast<char>(0xF0));
+        size_t count = 0;
+        size_t index = 0;
+        for(; 32 <= (utf8_length - index); index += 32) {
+            const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(utf8_string + index));
+            const uint32_t leads = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(bytes, continuation)));
+            const uint32_t fours = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_max_epu8(bytes, four_byte), bytes)));
+            count += std::popcount(leads) + std::popcount(fours);
+        }
+        return count + count_utf16_from_utf8(utf8_length, utf8_string, index);
+    }
+
+    template<bool Swap>
+    UCONV_TARGET_AVX2 size_t utf8_length_from_utf16_avx2(size_t utf16_length, const char16_t* utf16_string)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i ascii = _mm256_set1_epi16(static_cast<short>(0xFF80));
+        const __m256i two_byte = _mm256_set1_epi16(static_cast<short>(0xF800));
+        const __m256i surrogate = _mm256_set1_epi16(static_cast<short>(0xFC00));
+        const __m256i high = _mm256_set1_epi16(static_cast<short>(0xD800));
+        const __m256i low = _mm256_set1_epi16(static_cast<short>(0xDC00));
+        size_t count = 0;
+        size_t index = 0;
+        for(; 17 <= (utf16_length - index); index += 16) {
+            const __m256i units = swap_units<Swap>(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(utf16_string + index)));
+            const __m256i next = swap_units<Swap>(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(utf16_string + index + 1)));
+            const uint32_t ones = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_and_si256(units, ascii), zero)));
+            const uint32_t twos = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_and_si256(units, two_byte), zero)));
+            const __m256i pairs =
+                _mm256_and_si256(_mm256_cmpeq_epi16(_mm256_and_si256(units, surrogate), high), _mm256_cmpeq_epi16(_mm256_and_si256(next, surrogate), low));
+            count += 48 - ((std::popcount(ones) + std::popcount(twos)) >> 1) - std::popcount(static_cast<uint32_t>(_mm256_movemask_epi8(pairs)));
+        }
+        return count + count_utf8_from_utf16<Swap>(utf16_length, utf16_string, index);
+    }
+
+    UCONV_INLINE UCONV_TARGET_AVX512 size_t utf16_length_from_utf8_avx512(size_t utf8_length, const char8_t* utf8_string)
+    {
+        const __m512i continuation = _mm512_set1_epi8(static_cast<char>(0xBF));
+        const __m512i four_byte = _mm512_set1_epi8(static_cast<char>(0xF0));
+        size_t count = 0;
+        size_t index = 0;
+        for(; 64 <= (utf8_length - index); index += 64) {
+            const __m512i bytes = _mm512_loadu_si512(utf8_string + index);
+            count += std::popcount(_mm512_cmpgt_epi8_mask(bytes, continuation)) + std::popcount(_mm512_cmpge_epu8_mask(bytes, four_byte));
+        }
+        return count + count_utf16_from_utf8(utf8_length, utf8_string, index);
+    }
+
+    template<bool Swap>
+    UCONV_TARGET_AVX512 size_t utf8_length_from_utf16_avx512(size_t utf16_length, const char16_t* utf16_string)
+    {
+        const __m512i ascii = _mm512_set1_epi16(0x80);
+        const __m512i two_byte = _mm512_set1_epi16(0x800);
+        const __m512i surrogate = _mm512_set1_epi16(static_cast<short>(0xFC00));
+        const __m512i high = _mm512_set1_epi16(static_cast<short>(0xD800));
+        const __m512i low = _mm512_set1_epi16(static_cast<short>(0xDC00));
+        size_t count = 0;
+        size_t index = 0;
+        for(; 33 <= (utf16_length - index); index += 32) {
+            const __m512i units = swap_units<Swap>(_mm512_loadu_si512(utf16_string + index));
+            const __m512i next = swap_units<Swap>(_mm512_loadu_si512(utf16_string + index + 1));
+            const __mmask32 highs = _mm512_cmpeq_epi16_mask(_mm512_and_si512(units, surrogate), high);
+            const __mmask32 pairs = _mm512_mask_cmpeq_epi16_mask(highs, _mm512_and_si512(next, surrogate), low);
+            count += 96 - std::popcount(_mm512_cmplt_epu16_mask(units, ascii)) - std::popcount(_mm512_cmplt_epu16_mask(units, two_byte)) - 2 * std::popcount(pairs);
+        }
+        return count + count_utf8_from_utf16<Swap>(utf16_length, utf16_string, index);
+    }
+
+    // Length counters of the UTF-32 and Latin-1 conversions, the UTF-32 ones compare unsigned
+    // with max and min because code points above U+7FFFFFFF are negative as signed lanes
+    UCONV_INLINE UCONV_TARGET_SSE42 size_t utf32_length_from_utf8_sse42(size_t utf8_length, const char8_t* utf8_string)
+    {
+        const __m128i continuation = _mm_set1_epi8(static_cast<char>(0xBF));
+        size_t count = 0;
+        size_t index = 0;
+        for(; 16 <= (utf8_length - index); index += 16) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(utf8_string + index));
+            count += std::popcount(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpgt_epi8(bytes, continuation))));
+        }
+        return count + count_utf32_from_utf8(utf8_length, utf8_string, index);
+    }
+
+    UCONV_INLINE UCONV_TARGET_SSE42 size_t utf8_length_from_latin1_sse42(size_t latin1_length, const char* latin1_string)
+    {
+        size_t count = 0;
+        size_t index = 0;
+        for(; 16 <= (latin1_length - index); index += 16) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(latin1_string + index));
+            count += 16 + std::popcount(static_cast<uint32_t>(_mm_movemask_epi8(bytes)));
+        }
+        return count + count_utf8_from_latin1(latin1_length, latin1_string, index);
+    }
+
+    UCONV_INLINE UCONV_TARGET_SSE42 size_t utf32_length_from_utf16_sse42(size_t utf16_length, const char16_t* utf16_string)
+    {
+        const __m128i surrogate = _mm_set1_epi16(static_cast<short>(0xFC00));
+        const __m128i high = _mm_set1_epi16(static_cast<short>(0xD800));
+        const __m128i low = _mm_set1_epi16(static_cast<short>(0xDC00));
+        size_t count = 0;
+        size_t index = 0;
+        for(; 9 <= (utf16_length - index); index += 8) {
+            const __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i*>(utf16_string + index));
+            const __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(utf16_string + index + 1));
+            const __m128i pairs = _mm_and_si128(_mm_cmpeq_epi16(_mm_and_si128(units, surrogate), high), _mm_cmpeq_epi16(_mm_and_si128(next, surrogate), low));
+            count += 8 - (std::popcount(static_cast<uint32_t>(_mm_movemask_epi8(pairs))) >> 1);
+        }
+        return count + count_utf32_from_utf16(utf16_length, utf16_string, index);
+    }
+
+    UCONV_TARGET_SSE42 UCONV_FORCE_INLINE uint32_t supplementary_mask(__m128i codepoints)
+    {
+        const __m128i offset = _mm_sub_epi32(codepoints, _mm_set1_epi32(0x10000));
+        return static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_min_epu32(offset, _mm_set1_epi32(0xFFFFF)), offset))));
+    }
+
+    UCONV_INLINE UCONV_TARGET_SSE42 size_t utf8_length_from_utf32_sse42(size_t utf32_length, const char32_t* utf32_string)
+    {
+        const __m128i ascii = _mm_set1_epi32(0x80);
+        const __m128i two_byte = _mm_set1_epi32(0x800);
+        size_t count = 0;
+        size_t index = 0;
+        for(; 4 <= (utf32_length - index); index += 4) {
+            const __m128i codepoints = _mm_loadu_si128(reinterpret_cast<const __m128i*>(utf32_string + index));
+            const uint32_t twos = static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_max_epu32(codepoints, ascii), codepoints))));
+            const uint32_t threes = static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_max_epu32(codepoints, two_byte), codepoints))));
+            count += 4 + std::popcount(twos) + std::popcount(threes) + std::popcount(supplementary_mask(codepoints));
+        }
+        return count + count_utf8_from_utf32(utf32_length, utf32_string, index);
+    }
+
+    UCONV_INLINE UCONV_TARGET_SSE42 size_t utf16_length_from_utf32_sse42(size_t utf32_length, const char32_t* utf32_string)
+    {
+        size_t count = 0;
+        size_t index = 0;
+        for(; 4 <= (utf32_length - index); index += 4) {
+            const __m128i codepoints = _mm_loadu_si128(reinterpret_cast<const __m128i*>(utf32_string + index));
+            count += 4 + std::popcount(supplementary_mask(codepoints));
+        }
+        return count + count_utf16_from_utf32(utf32_length, utf32_string, index);
+    }
+
+    UCONV_INLINE UCONV_TARGET_AVX2 size_t utf32_length_from_utf8_avx2(size_t utf8_length, const char8_t* utf8_string)
+    {
+        const __m256i continuation = _mm256_set1_epi8(static_cast<char>(0xBF));
+        size_t count = 0;
+        size_t index = 0;
+        for(; 32 <= (utf8_length - index); index += 32) {
+            const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(utf8_string + index));
+            count += std::popcount(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(bytes, continuation))));
+        }
+        return count + count_utf32_from_utf8(utf8_length, utf8_string, index);
+    }
+
+    UCONV_INLINE UCONV_TARGET_AVX2 size_t utf8_length_from_latin1_avx2(size_t latin1_length, const char* latin1_string)
+    {
+        size_t count = 0;
+        size_t index = 0;
+        for(; 32 <= (latin1_length - index); index += 32) {
+            const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(latin1_string + index));
+            count += 32 + std::popcount(static_cast<uint32_t>(_mm256_movemask_epi8(bytes)));
+        }
+        return count + count_utf8_from_latin1(latin1_length, latin1_string, index);
+    }
+
+    UCONV_INLINE UCONV_TARGET_AVX2 size_t utf32_length_from_utf16_avx2(size_t utf16_length, const char16_t* utf16_string)
+    {
+        const __m256i surrogate = _mm256_set1_epi16(static_cast<short>(0xFC00));
+        const __m256i high = _mm256_set1_epi16(static_cast<short>(0xD800));
+        const __m256i low = _mm256_set1_epi16(static_cast<short>(0xDC00));
+        size_t count = 0;
+        size_t index = 0;
+        for(; 17 <= (utf16_length - index); index += 16) {
+            const __m256i units = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(utf16_string + index));
+            const __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(utf16_string + index + 1));
+            const __m256i pairs =
+                _mm256_and_si256(_mm256_cmpeq_epi16(_mm256_and_si256(units, surrogate), high), _mm256_cmpeq_epi16(_mm256_and_si256(next, surrogate), low));
+            count += 16 - (std::popcount(static_cast<uint32_t>(_mm256_movemask_epi8(pairs))) >> 1);
+        }
+        return count + count_utf32_from_utf16(utf16_length, utf16_string, index);
+    }
+
+    UCONV_TARGET_AVX2 UCONV_FORCE_INLINE uint32_t supplementary_mask(__m256i codepoints)
+    {
+        const __m256i offset = _mm256_sub_epi32(codepoints, _mm256_set1_epi32(0x10000));
+        return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_min_epu32(offset, _mm256_set1_epi32(0xFFFFF)), offset))));
+    }
+
+    UCONV_INLINE UCONV_TARGET_AVX2 size_t utf8_length_from_utf32_avx2(size_t utf32_length, const char32_t* utf32_string)
+    {
+        const __m256i ascii = _mm256_set1_epi32(0x80);
+        const __m256i two_byte = _mm256_set1_epi32(0x800);
+        size_t count = 0;
+        size_t index = 0;
+        for(; 8 <= (utf32_length - index); index += 8) {
+            const __m256i codepoints = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(utf32_string + index));
+            const uint32_t twos =
+                static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_max_epu32(codepoints, ascii), codepoints))));
+            const uint32_t threes =
+                static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_max_epu32(codepoints, two_byte), codepoints))));
+            count += 8 + std::popcount(twos) + std::popcount(threes) + std::popcount(supplementary_mask(codepoints));
+        }
+        return count + count_utf8_from_utf32(utf32_length, utf32_string, index);
+    }
+
+    UCONV_INLINE UCONV_TARGET_AVX2 size_t utf16_length_from_utf32_avx2(size_t utf32_length, const char32_t* utf32_string)
+    {
+        size_t count = 0;
+        size_t index = 0;
+        for(; 8 <= (utf32_length - index); index += 8) {
+            const __m256i codepoints = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(utf32_string + index));
+            count += 8 + std::popcount(supplementary_mask(codepoints));
+        }
+        return count + count_utf16_from_utf32(utf32_length, utf32_string, index);
+    }
+
+    UCONV_INLINE UCONV_TARGET_AVX512 size_t utf32_length_from_utf8_avx512(size_t utf8_length, const char8_t* utf8_string)
+    {
+        const __m512i continuation = _mm512_set1_epi8(static_cast<char>(0xBF));
+        size_t count = 0;
+        size_t index = 0;
+        for(; 64 <= (utf8_length - index); index += 64) {
+            count += std::popcount(_mm512_cmpgt_epi8_mask(_mm512_loadu_si512(utf8_string + index), continuation));
+        }
+        return count + count_utf32_from_utf8(utf8_length, utf8_string, index);
+    }
+
+    UCONV_INLINE UCONV_TARGET_AVX512 size_t utf8_length_from_latin1_avx512(size_t latin1_length, const char* latin1_string)
+    {
+        size_t count = 0;
+        size_t index = 0;
+        for(; 64 <= (latin1_length - index); index += 64) {
+            count += 64 + std::popcount(_mm512_movepi8_mask(_mm512_loadu_si512(latin1_string + index)));
+        }
+        return count + count_utf8_from_latin1(latin1_length, latin1_string, index);
+    }
+
+    UCONV_INLINE UCONV_TARGET_AVX512 size_t utf32_length_from_utf16_avx512(size_t utf16_length, const char16_t* utf16_string)
+    {
+        const __m512i surrogate = _mm512_set1_epi16(static_cast<short>(0xFC00));
+        const __m512i high = _mm512_set1_epi16(static_cast<short>(0xD800));
+        const __m512i low = _mm512_set1_epi16(static_cast<short>(0xDC00));
+        size_t count = 0;
+        size_t index = 0;
+        for(; 33 <= (utf16_length - index); index += 32) {
+            const __m512i units = _mm512_loadu_si512(utf16_string + index);
+            const __m512i next = _mm512_loadu_si512(utf16_string + index + 1);
+            const __mmask32 highs = _mm512_cmpeq_epi16_mask(_mm512_and_si512(units, surrogate), high);
+            count += 32 - std::popcount(_mm512_mask_cmpeq_epi16_mask(highs, _mm512_and_si512(next, surrogate), low));
+        }
+        return count + count_utf32_from_utf16(utf16_length, utf16_string, index);
+    }
+
+    UCONV_INLINE UCONV_TARGET_AVX512 size_t utf8_length_from_utf32_avx512(size_t utf32_length, const char32_t* utf32_string)
+    {
+        const __m512i ascii = _mm512_set1_epi32(0x80);
+        const __m512i two_byte = _mm512_set1_epi32(0x800);
+        const __m512i supplementary = _mm512_set1_epi32(0x10000);
+        const __m512i planes = _mm512_set1_epi32(0x100000);
+        size_t count = 0;
+        size_t index = 0;
+        for(; 16 <= (utf32_length - index); index += 16) {
+            const __m512i codepoints = _mm512_loadu_si512(utf32_string + index);
+            count += 16 + std::popcount(_mm512_cmpge_epu32_mask(codepoints, ascii)) + std::popcount(_mm512_cmpge_epu32_mask(codepoints, two_byte)) +
+                     std::popcount(_mm512_cmplt_epu32_mask(_mm512_sub_epi32(codepoints, supplementary), planes));
+        }
+        return count + count_utf8_from_utf32(utf32_length, utf32_string, index);
+    }
+
+    UCONV_INLINE UCONV_TARGET_AVX512 size_t utf16_length_from_utf32_avx512(size_t utf32_length, const char32_t* utf32_string)
+    {
+        const __m512i supplementary = _mm512_set1_epi32(0x10000);
+        const __m512i planes = _mm512_set1_epi32(0x100000);
+        size_t count = 0;
+        size_t index = 0;
+        for(; 16 <= (utf32_length - index); index += 16) {
+            const __m512i codepoints = _mm512_loadu_si512(utf32_string + index);
+            count += 16 + std::popcount(_mm512_cmplt_epu32_mask(_mm512_sub_epi32(codepoints, supplementary), planes));
+        }
+        return count + count_utf16_from_utf32(utf32_length, utf32_string, index);
+    }
+
+    // Validators, a block with an error is validated again by the scalar code from the
+    // last code point boundary before it to find the exact offset
+    UCONV_INLINE UCONV_TARGET_SSE42 size_t validate_utf8_sse42(size_t utf8_length, const char8_t* utf8_string)
+    {
+        __m128i previous = _mm_setzero_si128();
+        size_t index = 0;
+        for(; 64 <= (utf8_length - index); index += 64) {
+            __m128i bytes[4];
+            for(size_t i = 0; i < 4; ++i) {
+                bytes[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(utf8_string + index + i * 16));
+            }
+            const __m128i any = _mm_or_si128(_mm_or_si128(bytes[0], bytes[1]), _mm_or_si128(bytes[2], bytes[3]));
+            __m128i errors;
+            if(0 == _mm_movemask_epi8(any)) {
+                // An ASCII block is only in error if the previous one ended inside a sequence
+                errors = _mm_subs_epu8(previous, _mm_load_si128(reinterpret_cast<const __m128i*>(utf8_incomplete_limits)));
+            } else {
+                errors = _mm_or_si128(_mm_or_si128(utf8_errors_sse42(bytes[0], previous), utf8_errors_sse42(bytes[1], bytes[0])),
+                                      _mm_or_si128(utf8_errors_sse42(bytes[2], bytes[1]), utf8_errors_sse42(bytes[3], bytes[2])));
+            }
+            if(!_mm_testz_si128(errors, errors)) {
+                break;
+            }
+            previous = bytes[3];
+        }
+        return find_utf8_error(utf8_length, utf8_string, utf8_boundary(utf8_string, index));
+    }
+
+    UCONV_INLINE UCONV_TARGET_SSE42 size_t validate_utf16_sse42(size_t utf16_length, const char16_t* utf16_string)
+    {
+        const __m128i surrogate_bits = _mm_set1_epi16(static_cast<short>(0xF800));
+        const __m128i pair_bits = _mm_set1_epi16(static_cast<short>(0xFC00));
+        const __m128i high = _mm_set1_epi16(static_cast<short>(0xD800));
+        const __m128i low = _mm_set1_epi16(static_cast<short>(0xDC00));
+        // 1 if the previous block ended with a high surrogate
+        uint32_t carry = 0;
+        size_t index = 0;
+        for(; 16 <= (utf16_length - index); index += 16) {
+            const __m128i units0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(utf16_string + index));
+            const __m128i units1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(utf16_string + index + 8));
+            const __m128i surrogates = _mm_or_si128(_mm_cmpeq_epi16(_mm_and_si128(units0, surrogate_bits), high),
+                                                    _mm_cmpeq_epi16(_mm_and_si128(units1, surrogate_bits), high));
+            if(0 == carry && _mm_testz_si128(surrogates, surrogates)) {
+                continue;
+            }
+            // Every low surrogate must follow a high surrogate and the other way around
+            const uint32_t highs = static_cast<uint32_t>(_mm_movemask_epi8(
+                _mm_packs_epi16(_mm_cmpeq_epi16(_mm_and_si128(units0, pair_bits), high), _mm_cmpeq_epi16(_mm_and_si128(units1, pair_bits), high))));
+            const uint32_t lows = static_cast<uint32_t>(_mm_movemask_epi8(
+                _mm_packs_epi16(_mm_cmpeq_epi16(_mm_and_si128(units0, pair_bits), low), _mm_cmpeq_epi16(_mm_and_si128(units1, pair_bits), low))));
+            if((((highs << 1) | carry) & 0xFFFFU) != lows) {
+                break;
+            }
+            carry = highs >> 15;
+        }
+        return find_utf16_error(utf16_length, utf16_string, index - carry);
+    }
+
+    UCONV_INLINE UCONV_TARGET_AVX2 size_t validate_utf8_avx2(size_t utf8_length, const char8_t* utf8_string)
+    {
+        __m256i previous = _mm256_setzero_si256();
+        size_t index = 0;
+        for(; 64 <= (utf8_length - index); index += 64) {
+            const __m256i bytes0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(utf8_string + index));
+            const __m256i bytes1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(utf8_string + index + 32));
+            bool valid;
+            if(0 == _mm256_movemask_epi8(_mm256_or_si256(bytes0, bytes1))) {
+                const __m128i incomplete =
+                    _mm_subs_epu8(_mm256_extracti128_si256(previous, 1), _mm_load_si128(reinterpret_cast<const __m128i*>(utf8_incomplete_limits)));
+                valid = _mm_testz_si128(incomplete, incomplete);
+            } else {
+                const __m256i errors = _mm256_or_si256(utf8_errors_avx2(bytes0, previous), utf8_errors_avx2(bytes1, bytes0));
+                valid = _mm256_testz_si256(errors, errors);
+            }
+            if(!valid) {
+                break;
+            }
+            previous = bytes1;
+        }
+        return find_utf8_error(utf8_length, utf8_string, utf8_boundary(utf8_string, index));
+    }
+
+    UCONV_INLINE UCONV_TARGET_AVX2 size_t validate_utf16_avx2(size_t utf16_length, const char16_t* utf16_string)
+    {
+        const __m256i surrogate_bits = _mm256_set1_epi16(static_cast<short>(0xF800));
+        const __m256i pair_bits = _mm256_set1_epi16(static_cast<short>(0xFC00));
+        const __m256i high = _mm256_set1_epi16(static_cast<short>(0xD800));
+        const __m256i low = _mm256_set1_epi16(static_cast<short>(0xDC00));
+        uint64_t carry = 0;
+        size_t index = 0;
+        for(; 32 <= (utf16_length - index); index += 32) {
+            const __m256i units0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(utf16_string + index));
+            const __m256i units1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(utf16_string + index + 16));
+            const __m256i surrogates = _mm256_or_si256(_mm256_cmpeq_epi16(_mm256_and_si256(units0, surrogate_bits), high),
+                                                       _mm256_cmpeq_epi16(_mm256_and_si256(units1, surrogate_bits), high));
+            if(0 == carry && _mm256_testz_si256(surrogates, surrogates)) {
+                continue;
+            }
+            // The packs interleave the 128-bit lanes, the permute restores the unit order
+            const __m256i highs_packed = _mm256_packs_epi16(_mm256_cmpeq_epi16(_mm256_and_si256(units0, pair_bits), high),
+                                                            _mm256_cmpeq_epi16(_mm256_and_si256(units1, pair_bits), high));
+            const __m256i lows_packed = _mm256_packs_epi16(_mm256_cmpeq_epi16(_mm256_and_si256(units0, pair_bits), low),
+                                                           _mm256_cmpeq_epi16(_mm256_and_si256(units1, pair_bits), low));
+            const uint64_t highs = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_permute4x64_epi64(highs_packed, 0xD8)));
+            const uint64_t lows = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_permute4x64_epi64(lows_packed, 0xD8)));
+            if((((highs << 1) | carry) & 0xFFFFFFFFU) != lows) {
+                break;
+            }
+            carry = highs >> 31;
+        }
+        return find_utf16_error(utf16_length, utf16_string, index - carry);
+    }
+
+    UCONV_INLINE UCONV_TARGET_AVX512 size_t validate_utf8_avx512(size_t utf8_length, const char8_t* utf8_string)
+    {
+        __m512i previous = _mm512_setzero_si512();
+        size_t index = 0;
+        for(; 64 <= (utf8_length - index); index += 64) {
+            const __m512i bytes = _mm512_loadu_si512(utf8_string + index);
+            bool valid;
+            if(0 == _mm512_movepi8_mask(bytes)) {
+                const __m128i incomplete =
+                    _mm_subs_epu8(_mm512_extracti32x4_epi32(previous, 3), _mm_load_si128(reinterpret_cast<const __m128i*>(utf8_incomplete_limits)));
+                valid = _mm_testz_si128(incomplete, incomplete);
+            } else {
+                const __m512i errors = utf8_errors_avx512(bytes, previous);
+                valid = (0 == _mm512_test_epi8_mask(errors, errors));
+            }
+            if(!valid) {
+                break;
+            }
+            previous = bytes;
+        }
+        return find_utf8_error(utf8_length, utf8_string, utf8_boundary(utf8_string, index));
+    }
+
+    UCONV_INLINE UCONV_TARGET_AVX512 size_t validate_utf16_avx512(size_t utf16_length, const char16_t* utf16_string)
+    {
+        const __m512i surrogate_bits = _mm512_set1_epi16(static_cast<short>(0xF800));
+        const __m512i pair_bits = _mm512_set1_epi16(static_cast<short>(0xFC00));
+        const __m512i high = _mm512_set1_epi16(static_cast<short>(0xD800));
+        const __m512i low = _mm512_set1_epi16(static_cast<short>(0xDC00));
+        uint64_t carry = 0;
+        size_t index = 0;
+        for(; 32 <= (utf16_length - index); index += 32) {
+            const __m512i units = _mm512_loadu_si512(utf16_string + index);
+            if(0 == carry && 0 == _mm512_cmpeq_epi16_mask(_mm512_and_si512(units, surrogate_bits), high)) {
+                continue;
+            }
+            const __m512i pairs = _mm512_and_si512(units, pair_bits);
+            const uint64_t highs = _mm512_cmpeq_epi16_mask(pairs, high);
+            const uint64_t lows = _mm512_cmpeq_epi16_mask(pairs, low);
+            if((((highs << 1) | carry) & 0xFFFFFFFFU) != lows) {
+                break;
+            }
+            carry = highs >> 31;
+        }
+        return find_utf16_error(utf16_length, utf16_string, index - carry);
+    }
+
+    //--------------------------------------------------------------------------
+    // Unit kernels, a block of 16, 32 or 64 code units at a time. Every block is
+    // checked against the range before it is converted, so the saturating packs only
+    // ever see values that fit.
+
+    template<class From, UnitRange Range>
+    UCONV_TARGET_SSE42 UCONV_FORCE_INLINE bool in_range_sse42(const __m128i units[sizeof(From)])
+    {
+        if constexpr(UnitRange::any == Range) {
+            return true;
+        } else if constexpr(1 == sizeof(From)) {
+            static_assert(UnitRange::ascii == Range);
+            return 0 == _mm_movemask_epi8(units[0]);
+        } else if constexpr(2 == sizeof(From) && UnitRange::bmp == Range) {
+            const __m128i pair_bits = _mm_set1_epi16(static_cast<int16_t>(0xF800));
+            const __m128i surrogate = _mm_set1_epi16(static_cast<int16_t>(0xD800));
+            const __m128i surrogates = _mm_or_si128(_mm_cmpeq_epi16(_mm_and_si128(units[0], pair_bits), surrogate),
+                                                    _mm_cmpeq_epi16(_mm_and_si128(units[1], pair_bits), surrogate));
+            return _mm_testz_si128(surrogates, surrogates);
+        } else if constexpr(2 == sizeof(From)) {
+            const __m128i above = _mm_set1_epi16(static_cast<int16_t>(UnitRange::ascii == Range ? 0xFF80 : 0xFF00));
+            return _mm_testz_si128(_mm_or_si128(units[0], units[1]), above);
+        } else if constexpr(UnitRange::bmp == Range) {
+            const __m128i pair_bits = _mm_set1_epi32(static_cast<int32_t>(0xFFFFF800));
+            const __m128i surrogate = _mm_set1_epi32(0xD800);
+            __m128i invalid = _mm_setzero_si128();
+            __m128i any = _mm_setzero_si128();
+            for(size_t i = 0; i < 4; ++i) {
+                invalid = _mm_or_si128(invalid, _mm_cmpeq_epi32(_mm_and_si128(units[i], pair_bits), surrogate));
+                any = _mm_or_si128(any, units[i]);
+            }
+            return _mm_testz_si128(invalid, invalid) && _mm_testz_si128(any, _mm_set1_epi32(static_cast<int32_t>(0xFFFF0000)));
+        } else {
+            const __m128i above = _mm_set1_epi32(static_cast<int32_t>(UnitRange::ascii == Range ? 0xFFFFFF80 : 0xFFFFFF00));
+            return _mm_testz_si128(_mm_or_si128(_mm_or_si128(units[0], units[1]), _mm_or_si128(units[2], units[3])), above);
+        }
+    }
+
+    template<class From, class To>
+    UCONV_TARGET_SSE42 UCONV_FORCE_INLINE void store_units_sse42(To* output, const __m128i units[sizeof(From)])
+    {
+        __m128i* out = reinterpret_cast<__m128i*>(output);
+        if constexpr(sizeof(From) == sizeof(To)) {
+            _mm_storeu_si128(out, units[0]);
+        } else if constexpr(1 == sizeof(From) && 2 == sizeof(To)) {
+            _mm_storeu_si128(out, _mm_cvtepu8_epi16(units[0]));
+            _mm_storeu_si128(out + 1, _mm_cvtepu8_epi16(_mm_srli_si128(units[0], 8)));
+        } else if constexpr(1 == sizeof(From)) {
+            _mm_storeu_si128(out, _mm_cvtepu8_epi32(units[0]));
+            _mm_storeu_si128(out + 1, _mm_cvtepu8_epi32(_mm_srli_si128(units[0], 4)));
+            _mm_storeu_si128(out + 2, _mm_cvtepu8_epi32(_mm_srli_si128(units[0], 8)));
+            _mm_storeu_si128(out + 3, _mm_cvtepu8_epi32(_mm_srli_si128(units[0], 12)));
+        } else if constexpr(2 == sizeof(From) && 1 == sizeof(To)) {
+            _mm_storeu_si128(out, _mm_packus_epi16(units[0], units[1]));
+        } else if constexpr(2 == sizeof(From)) {
+            _mm_storeu_si128(out, _mm_cvtepu16_epi32(units[0]));
+            _mm_storeu_si128(out + 1, _mm_cvtepu16_epi32(_mm_srli_si128(units[0], 8)));
+            _mm_storeu_si128(out + 2, _mm_cvtepu16_epi32(units[1]));
+            _mm_storeu_si128(out + 3, _mm_cvtepu16_epi32(_mm_srli_si128(units[1], 8)));
+        } else if constexpr(1 == sizeof(To)) {
+            _mm_storeu_si128(out, _mm_packus_epi16(_mm_packus_epi32(units[0], units[1]), _mm_packus_epi32(units[2], units[3])));
+        } else {
+            _mm_storeu_si128(out, _mm_packus_epi32(units[0], units[1]));
+            _mm_storeu_si128(out + 1, _mm_packus_epi32(units[2], units[3]));
+        }
+    }
+
+    template<class From, class To, UnitRange Range>
+    UCONV_TARGET_SSE42 Progress convert_units_sse42(size_t output_length, To* output, size_t input_length, const From* input)
+    {
+        size_t index = 0;
+        const size_t length = std::min(output_length, input_length);
+        for(; 16 <= (length - index); index += 16) {
+            __m128i units[sizeof(From)];
+            for(size_t i = 0; i < sizeof(From); ++i) {
+                units[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + index) + i);
+            }
+            if(!in_range_sse42<From, Range>(units)) {
+                break;
+            }
+            store_units_sse42<From, To>(output + index, units);
+        }
+        return {index, index};
+    }
+
+    template<class From, UnitRange Range>
+    UCONV_TARGET_AVX2 UCONV_FORCE_INLINE bool in_range_avx2(const __m256i units[sizeof(From)])
+    {
+        if constexpr(UnitRange::any == Range) {
+            return true;
+        } else if constexpr(1 == sizeof(From)) {
+            static_assert(UnitRange::ascii == Range);
+            return 0 == _mm256_movemask_epi8(units[0]);
+        } else if constexpr(2 == sizeof(From) && UnitRange::bmp == Range) {
+            const __m256i pair_bits = _mm256_set1_epi16(static_cast<int16_t>(0xF800));
+            const __m256i surrogate = _mm256_set1_epi16(static_cast<int16_t>(0xD800));
+            const __m256i surrogates = _mm256_or_si256(_mm256_cmpeq_epi16(_mm256_and_si256(units[0], pair_bits), surrogate),
+                                                       _mm256_cmpeq_epi16(_mm256_and_si256(units[1], pair_bits), surrogate));
+            return _mm256_testz_si256(surrogates, surrogates);
+        } else if constexpr(2 == sizeof(From)) {
+            const __m256i above = _mm256_set1_epi16(static_cast<int16_t>(UnitRange::ascii == Range ? 0xFF80 : 0xFF00));
+            return _mm256_testz_si256(_mm256_or_si256(units[0], units[1]), above);
+        } else if constexpr(UnitRange::bmp == Range) {
+            const __m256i pair_bits = _mm256_set1_epi32(static_cast<int32_t>(0xFFFFF800));
+            const __m256i surrogate = _mm256_set1_epi32(0xD800);
+            __m256i invalid = _mm256_setzero_si256();
+            __m256i any = _mm256_setzero_si256();
+            for(size_t i = 0; i < 4; ++i) {
+                invalid = _mm256_or_si256(invalid, _mm256_cmpeq_epi32(_mm256_and_si256(units[i], pair_bits), surrogate));
+                any = _mm256_or_si256(any, units[i]);
+            }
+            return _mm256_testz_si256(invalid, invalid) && _mm256_testz_si256(any, _mm256_set1_epi32(static_cast<int32_t>(0xFFFF0000)));
+        } else {
+            const __m256i above = _mm256_set1_epi32(static_cast<int32_t>(UnitRange::ascii == Range ? 0xFFFFFF80 : 0xFFFFFF00));
+            return _mm256_testz_si256(_mm256_or_si256(_mm256_or_si256(units[0], units[1]), _mm256_or_si256(units[2], units[3])), above);
+        }
+    }
+
+    // The packs work within 128-bit lanes, the permutes restore the order across them
+    template<class From, class To>
+    UCONV_TARGET_AVX2 UCONV_FORCE_INLINE void store_units_avx2(To* output, const __m256i units[sizeof(From)])
+    {
+        __m256i* out = reinterpret_cast<__m256i*>(output);
+        if constexpr(sizeof(From) == sizeof(To)) {
+            _mm256_storeu_si256(out, units[0]);
+        } else if constexpr(1 == sizeof(From) && 2 == sizeof(To)) {
+            _mm256_storeu_si256(out, _mm256_cvtepu8_epi16(_mm256_castsi256_si128(units[0])));
+            _mm256_storeu_si256(out + 1, _mm256_cvtepu8_epi16(_mm256_extracti128_si256(units[0], 1)));
+        } else if constexpr(1 == sizeof(From)) {
+            const __m128i low = _mm256_castsi256_si128(units[0]);
+            const __m128i high = _mm256_extracti128_si256(units[0], 1);
+            _mm256_storeu_si256(out, _mm256_cvtepu8_epi32(low));
+            _mm256_storeu_si256(out + 1, _mm256_cvtepu8_epi32(_mm_srli_si128(low, 8)));
+            _mm256_storeu_si256(out + 2, _mm256_cvtepu8_epi32(high));
+            _mm256_storeu_si256(out + 3, _mm256_cvtepu8_epi32(_mm_srli_si128(high, 8)));
+        } else if constexpr(2 == sizeof(From) && 1 == sizeof(To)) {
+            _mm256_storeu_si256(out, _mm256_permute4x64_epi64(_mm256_packus_epi16(units[0], units[1]), 0xD8));
+        } else if constexpr(2 == sizeof(From)) {
+            _mm256_storeu_si256(out, _mm256_cvtepu16_epi32(_mm256_castsi256_si128(units[0])));
+            _mm256_storeu_si256(out + 1, _mm256_cvtepu16_epi32(_mm256_extracti128_si256(units[0], 1)));
+            _mm256_storeu_si256(out + 2, _mm256_cvtepu16_epi32(_mm256_castsi256_si128(units[1])));
+            _mm256_storeu_si256(out + 3, _mm256_cvtepu16_epi32(_mm256_extracti128_si256(units[1], 1)));
+        } else if constexpr(1 == sizeof(To)) {
+            const __m256i packed = _mm256_packus_epi16(_mm256_packus_epi32(units[0], units[1]), _mm256_packus_epi32(units[2], units[3]));
+            _mm256_storeu_si256(out, _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7)));
+        } else {
+            _mm256_storeu_si256(out, _mm256_permute4x64_epi64(_mm256_packus_epi32(units[0], units[1]), 0xD8));
+            _mm256_storeu_si256(out + 1, _mm256_permute4x64_epi64(_mm256_packus_epi32(units[2], units[3]), 0xD8));
+        }
+    }
+
+    template<class From, class To, UnitRange Range>
+    UCONV_TARGET_AVX2 Progress convert_units_avx2(size_t output_length, To* output, size_t input_length, const From* input)
+    {
+        size_t index = 0;
+        const size_t length = std::min(output_length, input_length);
+        for(; 32 <= (length - index); index += 32) {
+            __m256i units[sizeof(From)];
+            for(size_t i = 0; i < sizeof(From); ++i) {
+                units[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + index) + i);
+            }
+            if(!in_range_avx2<From, Range>(units)) {
+                break;
+            }
+            store_units_avx2<From, To>(output + index, units);
+        }
+        return {index, index};
+    }
+
+    template<class From, UnitRange Range>
+    UCONV_TARGET_AVX512 UCONV_FORCE_INLINE bool in_range_avx512(const __m512i units[sizeof(From)])
+    {
+        if constexpr(UnitRange::any == Range) {
+            return true;
+        } else if constexpr(1 == sizeof(From)) {
+            static_assert(UnitRange::ascii == Range);
+            return 0 == _mm512_movepi8_mask(units[0]);
+        } else if constexpr(2 == sizeof(From) && UnitRange::bmp == Range) {
+            const __m512i pair_bits = _mm512_set1_epi16(static_cast<int16_t>(0xF800));
+            const __m512i surrogate = _mm512_set1_epi16(static_cast<int16_t>(0xD800));
+            return 0 == (_mm512_cmpeq_epi16_mask(_mm512_and_si512(units[0], pair_bits), surrogate) | _mm512_cmpeq_epi16_mask(_mm512_and_si512(units[1], pair_bits), surrogate));
+        } else if constexpr(2 == sizeof(From)) {
+            const __m512i above = _mm512_set1_epi16(static_cast<int16_t>(UnitRange::ascii == Range ? 0xFF80 : 0xFF00));
+            return 0 == _mm512_test_epi16_mask(_mm512_or_si512(units[0], units[1]), above);
+        } else if constexpr(UnitRange::bmp == Range) {
+            const __m512i pair_bits = _mm512_set1_epi32(static_cast<int32_t>(0xFFFFF800));
+            const __m512i surrogate = _mm512_set1_epi32(0xD800);
+            const __m512i above = _mm512_set1_epi32(static_cast<int32_t>(0xFFFF0000));
+            __mmask16 invalid = 0;
+            for(size_t i = 0; i < 4; ++i) {
+                invalid |= _mm512_cmpeq_epi32_mask(_mm512_and_si512(units[i], pair_bits), surrogate) | _mm512_test_epi32_mask(units[i], above);
+            }
+            return 0 == invalid;
+        } else {
+            const __m512i above = _mm512_set1_epi32(static_cast<int32_t>(UnitRange::ascii == Range ? 0xFFFFFF80 : 0xFFFFFF00));
+            return 0 == _mm512_test_epi32_mask(_mm512_or_si512(_mm512_or_si512(units[0], units[1]), _mm512_or_si512(units[2], units[3])), above);
+        }
+    }
+
+    template<class From, class To>
+    UCONV_TARGET_AVX512 UCONV_FORCE_INLINE void store_units_avx512(To* output, const __m512i units[sizeof(From)])
+    {
+        if constexpr(sizeof(From) == sizeof(To)) {
+            _mm512_storeu_si512(output, units[0]);
+        } else if constexpr(1 == sizeof(From) && 2 == sizeof(To)) {
+            __m512i* out = reinterpret_cast<__m512i*>(output);
+            _mm512_storeu_si512(out, _mm512_cvtepu8_epi16(_mm512_castsi512_si256(units[0])));
+            _mm512_storeu_si512(out + 1, _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(units[0], 1)));
+        } else if constexpr(1 == sizeof(From)) {
+            __m512i* out = reinterpret_cast<__m512i*>(output);
+            _mm512_storeu_si512(out, _mm512_cvtepu8_epi32(_mm512_castsi512_si128(units[0])));
+            _mm512_storeu_si512(out + 1, _mm512_cvtepu8_epi32(_mm512_extracti32x4_epi32(units[0], 1)));
+            _mm512_storeu_si512(out + 2, _mm512_cvtepu8_epi32(_mm512_extracti32x4_epi32(units[0], 2)));
+            _mm512_storeu_si512(out + 3, _mm512_cvtepu8_epi32(_mm512_extracti32x4_epi32(units[0], 3)));
+        } else if constexpr(2 == sizeof(From) && 1 == sizeof(To)) {
+            __m256i* out = reinterpret_cast<__m256i*>(output);
+            _mm256_storeu_si256(out, _mm512_cvtepi16_epi8(units[0]));
+            _mm256_storeu_si256(out + 1, _mm512_cvtepi16_epi8(units[1]));
+        } else if constexpr(2 == sizeof(From)) {
+            __m512i* out = reinterpret_cast<__m512i*>(output);
+            _mm512_storeu_si512(out, _mm512_cvtepu16_epi32(_mm512_castsi512_si256(units[0])));
+            _mm512_storeu_si512(out + 1, _mm512_cvtepu16_epi32(_mm512_extracti64x4_epi64(units[0], 1)));
+            _mm512_storeu_si512(out + 2, _mm512_cvtepu16_epi32(_mm512_castsi512_si256(units[1])));
+            _mm512_storeu_si512(out + 3, _mm512_cvtepu16_epi32(_mm512_extracti64x4_epi64(units[1], 1)));
+        } else if constexpr(1 == sizeof(To)) {
+            __m128i* out = reinterpret_cast<__m128i*>(output);
+            for(size_t i = 0; i < 4; ++i) {
+                _mm_storeu_si128(out + i, _mm512_cvtepi32_epi8(units[i]));
+            }
+        } else {
+            __m256i* out = reinterpret_cast<__m256i*>(output);
+            for(size_t i = 0; i < 4; ++i) {
+                _mm256_storeu_si256(out + i, _mm512_cvtepi32_epi16(units[i]));
+            }
+        }
+    }
+
+    template<class From, class To, UnitRange Range>
+    UCONV_TARGET_AVX512 Progress convert_units_avx512(size_t output_length, To* output, size_t input_length, const From* input)
+    {
+        size_t index = 0;
+        const size_t length = std::min(output_length, input_length);
+        for(; 64 <= (length - index); index += 64) {
+            __m512i units[sizeof(From)];
+            for(size_t i = 0; i < sizeof(From); ++i) {
+                units[i] = _mm512_loadu_si512(reinterpret_cast<const __m512i*>(input + index) + i);
+            }
+            if(!in_range_avx512<From, Range>(units)) {
+                break;
+            }
+            store_units_avx512<From, To>(output + index, units);
+        }
+        return {index, index};
+    }
+
+    // Latin-1 to UTF-8 with the 2-byte sequences in registers, every character is widened to a 16-bit
+    // lane holding its whole sequence and the unused high bytes of the ASCII lanes are compressed out
+    UCONV_INLINE UCONV_TARGET_AVX512 Progress latin1_to_utf8_avx512(size_t utf8_length, char8_t* utf8_string, size_t latin1_length, const char* latin1_string)
+    {
+        const __m512i ascii = _mm512_set1_epi16(0x80);
+        const __m512i low_bits = _mm512_set1_epi16(0x3F);
+        const __m512i sequence_bits = _mm512_set1_epi16(static_cast<short>(0x80C0));
+        size_t index = 0;
+        size_t count = 0;
+        for(; 32 <= (latin1_length - index) && 64 <= (utf8_length - count); index += 32) {
+            const __m512i characters = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(latin1_string + index)));
+            const __mmask32 non_ascii = _mm512_cmpge_epu16_mask(characters, ascii);
+            // 0xC0 | (c >> 6) in the low byte and 0x80 | (c & 0x3F) in the high byte of the lane
+            const __m512i sequences =
+                _mm512_or_si512(sequence_bits, _mm512_or_si512(_mm512_srli_epi16(characters, 6), _mm512_slli_epi16(_mm512_and_si512(characters, low_bits), 8)));
+            const __m512i units = _mm512_mask_mov_epi16(characters, non_ascii, sequences);
+            const __mmask64 keep = 0x5555555555555555ULL | _pdep_u64(non_ascii, 0xAAAAAAAAAAAAAAAAULL);
+            const size_t written = std::popcount(keep);
+            _mm512_mask_storeu_epi8(utf8_string + count, _bzhi_u64(~0ULL, static_cast<uint32_t>(written)), _mm512_maskz_compress_epi8(keep, units));
+            count += written;
+        }
+        return {index, count};
+    }
+
+    // UTF-8 to Latin-1, accepts blocks of ASCII and complete sequences led by 0xC2 or 0xC3. A lead in
+    // the last byte is left to the next block, so 65 bytes are loaded for every 64 or 63 converted.
+    UCONV_INLINE UCONV_TARGET_AVX512 Progress utf8_to_latin1_avx512(size_t latin1_length, char* latin1_string, size_t utf8_length, const char8_t* utf8_string)
+    {
+        const __m512i ascii = _mm512_set1_epi8(static_cast<char>(0x80));
+        const __m512i lead_bits = _mm512_set1_epi8(static_cast<char>(0xFE));
+        const __m512i lead = _mm512_set1_epi8(static_cast<char>(0xC2));
+        const __m512i continuation_bits = _mm512_set1_epi8(static_cast<char>(0xC0));
+        const __m512i low_bits = _mm512_set1_epi8(0x3F);
+        size_t index = 0;
+        size_t count = 0;
+        while(65 <= (utf8_length - index) && 64 <= (latin1_length - count)) {
+            const __m512i bytes = _mm512_loadu_si512(utf8_string + index);
+            const __m512i next = _mm512_loadu_si512(utf8_string + index + 1);
+            const __mmask64 leads = _mm512_cmpeq_epi8_mask(_mm512_and_si512(bytes, lead_bits), lead);
+            const __mmask64 continuations = _mm512_cmpeq_epi8_mask(_mm512_and_si512(bytes, continuation_bits), ascii);
+            if((leads << 1) != continuations || ~0ULL != (_mm512_cmplt_epu8_mask(bytes, ascii) | leads | continuations)) {
+                break;
+            }
+            // ((lead & 0x03) << 6) | (continuation & 0x3F), the 16-bit shift keeps the lead bits in their byte
+            const __m512i characters = _mm512_or_si512(_mm512_and_si512(_mm512_slli_epi16(bytes, 6), continuation_bits), _mm512_and_si512(next, low_bits));
+            const __mmask64 keep = ~continuations & ~(leads & (1ULL << 63));
+            const size_t written = std::popcount(keep);
+            _mm512_mask_storeu_epi8(latin1_string + count,
+                                    _bzhi_u64(~0ULL, static_cast<uint32_t>(written)),
+                                    _mm512_maskz_compress_epi8(keep, _mm512_mask_mov_epi8(bytes, leads, characters)));
+            index += 64 - (leads >> 63);
+            count += written;
+        }
+        return {index, count};
+    }
+
+    static constexpr Kernels sse42_kernels = {Kernel::sse42,
+                                              utf8_to_utf16_sse42<false>,
+                                              utf16_to_utf8_sse42<false>,
+                                              utf16_length_from_utf8_sse42,
+                                              utf8_length_from_utf16_sse42<false>,
+                                              validate_utf8_sse42,
+                                              validate_utf16_sse42,
+                                              convert_units_sse42<char8_t, char32_t, UnitRange::ascii>,
+                                              convert_units_sse42<char32_t, char8_t, UnitRange::ascii>,
+                                              convert_units_sse42<char16_t, char32_t, UnitRange::bmp>,
+                                              convert_units_sse42<char32_t, char16_t, UnitRange::bmp>,
+                                              convert_units_sse42<char, char8_t, UnitRange::ascii>,
+                                              convert_units_sse42<char8_t, char, UnitRange::ascii>,
+                                              convert_units_sse42<char, char16_t, UnitRange::any>,
+                                              convert_units_sse42<char16_t, char, UnitRange::latin1>,
+                                              convert_units_sse42<char, char32_t, UnitRange::any>,
+                                              convert_units_sse42<char32_t, char, UnitRange::latin1>,
+                                              utf32_length_from_utf8_sse42,
+                                              utf8_length_from_latin1_sse42,
+                                              utf32_length_from_utf16_sse42,
+                                              utf8_length_from_utf32_sse42,
+                                              utf16_length_from_utf32_sse42,
+                                              utf8_to_utf16_sse42<true>,
+                                              utf16_to_utf8_sse42<true>,
+                                              utf8_length_from_utf16_sse42<true>};
+    static constexpr Kernels avx2_kernels = {Kernel::avx2,
+                                             utf8_to_utf16_avx2<false>,
+                                             utf16_to_utf8_avx2<false>,
+                                             utf16_length_from_utf8_avx2,
+                                             utf8_length_from_utf16_avx2<false>,
+                                             validate_utf8_avx2,
+                                             validate_utf16_avx2,
+                                             convert_units_avx2<char8_t, char32_t, UnitRange::ascii>,
+                                             convert_units_avx2<char32_t, char8_t, UnitRange::ascii>,
+                                             convert_units_avx2<char16_t, char32_t, UnitRange::bmp>,
+                                             convert_units_avx2<char32_t, char16_t, UnitRange::bmp>,
+                                             convert_units_avx2<char, char8_t, UnitRange::ascii>,
+                                             convert_units_avx2<char8_t, char, UnitRange::ascii>,
+                                             convert_units_avx2<char, char16_t, UnitRange::any>,
+                                             convert_units_avx2<char16_t, char, UnitRange::latin1>,
+                                             convert_units_avx2<char, char32_t, UnitRange::any>,
+                                             convert_units_avx2<char32_t, char, UnitRange::latin1>,
+                                             utf32_length_from_utf8_avx2,
+                                             utf8_length_from_latin1_avx2,
+                                             utf32_length_from_utf16_avx2,
+                                             utf8_length_from_utf32_avx2,
+                                             utf16_length_from_utf32_avx2,
+                                             utf8_to_utf16_avx2<true>,
+                                             utf16_to_utf8_avx2<true>,
+                                             utf8_length_from_utf16_avx2<true>};
+    static constexpr Kernels avx512_kernels = {Kernel::avx512,
+                                               utf8_to_utf16_avx512<false>,
+                                               utf16_to_utf8_avx512<false>,
+                                               utf16_length_from_utf8_avx512,
+                                               utf8_length_from_utf16_avx512<false>,
+                                               validate_utf8_avx512,
+                                               validate_utf16_avx512,
+                                               convert_units_avx512<char8_t, char32_t, UnitRange::ascii>,
+                                               convert_units_avx512<char32_t, char8_t, UnitRange::ascii>,
+                                               convert_units_avx512<char16_t, char32_t, UnitRange::bmp>,
+                                               convert_units_avx512<char32_t, char16_t, UnitRange::bmp>,
+                                               latin1_to_utf8_avx512,
+                                               utf8_to_latin1_avx512,
+                                               convert_units_avx512<char, char16_t, UnitRange::any>,
+                                               convert_units_avx512<char16_t, char, UnitRange::latin1>,
+                                               convert_units_avx512<char, char32_t, UnitRange::any>,
+                                               convert_units_avx512<char32_t, char, UnitRange::latin1>,
+                                               utf32_length_from_utf8_avx512,
+                                               utf8_length_from_latin1_avx512,
+                                               utf32_length_from_utf16_avx512,
+                                               utf8_length_from_utf32_avx512,
+                                               utf16_length_from_utf32_avx512,
+                                               utf8_to_utf16_avx512<true>,
+                                               utf16_to_utf8_avx512<true>,
+                                               utf8_length_from_utf16_avx512<true>};
+
+    UCONV_INLINE void cpuid(uint32_t registers[4], uint32_t leaf, uint32_t subleaf)
+    {
+#    if defined(_MSC_VER)
+        int values[4];
+        __cpuidex(values, static_cast<int>(leaf), static_cast<int>(subleaf));
+        for(size_t i = 0; i < 4; ++i) {
+            registers[i] = static_cast<uint32_t>(values[i]);
+        }
+#    else
+        __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#    endif
+    }
+
+    UCONV_INLINE uint64_t xgetbv()
+    {
+#    if defined(_MSC_VER)
+        return _xgetbv(0);
+#    else
+        uint32_t eax;
+        uint32_t edx;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return (static_cast<uint64_t>(edx) << 32) | eax;
+#    endif
+    }
+
+    UCONV_INLINE Kernel detect_kernel()
+    {
+        uint32_t registers[4];
+        cpuid(registers, 0, 0);
+        const uint32_t max_leaf = registers[0];
+        cpuid(registers, 1, 0);
+        const uint32_t features1 = registers[2];
+        // SSSE3, SSE4.1, SSE4.2, POPCNT
+        if((features1 & 0x00980200U) != 0x00980200U) {
+            return Kernel::scalar;
+        }
+        // OSXSAVE, AVX and the OS saving YMM state
+        if(max_leaf < 7 || (features1 & 0x18000000U) != 0x18000000U || (xgetbv() & 0x06U) != 0x06U) {
+            return Kernel::sse42;
+        }
+        cpuid(registers, 7, 0);
+        const uint32_t features7b = registers[1];
+        const uint32_t features7c = registers[2];
+        // AVX2, BMI1, BMI2
+        if((features7b & 0x00000128U) != 0x00000128U) {
+            return Kernel::sse42;
+        }
+        // AVX512F, AVX512BW, AVX512VL, AVX512VBMI, AVX512VBMI2 and the OS saving ZMM state
+        if((features7b & 0xC0010000U) != 0xC0010000U || (features7c & 0x00000042U) != 0x00000042U || (xgetbv() & 0xE6U) != 0xE6U) {
+            return Kernel::avx2;
+        }
+        return Kernel::avx512;
+    }
+
+#elif defined(UCONV_NEON)
+    template<bool Swap>
+    uint16x8_t swap_units(uint16x8_t units)
+    {
+        if constexpr(Swap) {
+            return vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(units)));
+        } else {
+            return units;
+        }
+    }
+
+    // ASCII fast path only, NEON is part of the AArch64 baseline
+    template<bool Swap>
+    Progress utf8_to_utf16_neon(size_t utf16_length, char16_t* utf16_string, size_t utf8_length, const char8_t* utf8_string)
+    {
+        size_t index = 0;
+        const size_t length = std::min(utf16_length, utf8_length);
+        for(; 16 <= (length - index); index += 16) {
+            uint8x16_t bytes = vld1q_u8(reinterpret_cast<const uint8_t*>(utf8_string + index));
+            if(0x80 <= vmaxvq_u8(bytes)) {
+                break;
+            }
+            vst1q_u16(reinterpret_cast<uint16_t*>(utf16_string + index), swap_units<Swap>(vmovl_u8(vget_low_u8(bytes))));
+            vst1q_u16(reinterpret_cast<uint16_t*>(utf16_string + index + 8), swap_units<Swap>(vmovl_high_u8(bytes)));
+        }
+        return {index, index};
+    }
+
+    template<bool Swap>
+    Progress utf16_to_utf8_neon(size_t utf8_length, char8_t* utf8_string, size_t utf16_length, const char16_t* utf16_string)
+    {
+        size_t index = 0;
+        const size_t length = std::min(utf16_length, utf8_length);
+        for(; 16 <= (length - index); index += 16) {
+            uint16x8_t low = swap_units<Swap>(vld1q_u16(reinterpret_cast<const uint16_t*>(utf16_string + index)));
+            uint16x8_t high = swap_units<Swap>(vld1q_u16(reinterpret_cast<const uint16_t*>(utf16_string + index + 8)));
+            if(0x80 <= vmaxvq_u16(vorrq_u16(low, high))) {
+                break;
+            }
+            vst1q_u8(reinterpret_cast<uint8_t*>(utf8_string + index), vcombine_u8(vmovn_u16(low), vmovn_u16(high)));
+        }
+        return {index, index};
+    }
+
+    UCONV_INLINE size_t utf16_length_from_utf8_neon(size_t utf8_length, const char8_t* utf8_string)
+    {
+        const int8x16_t continuation = vdupq_n_s8(static_cast<int8_t>(0xBF));
+        const uint8x16_t four_byte = vdupq_n_u8(0xF0);
+        const uint8x16_t one = vdupq_n_u8(1);
+        size_t count = 0;
+        size_t index = 0;
+        for(; 16 <= (utf8_length - index); index += 16) {
+            const uint8x16_t bytes = vld1q_u8(reinterpret_cast<const uint8_t*>(utf8_string + index));
+            const uint8x16_t leads = vandq_u8(vcgtq_s8(vreinterpretq_s8_u8(bytes), continuation), one);
+            const uint8x16_t fours = vandq_u8(vcgeq_u8(bytes, four_byte), one);
+            count += vaddvq_u8(vaddq_u8(leads, fours));
+        }
+        return count + count_utf16_from_utf8(utf8_length, utf8_string, index);
+    }
+
+    template<bool Swap>
+    size_t utf8_length_from_utf16_neon(size_t utf16_length, const char16_t* utf16_string)
+    {
+        const uint16x8_t ascii = vdupq_n_u16(0x80);
+        const uint16x8_t two_byte = vdupq_n_u16(0x800);
+        const uint16x8_t surrogate = vdupq_n_u16(0xFC00);
+        const uint16x8_t high = vdupq_n_u16(0xD800);
+        const uint16x8_t low = vdupq_n_u16(0xDC00);
+        const uint16x8_t one = vdupq_n_u16(1);
+        size_t count = 0;
+        size_t index = 0;
+        for(; 9 <= (utf16_length - index); index += 8) {
+            const uint16x8_t units = swap_units<Swap>(vld1q_u16(reinterpret_cast<const uint16_t*>(utf16_string + index)));
+            const uint16x8_t next = swap_units<Swap>(vld1q_u16(reinterpret_cast<const uint16_t*>(utf16_string + index + 1)));
+            const uint16x8_t pairs = vandq_u16(vceqq_u16(vandq_u16(units, surrogate), high), vceqq_u16(vandq_u16(next, surrogate), low));
+            // Adding the all-ones pair mask twice subtracts 2 bytes per pair
+            uint16x8_t bytes = vaddq_u16(one, vaddq_u16(vandq_u16(vcgeq_u16(units, ascii), one), vandq_u16(vcgeq_u16(units, two_byte), one)));
+            bytes = vaddq_u16(bytes, vaddq_u16(pairs, pairs));
+            count += static_cast<uint16_t>(vaddvq_u16(bytes));
+        }
+        return count + count_utf8_from_utf16<Swap>(utf16_length, utf16_string, index);
+    }
+
+    UCONV_INLINE size_t utf32_length_from_utf8_neon(size_t utf8_length, const char8_t* utf8_string)
+    {
+        const int8x16_t continuation = vdupq_n_s8(static_cast<int8_t>(0xBF));
+        const uint8x16_t one = vdupq_n_u8(1);
+        size_t count = 0;
+        size_t index = 0;
+        for(; 16 <= (utf8_length - index); index += 16) {
+            const uint8x16_t bytes = vld1q_u8(reinterpret_cast<const uint8_t*>(utf8_string + index));
+            count += vaddvq_u8(vandq_u8(vcgtq_s8(vreinterpretq_s8_u8(bytes), continuation), one));
+        }
+        return count + count_utf32_from_utf8(utf8_length, utf8_string, index);
+    }
+
+    UCONV_INLINE size_t utf8_length_from_latin1_neon(size_t latin1_length, const char* latin1_string)
+    {
+        size_t count = 0;
+        size_t index = 0;
+        for(; 16 <= (latin1_length - index); index += 16) {
+            const uint8x16_t bytes = vld1q_u8(reinterpret_cast<const uint8_t*>(latin1_string + index));
+            count += 16 + vaddvq_u8(vshrq_n_u8(bytes, 7));
+        }
+        return count + count_utf8_from_latin1(latin1_length, latin1_string, index);
+    }
+
+    UCONV_INLINE size_t utf32_length_from_utf16_neon(size_t utf16_length, const char16_t* utf16_string)
+    {
+        const uint16x8_t surrogate = vdupq_n_u16(0xFC00);
+        const uint16x8_t high = vdupq_n_u16(0xD800);
+        const uint16x8_t low = vdupq_n_u16(0xDC00);
+        size_t count = 0;
+        size_t index = 0;
+        for(; 9 <= (utf16_length - index); index += 8) {
+            const uint16x8_t units = vld1q_u16(reinterpret_cast<const uint16_t*>(utf16_string + index));
+            const uint16x8_t next = vld1q_u16(reinterpret_cast<const uint16_t*>(utf16_string + index + 1));
+            const uint16x8_t pairs = vandq_u16(vceqq_u16(vandq_u16(units, surrogate), high), vceqq_u16(vandq_u16(next, surrogate), low));
+            count += 8 - vaddvq_u16(vshrq_n_u16(pairs, 15));
+        }
+        return count + count_utf32_from_utf16(utf16_length, utf16_string, index);
+    }
+
+    UCONV_INLINE uint32_t supplementary_count_neon(uint32x4_t codepoints)
+    {
+        return vaddvq_u32(vshrq_n_u32(vcltq_u32(vsubq_u32(codepoints, vdupq_n_u32(0x10000)), vdupq_n_u32(0x100000)), 31));
+    }
+
+    UCONV_INLINE size_t utf8_length_from_utf32_neon(size_t utf32_length, const char32_t* utf32_string)
+    {
+        const uint32x4_t ascii = vdupq_n_u32(0x80);
+        const uint32x4_t two_byte = vdupq_n_u32(0x800);
+        size_t count = 0;
+        size_t index = 0;
+        for(; 4 <= (utf32_length - index); index += 4) {
+            const uint32x4_t codepoints = vld1q_u32(reinterpret_cast<const uint32_t*>(utf32_string + index));
+            const uint32x4_t bytes = vaddq_u32(vshrq_n_u32(vcgeq_u32(codepoints, ascii), 31), vshrq_n_u32(vcgeq_u32(codepoints, two_byte), 31));
+            count += 4 + vaddvq_u32(bytes) + supplementary_count_neon(codepoints);
+        }
+        return count + count_utf8_from_utf32(utf32_length, utf32_string, index);
+    }
+
+    UCONV_INLINE size_t utf16_length_from_utf32_neon(size_t utf32_length, const char32_t* utf32_string)
+    {
+        size_t count = 0;
+        size_t index = 0;
+        for(; 4 <= (utf32_length - index); index += 4) {
+            count += 4 + supplementary_count_neon(vld1q_u32(reinterpret_cast<const uint32_t*>(utf32_string + index)));
+        }
+        return count + count_utf16_from_utf32(utf32_length, utf32_string, index);
+    }
+
+    UCONV_INLINE uint8x16_t utf8_errors_neon(uint8x16_t input, uint8x16_t previous)
+    {
+        const uint8x16_t nibble = vdupq_n_u8(0x0F);
+        const uint8x16_t previous1 = vextq_u8(previous, input, 15);
+        const uint8x16_t byte1_high = vqtbl1q_u8(vld1q_u8(utf8_byte1_high), vshrq_n_u8(previous1, 4));
+        const uint8x16_t byte1_low = vqtbl1q_u8(vld1q_u8(utf8_byte1_low), vandq_u8(previous1, nibble));
+        const uint8x16_t byte2_high = vqtbl1q_u8(vld1q_u8(utf8_byte2_high), vshrq_n_u8(input, 4));
+        const uint8x16_t special_cases = vandq_u8(vandq_u8(byte1_high, byte1_low), byte2_high);
+        const uint8x16_t third = vqsubq_u8(vextq_u8(previous, input, 14), vdupq_n_u8(0xE0 - 0x80));
+        const uint8x16_t fourth = vqsubq_u8(vextq_u8(previous, input, 13), vdupq_n_u8(0xF0 - 0x80));
+        const uint8x16_t continuations = vandq_u8(vorrq_u8(third, fourth), vdupq_n_u8(0x80));
+        return veorq_u8(continuations, special_cases);
+    }
+
+    UCONV_INLINE size_t validate_utf8_neon(size_t utf8_length, const char8_t* utf8_string)
+    {
+        uint8x16_t previous = vdupq_n_u8(0);
+        size_t index = 0;
+        for(; 64 <= (utf8_length - index); index += 64) {
+            uint8x16_t bytes[4];
+            for(size_t i = 0; i < 4; ++i) {
+                bytes[i] = vld1q_u8(reinterpret_cast<const uint8_t*>(utf8_string + index + i * 16));
+            }
+            const uint8x16_t any = vorrq_u8(vorrq_u8(bytes[0], bytes[1]), vorrq_u8(bytes[2], bytes[3]));
+            uint8x16_t errors;
+            if(vmaxvq_u8(any) < 0x80) {
+                errors = vqsubq_u8(previous, vld1q_u8(utf8_incomplete_limits));
+            } else {
+                errors = vorrq_u8(vorrq_u8(utf8_errors_neon(bytes[0], previous), utf8_errors_neon(bytes[1], bytes[0])),
+                                  vorrq_u8(utf8_errors_neon(bytes[2], bytes[1]), utf8_errors_neon(bytes[3], bytes[2])));
+            }
+            if(0 != vmaxvq_u8(errors)) {
+                break;
+            }
+            previous = bytes[3];
+        }
+        return find_utf8_error(utf8_length, utf8_string, utf8_boundary(utf8_string, index));
+    }
+
+    // One bit per unit of an all-ones or all-zeros comparison result
+    UCONV_INLINE uint32_t unit_mask_neon(uint16x8_t mask)
+    {
+        static const uint16_t bits[8] = {1, 2, 4, 8, 16, 32, 64, 128};
+        return vaddvq_u16(vandq_u16(mask, vld1q_u16(bits)));
+    }
+
+    UCONV_INLINE size_t validate_utf16_neon(size_t utf16_length, const char16_t* utf16_string)
+    {
+        const uint16x8_t surrogate_bits = vdupq_n_u16(0xF800);
+        const uint16x8_t pair_bits = vdupq_n_u16(0xFC00);
+        const uint16x8_t high = vdupq_n_u16(0xD800);
+        const uint16x8_t low = vdupq_n_u16(0xDC00);
+        uint32_t carry = 0;
+        size_t index = 0;
+        for(; 16 <= (utf16_length - index); index += 16) {
+            const uint16x8_t units0 = vld1q_u16(reinterpret_cast<const uint16_t*>(utf16_string + index));
+            const uint16x8_t units1 = vld1q_u16(reinterpret_cast<const uint16_t*>(utf16_string + index + 8));
+            const uint16x8_t surrogates = vorrq_u16(vceqq_u16(vandq_u16(units0, surrogate_bits), high), vceqq_u16(vandq_u16(units1, surrogate_bits), high));
+            if(0 == carry && 0 == vmaxvq_u16(surrogates)) {
+                continue;
+            }
+            const uint32_t highs = unit_mask_neon(vceqq_u16(vandq_u16(units0, pair_bits), high)) | (unit_mask_neon(vceqq_u16(vandq_u16(units1, pair_bits), high)) << 8);
+            const uint32_t lows = unit_mask_neon(vceqq_u16(vandq_u16(units0, pair_bits), low)) | (unit_mask_neon(vceqq_u16(vandq_u16(units1, pair_bits), low)) << 8);
+            if((((highs << 1) | carry) & 0xFFFFU) != lows) {
+                break;
+            }
+            carry = highs >> 15;
+        }
+        return find_utf16_error(utf16_length, utf16_string, index - carry);
+    }
+
+    // Unit kernels, 16 code units at a time
+    template<class From, UnitRange Range>
+    bool in_range_neon(const uint32x4_t units[4])
+    {
+        if constexpr(UnitRange::any == Range) {
+            return true;
+        } else if constexpr(1 == sizeof(From)) {
+            static_assert(UnitRange::ascii == Range);
+            return vmaxvq_u8(vreinterpretq_u8_u32(units[0])) < 0x80;
+        } else if constexpr(2 == sizeof(From) && UnitRange::bmp == Range) {
+            const uint16x8_t pair_bits = vdupq_n_u16(0xF800);
+            const uint16x8_t surrogate = vdupq_n_u16(0xD800);
+            const uint16x8_t units0 = vreinterpretq_u16_u32(units[0]);
+            const uint16x8_t units1 = vreinterpretq_u16_u32(units[1]);
+            return 0 == vmaxvq_u16(vorrq_u16(vceqq_u16(vandq_u16(units0, pair_bits), surrogate), vceqq_u16(vandq_u16(units1, pair_bits), surrogate)));
+        } else if constexpr(2 == sizeof(From)) {
+            return vmaxvq_u16(vreinterpretq_u16_u32(vorrq_u32(units[0], units[1]))) <= (UnitRange::ascii == Range ? 0x7F : 0xFF);
+        } else if constexpr(UnitRange::bmp == Range) {
+            const uint32x4_t pair_bits = vdupq_n_u32(0xFFFFF800);
+            const uint32x4_t surrogate = vdupq_n_u32(0xD800);
+            uint32x4_t invalid = vdupq_n_u32(0);
+            uint32x4_t any = vdupq_n_u32(0);
+            for(size_t i = 0; i < 4; ++i) {
+                invalid = vorrq_u32(invalid, vceqq_u32(vandq_u32(units[i], pair_bits), surrogate));
+                any = vorrq_u32(any, units[i]);
+            }
+            return 0 == vmaxvq_u32(invalid) && vmaxvq_u32(any) <= 0xFFFF;
+        } else {
+            const uint32x4_t any = vorrq_u32(vorrq_u32(units[0], units[1]), vorrq_u32(units[2], units[3]));
+            return vmaxvq_u32(any) <= (UnitRange::ascii == Range ? 0x7FU : 0xFFU);
+        }
+    }
+
+    template<class From, class To>
+    void store_units_neon(To* output, const uint32x4_t units[4])
+    {
+        if constexpr(sizeof(From) == sizeof(To)) {
+            vst1q_u8(reinterpret_cast<uint8_t*>(output), vreinterpretq_u8_u32(units[0]));
+        } else if constexpr(1 == sizeof(From)) {
+            const uint8x16_t bytes = vreinterpretq_u8_u32(units[0]);
+            const uint16x8_t low = vmovl_u8(vget_low_u8(bytes));
+            const uint16x8_t high = vmovl_high_u8(bytes);
+            if constexpr(2 == sizeof(To)) {
+                vst1q_u16(reinterpret_cast<uint16_t*>(output), low);
+                vst1q_u16(reinterpret_cast<uint16_t*>(output) + 8, high);
+            } else {
+                uint32_t* out = reinterpret_cast<uint32_t*>(output);
+                vst1q_u32(out, vmovl_u16(vget_low_u16(low)));
+                vst1q_u32(out + 4, vmovl_high_u16(low));
+                vst1q_u32(out + 8, vmovl_u16(vget_low_u16(high)));
+                vst1q_u32(out + 12, vmovl_high_u16(high));
+            }
+        } else if constexpr(2 == sizeof(From)) {
+            const uint16x8_t units0 = vreinterpretq_u16_u32(units[0]);
+            const uint16x8_t units1 = vreinterpretq_u16_u32(units[1]);
+            if constexpr(1 == sizeof(To)) {
+                vst1q_u8(reinterpret_cast<uint8_t*>(output), vcombine_u8(vmovn_u16(units0), vmovn_u16(units1)));
+            } else {
+                uint32_t* out = reinterpret_cast<uint32_t*>(output);
+                vst1q_u32(out, vmovl_u16(vget_low_u16(units0)));
+                vst1q_u32(out + 4, vmovl_high_u16(units0));
+                vst1q_u32(out + 8, vmovl_u16(vget_low_u16(units1)));
+                vst1q_u32(out + 12, vmovl_high_u16(units1));
+            }
+        } else {
+            const uint16x8_t low = vcombine_u16(vmovn_u32(units[0]), vmovn_u32(units[1]));
+            const uint16x8_t high = vcombine_u16(vmovn_u32(units[2]), vmovn_u32(units[3]));
+            if constexpr(1 == sizeof(To)) {
+                vst1q_u8(reinterpret_cast<uint8_t*>(output), vcombine_u8(vmovn_u16(low), vmovn_u16(high)));
+            } else {
+                vst1q_u16(reinterpret_cast<uint16_t*>(output), low);
+                vst1q_u16(reinterpret_cast<uint16_t*>(output) + 8, high);
+            }
+        }
+    }
+
+    template<class From, class To, UnitRange Range>
+    Progress convert_units_neon(size_t output_length, To* output, size_t input_length, const From* input)
+    {
+        size_t index = 0;
+        const size_t length = std::min(output_length, input_length);
+        for(; 16 <= (length - index); index += 16) {
+            uint32x4_t units[4];
+            for(size_t i = 0; i < sizeof(From); ++i) {
+                units[i] = vreinterpretq_u32_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(input + index) + i * 16));
+            }
+            if(!in_range_neon<From, Range>(units)) {
+                break;
+            }
+            store_units_neon<From, To>(output + index, units);
+        }
+        return {index, index};
+    }
+
+    static constexpr Kernels neon_kernels = {Kernel::neon,
+                                             utf8_to_utf16_neon<false>,
+                                             utf16_to_utf8_neon<false>,
+                                             utf16_length_from_utf8_neon,
+                                             utf8_length_from_utf16_neon<false>,
+                                             validate_utf8_neon,
+                                             validate_utf16_neon,
+                                             convert_units_neon<char8_t, char32_t, UnitRange::ascii>,
+                                             convert_units_neon<char32_t, char8_t, UnitRange::ascii>,
+                                             convert_units_neon<char16_t, char32_t, UnitRange::bmp>,
+                                             convert_units_neon<char32_t, char16_t, UnitRange::bmp>,
+                                             convert_units_neon<char, char8_t, UnitRange::ascii>,
+                                             convert_units_neon<char8_t, char, UnitRange::ascii>,
+                                             convert_units_neon<char, char16_t, UnitRange::any>,
+                                             convert_units_neon<char16_t, char, UnitRange::latin1>,
+                                             convert_units_neon<char, char32_t, UnitRange::any>,
+                                             convert_units_neon<char32_t, char, UnitRange::latin1>,
+                                             utf32_length_from_utf8_neon,
+                                             utf8_length_from_latin1_neon,
+                                             utf32_length_from_utf16_neon,
+                                             utf8_length_from_utf32_neon,
+                                             utf16_length_from_utf32_neon,
+                                             utf8_to_utf16_neon<true>,
+                                             utf16_to_utf8_neon<true>,
+                                             utf8_length_from_utf16_neon<true>};
+
+    UCONV_INLINE Kernel detect_kernel()
+    {
+        return Kernel::neon;
+    }
+#else
+    UCONV_INLINE Kernel detect_kernel()
+    {
+        return Kernel::scalar;
+    }
+#endif
+
+    UCONV_INLINE const Kernels* find_kernels(Kernel kernel)
+    {
+        const Kernel best = detect_kernel();
+        switch(kernel) {
+        case Kernel::scalar:
+            return &scalar_kernels;
+#if defined(UCONV_X86)
+        case Kernel::sse42:
+            return (Kernel::sse42 == best || Kernel::avx2 == best || Kernel::avx512 == best) ? &sse42_kernels : nullptr;
+        case Kernel::avx2:
+            return (Kernel::avx2 == best || Kernel::avx512 == best) ? &avx2_kernels : nullptr;
+        case Kernel::avx512:
+            return (Kernel::avx512 == best) ? &avx512_kernels : nullptr;
+#elif defined(UCONV_NEON)
+        case Kernel::neon:
+            return &neon_kernels;
+#endif
+        default:
+            (void)best;
+            return nullptr;
+        }
+    }
+
+    // Selected once from the CPU features on first use
+    UCONV_INLINE std::atomic<const Kernels*>& current_kernels()
+    {
+        static std::atomic<const Kernels*> kernels(find_kernels(detect_kernel()));
+        return kernels;
+    }
+
+    constexpr uint64_t Stats::*stats_fields[] = {
+        &Stats::calls,
+        &Stats::bytes_in,
+        &Stats::bytes_out,
+        &Stats::ascii_calls,
+        &Stats::truncated,
+        &Stats::unexpected_continuation,
+        &Stats::missing_continuation,
+        &Stats::out_of_range,
+        &Stats::unpaired_surrogates,
+        &Stats::output_full,
+        &Stats::reallocations,
+    };
+
+    // The counters of one thread, written by the thread only and read by aggregate_stats()
+    // through std::atomic_ref. An exiting thread adds its counters to the retired ones.
+    struct ThreadStats
+    {
+        Stats counters = {};
+
+        ThreadStats();
+        ~ThreadStats();
+
+        Stats snapshot()
+        {
+            Stats stats = {};
+            for(uint64_t Stats::*field : stats_fields) {
+                stats.*field = std::atomic_ref<uint64_t>(counters.*field).load(std::memory_order_relaxed);
+            }
+            return stats;
+        }
+    };
+
+    struct StatsRegistry
+    {
+        std::mutex mutex;
+        std::vector<ThreadStats*> threads;
+        Stats retired = {};
+    };
+
+    // Never destroyed, threads may exit after the static destructors have run
+    UCONV_INLINE StatsRegistry& stats_registry()
+    {
+        static StatsRegistry* registry = new StatsRegistry;
+        return *registry;
+    }
+
+    UCONV_INLINE ThreadStats::ThreadStats()
+    {
+        StatsRegistry& registry = stats_registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.threads.push_back(this);
+    }
+
+    UCONV_INLINE ThreadStats::~ThreadStats()
+    {
+        StatsRegistry& registry = stats_registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.retired += snapshot();
+        std::erase(registry.threads, this);
+    }
+
+    UCONV_INLINE ThreadStats& local_stats()
+    {
+        thread_local ThreadStats stats;
+        return stats;
+    }
+
+    // Compiled out without UCONV_ENABLE_STATS. Only the calling thread writes its counter,
+    // a relaxed load and store is enough for the readers.
+    template<uint64_t Stats::*Field>
+    UCONV_FORCE_INLINE void count_stat(uint64_t value = 1)
+    {
+        if constexpr(stats_enabled) {
+            std::atomic_ref<uint64_t> counter(local_stats().counters.*Field);
+            counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+    }
+
+    // Shared by the utf16_to_utf8 overloads and Utf16ToUtf8Stream, stops on a code point
+    // boundary when utf8_string is full. Without CheckBounds utf8_string must hold
+    // utf8_length_from_utf16() bytes.
+    template<bool CheckBounds, bool Swap = false>
+    Progress convert_utf16_to_utf8(size_t utf8_length, char8_t* utf8_string, size_t utf16_length, const char16_t* utf16_string)
+    {
+        const Kernels* kernels = current_kernels().load(std::memory_order_relaxed);
+        const Utf16ToUtf8Kernel kernel = Swap ? kernels->utf16_to_utf8_swapped : kernels->utf16_to_utf8;
+        size_t count = 0;
+        size_t i = 0;
+        while(i < utf16_length) {
+            Progress progress = kernel(utf8_length - count, utf8_string + count, utf16_length - i, utf16_string + i);
+            i += progress.read;
+            count += progress.written;
+
+            // Convert at least one block of code units before trying the kernel again
+            size_t block_end = std::min(utf16_length, i + scalar_block_size);
+            while(i < block_end) {
+                char32_t code_point;
+                size_t units = 1;
+                char16_t unit = swap_unit<Swap>(utf16_string[i]);
+
+                if(0xD800 <= unit && unit <= 0xDBFF) { // High surrogate
+                    char16_t next_unit = (i + 1 < utf16_length) ? swap_unit<Swap>(utf16_string[i + 1]) : 0;
+                    if(0xDC00 <= next_unit && next_unit <= 0xDFFF) { // Low surrogate
+                        code_point = 0x10000 + ((unit - 0xD800) << 10) + (next_unit - 0xDC00);
+                        units = 2;
+                    } else {
+                        // Handle malformed UTF-16 (e.g., lone high surrogate)
+                        // Just treat it as a single unit
+                        code_point = unit;
+                    }
+                } else {
+                    code_point = unit;
+                }
+
+                // Encode code_point to UTF-8
+                char8_t utf8_units[4];
+                const size_t length = codepoint_to_utf8(utf8_units, code_point);
+                if(CheckBounds && utf8_length < (count + length)) {
+                    return {i, count};
+                }
+                for(size_t j = 0; j < length; ++j) {
+                    utf8_string[count++] = utf8_units[j];
+                }
+                if(stats_enabled && 1 == units && 0xD800 == (unit & 0xF800)) {
+                    count_stat<&Stats::unpaired_surrogates>();
+                }
+                i += units;
+            }
+        }
+        return {i, count};
+    }
+
+    // Decodes through the automaton one byte at a time, 8 ASCII bytes at once between code points. Every
+    // byte stores the code units of the code point decoded so far and only a completed code point moves
+    // the output on, so the cost of a byte does not depend on the script. Stops on a code point boundary
+    // at a malformed sequence and at the end of the input, a sequence crossing it is left. No byte yields
+    // more than one code unit, so with the input cut to the room for the stores the output cannot run full.
+    template<typename Unit, bool Swap = false>
+    UCONV_FORCE_INLINE Progress decode_utf8_block(size_t output_length, Unit* output, size_t utf8_length, const char8_t* utf8_string)
+    {
+        // A UTF-16 store writes the second unit of a pair as well
+        constexpr size_t store_length = std::is_same_v<Unit, char16_t> ? 2 : 1;
+        const size_t length = std::min(utf8_length, std::max(output_length, store_length - 1) - (store_length - 1));
+        Progress progress = {0, 0};
+        uint32_t state = detail::utf8_accept;
+        char32_t codepoint = 0;
+        size_t i = 0;
+        while(i < length) {
+            if(detail::utf8_accept == state && 8 <= (length - i) && is_ascii_word(utf8_string + i)) {
+                for(size_t j = 0; j < 8; ++j) {
+                    output[progress.written + j] = static_cast<Unit>(swap_unit<Swap>(utf8_string[i + j]));
+                }
+                i += 8;
+                progress.read = i;
+                progress.written += 8;
+                continue;
+            }
+            const size_t end = i + std::min<size_t>(length - i, 8);
+            while(i < end) {
+                state = detail::decode_utf8_byte(state, codepoint, utf8_string[i++]);
+                if(detail::utf8_reject == state) {
+                    return progress;
+                }
+                const size_t complete = 0 - static_cast<size_t>(detail::utf8_accept == state);
+                if constexpr(std::is_same_v<Unit, char16_t>) {
+                    const size_t pair = (0xFFFF < codepoint);
+                    output[progress.written] = swap_unit<Swap>(static_cast<char16_t>(pair ? 0xD7C0 + (codepoint >> 10) : codepoint));
+                    output[progress.written + 1] = swap_unit<Swap>(static_cast<char16_t>(0xDC00 | (codepoint & 0x3FF)));
+                    progress.written += (1 + pair) & complete;
+                } else {
+                    output[progress.written] = codepoint;
+                    progress.written += 1 & complete;
+                }
+                progress.read ^= (progress.read ^ i) & complete;
+            }
+        }
+        return progress;
+    }
+
+    // Shared by the utf8_to_utf16 overloads and Utf8ToUtf16Stream, stops on a code point
+    // boundary at a malformed sequence or when utf16_string is full
+    template<bool Swap = false>
+    Progress convert_utf8_to_utf16(size_t utf16_length, char16_t* utf16_string, size_t utf8_length, const char8_t* utf8_string)
+    {
+        const Kernels* kernels = current_kernels().load(std::memory_order_relaxed);
+        const Utf8ToUtf16Kernel kernel = Swap ? kernels->utf8_to_utf16_swapped : kernels->utf8_to_utf16;
+        size_t index = 0;
+        char16_t utf16_units[4];
+        size_t count = 0;
+        while(index < utf8_length) {
+            Progress progress = kernel(utf16_length - count, utf16_string + count, utf8_length - index, utf8_string + index);
+            index += progress.read;
+            count += progress.written;
+
+            // Decode a block of bytes before trying the kernel again. A block that decodes nothing starts
+            // with a malformed or truncated sequence or fills the output, its first code point is decoded
+            // with bounds checks.
+            const size_t block_length = std::min(utf8_length - index, scalar_block_size);
+            progress = decode_utf8_block<char16_t, Swap>(utf16_length - count, utf16_string + count, block_length, utf8_string + index);
+            index += progress.read;
+            count += progress.written;
+            if(0 == progress.read && index < utf8_length) {
+                size_t start = index;
+                char32_t codepoint = decode_to_codepoint(utf8_length, utf8_string, index);
+                if(invalid_codepoint == codepoint) {
+                    return {start, count};
+                }
+                size_t length = codepoint_to_utf16(utf16_units, codepoint);
+                if(utf16_length < (count + length)) {
+                    return {start, count};
+                }
+                for(size_t i = 0; i < length; ++i) {
+                    utf16_string[count++] = swap_unit<Swap>(utf16_units[i]);
+                }
+            }
+        }
+        return {index, count};
+    }
+
+    // Length of the sequence started by a lead byte, 1 for anything that cannot be completed
+    UCONV_INLINE size_t utf8_sequence_length(char8_t lead)
+    {
+        if(0xC0 == (lead & 0xE0)) {
+            return 2;
+        } else if(0xE0 == (lead & 0xF0)) {
+            return 3;
+        } else if(0xF0 == (lead & 0xF8)) {
+            return 4;
+        }
+        return 1;
+    }
+
+    // Length of the invalid sequence at index replaced by one U+FFFD, the longest prefix of
+    // a valid sequence or 1 byte, as recommended by the Unicode Standard (Section 3.9)
+    UCONV_INLINE size_t maximal_subpart(size_t utf8_length, const char8_t* utf8_string, size_t index)
+    {
+        const char8_t lead = utf8_string[index];
+        const size_t length = (lead < 0xC2 || 0xF4 < lead) ? 1 : utf8_sequence_length(lead);
+        // Second bytes excluding overlongs, surrogates and code points above U+10FFFF
+        char8_t lower = 0x80;
+        char8_t upper = 0xBF;
+        if(0xE0 == lead) {
+            lower = 0xA0;
+        } else if(0xED == lead) {
+            upper = 0x9F;
+        } else if(0xF0 == lead) {
+            lower = 0x90;
+        } else if(0xF4 == lead) {
+            upper = 0x8F;
+        }
+        size_t count = 1;
+        for(; count < length && (index + count) < utf8_length; ++count) {
+            const char8_t byte = utf8_string[index + count];
+            if(byte < lower || upper < byte) {
+                break;
+            }
+            lower = 0x80;
+            upper = 0xBF;
+        }
+        return count;
+    }
+
+    // Counts the malformed sequence at index by the way it is malformed
+    UCONV_INLINE void count_utf8_error(size_t utf8_length, const char8_t* utf8_string, size_t index)
+    {
+        const char8_t lead = utf8_string[index];
+        const size_t length = maximal_subpart(utf8_length, utf8_string, index);
+        if(0x80 == (lead & 0xC0)) {
+            count_stat<&Stats::unexpected_continuation>();
+        } else if(lead < 0xC2 || 0xF4 < lead) {
+            count_stat<&Stats::out_of_range>();
+        } else if(index + length == utf8_length) {
+            count_stat<&Stats::truncated>();
+        } else if(1 == length && 0x80 == (utf8_string[index + 1] & 0xC0)) {
+            // A continuation byte out of the range E0, ED, F0 or F4 allows
+            count_stat<&Stats::out_of_range>();
+        } else {
+            count_stat<&Stats::missing_continuation>();
+        }
+    }
+
+    // Counts a call of the utf8_to_utf16 and utf16_to_utf8 families, malformed if an error was replaced
+    template<typename From, typename To>
+    void count_call(size_t input_length, Progress progress, bool malformed = false)
+    {
+        count_stat<&Stats::calls>();
+        count_stat<&Stats::bytes_in>(progress.read * sizeof(From));
+        count_stat<&Stats::bytes_out>(progress.written * sizeof(To));
+        // Only ASCII converts to as many code units as it is made of
+        if(!malformed && progress.read == input_length && progress.written == input_length) {
+            count_stat<&Stats::ascii_calls>();
+        }
+    }
+
+    // Counts a call and why it stopped early, at a malformed sequence or at a full output buffer
+    template<typename From, typename To>
+    void count_conversion(size_t input_length, const From* input, Progress progress)
+    {
+        if constexpr(stats_enabled) {
+            count_call<From, To>(input_length, progress);
+            if(progress.read < input_length) {
+                size_t index = progress.read;
+                if constexpr(std::is_same_v<From, char8_t>) {
+                    if(invalid_codepoint == decode_to_codepoint(input_length, input, index)) {
+                        count_utf8_error(input_length, input, progress.read);
+                        return;
+                    }
+                }
+                count_stat<&Stats::output_full>();
+            }
+        }
+    }
+
+    // The string and buffer conversions of both byte orders, the utf16le, utf16be and utf16bom functions
+    // pass Swap for the byte order the host does not use
+    static constexpr bool little_endian = (std::endian::native == std::endian::little);
+
+    template<bool Swap>
+    size_t utf8_length_from_utf16_units(size_t utf16_length, const char16_t* utf16_string)
+    {
+        assert(0 == utf16_length || nullptr != utf16_string);
+        const Kernels* kernels = current_kernels().load(std::memory_order_relaxed);
+        return (Swap ? kernels->utf8_length_from_utf16_swapped : kernels->utf8_length_from_utf16)(utf16_length, utf16_string);
+    }
+
+    template<bool Swap>
+    std::u8string utf16_units_to_utf8(size_t utf16_length, const char16_t* utf16_string)
+    {
+        // The length is exact, the output is allocated once and written without bounds checks
+        std::u8string utf8_string;
+        Progress progress = {0, 0};
+        utf8_string.resize_and_overwrite(utf8_length_from_utf16_units<Swap>(utf16_length, utf16_string), [&](char8_t* data, size_t length) {
+            progress = convert_utf16_to_utf8<false, Swap>(length, data, utf16_length, utf16_string);
+            return progress.written;
+        });
+        count_conversion<char16_t, char8_t>(utf16_length, utf16_string, progress);
+        if(stats_enabled && std::u8string().capacity() < utf8_string.capacity()) {
+            count_stat<&Stats::reallocations>();
+        }
+        return utf8_string;
+    }
+
+    template<bool Swap>
+    BufferResult utf16_units_to_utf8(size_t utf8_length, char8_t* utf8_string, size_t utf16_length, const char16_t* utf16_string)
+    {
+        assert(0 == utf8_length || nullptr != utf8_string);
+        assert(0 == utf16_length || nullptr != utf16_string);
+        const Progress progress = convert_utf16_to_utf8<true, Swap>(utf8_length, utf8_string, utf16_length, utf16_string);
+        count_conversion<char16_t, char8_t>(utf16_length, utf16_string, progress);
+        return {progress.read, progress.written};
+    }
+
+    template<bool Swap>
+    std::u16string utf8_to_utf16_units(const std::u8string& utf8_string)
+    {
+        // The length is exact for valid input, malformed input stops the conversion early
+        std::u16string utf16_string;
+        Progress progress = {0, 0};
+        utf16_string.resize_and_overwrite(utf16_length_from_utf8(utf8_string.length(), utf8_string.data()), [&](char16_t* data, size_t length) {
+            progress = convert_utf8_to_utf16<Swap>(length, data, utf8_string.length(), utf8_string.data());
+            return progress.written;
+        });
+        count_conversion<char8_t, char16_t>(utf8_string.length(), utf8_string.data(), progress);
+        if(stats_enabled && std::u16string().capacity() < utf16_string.capacity()) {
+            count_stat<&Stats::reallocations>();
+        }
+        return utf16_string;
+    }
+
+    template<bool Swap>
+    BufferResult utf8_to_utf16_units(size_t utf16_length, char16_t* utf16_string, size_t utf8_length, const char8_t* utf8_string)
+    {
+        assert(0 == utf16_length || nullptr != utf16_string);
+        assert(0 == utf8_length || nullptr != utf8_string);
+        const Progress progress = convert_utf8_to_utf16<Swap>(utf16_length, utf16_string, utf8_length, utf8_string);
+        count_conversion<char8_t, char16_t>(utf8_length, utf8_string, progress);
+        return {progress.read, progress.written};
+    }
+
+    // A leading U+FEFF in either byte order, the mark is not converted
+    struct Utf16ByteOrder
+    {
+        bool swap;
+        size_t mark_length;
+    };
+
+    UCONV_INLINE Utf16ByteOrder utf16_byte_order(size_t utf16_length, const char16_t* utf16_string)
+    {
+        assert(0 == utf16_length || nullptr != utf16_string);
+        if(0 < utf16_length && 0xFEFF == utf16_string[0]) {
+            return {false, 1};
+        }
+        if(0 < utf16_length && 0xFFFE == utf16_string[0]) {
+            return {true, 1};
+        }
+        return {little_endian, 0};
+    }
+
+    // Runs a unit kernel and converts what it leaves one code point at a time. step(index, count)
+    // converts the code point at index and returns false at input it cannot convert or when
+    // the output is full.
+    template<class From, class To, class Step>
+    UCONV_FORCE_INLINE Progress convert_with_kernel(UnitKernel<From, To> kernel, size_t output_length, To* output, size_t input_length, const From* input, Step step)
+    {
+        size_t index = 0;
+        size_t count = 0;
+        while(index < input_length) {
+            Progress progress = kernel(output_length - count, output + count, input_length - index, input + index);
+            index += progress.read;
+            count += progress.written;
+
+            // Convert at least one block of code units before trying the kernel again
+            const size_t block_end = std::min(input_length, index + scalar_block_size);
+            while(index < block_end) {
+                if(!step(index, count)) {
+                    return {index, count};
+                }
+            }
+        }
+        return {index, count};
+    }
+
+    // Stops at a malformed sequence or when utf32_string is full
+    UCONV_INLINE Progress convert_utf8_to_utf32(size_t utf32_length, char32_t* utf32_string, size_t utf8_length, const char8_t* utf8_string)
+    {
+        const UnitKernel<char8_t, char32_t> kernel = current_kernels().load(std::memory_order_relaxed)->utf8_to_utf32;
+        return convert_with_kernel(kernel, utf32_length, utf32_string, utf8_length, utf8_string, [&](size_t& index, size_t& count) {
+            // The rest of the block through the automaton, a malformed or truncated sequence with bounds checks
+            const Progress progress = decode_utf8_block(utf32_length - count, utf32_string + count, std::min(utf8_length - index, scalar_block_size), utf8_string + index);
+            if(0 != progress.read) {
+                index += progress.read;
+                count += progress.written;
+                return true;
+            }
+            size_t next = index;
+            const char32_t codepoint = decode_to_codepoint(utf8_length, utf8_string, next);
+            if(invalid_codepoint == codepoint || utf32_length <= count) {
+                return false;
+            }
+            utf32_string[count++] = codepoint;
+            index = next;
+            return true;
+        });
+    }
+
+    // Code points above U+10FFFF become U+FFFD, stops on a code point boundary when utf8_string is full
+    UCONV_INLINE Progress convert_utf32_to_utf8(size_t utf8_length, char8_t* utf8_string, size_t utf32_length, const char32_t* utf32_string)
+    {
+        const UnitKernel<char32_t, char8_t> kernel = current_kernels().load(std::memory_order_relaxed)->utf32_to_utf8;
+        return convert_with_kernel(kernel, utf8_length, utf8_string, utf32_length, utf32_string, [&](size_t& index, size_t& count) {
+            const char32_t codepoint = (utf32_string[index] <= 0x10FFFF) ? utf32_string[index] : 0xFFFD;
+            char8_t utf8_units[4];
+            const size_t length = codepoint_to_utf8(utf8_units, codepoint);
+            if(utf8_length < (count + length)) {
+                return false;
+            }
+            std::copy_n(utf8_units, length, utf8_string + count);
+            count += length;
+            ++index;
+            return true;
+        });
+    }
+
+    // Combines surrogate pairs and copies unpaired surrogates, stops when utf32_string is full
+    UCONV_INLINE Progress convert_utf16_to_utf32(size_t utf32_length, char32_t* utf32_string, size_t utf16_length, const char16_t* utf16_string)
+    {
+        const UnitKernel<char16_t, char32_t> kernel = current_kernels().load(std::memory_order_relaxed)->utf16_to_utf32;
+        return convert_with_kernel(kernel, utf32_length, utf32_string, utf16_length, utf16_string, [&](size_t& index, size_t& count) {
+            if(utf32_length <= count) {
+                return false;
+            }
+            char32_t codepoint = utf16_string[index++];
+            if(0xD800 == (codepoint & 0xFC00) && index < utf16_length && 0xDC00 == (utf16_string[index] & 0xFC00)) {
+                codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (utf16_string[index++] - 0xDC00);
+            }
+            utf32_string[count++] = codepoint;
+            return true;
+        });
+    }
+
+    // Code points above U+10FFFF become U+FFFD, stops on a code point boundary when utf16_string is full
+    UCONV_INLINE Progress convert_utf32_to_utf16(size_t utf16_length, char16_t* utf16_string, size_t utf32_length, const char32_t* utf32_string)
+    {
+        const UnitKernel<char32_t, char16_t> kernel = current_kernels().load(std::memory_order_relaxed)->utf32_to_utf16;
+        return convert_with_kernel(kernel, utf16_length, utf16_string, utf32_length, utf32_string, [&](size_t& index, size_t& count) {
+            const char32_t codepoint = (utf32_string[index] <= 0x10FFFF) ? utf32_string[index] : 0xFFFD;
+            char16_t utf16_units[4];
+            const size_t length = codepoint_to_utf16(utf16_units, codepoint);
+            if(utf16_length < (count + length)) {
+                return false;
+            }
+            std::copy_n(utf16_units, length, utf16_string + count);
+            count += length;
+            ++index;
+            return true;
+        });
+    }
+
+    // Stops on a character boundary when utf8_string is full
+    UCONV_INLINE Progress convert_latin1_to_utf8(size_t utf8_length, char8_t* utf8_string, size_t latin1_length, const char* latin1_string)
+    {
+        const UnitKernel<char, char8_t> kernel = current_kernels().load(std::memory_order_relaxed)->latin1_to_utf8;
+        return convert_with_kernel(kernel, utf8_length, utf8_string, latin1_length, latin1_string, [&](size_t& index, size_t& count) {
+            const char8_t byte = static_cast<char8_t>(latin1_string[index]);
+            if(byte < 0x80) {
+                if(utf8_length <= count) {
+                    return false;
+                }
+                utf8_string[count++] = byte;
+            } else {
+                if(utf8_length < (count + 2)) {
+                    return false;
+                }
+                utf8_string[count++] = static_cast<char8_t>(0xC0 | (byte >> 6));
+                utf8_string[count++] = static_cast<char8_t>(0x80 | (byte & 0x3F));
+            }
+            ++index;
+            return true;
+        });
+    }
+
+    // Stops at a malformed sequence, at a code point above U+00FF or when latin1_string is full
+    UCONV_INLINE Progress convert_utf8_to_latin1(size_t latin1_length, char* latin1_string, size_t utf8_length, const char8_t* utf8_string)
+    {
+        const UnitKernel<char8_t, char> kernel = current_kernels().load(std::memory_order_relaxed)->utf8_to_latin1;
+        return convert_with_kernel(kernel, latin1_length, latin1_string, utf8_length, utf8_string, [&](size_t& index, size_t& count) {
+            size_t next = index;
+            const char32_t codepoint = decode_to_codepoint(utf8_length, utf8_string, next);
+            if(0xFF < codepoint || latin1_length <= count) {
+                return false;
+            }
+            latin1_string[count++] = static_cast<char>(codepoint);
+            index = next;
+            return true;
+        });
+    }
+
+    // Between Latin-1 and UTF-16 or UTF-32, code units above U+00FF stop the conversion
+    template<class From, class To>
+    Progress convert_latin1_units(UnitKernel<From, To> kernel, size_t output_length, To* output, size_t input_length, const From* input)
+    {
+        return convert_with_kernel(kernel, output_length, output, input_length, input, [&](size_t& index, size_t& count) {
+            const char32_t unit = std::is_same_v<char, From> ? static_cast<unsigned char>(input[index]) : static_cast<char32_t>(input[index]);
+            if(0xFF < unit || output_length <= count) {
+                return false;
+            }
+            output[count++] = static_cast<To>(unit);
+            ++index;
+            return true;
+        });
+    }
+
+    // Input validated at a time by convert(), the converted block stays in the cache
+    static constexpr size_t validation_block_size = 8192;
+
+    // Smallest input slice of the parallel conversions, in code units
+    static constexpr size_t parallel_slice_size = 256 * 1024;
+
+    // Splits the input into at most slice_count slices of at least parallel_slice_size code
+    // units, the slices start on the first code point boundary at or after an even split
+    template<class Char>
+    std::vector<size_t> split_on_boundaries(size_t length, const Char* string, size_t slice_count)
+    {
+        slice_count = std::clamp<size_t>(length / parallel_slice_size, 1, std::max<size_t>(slice_count, 1));
+        std::vector<size_t> starts(slice_count + 1, length);
+        starts[0] = 0;
+        for(size_t i = 1; i < slice_count; ++i) {
+            size_t start = std::max(starts[i - 1], length / slice_count * i);
+            if constexpr(std::is_same_v<Char, char8_t>) {
+                for(size_t j = 0; j < 3 && start < length && 0x80 == (string[start] & 0xC0); ++j) {
+                    ++start;
+                }
+            } else {
+                if(start < length && 0xDC00 == (string[start] & 0xFC00)) {
+                    ++start;
+                }
+            }
+            starts[i] = start;
+        }
+        return starts;
+    }
+
+    UCONV_INLINE void run_on_threads(size_t count, const std::function<void(size_t)>& task)
+    {
+        std::vector<std::jthread> threads;
+        threads.reserve(count);
+        for(size_t i = 1; i < count; ++i) {
+            threads.emplace_back(task, i);
+        }
+        task(0);
+    }
+
+    // Number of bytes at the end of utf8_string belonging to a sequence the next chunk completes
+    UCONV_INLINE size_t incomplete_utf8_tail(size_t utf8_length, const char8_t* utf8_string)
+    {
+        for(size_t length = 1; length <= std::min<size_t>(3, utf8_length); ++length) {
+            const char8_t byte = utf8_string[utf8_length - length];
+            if(0x80 != (byte & 0xC0)) {
+                return (length < utf8_sequence_length(byte)) ? length : 0;
+            }
+        }
+        return 0;
+    }
+
+    // Strings [first, end) of a batch follow each other in memory from begin on, empty strings join any run
+    struct AdjacentRun
+    {
+        size_t end;
+        const char8_t* begin;
+        size_t length;
+    };
+
+    template<class StringAt>
+    AdjacentRun adjacent_run(size_t first, size_t count, StringAt string_at)
+    {
+        AdjacentRun run{first, nullptr, 0};
+        for(; run.end < count; ++run.end) {
+            const std::u8string_view string = string_at(run.end);
+            if(string.empty()) {
+                continue;
+            }
+            if(nullptr == run.begin) {
+                run.begin = string.data();
+            } else if(string.data() != (run.begin + run.length)) {
+                break;
+            }
+            run.length += string.length();
+        }
+        return run;
+    }
+
+    // Converts the valid strings [first, last), length bytes from begin on, in one pass. The concatenation
+    // converts to the concatenation of the results if every string starts on a sequence, returns false
+    // if one does not or if the arena is too small
+    template<class StringAt>
+    bool convert_valid_utf8_strings(size_t first, size_t last, StringAt string_at, const char8_t* begin, size_t length, size_t arena_length, char16_t* arena, size_t* offsets)
+    {
+        const size_t utf16_length = utf16_length_from_utf8(length, begin);
+        if((arena_length - offsets[first]) < utf16_length) {
+            return false;
+        }
+        size_t offset = offsets[first];
+        if(utf16_length == length) {
+            // ASCII converts one to one, there is no continuation byte if the lengths are equal
+            for(size_t i = first; i < last; ++i) {
+                offset += string_at(i).length();
+                offsets[i + 1] = offset;
+            }
+        } else {
+            for(size_t i = first; i < last; ++i) {
+                const std::u8string_view string = string_at(i);
+                if(!string.empty() && 0x80 == (string[0] & 0xC0)) {
+                    return false;
+                }
+                offset += utf16_length_from_utf8(string.length(), string.data());
+                offsets[i + 1] = offset;
+            }
+        }
+        [[maybe_unused]] const size_t written = convert_utf8_to_utf16(arena_length - offsets[first], arena + offsets[first], length, begin).written;
+        assert(offsets[first] + written == offsets[last]);
+        return true;
+    }
+
+    // Converts string_at(0) to string_at(count - 1) into the arena, returns the number of strings converted.
+    // Adjacent is true if all strings are known to follow each other in memory.
+    template<bool Adjacent, class StringAt>
+    size_t convert_utf8_batch(size_t count, StringAt string_at, size_t arena_length, char16_t* arena, size_t* offsets)
+    {
+        assert(0 == arena_length || nullptr != arena);
+        assert(nullptr != offsets);
+        offsets[0] = 0;
+        size_t first = 0;
+        while(first < count) {
+            AdjacentRun run = Adjacent ? AdjacentRun{count, string_at(first).data(), static_cast<size_t>(string_at(count - 1).data() + string_at(count - 1).length() - string_at(first).data())}
+                                       : adjacent_run(first, count, string_at);
+            while(first < run.end) {
+                // The strings [first, last) lie in the valid prefix of the rest of the run
+                size_t last = first;
+                size_t prefix_length = 0;
+                if(1 < (run.end - first)) {
+                    const size_t valid_length = validate_utf8(run.length, run.begin);
+                    if(run.length == valid_length) {
+                        last = run.end;
+                        prefix_length = run.length;
+                    }
+                    for(; last < run.end && (prefix_length + string_at(last).length()) <= valid_length; ++last) {
+                        prefix_length += string_at(last).length();
+                    }
+                }
+                // The strings convert one at a time if the last one ends inside a sequence the next string completes
+                const bool split = prefix_length < run.length && 0x80 == (run.begin[prefix_length] & 0xC0);
+                size_t consumed = 0;
+                if(1 < (last - first) && !split && convert_valid_utf8_strings(first, last, string_at, run.begin, prefix_length, arena_length, arena, offsets)) {
+                    first = last;
+                    consumed = prefix_length;
+                }
+
+                // One string at a time up to the malformed string ending the prefix, which ends early
+                for(const size_t end = std::min(run.end, last + 1); first < end; ++first) {
+                    const std::u8string_view string = string_at(first);
+                    if((arena_length - offsets[first]) < utf16_length_from_utf8(string.length(), string.data())) {
+                        return first;
+                    }
+                    offsets[first + 1] = offsets[first] + convert_utf8_to_utf16(arena_length - offsets[first], arena + offsets[first], string.length(), string.data()).written;
+                    consumed += string.length();
+                }
+                run.begin += consumed;
+                run.length -= consumed;
+            }
+        }
+        return count;
+    }
+
+    // Bytes between two checkpoints of an OffsetIndex, moved forward to the end of a sequence
+    constexpr size_t offset_checkpoint_interval = 64;
+
+    // An offset inside a well-formed multi-byte sequence moves to its lead byte. Every byte of a malformed
+    // sequence is a sequence of its own, as codepoints() decodes it, so whether an offset starts a sequence
+    // depends on the 3 bytes before it and the 2 after it only.
+    UCONV_INLINE size_t sequence_start(std::u8string_view utf8_string, size_t utf8_offset)
+    {
+        if(utf8_string.length() <= utf8_offset || 0x80 != (utf8_string[utf8_offset] & 0xC0)) {
+            return utf8_offset;
+        }
+        for(size_t back = 1; back <= std::min<size_t>(3, utf8_offset); ++back) {
+            const char8_t* lead = utf8_string.data() + utf8_offset - back;
+            if(0x80 != (*lead & 0xC0)) {
+                return (back < detail::decode_next(lead, utf8_string.data() + utf8_string.length()).length) ? utf8_offset - back : utf8_offset;
+            }
+        }
+        return utf8_offset;
+    }
+
+    // UTF-16 is compared and hashed as UTF-8, encoded into a block of this many bytes on the stack
+    constexpr size_t text_block_length = 256;
+
+    // Hashes a byte stream 8 bytes at a time, the stream may be passed in pieces of any length
+    struct Utf8Hasher
+    {
+        uint64_t state = 0x9E3779B97F4A7C15;
+        uint64_t pending = 0;
+        size_t length = 0;
+
+        void mix(uint64_t word)
+        {
+            state = std::rotl((state ^ word) * 0xBF58476D1CE4E5B9, 31);
+        }
+
+        void update(size_t utf8_length, const char8_t* utf8_string)
+        {
+            size_t i = 0;
+            // Complete the word of the previous piece byte by byte
+            for(; i < utf8_length && 0 != (length % 8); ++i, ++length) {
+                pending |= static_cast<uint64_t>(utf8_string[i]) << (8 * (length % 8));
+                if(7 == (length % 8)) {
+                    mix(pending);
+                    pending = 0;
+                }
+            }
+            for(; (i + 8) <= utf8_length; i += 8, length += 8) {
+                uint64_t word;
+                std::memcpy(&word, utf8_string + i, sizeof(word));
+                if constexpr(std::endian::native == std::endian::big) {
+                    word = std::byteswap(word);
+                }
+                mix(word);
+            }
+            for(; i < utf8_length; ++i, ++length) {
+                pending |= static_cast<uint64_t>(utf8_string[i]) << (8 * (length % 8));
+            }
+        }
+
+        size_t finish() const
+        {
+            // The final mix of MurmurHash3
+            uint64_t hash = state ^ pending ^ (length * 0x94D049BB133111EB);
+            hash = (hash ^ (hash >> 33)) * 0xFF51AFD7ED558CCD;
+            hash = (hash ^ (hash >> 33)) * 0xC4CEB9FE1A85EC53;
+            return static_cast<size_t>(hash ^ (hash >> 33));
+        }
+    };
+} // namespace
+#if defined(UCONV_HEADER_ONLY)
+using namespace UCONV_INTERNAL_NAMESPACE;
+#endif
+
+UCONV_INLINE Kernel active_kernel()
+{
+    return current_kernels().load(std::memory_order_relaxed)->kernel;
+}
+
+UCONV_INLINE bool select_kernel(Kernel kernel)
+{
+    const Kernels* kernels = find_kernels(kernel);
+    if(nullptr == kernels) {
+        return false;
+    }
+    current_kernels().store(kernels, std::memory_order_relaxed);
+    return true;
+}
+
+UCONV_INLINE Stats& Stats::operator+=(const Stats& other)
+{
+    for(uint64_t Stats::*field : stats_fields) {
+        this->*field += other.*field;
+    }
+    return *this;
+}
+
+UCONV_INLINE Stats thread_stats()
+{
+    if constexpr(stats_enabled) {
+        return local_stats().snapshot();
+    }
+    return {};
+}
+
+UCONV_INLINE Stats aggregate_stats()
+{
+    if constexpr(stats_enabled) {
+        StatsRegistry& registry = stats_registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        Stats stats = registry.retired;
+        for(ThreadStats* thread : registry.threads) {
+            stats += thread->snapshot();
+        }
+        return stats;
+    }
+    return {};
+}
+
+UCONV_INLINE size_t utf8_length_from_utf16(size_t utf16_length, const char16_t* utf16_string)
+{
+    assert(0 == utf16_length || nullptr != utf16_string);
+    return current_kernels().load(std::memory_order_relaxed)->utf8_length_from_utf16(utf16_length, utf16_string);
+}
+
+UCONV_INLINE size_t utf16_length_from_utf8(size_t utf8_length, const char8_t* utf8_string)
+{
+    assert(0 == utf8_length || nullptr != utf8_string);
+    return current_kernels().load(std::memory_order_relaxed)->utf16_length_from_utf8(utf8_length, utf8_string);
+}
+
+UCONV_INLINE size_t validate_utf8(size_t utf8_length, const char8_t* utf8_string)
+{
+    assert(0 == utf8_length || nullptr != utf8_string);
+    return current_kernels().load(std::memory_order_relaxed)->validate_utf8(utf8_length, utf8_string);
+}
+
+UCONV_INLINE size_t validate_utf16(size_t utf16_length, const char16_t* utf16_string)
+{
+    assert(0 == utf16_length || nullptr != utf16_string);
+    return current_kernels().load(std::memory_order_relaxed)->validate_utf16(utf16_length, utf16_string);
+}
+
+namespace detail
+{
+UCONV_INLINE std::u8string utf16_to_utf8_long(const std::u16string& utf16_string)
+{
+    return utf16_units_to_utf8<false>(utf16_string.length(), utf16_string.data());
+}
+
+UCONV_INLINE std::u16string utf8_to_utf16_long(const std::u8string& utf8_string)
+{
+    return utf8_to_utf16_units<false>(utf8_string);
+}
+} // namespace detail
+
+UCONV_INLINE BufferResult utf16_to_utf8(size_t utf8_length, char8_t* utf8_string, size_t utf16_length, const char16_t* utf16_string)
+{
+    return utf16_units_to_utf8<false>(utf8_length, utf8_string, utf16_length, utf16_string);
+}
+
+UCONV_INLINE BufferResult utf8_to_utf16(size_t utf16_length, char16_t* utf16_string, size_t utf8_length, const char8_t* utf8_string)
+{
+    return utf8_to_utf16_units<false>(utf16_length, utf16_string, utf8_length, utf8_string);
+}
+
+UCONV_INLINE size_t utf8_length_from_utf16le(size_t utf16_length, const char16_t* utf16_string)
+{
+    return utf8_length_from_utf16_units<!little_endian>(utf16_length, utf16_string);
+}
+
+UCONV_INLINE size_t utf8_length_from_utf16be(size_t utf16_length, const char16_t* utf16_string)
+{
+    return utf8_length_from_utf16_units<little_endian>(utf16_length, utf16_string);
+}
+
+UCONV_INLINE std::u8string utf16le_to_utf8(const std::u16string& utf16_string)
+{
+    return utf16_units_to_utf8<!little_endian>(utf16_string.length(), utf16_string.data());
+}
+
+UCONV_INLINE std::u8string utf16be_to_utf8(const std::u16string& utf16_string)
+{
+    return utf16_units_to_utf8<little_endian>(utf16_string.length(), utf16_string.data());
+}
+
+UCONV_INLINE std::u8string utf16bom_to_utf8(const std::u16string& utf16_string)
+{
+    const Utf16ByteOrder order = utf16_byte_order(utf16_string.length(), utf16_string.data());
+    const size_t length = utf16_string.length() - order.mark_length;
+    const char16_t* units = utf16_string.data() + order.mark_length;
+    return order.swap ? utf16_units_to_utf8<true>(length, units) : utf16_units_to_utf8<false>(length, units);
+}
+
+UCONV_INLINE std::u16string utf8_to_utf16le(const std::u8string& utf8_string)
+{
+    return utf8_to_utf16_units<!little_endian>(utf8_string);
+}
+
+UCONV_INLINE std::u16string utf8_to_utf16be(const std::u8string& utf8_string)
+{
+    return utf8_to_utf16_units<little_endian>(utf8_string);
+}
+
+UCONV_INLINE BufferResult utf16le_to_utf8(size_t utf8_length, char8_t* utf8_string, size_t utf16_length, const char16_t* utf16_string)
+{
+    return utf16_units_to_utf8<!little_endian>(utf8_length, utf8_string, utf16_length, utf16_string);
+}
+
+UCONV_INLINE BufferResult utf16be_to_utf8(size_t utf8_length, char8_t* utf8_string, size_t utf16_length, const char16_t* utf16_string)
+{
+    return utf16_units_to_utf8<little_endian>(utf8_length, utf8_string, utf16_length, utf16_string);
+}
+
+UCONV_INLINE BufferResult utf16bom_to_utf8(size_t utf8_length, char8_t* utf8_string, size_t utf16_length, const char16_t* utf16_string)
+{
+    const Utf16ByteOrder order = utf16_byte_order(utf16_length, utf16_string);
+    const size_t length = utf16_length - order.mark_length;
+    const char16_t* units = utf16_string + order.mark_length;
+    const BufferResult result = order.swap ? utf16_units_to_utf8<true>(utf8_length, utf8_string, length, units)
+                                           : utf16_units_to_utf8<false>(utf8_length, utf8_string, length, units);
+    return {order.mark_length + result.consumed, result.produced};
+}
+
+UCONV_INLINE BufferResult utf8_to_utf16le(size_t utf16_length, char16_t* utf16_string, size_t utf8_length, const char8_t* utf8_string)
+{
+    return utf8_to_utf16_units<!little_endian>(utf16_length, utf16_string, utf8_length, utf8_string);
+}
+
+UCONV_INLINE BufferResult utf8_to_utf16be(size_t utf16_length, char16_t* utf16_string, size_t utf8_length, const char8_t* utf8_string)
+{
+    return utf8_to_utf16_units<little_endian>(utf16_length, utf16_string, utf8_length, utf8_string);
+}
+
+UCONV_INLINE size_t utf32_length_from_utf8(size_t utf8_length, const char8_t* utf8_string)
+{
+    assert(0 == utf8_length || nullptr != utf8_string);
+    return current_kernels().load(std::memory_order_relaxed)->utf32_length_from_utf8(utf8_length, utf8_string);
+}
+
+UCONV_INLINE size_t utf8_length_from_utf32(size_t utf32_length, const char32_t* utf32_string)
+{
+    assert(0 == utf32_length || nullptr != utf32_string);
+    return current_kernels().load(std::memory_order_relaxed)->utf8_length_from_utf32(utf32_length, utf32_string);
+}
+
+UCONV_INLINE size_t utf32_length_from_utf16(size_t utf16_length, const char16_t* utf16_string)
+{
+    assert(0 == utf16_length || nullptr != utf16_string);
+    return current_kernels().load(std::memory_order_relaxed)->utf32_length_from_utf16(utf16_length, utf16_string);
+}
+
+UCONV_INLINE size_t utf16_length_from_utf32(size_t utf32_length, const char32_t* utf32_string)
+{
+    assert(0 == utf32_length || nullptr != utf32_string);
+    return current_kernels().load(std::memory_order_relaxed)->utf16_length_from_utf32(utf32_length, utf32_string);
+}
+
+UCONV_INLINE size_t utf8_length_from_latin1(size_t latin1_length, const char* latin1_string)
+{
+    assert(0 == latin1_length || nullptr != latin1_string);
+    return current_kernels().load(std::memory_order_relaxed)->utf8_length_from_latin1(latin1_length, latin1_string);
+}
+
+UCONV_INLINE size_t latin1_length_from_utf8(size_t utf8_length, const char8_t* utf8_string)
+{
+    // One character per code point, the same as UTF-32
+    return utf32_length_from_utf8(utf8_length, utf8_string);
+}
+
+UCONV_INLINE std::u32string utf8_to_utf32(const std::u8string& utf8_string)
+{
+    // The length is exact for valid input, malformed input stops the conversion early
+    std::u32string utf32_string;
+    utf32_string.resize_and_overwrite(utf32_length_from_utf8(utf8_string.length(), utf8_string.data()), [&](char32_t* data, size_t length) {
+        return convert_utf8_to_utf32(length, data, utf8_string.length(), utf8_string.data()).written;
+    });
+    return utf32_string;
+}
+
+UCONV_INLINE std::u8string utf32_to_utf8(const std::u32string& utf32_string)
+{
+    std::u8string utf8_string;
+    utf8_string.resize_and_overwrite(utf8_length_from_utf32(utf32_string.length(), utf32_string.data()), [&](char8_t* data, size_t length) {
+        return convert_utf32_to_utf8(length, data, utf32_string.length(), utf32_string.data()).written;
+    });
+    return utf8_string;
+}
+
+UCONV_INLINE std::u32string utf16_to_utf32(const std::u16string& utf16_string)
+{
+    std::u32string utf32_string;
+    utf32_string.resize_and_overwrite(utf32_length_from_utf16(utf16_string.length(), utf16_string.data()), [&](char32_t* data, size_t length) {
+        return convert_utf16_to_utf32(length, data, utf16_string.length(), utf16_string.data()).written;
+    });
+    return utf32_string;
+}
+
+UCONV_INLINE std::u16string utf32_to_utf16(const std::u32string& utf32_string)
+{
+    std::u16string utf16_string;
+    utf16_string.resize_and_overwrite(utf16_length_from_utf32(utf32_string.length(), utf32_string.data()), [&](char16_t* data, size_t length) {
+        return convert_utf32_to_utf16(length, data, utf32_string.length(), utf32_string.data()).written;
+    });
+    return utf16_string;
+}
+
+UCONV_INLINE std::u8string latin1_to_utf8(const std::string& latin1_string)
+{
+    std::u8string utf8_string;
+    utf8_string.resize_and_overwrite(utf8_length_from_latin1(latin1_string.length(), latin1_string.data()), [&](char8_t* data, size_t length) {
+        return convert_latin1_to_utf8(length, data, latin1_string.length(), latin1_string.data()).written;
+    });
+    return utf8_string;
+}
+
+UCONV_INLINE std::string utf8_to_latin1(const std::u8string& utf8_string)
+{
+    // The length is exact for valid input in range, anything else stops the conversion early
+    std::string latin1_string;
+    latin1_string.resize_and_overwrite(latin1_length_from_utf8(utf8_string.length(), utf8_string.data()), [&](char* data, size_t length) {
+        return convert_utf8_to_latin1(length, data, utf8_string.length(), utf8_string.data()).written;
+    });
+    return latin1_string;
+}
+
+UCONV_INLINE std::u16string latin1_to_utf16(const std::string& latin1_string)
+{
+    std::u16string utf16_string;
+    utf16_string.resize_and_overwrite(latin1_string.length(), [&](char16_t* data, size_t length) {
+        const UnitKernel<char, char16_t> kernel = current_kernels().load(std::memory_order_relaxed)->latin1_to_utf16;
+        return convert_latin1_units(kernel, length, data, latin1_string.length(), latin1_string.data()).written;
+    });
+    return utf16_string;
+}
+
+UCONV_INLINE std::string utf16_to_latin1(const std::u16string& utf16_string)
+{
+    std::string latin1_string;
+    latin1_string.resize_and_overwrite(utf16_string.length(), [&](char* data, size_t length) {
+        const UnitKernel<char16_t, char> kernel = current_kernels().load(std::memory_order_relaxed)->utf16_to_latin1;
+        return convert_latin1_units(kernel, length, data, utf16_string.length(), utf16_string.data()).written;
+    });
+    return latin1_string;
+}
+
+UCONV_INLINE std::u32string latin1_to_utf32(const std::string& latin1_string)
+{
+    std::u32string utf32_string;
+    utf32_string.resize_and_overwrite(latin1_string.length(), [&](char32_t* data, size_t length) {
+        const UnitKernel<char, char32_t> kernel = current_kernels().load(std::memory_order_relaxed)->latin1_to_utf32;
+        return convert_latin1_units(kernel, length, data, latin1_string.length(), latin1_string.data()).written;
+    });
+    return utf32_string;
+}
+
+UCONV_INLINE std::string utf32_to_latin1(const std::u32string& utf32_string)
+{
+    std::string latin1_string;
+    latin1_string.resize_and_overwrite(utf32_string.length(), [&](char* data, size_t length) {
+        const UnitKernel<char32_t, char> kernel = current_kernels().load(std::memory_order_relaxed)->utf32_to_latin1;
+        return convert_latin1_units(kernel, length, data, utf32_string.length(), utf32_string.data()).written;
+    });
+    return latin1_string;
+}
+
+UCONV_INLINE size_t utf8_to_utf32(size_t utf32_length, char32_t* utf32_string, size_t utf8_length, const char8_t* utf8_string)
+{
+    assert(nullptr != utf32_string || 0 == utf32_length);
+    assert(nullptr != utf8_string || 0 == utf8_length);
+    return convert_utf8_to_utf32(utf32_length, utf32_string, utf8_length, utf8_string).written;
+}
+
+UCONV_INLINE size_t utf32_to_utf8(size_t utf8_length, char8_t* utf8_string, size_t utf32_length, const char32_t* utf32_string)
+{
+    assert(nullptr != utf8_string || 0 == utf8_length);
+    assert(nullptr != utf32_string || 0 == utf32_length);
+    return convert_utf32_to_utf8(utf8_length, utf8_string, utf32_length, utf32_string).written;
+}
+
+UCONV_INLINE size_t utf16_to_utf32(size_t utf32_length, char32_t* utf32_string, size_t utf16_length, const char16_t* utf16_string)
+{
+    assert(nullptr != utf32_string || 0 == utf32_length);
+    assert(nullptr != utf16_string || 0 == utf16_length);
+    return convert_utf16_to_utf32(utf32_length, utf32_string, utf16_length, utf16_string).written;
+}
+
+UCONV_INLINE size_t utf32_to_utf16(size_t utf16_length, char16_t* utf16_string, size_t utf32_length, const char32_t* utf32_string)
+{
+    assert(nullptr != utf16_string || 0 == utf16_length);
+    assert(nullptr != utf32_string || 0 == utf32_length);
+    return convert_utf32_to_utf16(utf16_length, utf16_string, utf32_length, utf32_string).written;
+}
+
+UCONV_INLINE size_t latin1_to_utf8(size_t utf8_length, char8_t* utf8_string, size_t latin1_length, const char* latin1_string)
+{
+    assert(nullptr != utf8_string || 0 == utf8_length);
+    assert(nullptr != latin1_string || 0 == latin1_length);
+    return convert_latin1_to_utf8(utf8_length, utf8_string, latin1_length, latin1_string).written;
+}
+
+UCONV_INLINE size_t utf8_to_latin1(size_t latin1_length, char* latin1_string, size_t utf8_length, const char8_t* utf8_string)
+{
+    assert(nullptr != latin1_string || 0 == latin1_length);
+    assert(nullptr != utf8_string || 0 == utf8_length);
+    return convert_utf8_to_latin1(latin1_length, latin1_string, utf8_length, utf8_string).written;
+}
+
+UCONV_INLINE size_t latin1_to_utf16(size_t utf16_length, char16_t* utf16_string, size_t latin1_length, const char* latin1_string)
+{
+    assert(nullptr != utf16_string || 0 == utf16_length);
+    assert(nullptr != latin1_string || 0 == latin1_length);
+    const UnitKernel<char, char16_t> kernel = current_kernels().load(std::memory_order_relaxed)->latin1_to_utf16;
+    return convert_latin1_units(kernel, utf16_length, utf16_string, latin1_length, latin1_string).written;
+}
+
+UCONV_INLINE size_t utf16_to_latin1(size_t latin1_length, char* latin1_string, size_t utf16_length, const char16_t* utf16_string)
+{
+    assert(nullptr != latin1_string || 0 == latin1_length);
+    assert(nullptr != utf16_string || 0 == utf16_length);
+    const UnitKernel<char16_t, char> kernel = current_kernels().load(std::memory_order_relaxed)->utf16_to_latin1;
+    return convert_latin1_units(kernel, latin1_length, latin1_string, utf16_length, utf16_string).written;
+}
+
+UCONV_INLINE size_t latin1_to_utf32(size_t utf32_length, char32_t* utf32_string, size_t latin1_length, const char* latin1_string)
+{
+    assert(nullptr != utf32_string || 0 == utf32_length);
+    assert(nullptr != latin1_string || 0 == latin1_length);
+    const UnitKernel<char, char32_t> kernel = current_kernels().load(std::memory_order_relaxed)->latin1_to_utf32;
+    return convert_latin1_units(kernel, utf32_length, utf32_string, latin1_length, latin1_string).written;
+}
+
+UCONV_INLINE size_t utf32_to_latin1(size_t latin1_length, char* latin1_string, size_t utf32_length, const char32_t* utf32_string)
+{
+    assert(nullptr != latin1_string || 0 == latin1_length);
+    assert(nullptr != utf32_string || 0 == utf32_length);
+    const UnitKernel<char32_t, char> kernel = current_kernels().load(std::memory_order_relaxed)->utf32_to_latin1;
+    return convert_latin1_units(kernel, latin1_length, latin1_string, utf32_length, utf32_string).written;
+}
+
+template<ErrorPolicy Policy>
+Result convert(size_t utf16_length, char16_t* utf16_string, size_t utf8_length, const char8_t* utf8_string)
+{
+    assert(nullptr != utf16_string || 0 == utf16_length);
+    assert(nullptr != utf8_string || 0 == utf8_length);
+    const Utf8Validator validate = current_kernels().load(std::memory_order_relaxed)->validate_utf8;
+    Result result = {Status::success, 0, 0, utf8_length};
+    size_t& index = result.consumed;
+    size_t& count = result.written;
+    while(index < utf8_length) {
+        // Validate a block, convert its valid prefix with the kernels
+        const size_t block_end = (utf8_length - index) <= validation_block_size ? utf8_length : index + validation_block_size;
+        const size_t valid_end = index + validate(block_end - index, utf8_string + index);
+        Progress progress = convert_utf8_to_utf16(utf16_length - count, utf16_string + count, valid_end - index, utf8_string + index);
+        index += progress.read;
+        count += progress.written;
+        if(index < valid_end) {
+            result.status = Status::output_too_small;
+            break;
+        }
+        if(valid_end == block_end || (block_end < utf8_length && (block_end - valid_end) < 4)) {
+            // Valid, or a sequence split by the end of the block
+            continue;
+        }
+
+        result.error_offset = std::min(result.error_offset, index);
+        if constexpr(stats_enabled) {
+            count_utf8_error(utf8_length, utf8_string, index);
+        }
+        if constexpr(ErrorPolicy::strict == Policy) {
+            result.status = Status::invalid_input;
+            break;
+        } else {
+            char16_t unit = 0xFFFD;
+            size_t length = maximal_subpart(utf8_length, utf8_string, index);
+            if constexpr(ErrorPolicy::pass_through == Policy) {
+                // ED A0 80 to ED BF BF encode U+D800 to U+DFFF
+                if(3 <= (utf8_length - index) && 0xED == utf8_string[index] && 0xA0 == (utf8_string[index + 1] & 0xE0) && 0x80 == (utf8_string[index + 2] & 0xC0)) {
+                    unit = static_cast<char16_t>(0xD000 | ((utf8_string[index + 1] & 0x3F) << 6) | (utf8_string[index + 2] & 0x3F));
+                    length = 3;
+                }
+            }
+            if(utf16_length == count) {
+                result.status = Status::output_too_small;
+                break;
+            }
+            utf16_string[count++] = unit;
+            index += length;
+        }
+    }
+    result.error_offset = std::min(result.error_offset, index);
+    if constexpr(stats_enabled) {
+        count_call<char8_t, char16_t>(utf8_length, {index, count}, result.error_offset < utf8_length);
+        if(Status::output_too_small == result.status) {
+            count_stat<&Stats::output_full>();
+        }
+    }
+    return result;
+}
+
+template<ErrorPolicy Policy>
+Result convert(size_t utf8_length, char8_t* utf8_string, size_t utf16_length, const char16_t* utf16_string)
+{
+    assert(nullptr != utf8_string || 0 == utf8_length);
+    assert(nullptr != utf16_string || 0 == utf16_length);
+    const Utf16Validator validate = current_kernels().load(std::memory_order_relaxed)->validate_utf16;
+    Result result = {Status::success, 0, 0, utf16_length};
+    size_t& index = result.consumed;
+    size_t& count = result.written;
+    while(index < utf16_length) {
+        const size_t block_end = (utf16_length - index) <= validation_block_size ? utf16_length : index + validation_block_size;
+        const size_t valid_end = index + validate(block_end - index, utf16_string + index);
+        Progress progress = convert_utf16_to_utf8<true>(utf8_length - count, utf8_string + count, valid_end - index, utf16_string + index);
+        index += progress.read;
+        count += progress.written;
+        if(index < valid_end) {
+            result.status = Status::output_too_small;
+            break;
+        }
+        if(valid_end == block_end || (block_end < utf16_length && (block_end - valid_end) < 2)) {
+            // Valid, or a surrogate pair split by the end of the block
+            continue;
+        }
+
+        result.error_offset = std::min(result.error_offset, index);
+        count_stat<&Stats::unpaired_surrogates>();
+        if constexpr(ErrorPolicy::strict == Policy) {
+            result.status = Status::invalid_input;
+            break;
+        } else {
+            const char16_t unit = (ErrorPolicy::pass_through == Policy) ? utf16_string[index] : char16_t(0xFFFD);
+            if((utf8_length - count) < 3) {
+                result.status = Status::output_too_small;
+                break;
+            }
+            utf8_string[count++] = static_cast<char8_t>(0xE0 | (unit >> 12));
+            utf8_string[count++] = static_cast<char8_t>(0x80 | ((unit >> 6) & 0x3F));
+            utf8_string[count++] = static_cast<char8_t>(0x80 | (unit & 0x3F));
+            ++index;
+        }
+    }
+    result.error_offset = std::min(result.error_offset, index);
+    if constexpr(stats_enabled) {
+        count_call<char16_t, char8_t>(utf16_length, {index, count}, result.error_offset < utf16_length);
+        if(Status::output_too_small == result.status) {
+            count_stat<&Stats::output_full>();
+        }
+    }
+    return result;
+}
+
+#if !defined(UCONV_HEADER_ONLY)
+template Result convert<ErrorPolicy::strict>(size_t, char16_t*, size_t, const char8_t*);
+template Result convert<ErrorPolicy::replace>(size_t, char16_t*, size_t, const char8_t*);
+template Result convert<ErrorPolicy::pass_through>(size_t, char16_t*, size_t, const char8_t*);
+template Result convert<ErrorPolicy::strict>(size_t, char8_t*, size_t, const char16_t*);
+template Result convert<ErrorPolicy::replace>(size_t, char8_t*, size_t, const char16_t*);
+template Result convert<ErrorPolicy::pass_through>(size_t, char8_t*, size_t, const char16_t*);
+#endif
+
+UCONV_INLINE StreamResult Utf8ToUtf16Stream::convert(size_t utf16_length, char16_t* utf16_string, size_t utf8_length, const char8_t* utf8_string)
+{
+    assert(nullptr != utf16_string || 0 == utf16_length);
+    assert(nullptr != utf8_string || 0 == utf8_length);
+    size_t consumed = 0;
+    size_t produced = 0;
+    if(0 < pending_length_) {
+        // Complete the sequence kept from the previous chunk
+        const size_t sequence_length = utf8_sequence_length(pending_bytes_[0]);
+        const size_t taken = std::min(sequence_length - pending_length_, utf8_length);
+        if((pending_length_ + taken) < sequence_length) {
+            std::copy_n(utf8_string, taken, pending_bytes_ + pending_length_);
+            pending_length_ += taken;
+            return {taken, 0};
+        }
+        char8_t sequence[4];
+        std::copy_n(pending_bytes_, pending_length_, sequence);
+        std::copy_n(utf8_string, taken, sequence + pending_length_);
+        Progress progress = convert_utf8_to_utf16(utf16_length, utf16_string, sequence_length, sequence);
+        if(progress.read < sequence_length) {
+            return {0, 0};
+        }
+        pending_length_ = 0;
+        consumed = taken;
+        produced = progress.written;
+    }
+
+    const size_t tail = incomplete_utf8_tail(utf8_length - consumed, utf8_string + consumed);
+    Progress progress = convert_utf8_to_utf16(utf16_length - produced, utf16_string + produced, utf8_length - consumed - tail, utf8_string + consumed);
+    consumed += progress.read;
+    produced += progress.written;
+    if(0 < tail && (utf8_length - tail) == consumed) {
+        std::copy_n(utf8_string + consumed, tail, pending_bytes_);
+        pending_length_ = tail;
+        consumed = utf8_length;
+    }
+    return {consumed, produced};
+}
+
+UCONV_INLINE bool Utf8ToUtf16Stream::finish()
+{
+    const bool complete = (0 == pending_length_);
+    reset();
+    return complete;
+}
+
+UCONV_INLINE bool Utf8ToUtf16Stream::pending() const
+{
+    return 0 < pending_length_;
+}
+
+UCONV_INLINE void Utf8ToUtf16Stream::reset()
+{
+    pending_length_ = 0;
+}
+
+UCONV_INLINE StreamResult Utf16ToUtf8Stream::convert(size_t utf8_length, char8_t* utf8_string, size_t utf16_length, const char16_t* utf16_string)
+{
+    assert(nullptr != utf8_string || 0 == utf8_length);
+    assert(nullptr != utf16_string || 0 == utf16_length);
+    size_t consumed = 0;
+    size_t produced = 0;
+    if(0 != pending_unit_) {
+        // Pair the high surrogate kept from the previous chunk, or encode it as-is
+        if(0 == utf16_length) {
+            return {0, 0};
+        }
+        const char16_t units[2] = {pending_unit_, utf16_string[0]};
+        const size_t unit_count = (0xDC00 == (utf16_string[0] & 0xFC00)) ? 2 : 1;
+        Progress progress = convert_utf16_to_utf8<true>(utf8_length, utf8_string, unit_count, units);
+        if(progress.read < unit_count) {
+            return {0, 0};
+        }
+        pending_unit_ = 0;
+        consumed = unit_count - 1;
+        produced = progress.written;
+    }
+
+    const size_t tail = (consumed < utf16_length && 0xD800 == (utf16_string[utf16_length - 1] & 0xFC00)) ? 1 : 0;
+    Progress progress = convert_utf16_to_utf8<true>(utf8_length - produced, utf8_string + produced, utf16_length - consumed - tail, utf16_string + consumed);
+    consumed += progress.read;
+    produced += progress.written;
+    if(0 < tail && (utf16_length - tail) == consumed) {
+        pending_unit_ = utf16_string[consumed];
+        consumed = utf16_length;
+    }
+    return {consumed, produced};
+}
+
+UCONV_INLINE size_t Utf16ToUtf8Stream::finish(size_t utf8_length, char8_t* utf8_string)
+{
+    assert(nullptr != utf8_string || 0 == utf8_length);
+    size_t produced = 0;
+    if(0 != pending_unit_) {
+        produced = convert_utf16_to_utf8<true>(utf8_length, utf8_string, 1, &pending_unit_).written;
+        if(0 == produced) {
+            return 0;
+        }
+    }
+    reset();
+    return produced;
+}
+
+UCONV_INLINE bool Utf16ToUtf8Stream::pending() const
+{
+    return 0 != pending_unit_;
+}
+
+UCONV_INLINE void Utf16ToUtf8Stream::reset()
+{
+    pending_unit_ = 0;
+}
+
+namespace detail
+{
+UCONV_INLINE void count_reallocation()
+{
+    count_stat<&Stats::reallocations>();
+}
+
+UCONV_INLINE size_t utf8_to_utf16_sized(size_t utf16_length, char16_t* utf16_string, size_t utf8_length, const char8_t* utf8_string)
+{
+    assert(0 == utf8_length || nullptr != utf8_string);
+    const Progress progress = convert_utf8_to_utf16(utf16_length, utf16_string, utf8_length, utf8_string);
+    count_conversion<char8_t, char16_t>(utf8_length, utf8_string, progress);
+    return progress.written;
+}
+
+UCONV_INLINE size_t utf16_to_utf8_sized(size_t utf8_length, char8_t* utf8_string, size_t utf16_length, const char16_t* utf16_string)
+{
+    assert(0 == utf16_length || nullptr != utf16_string);
+    const Progress progress = convert_utf16_to_utf8<false>(utf8_length, utf8_string, utf16_length, utf16_string);
+    count_conversion<char16_t, char8_t>(utf16_length, utf16_string, progress);
+    return progress.written;
+}
+} // namespace detail
+
+UCONV_INLINE size_t utf8_to_utf16_batch(size_t count, const std::u8string_view* utf8_strings, size_t arena_length, char16_t* arena, size_t* offsets)
+{
+    assert(0 == count || nullptr != utf8_strings);
+    return convert_utf8_batch<false>(count, [utf8_strings](size_t i) { return utf8_strings[i]; }, arena_length, arena, offsets);
+}
+
+UCONV_INLINE size_t utf8_to_utf16_batch(size_t count, const size_t* utf8_offsets, const char8_t* utf8_data, size_t arena_length, char16_t* arena, size_t* offsets)
+{
+    assert(nullptr != utf8_offsets);
+    return convert_utf8_batch<true>(count, [utf8_offsets, utf8_data](size_t i) {
+        return std::u8string_view(utf8_data + utf8_offsets[i], utf8_offsets[i + 1] - utf8_offsets[i]);
+    }, arena_length, arena, offsets);
+}
+
+UCONV_INLINE Utf16Batch utf8_to_utf16_batch(size_t count, const std::u8string_view* utf8_strings, std::pmr::memory_resource* resource)
+{
+    assert(0 == count || nullptr != utf8_strings);
+    const auto string_at = [utf8_strings](size_t i) { return utf8_strings[i]; };
+
+    // The length counts add up over adjacent strings, a run is counted at once
+    size_t arena_length = 0;
+    for(size_t first = 0; first < count;) {
+        const AdjacentRun run = adjacent_run(first, count, string_at);
+        arena_length += utf16_length_from_utf8(run.length, run.begin);
+        first = run.end;
+    }
+
+    Utf16Batch batch{std::pmr::u16string(resource), std::pmr::vector<size_t>(count + 1, resource)};
+    batch.arena.resize_and_overwrite(arena_length, [&](char16_t* data, size_t length) {
+        convert_utf8_batch<false>(count, string_at, length, data, batch.offsets.data());
+        return batch.offsets[count];
+    });
+    return batch;
+}
+
+UCONV_INLINE OffsetIndex::OffsetIndex(std::u8string_view utf8_string)
+    : utf8_string_(utf8_string)
+{
+    checkpoints_.reserve(utf8_string.length() / offset_checkpoint_interval + 2);
+    append_checkpoints(checkpoints_, utf8_string.length());
+}
+
+UCONV_INLINE size_t OffsetIndex::utf8_length() const
+{
+    return checkpoints_.back().utf8;
+}
+
+UCONV_INLINE size_t OffsetIndex::utf16_length() const
+{
+    return checkpoints_.back().utf16;
+}
+
+UCONV_INLINE size_t OffsetIndex::codepoint_length() const
+{
+    return checkpoints_.back().codepoint;
+}
+
+UCONV_INLINE size_t OffsetIndex::utf8_offset_from_utf16(size_t utf16_offset) const
+{
+    return utf8_offset_from(&Checkpoint::utf16, utf16_offset);
+}
+
+UCONV_INLINE size_t OffsetIndex::utf16_offset_from_utf8(size_t utf8_offset) const
+{
+    return offset_from_utf8(&Checkpoint::utf16, utf8_offset);
+}
+
+UCONV_INLINE size_t OffsetIndex::utf8_offset_from_codepoint(size_t codepoint_offset) const
+{
+    return utf8_offset_from(&Checkpoint::codepoint, codepoint_offset);
+}
+
+UCONV_INLINE size_t OffsetIndex::codepoint_offset_from_utf8(size_t utf8_offset) const
+{
+    return offset_from_utf8(&Checkpoint::codepoint, utf8_offset);
+}
+
+UCONV_INLINE size_t OffsetIndex::utf16_offset_from_codepoint(size_t codepoint_offset) const
+{
+    return utf16_offset_from_utf8(utf8_offset_from_codepoint(codepoint_offset));
+}
+
+UCONV_INLINE size_t OffsetIndex::codepoint_offset_from_utf16(size_t utf16_offset) const
+{
+    return codepoint_offset_from_utf8(utf8_offset_from_utf16(utf16_offset));
+}
+
+UCONV_INLINE void OffsetIndex::update(std::u8string_view utf8_string, size_t utf8_offset, size_t removed_length, size_t inserted_length)
+{
+    assert((utf8_offset + removed_length) <= utf8_length());
+    assert(utf8_string.length() == (utf8_length() - removed_length + inserted_length));
+    utf8_string_ = utf8_string;
+
+    // The checkpoints from first to last are rescanned, first is the last one at least 3 bytes before
+    // the edit and last the first one at least 3 bytes after it, checkpoints_.end() if there is none.
+    // The edit cannot move the sequence boundaries at either of them, see sequence_start().
+    const auto first = std::ranges::upper_bound(checkpoints_, utf8_offset - std::min<size_t>(utf8_offset, 3), {}, &Checkpoint::utf8) - 1;
+    const auto last = std::ranges::lower_bound(first + 1, checkpoints_.end(), utf8_offset + removed_length + 3, {}, &Checkpoint::utf8);
+    if(checkpoints_.end() == last) {
+        checkpoints_.erase(first + 1, checkpoints_.end());
+        append_checkpoints(checkpoints_, utf8_string.length());
+        return;
+    }
+
+    std::vector<Checkpoint> rescanned = {*first};
+    append_checkpoints(rescanned, last->utf8 - removed_length + inserted_length);
+    // Unsigned differences, adding them wraps around to the shifted offsets
+    const Checkpoint shift = {rescanned.back().utf8 - last->utf8, rescanned.back().utf16 - last->utf16, rescanned.back().codepoint - last->codepoint};
+    const auto replaced = checkpoints_.erase(first + 1, last + 1);
+    const auto shifted = checkpoints_.insert(replaced, rescanned.begin() + 1, rescanned.end()) + static_cast<std::ptrdiff_t>(rescanned.size() - 1);
+    for(auto checkpoint = shifted; checkpoint != checkpoints_.end(); ++checkpoint) {
+        checkpoint->utf8 += shift.utf8;
+        checkpoint->utf16 += shift.utf16;
+        checkpoint->codepoint += shift.codepoint;
+    }
+}
+
+// Continues from checkpoints.back() with one checkpoint every offset_checkpoint_interval bytes and one at utf8_end,
+// which must start a sequence. Valid runs are counted with the SIMD length functions, malformed input is decoded.
+UCONV_INLINE void OffsetIndex::append_checkpoints(std::vector<Checkpoint>& checkpoints, size_t utf8_end) const
+{
+    const char8_t* utf8_string = utf8_string_.data();
+    Checkpoint checkpoint = checkpoints.back();
+    size_t valid_end = checkpoint.utf8 + validate_utf8(utf8_end - checkpoint.utf8, utf8_string + checkpoint.utf8);
+    while(checkpoint.utf8 < utf8_end) {
+        const size_t end = std::min(checkpoint.utf8 + offset_checkpoint_interval, utf8_end);
+        if(valid_end < checkpoint.utf8) {
+            valid_end = checkpoint.utf8 + validate_utf8(utf8_end - checkpoint.utf8, utf8_string + checkpoint.utf8);
+        }
+        size_t valid = std::min(end, valid_end);
+        while(valid < valid_end && 0x80 == (utf8_string[valid] & 0xC0)) {
+            ++valid;
+        }
+        const size_t length = valid - checkpoint.utf8;
+        checkpoint = {valid, checkpoint.utf16 + utf16_length_from_utf8(length, utf8_string + checkpoint.utf8),
+                      checkpoint.codepoint + utf32_length_from_utf8(length, utf8_string + checkpoint.utf8)};
+        // The rest of the block from the first malformed sequence on, as codepoints() decodes it
+        while(checkpoint.utf8 < end) {
+            const detail::DecodedCodepoint decoded = detail::decode_next(utf8_string + checkpoint.utf8, utf8_string + utf8_end);
+            checkpoint = {checkpoint.utf8 + decoded.length, checkpoint.utf16 + 1 + (0xFFFF < decoded.codepoint), checkpoint.codepoint + 1};
+        }
+        checkpoints.push_back(checkpoint);
+    }
+}
+
+// The largest byte offset on a sequence whose count of units is at most offset
+UCONV_INLINE size_t OffsetIndex::utf8_offset_from(size_t Checkpoint::*units, size_t offset) const
+{
+    const bool utf16 = (&Checkpoint::utf16 == units);
+    const Checkpoint& checkpoint = *(std::ranges::upper_bound(checkpoints_, offset, {}, units) - 1);
+    const char8_t* last = utf8_string_.data() + utf8_string_.length();
+    size_t index = checkpoint.utf8;
+    size_t count = checkpoint.*units;
+    while(index < utf8_string_.length()) {
+        const detail::DecodedCodepoint decoded = detail::decode_next(utf8_string_.data() + index, last);
+        const size_t length = 1 + (utf16 && 0xFFFF < decoded.codepoint);
+        if(offset < (count + length)) {
+            break;
+        }
+        count += length;
+        index += decoded.length;
+    }
+    return index;
+}
+
+UCONV_INLINE size_t OffsetIndex::offset_from_utf8(size_t Checkpoint::*units, size_t utf8_offset) const
+{
+    const bool utf16 = (&Checkpoint::utf16 == units);
+    utf8_offset = sequence_start(utf8_string_, std::min(utf8_offset, utf8_string_.length()));
+    const Checkpoint& checkpoint = *(std::ranges::upper_bound(checkpoints_, utf8_offset, {}, &Checkpoint::utf8) - 1);
+    const size_t length = utf8_offset - checkpoint.utf8;
+    const char8_t* block = utf8_string_.data() + checkpoint.utf8;
+    if(length == validate_utf8(length, block)) {
+        return checkpoint.*units + (utf16 ? utf16_length_from_utf8(length, block) : utf32_length_from_utf8(length, block));
+    }
+    size_t count = checkpoint.*units;
+    for(size_t index = 0; index < length;) {
+        const detail::DecodedCodepoint decoded = detail::decode_next(block + index, block + length);
+        count += 1 + (utf16 && 0xFFFF < decoded.codepoint);
+        index += decoded.length;
+    }
+    return count;
+}
+
+struct ConversionCache::Shard
+{
+    // Looked up with the string view of the input, no key is built on a hit
+    struct Hash
+    {
+        using is_transparent = void;
+
+        size_t operator()(std::u8string_view utf8_string) const
+        {
+            return std::hash<std::u8string_view>()(utf8_string);
+        }
+    };
+
+    std::mutex mutex;
+    std::unordered_map<std::u8string, std::shared_ptr<const std::u16string>, Hash, std::equal_to<>> entries;
+    // The keys in insertion order, the oldest is dropped first. The views point into the keys
+    // of the entries, which do not move.
+    std::deque<std::u8string_view> order;
+    size_t capacity = 0;
+    // Written under the lock, read by stats() without it
+    std::atomic<uint64_t> hits = 0;
+    std::atomic<uint64_t> misses = 0;
+    std::atomic<uint64_t> evictions = 0;
+
+    static void increment(std::atomic<uint64_t>& counter)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+};
+
+UCONV_INLINE ConversionCache::ConversionCache(size_t capacity, size_t shard_count)
+    : shard_count_(std::clamp<size_t>((0 == shard_count) ? std::thread::hardware_concurrency() : shard_count, 1, std::max<size_t>(1, capacity)))
+    , shards_(std::make_unique<Shard[]>(shard_count_))
+{
+    // The capacity is split exactly, the first capacity % shard_count_ shards keep one entry more
+    for(size_t i = 0; i < shard_count_; ++i) {
+        shards_[i].capacity = capacity / shard_count_ + ((i < capacity % shard_count_) ? 1 : 0);
+        shards_[i].entries.reserve(shards_[i].capacity);
+    }
+}
+
+UCONV_INLINE ConversionCache::~ConversionCache() = default;
+
+UCONV_INLINE ConversionCache::Shard& ConversionCache::shard_of(size_t hash) const
+{
+    // The high half of the hash, the low bits choose the bucket within the shard
+    return shards_[(hash >> (std::numeric_limits<size_t>::digits / 2)) % shard_count_];
+}
+
+UCONV_INLINE std::shared_ptr<const std::u16string> ConversionCache::utf8_to_utf16(std::u8string_view utf8_string)
+{
+    Shard& shard = shard_of(Shard::Hash()(utf8_string));
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        const auto entry = shard.entries.find(utf8_string);
+        if(shard.entries.end() != entry) {
+            Shard::increment(shard.hits);
+            return entry->second;
+        }
+        Shard::increment(shard.misses);
+    }
+
+    // Converted outside of the lock, another thread converting the same string keeps the entry it inserted first
+    std::shared_ptr<std::u16string> utf16_string = std::make_shared<std::u16string>();
+    uconv::utf8_to_utf16(*utf16_string, utf8_string);
+    if(max_cached_length < utf8_string.length() || 0 == shard.capacity) {
+        return utf16_string;
+    }
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const auto [entry, inserted] = shard.entries.try_emplace(std::u8string(utf8_string), std::move(utf16_string));
+    if(inserted) {
+        shard.order.push_back(entry->first);
+        if(shard.capacity < shard.order.size()) {
+            shard.entries.erase(shard.entries.find(shard.order.front()));
+            shard.order.pop_front();
+            Shard::increment(shard.evictions);
+        }
+    }
+    return entry->second;
+}
+
+UCONV_INLINE size_t ConversionCache::size() const
+{
+    size_t size = 0;
+    for(size_t i = 0; i < shard_count_; ++i) {
+        std::lock_guard<std::mutex> lock(shards_[i].mutex);
+        size += shards_[i].entries.size();
+    }
+    return size;
+}
+
+UCONV_INLINE CacheStats ConversionCache::stats() const
+{
+    CacheStats stats = {0, 0, 0};
+    for(size_t i = 0; i < shard_count_; ++i) {
+        stats.hits += shards_[i].hits.load(std::memory_order_relaxed);
+        stats.misses += shards_[i].misses.load(std::memory_order_relaxed);
+        stats.evictions += shards_[i].evictions.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+UCONV_INLINE void ConversionCache::clear()
+{
+    for(size_t i = 0; i < shard_count_; ++i) {
+        std::lock_guard<std::mutex> lock(shards_[i].mutex);
+        shards_[i].entries.clear();
+        shards_[i].order.clear();
+    }
+}
+
+UCONV_INLINE int compare(std::u8string_view utf8_string, std::u16string_view utf16_string)
+{
+    // Encodes the UTF-16 string a block at a time and compares the blocks with the UTF-8 bytes,
+    // the kernel and the comparison of the bytes run over ASCII at vector speed
+    char8_t utf8_block[text_block_length];
+    size_t offset = 0;
+    size_t index = 0;
+    while(index < utf16_string.length()) {
+        const Progress progress = convert_utf16_to_utf8<true>(text_block_length, utf8_block, utf16_string.length() - index, utf16_string.data() + index);
+        index += progress.read;
+        const size_t length = std::min(utf8_string.length() - offset, progress.written);
+        const int order = std::char_traits<char8_t>::compare(utf8_string.data() + offset, utf8_block, length);
+        if(0 != order) {
+            return order;
+        }
+        if(length < progress.written) {
+            return -1;
+        }
+        offset += length;
+    }
+    return (offset < utf8_string.length()) ? 1 : 0;
+}
+
+UCONV_INLINE bool equal(std::u8string_view utf8_string, std::u16string_view utf16_string)
+{
+    // A code unit encodes to 1 to 3 bytes
+    if(utf8_string.length() < utf16_string.length() || (3 * utf16_string.length()) < utf8_string.length()) {
+        return false;
+    }
+    return 0 == compare(utf8_string, utf16_string);
+}
+
+UCONV_INLINE size_t hash(std::u8string_view utf8_string)
+{
+    Utf8Hasher hasher;
+    hasher.update(utf8_string.length(), utf8_string.data());
+    return hasher.finish();
+}
+
+UCONV_INLINE size_t hash(std::u16string_view utf16_string)
+{
+    Utf8Hasher hasher;
+    char8_t utf8_block[text_block_length];
+    for(size_t index = 0; index < utf16_string.length();) {
+        const Progress progress = convert_utf16_to_utf8<true>(text_block_length, utf8_block, utf16_string.length() - index, utf16_string.data() + index);
+        index += progress.read;
+        hasher.update(progress.written, utf8_block);
+    }
+    return hasher.finish();
+}
+
+namespace parallel
+{
+UCONV_INLINE std::u8string utf16_to_utf8(const std::u16string& utf16_string, size_t thread_count)
+{
+    if(0 == thread_count) {
+        thread_count = std::max(1U, std::thread::hardware_concurrency());
+    }
+    return utf16_to_utf8(utf16_string, run_on_threads, thread_count);
+}
+
+UCONV_INLINE std::u8string utf16_to_utf8(const std::u16string& utf16_string, const Executor& executor, size_t slice_count)
+{
+    const std::vector<size_t> starts = split_on_boundaries(utf16_string.length(), utf16_string.data(), slice_count);
+    slice_count = starts.size() - 1;
+    if(1 == slice_count) {
+        return uconv::utf16_to_utf8(utf16_string);
+    }
+
+    // Every slice gets the exact output length, no high surrogate is left at the end of a slice
+    std::vector<size_t> offsets(slice_count + 1, 0);
+    executor(slice_count, [&](size_t i) {
+        offsets[i + 1] = utf8_length_from_utf16(starts[i + 1] - starts[i], utf16_string.data() + starts[i]);
+    });
+    for(size_t i = 0; i < slice_count; ++i) {
+        offsets[i + 1] += offsets[i];
+    }
+
+    std::u8string utf8_string;
+    utf8_string.resize_and_overwrite(offsets[slice_count], [&](char8_t* data, size_t length) {
+        executor(slice_count, [&](size_t i) {
+            convert_utf16_to_utf8<false>(offsets[i + 1] - offsets[i], data + offsets[i], starts[i + 1] - starts[i], utf16_string.data() + starts[i]);
+        });
+        return length;
+    });
+    return utf8_string;
+}
+
+UCONV_INLINE std::u16string utf8_to_utf16(const std::u8string& utf8_string, size_t thread_count)
+{
+    if(0 == thread_count) {
+        thread_count = std::max(1U, std::thread::hardware_concurrency());
+    }
+    return utf8_to_utf16(utf8_string, run_on_threads, thread_count);
+}
+
+UCONV_INLINE std::u16string utf8_to_utf16(const std::u8string& utf8_string, const Executor& executor, size_t slice_count)
+{
+    const std::vector<size_t> starts = split_on_boundaries(utf8_string.length(), utf8_string.data(), slice_count);
+    slice_count = starts.size() - 1;
+    if(1 == slice_count) {
+        return uconv::utf8_to_utf16(utf8_string);
+    }
+
+    // The counts are exact for valid input and upper bounds otherwise
+    std::vector<size_t> offsets(slice_count + 1, 0);
+    executor(slice_count, [&](size_t i) {
+        offsets[i + 1] = utf16_length_from_utf8(starts[i + 1] - starts[i], utf8_string.data() + starts[i]);
+    });
+    for(size_t i = 0; i < slice_count; ++i) {
+        offsets[i + 1] += offsets[i];
+    }
+
+    std::u16string utf16_string;
+    utf16_string.resize_and_overwrite(offsets[slice_count], [&](char16_t* data, size_t length) {
+        std::vector<Progress> progress(slice_count);
+        executor(slice_count, [&](size_t i) {
+            progress[i] = convert_utf8_to_utf16(offsets[i + 1] - offsets[i], data + offsets[i], starts[i + 1] - starts[i], utf8_string.data() + starts[i]);
+        });
+
+        // Malformed input can leave gaps between the slices. A slice that stopped early
+        // ends the conversion like in utf8_to_utf16(), unless it only stopped at a
+        // sequence split by the end of the slice, which the rest of the input completes.
+        size_t count = 0;
+        for(size_t i = 0; i < slice_count; ++i) {
+            if(count != offsets[i]) {
+                std::copy_n(data + offsets[i], progress[i].written, data + count);
+            }
+            count += progress[i].written;
+            if(progress[i].read < (starts[i + 1] - starts[i])) {
+                const size_t index = starts[i] + progress[i].read;
+                count += convert_utf8_to_utf16(length - count, data + count, utf8_string.length() - index, utf8_string.data() + index).written;
+                break;
+            }
+        }
+        return count;
+    });
+    return utf16_string;
 }
+} // namespace parallel
 } // namespace uconv
 
+#if defined(UCONV_X86) && defined(__GNUC__) && !defined(__clang__)
+#    pragma GCC diagnostic pop
+#endif
@@ -1,10 +1,153 @@
 #ifndef INC_UCONV_H_
 #define INC_UCONV_H_
+#include <array>
+#include <cassert>
+#include <concepts>
+#include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <ranges>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace uconv
 {
+/**
+ * @brief Instruction sets the conversion functions can be accelerated with.
+ */
+enum class Kernel
+{
+    scalar, //!< Portable code only
+    sse42,  //!< SSSE3, SSE4.1, SSE4.2 and POPCNT
+    avx2,   //!< AVX2, BMI1 and BMI2
+    avx512, //!< AVX-512 F, BW, VL, VBMI and VBMI2
+    neon,   //!< AArch64 NEON
+};
+
+/**
+ * @brief Returns the kernel used by the conversion functions.
+ *
+ * The best kernel the CPU supports is selected once, on the first call into the library.
+ */
+Kernel active_kernel();
+
+/**
+ * @brief Makes the conversion functions use the given kernel.
+ *
+ * Intended for testing and benchmarking, the conversion results do not depend on the kernel.
+ *
+ * @param kernel The kernel to use.
+ * @return true on success, false if the CPU or the build does not support @p kernel.
+ */
+bool select_kernel(Kernel kernel);
+
+//------------------------------------------------------------------------------
+// Conversion statistics
+//
+// Built with UCONV_ENABLE_STATS defined, for the library and for every translation unit
+// including this header, the conversions between UTF-8 and UTF-16 count their calls,
+// bytes and errors. Every thread writes its own counters, counting takes no lock and no
+// atomic read-modify-write. Without the macro the counting is compiled out and the
+// functions below return zeros.
+
+#if defined(UCONV_ENABLE_STATS)
+inline constexpr bool stats_enabled = true;
+#else
+inline constexpr bool stats_enabled = false;
+#endif
+
+/**
+ * @brief Counters of the conversions between UTF-8 and UTF-16.
+ *
+ * Calls and bytes are counted by utf8_to_utf16(), utf16_to_utf8(), their UTF-16LE, UTF-16BE and
+ * byte order mark variants and convert(). Errors are counted by every conversion between UTF-8
+ * and UTF-16, streams and batches included. UTF-16 is counted as 2 bytes per code unit.
+ */
+struct Stats
+{
+    uint64_t calls;                   //!< Conversions
+    uint64_t bytes_in;                //!< Bytes read
+    uint64_t bytes_out;               //!< Bytes written
+    uint64_t ascii_calls;             //!< Conversions of ASCII only input, which take the ASCII fast paths only
+    uint64_t truncated;               //!< UTF-8 input ending inside a sequence
+    uint64_t unexpected_continuation; //!< UTF-8 continuation bytes without a lead byte
+    uint64_t missing_continuation;    //!< UTF-8 lead bytes not followed by enough continuation bytes
+    uint64_t out_of_range;            //!< Overlong UTF-8, encoded surrogates, code points above U+10FFFF and bytes C0, C1, F5-FF
+    uint64_t unpaired_surrogates;     //!< Unpaired surrogates in UTF-16 input
+    uint64_t output_full;             //!< Conversions stopped by a full output buffer
+    uint64_t reallocations;           //!< Result strings allocated and containers grown by the append overloads
+
+    Stats& operator+=(const Stats& other);
+};
+
+/**
+ * @brief Returns the counters of the calling thread.
+ */
+Stats thread_stats();
+
+/**
+ * @brief Returns the sum of the counters of all threads, including the threads that have exited.
+ *
+ * Reads the counters of running threads while they count, the sum is consistent per counter.
+ * Intended for periodic export to a metrics system, rates are the difference of two snapshots.
+ */
+Stats aggregate_stats();
+
+namespace detail
+{
+// Counts a container grown by the append overloads
+void count_reallocation();
+} // namespace detail
+
+/**
+ * @brief Returns the number of bytes utf16_to_utf8() produces for a UTF-16 string.
+ *
+ * Unpaired surrogates count 3 bytes, the same as they are encoded.
+ *
+ * @param utf16_length The number of UTF-16 code units in the input string.
+ * @param utf16_string Pointer to the UTF-16 encoded input string.
+ * @return The exact length of the UTF-8 encoded result, in bytes.
+ */
+size_t utf8_length_from_utf16(size_t utf16_length, const char16_t* utf16_string);
+
+/**
+ * @brief Returns the number of code units utf8_to_utf16() produces for a UTF-8 string.
+ *
+ * @param utf8_length The number of bytes in the input UTF-8 string.
+ * @param utf8_string Pointer to the UTF-8 encoded input string.
+ * @return The exact length of the UTF-16 encoded result for valid UTF-8, in code units.
+ *         For malformed UTF-8 the result is an upper bound, as the conversion stops early.
+ */
+size_t utf16_length_from_utf8(size_t utf8_length, const char8_t* utf8_string);
+
+/**
+ * @brief Validates a UTF-8 string.
+ *
+ * Rejects malformed and truncated sequences, overlong encodings, encoded surrogates
+ * (U+D800 – U+DFFF) and code points above U+10FFFF.
+ *
+ * @param utf8_length The number of bytes in the input UTF-8 string.
+ * @param utf8_string Pointer to the UTF-8 encoded input string.
+ * @return The offset of the first byte of the first invalid sequence,
+ *         @p utf8_length if the string is valid.
+ */
+size_t validate_utf8(size_t utf8_length, const char8_t* utf8_string);
+
+/**
+ * @brief Validates a UTF-16 string.
+ *
+ * Rejects unpaired high and low surrogates.
+ *
+ * @param utf16_length The number of UTF-16 code units in the input string.
+ * @param utf16_string Pointer to the UTF-16 encoded input string.
+ * @return The offset of the first unpaired surrogate, @p utf16_length if the string is valid.
+ */
+size_t validate_utf16(size_t utf16_length, const char16_t* utf16_string);
+
 /**
  * @brief Converts a UTF-16 encoded string to a UTF-8 encoded string.
  *
@@ -18,13 +161,14 @@ namespace uconv
  *
  * @param utf16_string The input UTF-16 encoded string to be converted.
  * @return A std::u8string containing the UTF-8 encoded result.
- * @note The function reserves memory in multiples of 4 bytes for efficiency,
- *       but the actual output length may be smaller than the reserved capacity.
+ * @note The conversion runs on the SIMD kernel returned by active_kernel().
+ *       The output is allocated once, sized by utf8_length_from_utf16(). Strings of up
+ *       to 16 code units are converted inline at the call site instead.
  * @warning Invalid or malformed UTF-16 sequences are not rejected. they are
  *          encoded as-is. Applications requiring strict validation of UTF-16
- *          input should handle validation before calling this function.
+ *          input should call validate_utf16() before calling this function.
  */
-std::u8string utf16_to_utf8(const std::u16string& utf16_string);
+inline std::u8string utf16_to_utf8(const std::u16string& utf16_string);
 
 /**
  * @brief Converts a UTF-8 encoded string to a UTF-16 encoded string.
@@ -40,13 +184,23 @@ std::u8string utf16_to_utf8(const std::u16string& utf16_string);
  *
  * @param utf8_string The input UTF-8 encoded string to be converted.
  * @return A std::u16string containing the UTF-16 encoded result.
- * @note The function reserves memory in multiples of 4 code units for efficiency,
- *       but the actual output length may be smaller.
- * @warning Malformed UTF-8 sequences result in a `0` code point and cause the
- *          conversion process to stop early. Applications requiring strict error
- *          handling should validate UTF-8 input before calling this function.
+ * @note The conversion runs on the SIMD kernel returned by active_kernel().
+ *       The output is allocated once, sized by utf16_length_from_utf8(). Strings of up
+ *       to 16 bytes are converted inline at the call site instead.
+ * @warning Malformed or truncated UTF-8 sequences cause the conversion process
+ *          to stop early. Applications requiring strict error
+ *          handling should call validate_utf8() before calling this function.
+ */
+inline std::u16string utf8_to_utf16(const std::u8string& utf8_string);
+
+/**
+ * @brief Input consumed and output produced by a conversion into a user-provided buffer.
  */
-std::u16string utf8_to_utf16(const std::u8string& utf8_string);
+struct BufferResult
+{
+    size_t consumed; //!< Code units read from the input
+    size_t produced; //!< Code units written to the output buffer
+};
 
 /**
  * @brief Converts a UTF-16 encoded string to a UTF-8 encoded string (into a user-provided buffer).
@@ -57,19 +211,21 @@ std::u16string utf8_to_utf16(const std::u8string& utf8_string);
  * (U+10000 – U+10FFFF). Malformed UTF-16 sequences (such as a lone high surrogate or
  * low surrogate) are treated as individual code units and directly encoded.
  *
- * @param utf8_length The size of the output buffer, in bytes. Must be at least 128.
+ * @param utf8_length The size of the output buffer, in bytes.
  * @param utf8_string Pointer to the output buffer where the UTF-8 encoded data
- *                    will be written. Must not be null.
- * @param utf16_length The number of UTF-16 code units in the input string. Must be at least 1.
- * @param utf16_string Pointer to the UTF-16 encoded input string. Must not be null.
- * @return The number of bytes written to @p utf8_string on success.
- *         Returns 0 if the output buffer is too small to hold the full conversion.
+ *                    will be written. May be null if @p utf8_length is 0.
+ * @param utf16_length The number of UTF-16 code units in the input string.
+ * @param utf16_string Pointer to the UTF-16 encoded input string. May be null if @p utf16_length is 0.
+ * @return The UTF-16 code units consumed and the bytes written to @p utf8_string.
+ *         @p consumed is less than @p utf16_length only if the buffer is full.
  * @note The function performs boundary checks before writing multi-byte UTF-8 sequences.
- *       If insufficient space remains in the buffer, the function stops and returns 0.
+ *       If insufficient space remains in the buffer, the function stops before the code
+ *       point that does not fit, a surrogate pair is never split. Calling it again with
+ *       the rest of the input and a drained buffer continues the conversion.
  * @warning The function does not append a null terminator to the output buffer.
  *          The caller must handle null-termination if required.
  */
-size_t utf16_to_utf8(size_t utf8_length, char8_t* utf8_string, size_t utf16_length, const char16_t* utf16_string);
+BufferResult utf16_to_utf8(size_t utf8_length, char8_t* utf8_string, size_t utf16_length, const char16_t* utf16_string);
 
 /**
  * @brief Converts a UTF-8 encoded string to a UTF-16 encoded string (into a user-provided buffer).
@@ -77,21 +233,1758 @@ size_t utf16_to_utf8(size_t utf8_length, char8_t* utf8_string, size_t utf16_leng
  * This function decodes UTF-8 byte sequences into Unicode code points and encodes
  * them into UTF-16 code units, writing the result into the provided output buffer.
  * Surrogate pairs are generated for code points outside the Basic Multilingual Plane
- * (U+10000 – U+10FFFF). Malformed UTF-8 sequences result in a `0` code point and
- * terminate the conversion early.
+ * (U+10000 – U+10FFFF). Malformed or truncated UTF-8 sequences terminate the
+ * conversion early. Exactly @p utf8_length bytes are read, embedded null
+ * characters included, and no memory is allocated.
  *
- * @param utf16_length The size of the output buffer, in code units. Must be at least 64.
+ * @param utf16_length The size of the output buffer, in code units.
  * @param utf16_string Pointer to the output buffer where UTF-16 code units will be written.
- *                     Must not be null.
- * @param utf8_length The number of bytes in the input UTF-8 string. Must be at least 1.
- * @param utf8_string Pointer to the input UTF-8 encoded string. Must not be null.
- * @return The number of UTF-16 code units written to @p utf16_string on success.
- *         Returns the count accumulated before encountering an invalid sequence.
- * @note The function does not append a null terminator to the output buffer. The caller
- *       must handle null-termination if required.
+ *                     May be null if @p utf16_length is 0.
+ * @param utf8_length The number of bytes in the input UTF-8 string.
+ * @param utf8_string Pointer to the input UTF-8 encoded string. May be null if @p utf8_length is 0.
+ * @return The bytes consumed and the UTF-16 code units written to @p utf16_string.
+ *         @p consumed is less than @p utf8_length if the buffer is full or at an invalid sequence.
+ * @note The conversion stops before a code point whose code units do not fit, a surrogate
+ *       pair is never split. Calling it again with the rest of the input and a drained
+ *       buffer continues the conversion. If it stops with room left for a surrogate pair,
+ *       the input is malformed there. The function does not append a null terminator to
+ *       the output buffer. The caller must handle null-termination if required.
  * @warning If a malformed UTF-8 sequence is detected, conversion stops immediately.
- *          Applications requiring strict validation should sanitize input beforehand.
+ *          Applications requiring strict validation should call validate_utf8() beforehand.
  */
-size_t utf8_to_utf16(size_t utf16_length, char16_t* utf16_string, size_t utf8_length, const char8_t* utf8_string);
-} // namespace uconv
+BufferResult utf8_to_utf16(size_t utf16_length, char16_t* utf16_string, size_t utf8_length, const char8_t* utf8_string);
+
+//------------------------------------------------------------------------------
+// UTF-16LE and UTF-16BE
+//
+// The code units of the utf16le and utf16be strings are stored in little and big endian
+// byte order, whatever the byte order of the host. The kernels swap the bytes as they load
+// or store a vector, foreign byte order input converts without a temporary copy and about
+// as fast as native input. The utf16bom functions read the byte order from a leading byte
+// order mark, which is not converted, and assume big endian without one, as RFC 2781 does.
+// Malformed input is handled as by utf16_to_utf8() and utf8_to_utf16().
+
+/**
+ * @brief Returns the number of bytes utf16le_to_utf8() produces for a UTF-16LE string.
+ *
+ * @param utf16_length The number of UTF-16 code units in the input string.
+ * @param utf16_string Pointer to the UTF-16LE encoded input string.
+ * @return The exact length of the UTF-8 encoded result, in bytes.
+ */
+size_t utf8_length_from_utf16le(size_t utf16_length, const char16_t* utf16_string);
+
+/**
+ * @brief Returns the number of bytes utf16be_to_utf8() produces for a UTF-16BE string.
+ *
+ * @param utf16_length The number of UTF-16 code units in the input string.
+ * @param utf16_string Pointer to the UTF-16BE encoded input string.
+ * @return The exact length of the UTF-8 encoded result, in bytes.
+ */
+size_t utf8_length_from_utf16be(size_t utf16_length, const char16_t* utf16_string);
+
+/**
+ * @brief Converts a UTF-16LE encoded string to a UTF-8 encoded string.
+ *
+ * @param utf16_string The input string, code units in little endian byte order.
+ * @return A std::u8string containing the UTF-8 encoded result.
+ */
+std::u8string utf16le_to_utf8(const std::u16string& utf16_string);
+
+/**
+ * @brief Converts a UTF-16BE encoded string to a UTF-8 encoded string.
+ *
+ * @param utf16_string The input string, code units in big endian byte order.
+ * @return A std::u8string containing the UTF-8 encoded result.
+ */
+std::u8string utf16be_to_utf8(const std::u16string& utf16_string);
+
+/**
+ * @brief Converts a UTF-16 encoded string to a UTF-8 encoded string in the byte order of its byte order mark.
+ *
+ * @param utf16_string The input string, big endian without a byte order mark.
+ * @return A std::u8string containing the UTF-8 encoded result, without the byte order mark.
+ */
+std::u8string utf16bom_to_utf8(const std::u16string& utf16_string);
+
+/**
+ * @brief Converts a UTF-8 encoded string to a UTF-16LE encoded string.
+ *
+ * @param utf8_string The input UTF-8 encoded string to be converted.
+ * @return A std::u16string with the code units in little endian byte order.
+ */
+std::u16string utf8_to_utf16le(const std::u8string& utf8_string);
+
+/**
+ * @brief Converts a UTF-8 encoded string to a UTF-16BE encoded string.
+ *
+ * @param utf8_string The input UTF-8 encoded string to be converted.
+ * @return A std::u16string with the code units in big endian byte order.
+ */
+std::u16string utf8_to_utf16be(const std::u8string& utf8_string);
+
+/**
+ * @brief Converts a UTF-16LE encoded string to a UTF-8 encoded string (into a user-provided buffer).
+ *
+ * Same as utf16_to_utf8(size_t, char8_t*, size_t, const char16_t*) for little endian input.
+ *
+ * @return The UTF-16 code units consumed and the bytes written to @p utf8_string.
+ */
+BufferResult utf16le_to_utf8(size_t utf8_length, char8_t* utf8_string, size_t utf16_length, const char16_t* utf16_string);
+
+/**
+ * @brief Converts a UTF-16BE encoded string to a UTF-8 encoded string (into a user-provided buffer).
+ *
+ * Same as utf16_to_utf8(size_t, char8_t*, size_t, const char16_t*) for big endian input.
+ *
+ * @return The UTF-16 code units consumed and the bytes written to @p utf8_string.
+ */
+BufferResult utf16be_to_utf8(size_t utf8_length, char8_t* utf8_string, size_t utf16_length, const char16_t* utf16_string);
+
+/**
+ * @brief Converts a UTF-16 encoded string to a UTF-8 encoded string in the byte order of its byte order mark
+ *        (into a user-provided buffer).
+ *
+ * Same as utf16_to_utf8(size_t, char8_t*, size_t, const char16_t*), big endian without a byte order mark.
+ *
+ * @return The UTF-16 code units consumed, the byte order mark included, and the bytes written
+ *         to @p utf8_string. The rest of the input is resumed with utf16le_to_utf8() or
+ *         utf16be_to_utf8(), the byte order mark is not repeated.
+ */
+BufferResult utf16bom_to_utf8(size_t utf8_length, char8_t* utf8_string, size_t utf16_length, const char16_t* utf16_string);
+
+/**
+ * @brief Converts a UTF-8 encoded string to a UTF-16LE encoded string (into a user-provided buffer).
+ *
+ * Same as utf8_to_utf16(size_t, char16_t*, size_t, const char8_t*), the code units are written in little endian byte order.
+ *
+ * @return The bytes consumed and the UTF-16 code units written to @p utf16_string.
+ */
+BufferResult utf8_to_utf16le(size_t utf16_length, char16_t* utf16_string, size_t utf8_length, const char8_t* utf8_string);
+
+/**
+ * @brief Converts a UTF-8 encoded string to a UTF-16BE encoded string (into a user-provided buffer).
+ *
+ * Same as utf8_to_utf16(size_t, char16_t*, size_t, const char8_t*), the code units are written in big endian byte order.
+ *
+ * @return The bytes consumed and the UTF-16 code units written to @p utf16_string.
+ */
+BufferResult utf8_to_utf16be(size_t utf16_length, char16_t* utf16_string, size_t utf8_length, const char8_t* utf8_string);
+
+//------------------------------------------------------------------------------
+// UTF-32 and Latin-1
+//
+// Latin-1 (ISO-8859-1) strings hold one char per code point, U+0000 – U+00FF.
+// Every direction converts directly, without a temporary UTF-16 string. Code points
+// above U+10FFFF in UTF-32 input are converted to U+FFFD, surrogates in UTF-32 and
+// unpaired surrogates in UTF-16 are encoded as-is, like utf16_to_utf8() does.
+// Malformed UTF-8 and code points Latin-1 cannot represent stop the conversion.
+
+/**
+ * @brief Returns the number of code points in a UTF-8 string.
+ *
+ * @param utf8_length The number of bytes in the input UTF-8 string.
+ * @param utf8_string Pointer to the UTF-8 encoded input string.
+ * @return The exact length of the result of utf8_to_utf32() for valid UTF-8, an upper bound otherwise.
+ */
+size_t utf32_length_from_utf8(size_t utf8_length, const char8_t* utf8_string);
+
+/**
+ * @brief Returns the number of bytes utf32_to_utf8() produces for a UTF-32 string.
+ *
+ * @param utf32_length The number of code points in the input string.
+ * @param utf32_string Pointer to the UTF-32 encoded input string.
+ * @return The exact length of the UTF-8 encoded result, in bytes.
+ */
+size_t utf8_length_from_utf32(size_t utf32_length, const char32_t* utf32_string);
+
+/**
+ * @brief Returns the number of code points utf16_to_utf32() produces for a UTF-16 string.
+ *
+ * @param utf16_length The number of UTF-16 code units in the input string.
+ * @param utf16_string Pointer to the UTF-16 encoded input string.
+ * @return The exact length of the UTF-32 encoded result, in code points.
+ */
+size_t utf32_length_from_utf16(size_t utf16_length, const char16_t* utf16_string);
+
+/**
+ * @brief Returns the number of code units utf32_to_utf16() produces for a UTF-32 string.
+ *
+ * @param utf32_length The number of code points in the input string.
+ * @param utf32_string Pointer to the UTF-32 encoded input string.
+ * @return The exact length of the UTF-16 encoded result, in code units.
+ */
+size_t utf16_length_from_utf32(size_t utf32_length, const char32_t* utf32_string);
+
+/**
+ * @brief Returns the number of bytes latin1_to_utf8() produces for a Latin-1 string.
+ *
+ * @param latin1_length The number of characters in the input Latin-1 string.
+ * @param latin1_string Pointer to the Latin-1 encoded input string.
+ * @return The exact length of the UTF-8 encoded result, in bytes.
+ */
+size_t utf8_length_from_latin1(size_t latin1_length, const char* latin1_string);
+
+/**
+ * @brief Returns the number of characters utf8_to_latin1() produces for a UTF-8 string.
+ *
+ * @param utf8_length The number of bytes in the input UTF-8 string.
+ * @param utf8_string Pointer to the UTF-8 encoded input string.
+ * @return The exact length of the Latin-1 result if every code point is at most U+00FF,
+ *         an upper bound otherwise.
+ */
+size_t latin1_length_from_utf8(size_t utf8_length, const char8_t* utf8_string);
+
+/**
+ * @brief Converts a UTF-8 encoded string to a UTF-32 encoded string.
+ *
+ * @param utf8_string The input UTF-8 encoded string to be converted.
+ * @return A std::u32string containing the code points, up to the first malformed sequence.
+ */
+std::u32string utf8_to_utf32(const std::u8string& utf8_string);
+
+/**
+ * @brief Converts a UTF-32 encoded string to a UTF-8 encoded string.
+ *
+ * @param utf32_string The input UTF-32 encoded string to be converted.
+ * @return A std::u8string containing the UTF-8 encoded result.
+ */
+std::u8string utf32_to_utf8(const std::u32string& utf32_string);
+
+/**
+ * @brief Converts a UTF-16 encoded string to a UTF-32 encoded string.
+ *
+ * @param utf16_string The input UTF-16 encoded string to be converted.
+ * @return A std::u32string containing the code points, surrogate pairs combined.
+ */
+std::u32string utf16_to_utf32(const std::u16string& utf16_string);
+
+/**
+ * @brief Converts a UTF-32 encoded string to a UTF-16 encoded string.
+ *
+ * @param utf32_string The input UTF-32 encoded string to be converted.
+ * @return A std::u16string containing the UTF-16 encoded result.
+ */
+std::u16string utf32_to_utf16(const std::u32string& utf32_string);
+
+/**
+ * @brief Converts a Latin-1 encoded string to a UTF-8 encoded string.
+ *
+ * @param latin1_string The input Latin-1 encoded string to be converted.
+ * @return A std::u8string containing the UTF-8 encoded result.
+ */
+std::u8string latin1_to_utf8(const std::string& latin1_string);
+
+/**
+ * @brief Converts a UTF-8 encoded string to a Latin-1 encoded string.
+ *
+ * @param utf8_string The input UTF-8 encoded string to be converted.
+ * @return A std::string containing the result, up to the first malformed sequence
+ *         or code point above U+00FF.
+ */
+std::string utf8_to_latin1(const std::u8string& utf8_string);
+
+/**
+ * @brief Converts a Latin-1 encoded string to a UTF-16 encoded string.
+ *
+ * @param latin1_string The input Latin-1 encoded string to be converted.
+ * @return A std::u16string of the same length containing the UTF-16 encoded result.
+ */
+std::u16string latin1_to_utf16(const std::string& latin1_string);
+
+/**
+ * @brief Converts a UTF-16 encoded string to a Latin-1 encoded string.
+ *
+ * @param utf16_string The input UTF-16 encoded string to be converted.
+ * @return A std::string containing the result, up to the first code unit above U+00FF.
+ */
+std::string utf16_to_latin1(const std::u16string& utf16_string);
+
+/**
+ * @brief Converts a Latin-1 encoded string to a UTF-32 encoded string.
+ *
+ * @param latin1_string The input Latin-1 encoded string to be converted.
+ * @return A std::u32string of the same length containing the code points.
+ */
+std::u32string latin1_to_utf32(const std::string& latin1_string);
+
+/**
+ * @brief Converts a UTF-32 encoded string to a Latin-1 encoded string.
+ *
+ * @param utf32_string The input UTF-32 encoded string to be converted.
+ * @return A std::string containing the result, up to the first code point above U+00FF.
+ */
+std::string utf32_to_latin1(const std::u32string& utf32_string);
+
+/**
+ * @brief Converts a UTF-8 encoded string to UTF-32 (into a user-provided buffer).
+ *
+ * The buffer overloads of this family read at most the given input length, write at most
+ * the given output length and never allocate. They do not append a null terminator.
+ *
+ * @param utf32_length The size of the output buffer, in code points.
+ * @param utf32_string Pointer to the output buffer.
+ * @param utf8_length The number of bytes in the input UTF-8 string.
+ * @param utf8_string Pointer to the UTF-8 encoded input string.
+ * @return The number of code points written. The conversion stops early at a malformed
+ *         sequence or when the output buffer is full.
+ */
+size_t utf8_to_utf32(size_t utf32_length, char32_t* utf32_string, size_t utf8_length, const char8_t* utf8_string);
+
+/**
+ * @brief Converts a UTF-32 encoded string to UTF-8 (into a user-provided buffer).
+ *
+ * @param utf8_length The size of the output buffer, in bytes.
+ * @param utf8_string Pointer to the output buffer.
+ * @param utf32_length The number of code points in the input string.
+ * @param utf32_string Pointer to the UTF-32 encoded input string.
+ * @return The number of bytes written. The conversion stops early, on a code point
+ *         boundary, when the output buffer is full.
+ */
+size_t utf32_to_utf8(size_t utf8_length, char8_t* utf8_string, size_t utf32_length, const char32_t* utf32_string);
+
+/**
+ * @brief Converts a UTF-16 encoded string to UTF-32 (into a user-provided buffer).
+ *
+ * @param utf32_length The size of the output buffer, in code points.
+ * @param utf32_string Pointer to the output buffer.
+ * @param utf16_length The number of UTF-16 code units in the input string.
+ * @param utf16_string Pointer to the UTF-16 encoded input string.
+ * @return The number of code points written. The conversion stops early when the output buffer is full.
+ */
+size_t utf16_to_utf32(size_t utf32_length, char32_t* utf32_string, size_t utf16_length, const char16_t* utf16_string);
+
+/**
+ * @brief Converts a UTF-32 encoded string to UTF-16 (into a user-provided buffer).
+ *
+ * @param utf16_length The size of the output buffer, in code units.
+ * @param utf16_string Pointer to the output buffer.
+ * @param utf32_length The number of code points in the input string.
+ * @param utf32_string Pointer to the UTF-32 encoded input string.
+ * @return The number of code units written. The conversion stops early, never between
+ *         the units of a surrogate pair, when the output buffer is full.
+ */
+size_t utf32_to_utf16(size_t utf16_length, char16_t* utf16_string, size_t utf32_length, const char32_t* utf32_string);
+
+/**
+ * @brief Converts a Latin-1 encoded string to UTF-8 (into a user-provided buffer).
+ *
+ * @param utf8_length The size of the output buffer, in bytes.
+ * @param utf8_string Pointer to the output buffer.
+ * @param latin1_length The number of characters in the input Latin-1 string.
+ * @param latin1_string Pointer to the Latin-1 encoded input string.
+ * @return The number of bytes written. The conversion stops early, on a character
+ *         boundary, when the output buffer is full.
+ */
+size_t latin1_to_utf8(size_t utf8_length, char8_t* utf8_string, size_t latin1_length, const char* latin1_string);
+
+/**
+ * @brief Converts a UTF-8 encoded string to Latin-1 (into a user-provided buffer).
+ *
+ * @param latin1_length The size of the output buffer, in characters.
+ * @param latin1_string Pointer to the output buffer.
+ * @param utf8_length The number of bytes in the input UTF-8 string.
+ * @param utf8_string Pointer to the UTF-8 encoded input string.
+ * @return The number of characters written. The conversion stops early at a malformed
+ *         sequence, at a code point above U+00FF or when the output buffer is full.
+ */
+size_t utf8_to_latin1(size_t latin1_length, char* latin1_string, size_t utf8_length, const char8_t* utf8_string);
+
+/**
+ * @brief Converts a Latin-1 encoded string to UTF-16 (into a user-provided buffer).
+ *
+ * @param utf16_length The size of the output buffer, in code units.
+ * @param utf16_string Pointer to the output buffer.
+ * @param latin1_length The number of characters in the input Latin-1 string.
+ * @param latin1_string Pointer to the Latin-1 encoded input string.
+ * @return The number of code units written, the smaller of the two lengths.
+ */
+size_t latin1_to_utf16(size_t utf16_length, char16_t* utf16_string, size_t latin1_length, const char* latin1_string);
+
+/**
+ * @brief Converts a UTF-16 encoded string to Latin-1 (into a user-provided buffer).
+ *
+ * @param latin1_length The size of the output buffer, in characters.
+ * @param latin1_string Pointer to the output buffer.
+ * @param utf16_length The number of UTF-16 code units in the input string.
+ * @param utf16_string Pointer to the UTF-16 encoded input string.
+ * @return The number of characters written. The conversion stops early at a code unit
+ *         above U+00FF or when the output buffer is full.
+ */
+size_t utf16_to_latin1(size_t latin1_length, char* latin1_string, size_t utf16_length, const char16_t* utf16_string);
+
+/**
+ * @brief Converts a Latin-1 encoded string to UTF-32 (into a user-provided buffer).
+ *
+ * @param utf32_length The size of the output buffer, in code points.
+ * @param utf32_string Pointer to the output buffer.
+ * @param latin1_length The number of characters in the input Latin-1 string.
+ * @param latin1_string Pointer to the Latin-1 encoded input string.
+ * @return The number of code points written, the smaller of the two lengths.
+ */
+size_t latin1_to_utf32(size_t utf32_length, char32_t* utf32_string, size_t latin1_length, const char* latin1_string);
+
+/**
+ * @brief Converts a UTF-32 encoded string to Latin-1 (into a user-provided buffer).
+ *
+ * @param latin1_length The size of the output buffer, in characters.
+ * @param latin1_string Pointer to the output buffer.
+ * @param utf32_length The number of code points in the input string.
+ * @param utf32_string Pointer to the UTF-32 encoded input string.
+ * @return The number of characters written. The conversion stops early at a code point
+ *         above U+00FF or when the output buffer is full.
+ */
+size_t utf32_to_latin1(size_t latin1_length, char* latin1_string, size_t utf32_length, const char32_t* utf32_string);
+
+/**
+ * @brief What convert() does with invalid input.
+ */
+enum class ErrorPolicy
+{
+    strict,       //!< Stop at the first invalid sequence
+    replace,      //!< Replace every maximal invalid subsequence with U+FFFD
+    pass_through, //!< Keep surrogates as-is, unpaired in UTF-16 or encoded in UTF-8, replace anything else with U+FFFD
+};
+
+/**
+ * @brief Outcome of convert().
+ */
+enum class Status
+{
+    success,          //!< The whole input was converted
+    invalid_input,    //!< Stopped at an invalid sequence, only with ErrorPolicy::strict
+    output_too_small, //!< Stopped on a code point boundary because the output buffer is full
+};
+
+/**
+ * @brief Result of convert().
+ */
+struct Result
+{
+    Status status;
+    size_t consumed;     //!< Code units read from the input
+    size_t written;      //!< Code units written to the output
+    size_t error_offset; //!< Offset of the first invalid sequence, @p consumed if there was none
+};
+
+/**
+ * @brief Converts UTF-8 to UTF-16 into a user-provided buffer, with an error policy.
+ *
+ * Invalid input is malformed or truncated sequences, overlong encodings, encoded
+ * surrogates and code points above U+10FFFF, as rejected by validate_utf8(). The
+ * policy is a template parameter, valid input runs the same kernels for every policy.
+ * Encoded surrogates passed through by ErrorPolicy::pass_through become unpaired
+ * surrogates in the output.
+ *
+ * @tparam Policy What to do with invalid input.
+ * @param utf16_length The size of the output buffer, in code units.
+ * @param utf16_string Pointer to the output buffer.
+ * @param utf8_length The number of bytes in the input UTF-8 string.
+ * @param utf8_string Pointer to the input UTF-8 encoded string.
+ * @return The status, the bytes consumed, the code units written and the offset of the first error.
+ */
+template<ErrorPolicy Policy = ErrorPolicy::strict>
+Result convert(size_t utf16_length, char16_t* utf16_string, size_t utf8_length, const char8_t* utf8_string);
+
+/**
+ * @brief Converts UTF-16 to UTF-8 into a user-provided buffer, with an error policy.
+ *
+ * Invalid input is unpaired surrogates, as rejected by validate_utf16().
+ * ErrorPolicy::pass_through encodes them as-is, like utf16_to_utf8() does.
+ *
+ * @tparam Policy What to do with invalid input.
+ * @param utf8_length The size of the output buffer, in bytes.
+ * @param utf8_string Pointer to the output buffer.
+ * @param utf16_length The number of UTF-16 code units in the input string.
+ * @param utf16_string Pointer to the UTF-16 encoded input string.
+ * @return The status, the code units consumed, the bytes written and the offset of the first error.
+ */
+template<ErrorPolicy Policy = ErrorPolicy::strict>
+Result convert(size_t utf8_length, char8_t* utf8_string, size_t utf16_length, const char16_t* utf16_string);
+
+#if !defined(UCONV_HEADER_ONLY)
+extern template Result convert<ErrorPolicy::strict>(size_t, char16_t*, size_t, const char8_t*);
+extern template Result convert<ErrorPolicy::replace>(size_t, char16_t*, size_t, const char8_t*);
+extern template Result convert<ErrorPolicy::pass_through>(size_t, char16_t*, size_t, const char8_t*);
+extern template Result convert<ErrorPolicy::strict>(size_t, char8_t*, size_t, const char16_t*);
+extern template Result convert<ErrorPolicy::replace>(size_t, char8_t*, size_t, const char16_t*);
+extern template Result convert<ErrorPolicy::pass_through>(size_t, char8_t*, size_t, const char16_t*);
+#endif
+
+/**
+ * @brief Input consumed and output produced by one call to a stream converter.
+ *
+ * @p consumed includes a partial sequence kept by the stream.
+ */
+using StreamResult = BufferResult;
+
+/**
+ * @brief Converts UTF-8 to UTF-16 chunk by chunk.
+ *
+ * A sequence split across two chunks is kept by the stream and converted with the
+ * next chunk, so the input can be read in fixed-size pieces without reassembling it.
+ * The stream never allocates.
+ */
+class Utf8ToUtf16Stream
+{
+public:
+    /**
+     * @brief Converts the next chunk of UTF-8 into a user-provided buffer.
+     *
+     * The conversion stops on a code point boundary when the output buffer is full, the
+     * caller passes the unconsumed rest of the chunk again with a new buffer. A trailing
+     * partial sequence is consumed and kept for the next call.
+     *
+     * @param utf16_length The size of the output buffer, in code units.
+     * @param utf16_string Pointer to the output buffer.
+     * @param utf8_length The number of bytes in the chunk.
+     * @param utf8_string Pointer to the chunk.
+     * @return The number of bytes consumed and code units produced.
+     * @warning A malformed sequence stops the conversion, @p consumed is then less than
+     *          @p utf8_length although the output buffer has room left.
+     */
+    StreamResult convert(size_t utf16_length, char16_t* utf16_string, size_t utf8_length, const char8_t* utf8_string);
+
+    /**
+     * @brief Ends the input and resets the stream.
+     *
+     * @return true if the input ended on a complete sequence, false if a truncated sequence was discarded.
+     */
+    bool finish();
+
+    /**
+     * @brief Returns true if a partial sequence is waiting for the next chunk.
+     */
+    bool pending() const;
+
+    /**
+     * @brief Discards a partial sequence, the next chunk starts a new input.
+     */
+    void reset();
+
+private:
+    char8_t pending_bytes_[4] = {};
+    size_t pending_length_ = 0;
+};
+
+/**
+ * @brief Converts UTF-16 to UTF-8 chunk by chunk.
+ *
+ * A surrogate pair split across two chunks is kept by the stream and converted with
+ * the next chunk, so the input can be read in fixed-size pieces without reassembling it.
+ * The stream never allocates.
+ */
+class Utf16ToUtf8Stream
+{
+public:
+    /**
+     * @brief Converts the next chunk of UTF-16 into a user-provided buffer.
+     *
+     * The conversion stops on a code point boundary when the output buffer is full, the
+     * caller passes the unconsumed rest of the chunk again with a new buffer. A trailing
+     * high surrogate is consumed and kept for the next call. Unpaired surrogates are
+     * encoded as-is, like utf16_to_utf8() does.
+     *
+     * @param utf8_length The size of the output buffer, in bytes.
+     * @param utf8_string Pointer to the output buffer.
+     * @param utf16_length The number of code units in the chunk.
+     * @param utf16_string Pointer to the chunk.
+     * @return The number of code units consumed and bytes produced.
+     */
+    StreamResult convert(size_t utf8_length, char8_t* utf8_string, size_t utf16_length, const char16_t* utf16_string);
+
+    /**
+     * @brief Ends the input, encodes a kept high surrogate as-is and resets the stream.
+     *
+     * @param utf8_length The size of the output buffer, in bytes.
+     * @param utf8_string Pointer to the output buffer.
+     * @return The number of bytes written, 0 if the buffer is smaller than the 3 bytes
+     *         a kept high surrogate needs. The stream is not reset in that case.
+     */
+    size_t finish(size_t utf8_length, char8_t* utf8_string);
+
+    /**
+     * @brief Returns true if a high surrogate is waiting for the next chunk.
+     */
+    bool pending() const;
+
+    /**
+     * @brief Discards a kept high surrogate, the next chunk starts a new input.
+     */
+    void reset();
+
+private:
+    char16_t pending_unit_ = 0;
+};
+
+//------------------------------------------------------------------------------
+// Batch conversion
+//
+// Converts many short strings, such as the values of a column, into one arena with
+// no allocation per string. Strings that follow each other in memory are validated
+// and converted in one pass, across string boundaries, and only fall back to one
+// conversion per string when the pass finds a malformed string.
+
+/**
+ * @brief Converts many UTF-8 strings to UTF-16, back to back into one user-provided arena.
+ *
+ * String i is written to arena[offsets[i], offsets[i + 1]). Each string is converted as by
+ * utf8_to_utf16(), a malformed sequence ends that string early and the next string is
+ * converted normally. Adjacent strings, where one string ends at the first byte of the
+ * next, are converted together, so views into one buffer convert as fast as the buffer.
+ *
+ * @param count The number of input strings.
+ * @param utf8_strings Pointer to @p count UTF-8 encoded input strings.
+ * @param arena_length The size of the arena, in code units.
+ * @param arena Pointer to the arena.
+ * @param offsets Pointer to an array of at least @p count + 1 offsets into the arena.
+ * @return The number of strings converted, less than @p count if the arena is full. A string
+ *         is only converted if utf16_length_from_utf8() of it fits in the rest of the arena,
+ *         offsets[0] to offsets[returned value] are written.
+ */
+size_t utf8_to_utf16_batch(size_t count, const std::u8string_view* utf8_strings, size_t arena_length, char16_t* arena, size_t* offsets);
+
+/**
+ * @brief Converts a column of UTF-8 strings stored back to back in one buffer.
+ *
+ * String i is utf8_data[utf8_offsets[i], utf8_offsets[i + 1]), the layout of Apache Arrow
+ * string columns. Same as utf8_to_utf16_batch() otherwise.
+ *
+ * @param count The number of input strings.
+ * @param utf8_offsets Pointer to @p count + 1 non-decreasing offsets into @p utf8_data.
+ * @param utf8_data Pointer to the UTF-8 encoded strings.
+ * @param arena_length The size of the arena, in code units.
+ * @param arena Pointer to the arena.
+ * @param offsets Pointer to an array of at least @p count + 1 offsets into the arena.
+ * @return The number of strings converted, less than @p count if the arena is full.
+ */
+size_t utf8_to_utf16_batch(size_t count, const size_t* utf8_offsets, const char8_t* utf8_data, size_t arena_length, char16_t* arena, size_t* offsets);
+
+/**
+ * @brief UTF-16 strings converted by utf8_to_utf16_batch(), stored back to back in one arena.
+ */
+struct Utf16Batch
+{
+    std::pmr::u16string arena;        //!< The converted strings, back to back
+    std::pmr::vector<size_t> offsets; //!< String i is arena[offsets[i], offsets[i + 1])
+
+    /**
+     * @brief Returns the number of strings.
+     */
+    size_t size() const
+    {
+        return offsets.empty() ? 0 : offsets.size() - 1;
+    }
+
+    /**
+     * @brief Returns string @p index.
+     */
+    std::u16string_view operator[](size_t index) const
+    {
+        assert(index < size());
+        return std::u16string_view(arena).substr(offsets[index], offsets[index + 1] - offsets[index]);
+    }
+};
+
+/**
+ * @brief Converts many UTF-8 strings to UTF-16 into an arena allocated from a memory resource.
+ *
+ * The arena and the offsets are allocated once each, a std::pmr::monotonic_buffer_resource
+ * over a reused buffer makes the whole batch allocation free.
+ *
+ * @param count The number of input strings.
+ * @param utf8_strings Pointer to @p count UTF-8 encoded input strings.
+ * @param resource The memory resource the arena and the offsets are allocated from.
+ * @return The converted strings.
+ */
+Utf16Batch utf8_to_utf16_batch(size_t count, const std::u8string_view* utf8_strings, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+//------------------------------------------------------------------------------
+// Conversion into any container
+//
+// The input is a string view, so std::u8string, std::pmr::u8string, string literals and
+// std::u8string_view(span) all convert without a copy. The output is appended to any
+// contiguous container of the output code unit with resize(), such as std::vector<char16_t>
+// or a std::basic_string with its own allocator. A container cleared and reused across
+// calls keeps its capacity, so steady-state conversions do not allocate.
+
+namespace detail
+{
+template<class Container, class Char>
+concept output_container = std::ranges::contiguous_range<Container> && std::same_as<std::ranges::range_value_t<Container>, Char> && requires(Container& container, size_t length) {
+    container.resize(length);
+};
+
+// Same as the buffer overloads, returning the code units written. The output is sized by
+// the length functions, utf16_to_utf8_sized() does not check its bounds.
+size_t utf8_to_utf16_sized(size_t utf16_length, char16_t* utf16_string, size_t utf8_length, const char8_t* utf8_string);
+size_t utf16_to_utf8_sized(size_t utf8_length, char8_t* utf8_string, size_t utf16_length, const char16_t* utf16_string);
+
+// Grows the container by at most length code units, convert(data) writes them and returns
+// the number written, the container is then shrunk to what was written
+template<class Container, class Convert>
+size_t append_to(Container& container, size_t length, Convert convert)
+{
+    const size_t size = std::ranges::size(container);
+    const auto* old_data = std::ranges::data(container);
+    if constexpr(requires { container.resize_and_overwrite(length, [](auto*, size_t) { return size_t(0); }); }) {
+        // Strings are grown without filling the new code units first
+        container.resize_and_overwrite(size + length, [&](auto* data, size_t) { return size + convert(data + size); });
+    } else {
+        container.resize(size + length);
+        container.resize(size + convert(std::ranges::data(container) + size));
+    }
+    if constexpr(stats_enabled) {
+        if(old_data != std::ranges::data(container)) {
+            count_reallocation();
+        }
+    }
+    return std::ranges::size(container) - size;
+}
+} // namespace detail
+
+/**
+ * @brief Converts a UTF-8 encoded string to UTF-16 and appends the result to a container.
+ *
+ * Same as utf8_to_utf16(const std::u8string&) otherwise, malformed input stops the conversion.
+ *
+ * @param utf16_output The container the UTF-16 code units are appended to.
+ * @param utf8_string The input UTF-8 encoded string to be converted.
+ * @return The number of code units appended.
+ */
+template<detail::output_container<char16_t> Container>
+size_t utf8_to_utf16(Container& utf16_output, std::u8string_view utf8_string)
+{
+    const size_t utf16_length = utf16_length_from_utf8(utf8_string.length(), utf8_string.data());
+    return detail::append_to(utf16_output, utf16_length, [&](char16_t* data) {
+        return detail::utf8_to_utf16_sized(utf16_length, data, utf8_string.length(), utf8_string.data());
+    });
+}
+
+/**
+ * @brief Converts a UTF-16 encoded string to UTF-8 and appends the result to a container.
+ *
+ * Same as utf16_to_utf8(const std::u16string&) otherwise, unpaired surrogates are encoded as-is.
+ *
+ * @param utf8_output The container the UTF-8 bytes are appended to.
+ * @param utf16_string The input UTF-16 encoded string to be converted.
+ * @return The number of bytes appended.
+ */
+template<detail::output_container<char8_t> Container>
+size_t utf16_to_utf8(Container& utf8_output, std::u16string_view utf16_string)
+{
+    const size_t utf8_length = utf8_length_from_utf16(utf16_string.length(), utf16_string.data());
+    return detail::append_to(utf8_output, utf8_length, [&](char8_t* data) {
+        return detail::utf16_to_utf8_sized(utf8_length, data, utf16_string.length(), utf16_string.data());
+    });
+}
+
+/**
+ * @brief Converts a UTF-8 encoded string to a UTF-16 string using the given allocator.
+ *
+ * @param utf8_string The input UTF-8 encoded string to be converted.
+ * @param allocator The allocator of the result, a std::pmr::polymorphic_allocator for example.
+ * @return The UTF-16 encoded result, allocated once.
+ */
+template<class Allocator>
+    requires std::same_as<typename Allocator::value_type, char16_t>
+std::basic_string<char16_t, std::char_traits<char16_t>, Allocator> utf8_to_utf16(std::u8string_view utf8_string, const Allocator& allocator)
+{
+    std::basic_string<char16_t, std::char_traits<char16_t>, Allocator> utf16_string(allocator);
+    utf8_to_utf16(utf16_string, utf8_string);
+    return utf16_string;
+}
+
+/**
+ * @brief Converts a UTF-16 encoded string to a UTF-8 string using the given allocator.
+ *
+ * @param utf16_string The input UTF-16 encoded string to be converted.
+ * @param allocator The allocator of the result, a std::pmr::polymorphic_allocator for example.
+ * @return The UTF-8 encoded result, allocated once.
+ */
+template<class Allocator>
+    requires std::same_as<typename Allocator::value_type, char8_t>
+std::basic_string<char8_t, std::char_traits<char8_t>, Allocator> utf16_to_utf8(std::u16string_view utf16_string, const Allocator& allocator)
+{
+    std::basic_string<char8_t, std::char_traits<char8_t>, Allocator> utf8_string(allocator);
+    utf16_to_utf8(utf8_string, utf16_string);
+    return utf8_string;
+}
+
+//------------------------------------------------------------------------------
+// Compile-time conversion
+//
+// The scalar core of the library is constexpr, literal() converts a UTF-8 string
+// literal while compiling. The result is a constant with no static initialization.
+
+namespace detail
+{
+// Returned by decode_to_codepoint() for a malformed or truncated sequence
+inline constexpr char32_t invalid_codepoint = 0xFFFFFFFFUL;
+
+// Encodes a code point to one code unit or a surrogate pair, returns the number of code units
+constexpr size_t codepoint_to_utf16(char16_t utf16_units[4], char32_t codepoint)
+{
+    size_t length = 0;
+    if(codepoint <= 0xFFFF) {
+        utf16_units[length++] = static_cast<char16_t>(codepoint);
+    } else {
+        char32_t temp = codepoint - 0x10000;
+        char16_t high_surrogate = static_cast<char16_t>(0xD800 + (temp >> 10));
+        char16_t low_surrogate = 0xDC00 + (temp & 0x3FF);
+        utf16_units[length++] = high_surrogate;
+        utf16_units[length++] = low_surrogate;
+    }
+    return length;
+}
+
+// Encodes a code point up to U+10FFFF, surrogates included, to UTF-8
+constexpr size_t codepoint_to_utf8(char8_t utf8_units[4], char32_t codepoint)
+{
+    if(codepoint <= 0x7F) {
+        utf8_units[0] = static_cast<char8_t>(codepoint);
+        return 1;
+    } else if(codepoint <= 0x7FF) {
+        utf8_units[0] = static_cast<char8_t>(0xC0 | (codepoint >> 6));
+        utf8_units[1] = static_cast<char8_t>(0x80 | (codepoint & 0x3F));
+        return 2;
+    } else if(codepoint <= 0xFFFF) {
+        utf8_units[0] = static_cast<char8_t>(0xE0 | (codepoint >> 12));
+        utf8_units[1] = static_cast<char8_t>(0x80 | ((codepoint >> 6) & 0x3F));
+        utf8_units[2] = static_cast<char8_t>(0x80 | (codepoint & 0x3F));
+        return 3;
+    }
+    utf8_units[0] = static_cast<char8_t>(0xF0 | (codepoint >> 18));
+    utf8_units[1] = static_cast<char8_t>(0x80 | ((codepoint >> 12) & 0x3F));
+    utf8_units[2] = static_cast<char8_t>(0x80 | ((codepoint >> 6) & 0x3F));
+    utf8_units[3] = static_cast<char8_t>(0x80 | (codepoint & 0x3F));
+    return 4;
+}
+
+// UTF-8 decoder as a deterministic finite automaton (Bjoern Hoehrmann, "Flexible and Economical
+// UTF-8 Decoder"). Every byte is mapped to a class and the class moves the automaton to the next
+// state, well-formed sequences as defined by the Unicode Standard (Table 3-7) end in the accept
+// state. Overlong sequences, encoded surrogates, code points above U+10FFFF, stray continuation
+// bytes and bytes that never appear in UTF-8 end in the reject state, which is never left.
+//
+// 0: 00-7F, 1: 80-8F, 9: 90-9F, 7: A0-BF, 8: C0-C1 F5-FF, 2: C2-DF, 10: E0, 3: E1-EC EE-EF, 4: ED, 11: F0, 6: F1-F3, 5: F4
+inline constexpr uint8_t utf8_classes[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    8, 8, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    10, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 4, 3, 3, 11, 6, 6, 6, 5, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8};
+
+// The next state by state and class
+inline constexpr uint8_t utf8_transitions[9][12] = {
+    {0, 1, 2, 3, 5, 8, 7, 1, 1, 1, 4, 6}, // accept
+    {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1}, // reject
+    {1, 0, 1, 1, 1, 1, 1, 0, 1, 0, 1, 1}, // 1 continuation byte left
+    {1, 2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 1}, // 2 left
+    {1, 1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1}, // after E0, A0-BF
+    {1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1, 1}, // after ED, 80-9F
+    {1, 1, 1, 1, 1, 1, 1, 3, 1, 3, 1, 1}, // after F0, 90-BF
+    {1, 3, 1, 1, 1, 1, 1, 3, 1, 3, 1, 1}, // 3 left
+    {1, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1}, // after F4, 80-8F
+};
+
+// The transitions of a byte from all 9 states packed in one row, 6 bits each, with the payload
+// bits of the byte in the top 8 bits. A state is the bit offset of its field, so the next state
+// is a shift of the row and the row is loaded without waiting for the state.
+inline constexpr uint32_t utf8_accept = 0;
+inline constexpr uint32_t utf8_reject = 6;
+
+inline constexpr std::array<uint64_t, 256> utf8_rows = [] {
+    std::array<uint64_t, 256> rows = {};
+    for(size_t byte = 0; byte < rows.size(); ++byte) {
+        const uint8_t type = utf8_classes[byte];
+        const size_t payload = (byte < 0x80) ? byte : (byte < 0xC0) ? byte & 0x3F : (byte < 0xE0) ? byte & 0x1F : (byte < 0xF0) ? byte & 0x0F : byte & 0x07;
+        rows[byte] = static_cast<uint64_t>(payload) << 56;
+        for(size_t state = 0; state < std::size(utf8_transitions); ++state) {
+            rows[byte] |= static_cast<uint64_t>(6 * utf8_transitions[state][type]) << (6 * state);
+        }
+    }
+    return rows;
+}();
+
+// Moves the automaton on by one byte
+constexpr uint32_t next_utf8_state(uint32_t state, char8_t byte)
+{
+    return static_cast<uint32_t>(utf8_rows[byte] >> state) & 0x3F;
+}
+
+// Feeds one byte to the automaton, codepoint holds the bits decoded so far and the code point
+// once the returned state is utf8_accept. The bits are masked in rather than selected, compilers
+// turn a select into a branch that mispredicts on mixed scripts.
+constexpr uint32_t decode_utf8_byte(uint32_t state, char32_t& codepoint, char8_t byte)
+{
+    const uint64_t row = utf8_rows[byte];
+    const char32_t continuation = 0U - static_cast<char32_t>(utf8_accept != state);
+    codepoint = ((codepoint << 6) & continuation) | static_cast<char32_t>(row >> 56);
+    return static_cast<uint32_t>(row >> state) & 0x3F;
+}
+
+// Decodes a single UTF-8 sequence to a codepoint, invalid_codepoint for a malformed or truncated
+// sequence. Reads at most utf8_length bytes and stops at the byte that was rejected.
+constexpr char32_t decode_to_codepoint(size_t utf8_length, const char8_t* utf8_string, size_t& index)
+{
+    assert(index < utf8_length);
+    if(utf8_string[index] < 0x80) {
+        return utf8_string[index++];
+    }
+    uint32_t state = utf8_accept;
+    char32_t codepoint = 0;
+    do {
+        state = decode_utf8_byte(state, codepoint, utf8_string[index++]);
+    } while(utf8_reject < state && index < utf8_length);
+    return (utf8_accept == state) ? codepoint : invalid_codepoint;
+}
+
+// Number of UTF-16 code units of a UTF-8 string, invalid_length for a malformed sequence
+inline constexpr size_t invalid_length = static_cast<size_t>(-1);
+
+constexpr size_t utf16_length_of(size_t utf8_length, const char8_t* utf8_string)
+{
+    size_t length = 0;
+    char16_t utf16_units[4] = {};
+    for(size_t index = 0; index < utf8_length;) {
+        char32_t codepoint = decode_to_codepoint(utf8_length, utf8_string, index);
+        if(invalid_codepoint == codepoint) {
+            return invalid_length;
+        }
+        length += codepoint_to_utf16(utf16_units, codepoint);
+    }
+    return length;
+}
+
+// A UTF-8 string literal as a template argument, the terminating null character is not part of the string
+template<size_t N>
+struct Utf8Literal
+{
+    char8_t units[N];
+
+    consteval Utf8Literal(const char8_t (&string)[N])
+    {
+        for(size_t i = 0; i < N; ++i) {
+            units[i] = string[i];
+        }
+    }
+
+    static constexpr size_t length = N - 1;
+};
+} // namespace detail
+
+/**
+ * @brief Converts a UTF-8 string literal to UTF-16 at compile time.
+ *
+ * @code
+ * static constexpr auto greeting = uconv::literal<u8"こんにちは">(); // std::array<char16_t, 5>
+ * @endcode
+ *
+ * @tparam Utf8 The UTF-8 string literal, a malformed or truncated sequence fails to compile.
+ * @return The UTF-16 code units, without a terminating null character.
+ */
+template<detail::Utf8Literal Utf8>
+consteval auto literal()
+{
+    constexpr size_t utf16_length = detail::utf16_length_of(Utf8.length, Utf8.units);
+    static_assert(detail::invalid_length != utf16_length, "uconv::literal: malformed UTF-8");
+    std::array<char16_t, utf16_length> utf16_string = {};
+    size_t count = 0;
+    for(size_t index = 0; index < Utf8.length;) {
+        char16_t utf16_units[4] = {};
+        const size_t length = detail::codepoint_to_utf16(utf16_units, detail::decode_to_codepoint(Utf8.length, Utf8.units, index));
+        for(size_t i = 0; i < length; ++i) {
+            utf16_string[count++] = utf16_units[i];
+        }
+    }
+    return utf16_string;
+}
+
+//------------------------------------------------------------------------------
+// Short strings
+//
+// Strings of up to short_string_length code units, the bulk of identifiers, keys and
+// labels, are converted by the scalar core inline at the call site into a local buffer.
+// There is no kernel dispatch, no length pass and no reservation, the result is the
+// same as the library's. Statistics are only counted by the library.
+
+namespace detail
+{
+inline constexpr size_t short_string_length = 16;
+
+// Same conversion as utf8_to_utf16(), utf16_string holds utf8_length code units
+constexpr size_t utf8_to_utf16_short(char16_t* utf16_string, size_t utf8_length, const char8_t* utf8_string)
+{
+    size_t count = 0;
+    for(size_t index = 0; index < utf8_length;) {
+        const char32_t codepoint = decode_to_codepoint(utf8_length, utf8_string, index);
+        if(invalid_codepoint == codepoint) {
+            break;
+        }
+        char16_t utf16_units[4] = {};
+        const size_t length = codepoint_to_utf16(utf16_units, codepoint);
+        for(size_t i = 0; i < length; ++i) {
+            utf16_string[count++] = utf16_units[i];
+        }
+    }
+    return count;
+}
+
+// Same conversion as utf16_to_utf8(), utf8_string holds 3 bytes per code unit
+constexpr size_t utf16_to_utf8_short(char8_t* utf8_string, size_t utf16_length, const char16_t* utf16_string)
+{
+    size_t count = 0;
+    for(size_t i = 0; i < utf16_length; ++i) {
+        char32_t codepoint = utf16_string[i];
+        // An unpaired surrogate is encoded as-is
+        if(0xD800 == (codepoint & 0xFC00) && (i + 1) < utf16_length && 0xDC00 == (utf16_string[i + 1] & 0xFC00)) {
+            codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (utf16_string[++i] - 0xDC00);
+        }
+        char8_t utf8_units[4] = {};
+        const size_t length = codepoint_to_utf8(utf8_units, codepoint);
+        for(size_t j = 0; j < length; ++j) {
+            utf8_string[count++] = utf8_units[j];
+        }
+    }
+    return count;
+}
+
+// The conversions of longer strings
+std::u16string utf8_to_utf16_long(const std::u8string& utf8_string);
+std::u8string utf16_to_utf8_long(const std::u16string& utf16_string);
+} // namespace detail
+
+inline std::u16string utf8_to_utf16(const std::u8string& utf8_string)
+{
+    if(!stats_enabled && utf8_string.length() <= detail::short_string_length) {
+        char16_t utf16_string[detail::short_string_length];
+        return std::u16string(utf16_string, detail::utf8_to_utf16_short(utf16_string, utf8_string.length(), utf8_string.data()));
+    }
+    return detail::utf8_to_utf16_long(utf8_string);
+}
+
+inline std::u8string utf16_to_utf8(const std::u16string& utf16_string)
+{
+    if(!stats_enabled && utf16_string.length() <= detail::short_string_length) {
+        char8_t utf8_string[3 * detail::short_string_length];
+        return std::u8string(utf8_string, detail::utf16_to_utf8_short(utf8_string, utf16_string.length(), utf16_string.data()));
+    }
+    return detail::utf16_to_utf8_long(utf16_string);
+}
+
+//------------------------------------------------------------------------------
+// Code point views
+//
+// codepoints() walks the code points of a string without converting it, as_utf16() and
+// as_utf8() transcode on the fly. The views are lazy, bidirectional and borrowed, so they
+// compose with std::ranges algorithms and std::views, and nothing is materialized unless
+// the caller collects the elements.
+//
+// A malformed UTF-8 sequence, anything validate_utf8() rejects, yields U+FFFD for each of its
+// bytes. Unpaired UTF-16 surrogates are yielded as-is, as by utf16_to_utf8().
+// Backward iteration yields exactly the code points of forward iteration, in reverse order.
+
+namespace detail
+{
+inline constexpr char32_t replacement_codepoint = 0xFFFD;
+
+// A code point and the number of code units it was decoded from, 0 at the end of the string
+struct DecodedCodepoint
+{
+    char32_t codepoint;
+    size_t length;
+};
+
+// Decodes the code point starting at first, the multi-byte sequences out of line
+constexpr DecodedCodepoint decode_next_sequence(const char8_t* first, const char8_t* last)
+{
+    size_t index = 0;
+    const char32_t codepoint = decode_to_codepoint(static_cast<size_t>(last - first), first, index);
+    return (invalid_codepoint != codepoint) ? DecodedCodepoint{codepoint, index} : DecodedCodepoint{replacement_codepoint, 1};
+}
+
+constexpr DecodedCodepoint decode_next(const char8_t* first, const char8_t* last)
+{
+    return (first[0] < 0x80) ? DecodedCodepoint{first[0], 1} : decode_next_sequence(first, last);
+}
+
+constexpr DecodedCodepoint decode_next(const char16_t* first, const char16_t* last)
+{
+    const char16_t unit = first[0];
+    if(0xD800 == (unit & 0xFC00) && 1 < (last - first) && 0xDC00 == (first[1] & 0xFC00)) {
+        return {0x10000 + ((static_cast<char32_t>(unit) - 0xD800) << 10) + (first[1] - 0xDC00), 2};
+    }
+    return {unit, 1};
+}
+
+// Decodes the code point ending at last. Forward decoding only steps over a lead byte as part of
+// a sequence starting at it, so a complete sequence ending at last is the one forward decoding found.
+constexpr DecodedCodepoint decode_previous(const char8_t* first, const char8_t* last)
+{
+    size_t length = 1;
+    while(length < 4 && length < static_cast<size_t>(last - first) && 0x80 == (last[-static_cast<std::ptrdiff_t>(length)] & 0xC0)) {
+        ++length;
+    }
+    if(1 < length) {
+        const DecodedCodepoint decoded = decode_next(last - length, last);
+        if(decoded.length == length) {
+            return decoded;
+        }
+    }
+    return decode_next(last - 1, last);
+}
+
+constexpr DecodedCodepoint decode_previous(const char16_t* first, const char16_t* last)
+{
+    if(0xDC00 == (last[-1] & 0xFC00) && 1 < (last - first) && 0xD800 == (last[-2] & 0xFC00)) {
+        return decode_next(last - 2, last);
+    }
+    return {last[-1], 1};
+}
+
+constexpr size_t encode_codepoint(char8_t units[4], char32_t codepoint)
+{
+    return codepoint_to_utf8(units, codepoint);
+}
+
+constexpr size_t encode_codepoint(char16_t units[4], char32_t codepoint)
+{
+    return codepoint_to_utf16(units, codepoint);
+}
+} // namespace detail
+
+/**
+ * @brief Bidirectional iterator over the code points of a UTF-8 or UTF-16 string.
+ */
+template<class Unit>
+class CodepointIterator
+{
+public:
+    using value_type = char32_t;
+    using difference_type = std::ptrdiff_t;
+    using iterator_concept = std::bidirectional_iterator_tag;
+    using iterator_category = std::input_iterator_tag;
+
+    constexpr CodepointIterator() = default;
+
+    constexpr CodepointIterator(const Unit* first, const Unit* position, const Unit* last)
+        : first_(first)
+        , position_(position)
+        , last_(last)
+        , current_((position < last) ? detail::decode_next(position, last) : detail::DecodedCodepoint{0, 0})
+    {
+    }
+
+    constexpr char32_t operator*() const
+    {
+        assert(position_ < last_);
+        return current_.codepoint;
+    }
+
+    /**
+     * @brief Returns a pointer to the first code unit of the current code point.
+     */
+    constexpr const Unit* base() const
+    {
+        return position_;
+    }
+
+    /**
+     * @brief Returns the number of code units of the current code point, 0 at the end.
+     */
+    constexpr size_t length() const
+    {
+        return current_.length;
+    }
+
+    constexpr CodepointIterator& operator++()
+    {
+        assert(position_ < last_);
+        position_ += current_.length;
+        current_ = (position_ < last_) ? detail::decode_next(position_, last_) : detail::DecodedCodepoint{0, 0};
+        return *this;
+    }
+
+    constexpr CodepointIterator operator++(int)
+    {
+        CodepointIterator iterator = *this;
+        ++*this;
+        return iterator;
+    }
+
+    constexpr CodepointIterator& operator--()
+    {
+        assert(first_ < position_);
+        current_ = detail::decode_previous(first_, position_);
+        position_ -= current_.length;
+        return *this;
+    }
+
+    constexpr CodepointIterator operator--(int)
+    {
+        CodepointIterator iterator = *this;
+        --*this;
+        return iterator;
+    }
+
+    friend constexpr bool operator==(const CodepointIterator& lhs, const CodepointIterator& rhs)
+    {
+        return lhs.position_ == rhs.position_;
+    }
+
+private:
+    const Unit* first_ = nullptr;
+    const Unit* position_ = nullptr;
+    const Unit* last_ = nullptr;
+    detail::DecodedCodepoint current_ = {0, 0};
+};
+
+/**
+ * @brief View of the code points of a UTF-8 or UTF-16 string, returned by codepoints().
+ */
+template<class Unit>
+class CodepointView: public std::ranges::view_interface<CodepointView<Unit>>
+{
+public:
+    constexpr CodepointView() = default;
+
+    constexpr explicit CodepointView(std::basic_string_view<Unit> string)
+        : string_(string)
+    {
+    }
+
+    constexpr CodepointIterator<Unit> begin() const
+    {
+        return {string_.data(), string_.data(), string_.data() + string_.size()};
+    }
+
+    constexpr CodepointIterator<Unit> end() const
+    {
+        return {string_.data(), string_.data() + string_.size(), string_.data() + string_.size()};
+    }
+
+private:
+    std::basic_string_view<Unit> string_;
+};
+
+/**
+ * @brief Bidirectional iterator over the code units of a string transcoded to UTF-16 or UTF-8.
+ */
+template<class To, class From>
+class TranscodingIterator
+{
+public:
+    using value_type = To;
+    using difference_type = std::ptrdiff_t;
+    using iterator_concept = std::bidirectional_iterator_tag;
+    using iterator_category = std::input_iterator_tag;
+
+    constexpr TranscodingIterator() = default;
+
+    constexpr explicit TranscodingIterator(CodepointIterator<From> codepoint)
+        : codepoint_(codepoint)
+    {
+        encode();
+    }
+
+    constexpr To operator*() const
+    {
+        assert(index_ < length_);
+        return units_[index_];
+    }
+
+    /**
+     * @brief Returns the iterator to the code point the current code unit belongs to.
+     */
+    constexpr CodepointIterator<From> base() const
+    {
+        return codepoint_;
+    }
+
+    constexpr TranscodingIterator& operator++()
+    {
+        if(length_ == ++index_) {
+            ++codepoint_;
+            encode();
+        }
+        return *this;
+    }
+
+    constexpr TranscodingIterator operator++(int)
+    {
+        TranscodingIterator iterator = *this;
+        ++*this;
+        return iterator;
+    }
+
+    constexpr TranscodingIterator& operator--()
+    {
+        if(0 == index_) {
+            --codepoint_;
+            encode();
+            index_ = length_;
+        }
+        --index_;
+        return *this;
+    }
+
+    constexpr TranscodingIterator operator--(int)
+    {
+        TranscodingIterator iterator = *this;
+        --*this;
+        return iterator;
+    }
+
+    friend constexpr bool operator==(const TranscodingIterator& lhs, const TranscodingIterator& rhs)
+    {
+        return lhs.codepoint_ == rhs.codepoint_ && lhs.index_ == rhs.index_;
+    }
+
+private:
+    constexpr void encode()
+    {
+        index_ = 0;
+        length_ = (0 < codepoint_.length()) ? detail::encode_codepoint(units_, *codepoint_) : 0;
+    }
+
+    CodepointIterator<From> codepoint_;
+    To units_[4] = {};
+    size_t length_ = 0;
+    size_t index_ = 0;
+};
+
+/**
+ * @brief View of a string transcoded to UTF-16 or UTF-8, returned by as_utf16() and as_utf8().
+ */
+template<class To, class From>
+class TranscodingView: public std::ranges::view_interface<TranscodingView<To, From>>
+{
+public:
+    constexpr TranscodingView() = default;
+
+    constexpr explicit TranscodingView(std::basic_string_view<From> string)
+        : codepoints_(string)
+    {
+    }
+
+    constexpr TranscodingIterator<To, From> begin() const
+    {
+        return TranscodingIterator<To, From>(codepoints_.begin());
+    }
+
+    constexpr TranscodingIterator<To, From> end() const
+    {
+        return TranscodingIterator<To, From>(codepoints_.end());
+    }
+
+private:
+    CodepointView<From> codepoints_;
+};
+
+/**
+ * @brief Returns a lazy view of the code points of a UTF-8 string.
+ *
+ * @code
+ * for(char32_t codepoint: uconv::codepoints(u8"世界")) { ... }
+ * @endcode
+ *
+ * @param utf8_string The UTF-8 encoded string, which must outlive the view.
+ * @return A bidirectional range of char32_t.
+ */
+constexpr CodepointView<char8_t> codepoints(std::u8string_view utf8_string)
+{
+    return CodepointView<char8_t>(utf8_string);
+}
+
+/**
+ * @brief Returns a lazy view of the code points of a UTF-16 string.
+ *
+ * @param utf16_string The UTF-16 encoded string, which must outlive the view.
+ * @return A bidirectional range of char32_t.
+ */
+constexpr CodepointView<char16_t> codepoints(std::u16string_view utf16_string)
+{
+    return CodepointView<char16_t>(utf16_string);
+}
+
+/**
+ * @brief Returns a lazy view of a UTF-8 string transcoded to UTF-16.
+ *
+ * @param utf8_string The UTF-8 encoded string, which must outlive the view.
+ * @return A bidirectional range of char16_t, the code units utf8_to_utf16() produces for valid input.
+ */
+constexpr TranscodingView<char16_t, char8_t> as_utf16(std::u8string_view utf8_string)
+{
+    return TranscodingView<char16_t, char8_t>(utf8_string);
+}
+
+/**
+ * @brief Returns a lazy view of a UTF-16 string transcoded to UTF-8.
+ *
+ * @param utf16_string The UTF-16 encoded string, which must outlive the view.
+ * @return A bidirectional range of char8_t, the bytes utf16_to_utf8() produces.
+ */
+constexpr TranscodingView<char8_t, char16_t> as_utf8(std::u16string_view utf16_string)
+{
+    return TranscodingView<char8_t, char16_t>(utf16_string);
+}
+
+//------------------------------------------------------------------------------
+// Offset index
+
+/**
+ * @brief Translates offsets into a UTF-8 string between bytes, UTF-16 code units and code points.
+ *
+ * Editors and language servers address text in UTF-16 code units (LSP, JavaScript) while
+ * storing it as UTF-8. The index keeps the three offsets every 64 bytes, found in one pass
+ * with the SIMD length functions. A lookup finds the nearest checkpoint by binary search and
+ * scans at most 67 bytes, O(log n). Malformed input is counted as codepoints() and as_utf16()
+ * decode it, every byte of a malformed sequence is one U+FFFD.
+ *
+ * The index refers to the string without copying it. The string must outlive the index, and
+ * update() must be called with the edited string after every edit, which rescans the edited
+ * range only and shifts the checkpoints after it.
+ */
+class OffsetIndex
+{
+public:
+    /**
+     * @brief Creates the index of an empty string.
+     */
+    OffsetIndex() = default;
+
+    /**
+     * @brief Creates the index of a UTF-8 string.
+     *
+     * @param utf8_string The UTF-8 encoded string, which must outlive the index.
+     */
+    explicit OffsetIndex(std::u8string_view utf8_string);
+
+    /**
+     * @brief Returns the length of the string, in bytes.
+     */
+    size_t utf8_length() const;
+
+    /**
+     * @brief Returns the length of the string, in UTF-16 code units.
+     */
+    size_t utf16_length() const;
+
+    /**
+     * @brief Returns the length of the string, in code points.
+     */
+    size_t codepoint_length() const;
+
+    /**
+     * @brief Returns the byte offset of a UTF-16 offset.
+     *
+     * @param utf16_offset The offset in UTF-16 code units. An offset between the two code units
+     *                     of a surrogate pair is rounded down to the pair, one past the end to the end.
+     * @return The offset in bytes.
+     */
+    size_t utf8_offset_from_utf16(size_t utf16_offset) const;
+
+    /**
+     * @brief Returns the UTF-16 offset of a byte offset.
+     *
+     * @param utf8_offset The offset in bytes. An offset inside a sequence is rounded down to the
+     *                    sequence, one past the end to the end.
+     * @return The offset in UTF-16 code units.
+     */
+    size_t utf16_offset_from_utf8(size_t utf8_offset) const;
+
+    /**
+     * @brief Returns the byte offset of a code point offset, the end for an offset past the end.
+     */
+    size_t utf8_offset_from_codepoint(size_t codepoint_offset) const;
+
+    /**
+     * @brief Returns the code point offset of a byte offset, rounded down as by utf16_offset_from_utf8().
+     */
+    size_t codepoint_offset_from_utf8(size_t utf8_offset) const;
+
+    /**
+     * @brief Returns the UTF-16 offset of a code point offset.
+     */
+    size_t utf16_offset_from_codepoint(size_t codepoint_offset) const;
+
+    /**
+     * @brief Returns the code point offset of a UTF-16 offset, rounded down as by utf8_offset_from_utf16().
+     */
+    size_t codepoint_offset_from_utf16(size_t utf16_offset) const;
+
+    /**
+     * @brief Updates the index after a range of the string was replaced.
+     *
+     * Rescans the inserted text and up to 70 bytes on either side of it, the checkpoints after
+     * the edit are shifted without reading the rest of the string.
+     *
+     * @param utf8_string The edited string, which must outlive the index.
+     * @param utf8_offset The byte offset of the replaced range.
+     * @param removed_length The number of bytes replaced, in the string before the edit.
+     * @param inserted_length The number of bytes inserted in their place.
+     */
+    void update(std::u8string_view utf8_string, size_t utf8_offset, size_t removed_length, size_t inserted_length);
+
+private:
+    struct Checkpoint
+    {
+        size_t utf8;
+        size_t utf16;
+        size_t codepoint;
+    };
+
+    void append_checkpoints(std::vector<Checkpoint>& checkpoints, size_t utf8_end) const;
+    size_t utf8_offset_from(size_t Checkpoint::*units, size_t offset) const;
+    size_t offset_from_utf8(size_t Checkpoint::*units, size_t utf8_offset) const;
+
+    std::u8string_view utf8_string_;
+    std::vector<Checkpoint> checkpoints_ = {{0, 0, 0}};
+};
+
+//------------------------------------------------------------------------------
+// Conversion cache
+
+/**
+ * @brief Hits and misses of a ConversionCache.
+ */
+struct CacheStats
+{
+    uint64_t hits;      //!< Lookups answered from the cache
+    uint64_t misses;    //!< Lookups converted, cached or not
+    uint64_t evictions; //!< Entries dropped to make room
+};
+
+/**
+ * @brief Converts repeated UTF-8 strings to UTF-16 once and shares the results.
+ *
+ * Enum names, header keys and column names are converted over and over. The cache maps
+ * the input bytes to a shared, immutable result, so a repeated conversion is a hash lookup
+ * and a reference count increment, with no allocation. A miss converts with utf8_to_utf16(),
+ * malformed input included, and keeps the result.
+ *
+ * The entries are spread over shards by hash, each with its own lock, held for the hash lookup
+ * only. A conversion runs outside of the lock. A full shard drops its oldest entry, first in
+ * first out, which unlike least recently used does not reorder the entries on a hit. Results
+ * handed out stay valid after they are dropped.
+ */
+class ConversionCache
+{
+public:
+    /**
+     * @brief Inputs longer than this are converted without being cached.
+     */
+    static constexpr size_t max_cached_length = 256;
+
+    /**
+     * @brief Creates an empty cache.
+     *
+     * @param capacity The most entries kept, spread evenly over the shards.
+     * @param shard_count The number of shards, 0 for one per hardware thread, at most capacity.
+     */
+    explicit ConversionCache(size_t capacity = 4096, size_t shard_count = 0);
+    ~ConversionCache();
+
+    ConversionCache(const ConversionCache&) = delete;
+    ConversionCache& operator=(const ConversionCache&) = delete;
+
+    /**
+     * @brief Converts a UTF-8 encoded string to UTF-16, from the cache if it was converted before.
+     *
+     * @param utf8_string The input UTF-8 encoded string to be converted.
+     * @return The same result as utf8_to_utf16(), shared with the cache and the other callers.
+     */
+    std::shared_ptr<const std::u16string> utf8_to_utf16(std::u8string_view utf8_string);
+
+    /**
+     * @brief Returns the number of entries.
+     */
+    size_t size() const;
+
+    /**
+     * @brief Returns the hits, misses and evictions since the cache was created.
+     */
+    CacheStats stats() const;
+
+    /**
+     * @brief Drops every entry, the counters are kept.
+     */
+    void clear();
+
+private:
+    struct Shard;
+
+    Shard& shard_of(size_t hash) const;
+
+    size_t shard_count_;
+    std::unique_ptr<Shard[]> shards_;
+};
+
+//------------------------------------------------------------------------------
+// Comparison and hashing
+//
+// Text in UTF-8 and in UTF-16 is compared and hashed without converting it to a string.
+// The UTF-16 text is encoded to UTF-8 a block at a time on the stack, with the kernel of
+// utf16_to_utf8(), and compared with the UTF-8 bytes as it goes. Both compare as their
+// UTF-8 bytes: valid text in code point order, unpaired surrogates as utf16_to_utf8()
+// encodes them and malformed UTF-8 by its bytes.
+
+/**
+ * @brief Tells whether a UTF-8 string and a UTF-16 string hold the same text.
+ *
+ * @param utf8_string The UTF-8 encoded string.
+ * @param utf16_string The UTF-16 encoded string.
+ * @return true if utf16_to_utf8() of @p utf16_string is @p utf8_string.
+ */
+bool equal(std::u8string_view utf8_string, std::u16string_view utf16_string);
+
+/**
+ * @brief Compares a UTF-8 string with a UTF-16 string in code point order.
+ *
+ * Unlike a comparison of the UTF-16 code units, code points above U+FFFF order after
+ * U+E000 – U+FFFF.
+ *
+ * @param utf8_string The UTF-8 encoded string.
+ * @param utf16_string The UTF-16 encoded string.
+ * @return A negative value if @p utf8_string orders first, 0 for the same text and a positive value otherwise.
+ */
+int compare(std::u8string_view utf8_string, std::u16string_view utf16_string);
+
+/**
+ * @brief Hashes UTF-8 text, with the same result as hash(std::u16string_view) for the same text.
+ *
+ * @param utf8_string The UTF-8 encoded string.
+ * @return The hash of the bytes, the same within a program but not across versions of the library.
+ */
+size_t hash(std::u8string_view utf8_string);
+
+/**
+ * @brief Hashes UTF-16 text, with the same result as hash(std::u8string_view) for the same text.
+ *
+ * @param utf16_string The UTF-16 encoded string.
+ * @return The hash of the UTF-8 encoding, the same within a program but not across versions of the library.
+ */
+size_t hash(std::u16string_view utf16_string);
+
+/**
+ * @brief Hash of unordered containers with text keys looked up in either encoding.
+ *
+ * With TextEqual, a std::unordered_map<std::u16string, T, TextHash, TextEqual> is searched
+ * with a UTF-8 key, or the other way round, without converting the key.
+ */
+struct TextHash
+{
+    using is_transparent = void;
+
+    size_t operator()(std::u8string_view utf8_string) const
+    {
+        return hash(utf8_string);
+    }
+
+    size_t operator()(std::u16string_view utf16_string) const
+    {
+        return hash(utf16_string);
+    }
+};
+
+/**
+ * @brief Equality of unordered containers with text keys looked up in either encoding, see TextHash.
+ */
+struct TextEqual
+{
+    using is_transparent = void;
+
+    bool operator()(std::u8string_view lhs, std::u8string_view rhs) const
+    {
+        return lhs == rhs;
+    }
+
+    bool operator()(std::u16string_view lhs, std::u16string_view rhs) const
+    {
+        return lhs == rhs;
+    }
+
+    bool operator()(std::u8string_view lhs, std::u16string_view rhs) const
+    {
+        return equal(lhs, rhs);
+    }
+
+    bool operator()(std::u16string_view lhs, std::u8string_view rhs) const
+    {
+        return equal(rhs, lhs);
+    }
+};
+
+namespace parallel
+{
+/**
+ * @brief Runs task(0) to task(count - 1), possibly concurrently, and returns once all of them finished.
+ *
+ * Adapts a thread pool to the parallel conversion functions.
+ */
+using Executor = std::function<void(size_t count, const std::function<void(size_t index)>& task)>;
+
+/**
+ * @brief Converts a UTF-16 encoded string to a UTF-8 encoded string on several threads.
+ *
+ * The input is split into slices on code point boundaries. The output length of every slice is
+ * counted, then the slices are converted concurrently into one exactly sized string.
+ * The result is the same as the one of uconv::utf16_to_utf8().
+ *
+ * @param utf16_string The input UTF-16 encoded string to be converted.
+ * @param thread_count The number of threads to use, 0 for std::thread::hardware_concurrency().
+ *                     Short strings use fewer threads.
+ * @return A std::u8string containing the UTF-8 encoded result.
+ */
+std::u8string utf16_to_utf8(const std::u16string& utf16_string, size_t thread_count = 0);
+
+/**
+ * @brief Converts a UTF-16 encoded string to a UTF-8 encoded string with an executor.
+ *
+ * @param utf16_string The input UTF-16 encoded string to be converted.
+ * @param executor Runs the slices, called twice, once to count and once to convert.
+ * @param slice_count The number of slices to split the input into. Short strings use fewer slices.
+ * @return A std::u8string containing the UTF-8 encoded result.
+ */
+std::u8string utf16_to_utf8(const std::u16string& utf16_string, const Executor& executor, size_t slice_count);
+
+/**
+ * @brief Converts a UTF-8 encoded string to a UTF-16 encoded string on several threads.
+ *
+ * The input is split into slices on code point boundaries. The output length of every slice is
+ * counted, then the slices are converted concurrently into one string. The result is the same
+ * as the one of uconv::utf8_to_utf16(), malformed input included.
+ *
+ * @param utf8_string The input UTF-8 encoded string to be converted.
+ * @param thread_count The number of threads to use, 0 for std::thread::hardware_concurrency().
+ *                     Short strings use fewer threads.
+ * @return A std::u16string containing the UTF-16 encoded result.
+ */
+std::u16string utf8_to_utf16(const std::u8string& utf8_string, size_t thread_count = 0);
+
+/**
+ * @brief Converts a UTF-8 encoded string to a UTF-16 encoded string with an executor.
+ *
+ * @param utf8_string The input UTF-8 encoded string to be converted.
+ * @param executor Runs the slices, called twice, once to count and once to convert.
+ * @param slice_count The number of slices to split the input into. Short strings use fewer slices.
+ * @return A std::u16string containing the UTF-16 encoded result.
+ */
+std::u16string utf8_to_utf16(const std::u8string& utf8_string, const Executor& executor, size_t slice_count);
+} // namespace parallel
+} // namespace uconv
+
+// The views only point into the string, their iterators stay valid after the view is gone
+template<class Unit>
+inline constexpr bool std::ranges::enable_borrowed_range<uconv::CodepointView<Unit>> = true;
+template<class To, class From>
+inline constexpr bool std::ranges::enable_borrowed_range<uconv::TranscodingView<To, From>> = true;
+
+// The header-only build, uconv.cpp is installed next to uconv.h
+#if defined(UCONV_HEADER_ONLY)
+#    include "uconv.cpp"
+#endif
 #endif // INC_UCONV_H_